@@ -0,0 +1,147 @@
+/* SPDX-License-Identifier:Unlicense */
+
+/* Aravis header */
+
+#include <arv.h>
+
+/* Standard headers */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "feature-snapshot.h"
+#include "timing.h"
+
+/*
+ * Connect to a camera, walk its GenICam node tree once, then dump the value of every readable feature as JSON
+ * using coalesced register block reads where possible.
+ *
+ * Usage: 04-camera-features-snapshot [camera-id] [--fake] [-o snapshot.json] [--compare N]
+ *                                    [--max-block bytes] [--max-gap bytes]
+ *
+ * --compare N captures the snapshot N times and reads the same feature list N times through the per-feature
+ * ArvCamera API used by 04-camera-features, then prints both timings.
+ */
+
+static unsigned long
+read_features_one_by_one (ArvCamera *camera, struct FeatureSnapshot *snapshot)
+{
+	unsigned long start_time = monotonicMicroseconds ();
+	unsigned int i;
+
+	for (i = 0; i < snapshot->numberOfEntries; i++) {
+		const char *name = snapshot->entries[i].name;
+		GError *error = NULL;
+
+		switch (snapshot->entries[i].kind) {
+			case FEATURE_KIND_INTEGER:
+				arv_camera_get_integer (camera, name, &error);
+				break;
+			case FEATURE_KIND_FLOAT:
+				arv_camera_get_float (camera, name, &error);
+				break;
+			case FEATURE_KIND_BOOLEAN:
+				arv_camera_get_boolean (camera, name, &error);
+				break;
+			default:
+				arv_camera_get_string (camera, name, &error);
+				break;
+		}
+		g_clear_error (&error);
+	}
+
+	return monotonicMicroseconds () - start_time;
+}
+
+int
+main (int argc, char **argv)
+{
+	ArvCamera *camera;
+	GError *error = NULL;
+	const char *camera_id = NULL;
+	const char *output_filename = NULL;
+	unsigned int compare_runs = 0;
+	unsigned int max_block_size = 512;
+	unsigned int max_gap = 0;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp (argv[i], "--fake") == 0) {
+			arv_enable_interface ("Fake");
+			camera_id = "Fake_1";
+		} else if ((strcmp (argv[i], "-o") == 0) && (i + 1 < argc)) {
+			output_filename = argv[++i];
+		} else if ((strcmp (argv[i], "--compare") == 0) && (i + 1 < argc)) {
+			compare_runs = atoi (argv[++i]);
+		} else if ((strcmp (argv[i], "--max-block") == 0) && (i + 1 < argc)) {
+			max_block_size = atoi (argv[++i]);
+		} else if ((strcmp (argv[i], "--max-gap") == 0) && (i + 1 < argc)) {
+			max_gap = atoi (argv[++i]);
+		} else {
+			camera_id = argv[i];
+		}
+	}
+
+	/* Connect to the requested camera, or the first available one */
+	camera = arv_camera_new (camera_id, &error);
+
+	if (ARV_IS_CAMERA (camera)) {
+		struct FeatureSnapshot *snapshot;
+
+		fprintf (stderr, "Found camera '%s'\n", arv_camera_get_model_name (camera, NULL));
+
+		/* Walk the node tree once, keeping the node handles and the registers behind them */
+		snapshot = featureSnapshotCreate (arv_camera_get_device (camera), max_block_size, max_gap);
+
+		if (snapshot != NULL) {
+			FILE *fp = stdout;
+
+			featureSnapshotCapture (snapshot);
+
+			if (output_filename != NULL)
+				fp = fopen (output_filename, "w");
+
+			if (fp != NULL) {
+				featureSnapshotWriteJSON (fp, snapshot);
+				if (fp != stdout)
+					fclose (fp);
+			} else {
+				fprintf (stderr, "Could not open %s\n", output_filename);
+			}
+
+			if (compare_runs > 0) {
+				unsigned long snapshot_time = 0;
+				unsigned long naive_time = 0;
+				unsigned int run;
+
+				for (run = 0; run < compare_runs; run++) {
+					featureSnapshotCapture (snapshot);
+					snapshot_time += snapshot->captureMicroseconds;
+					naive_time += read_features_one_by_one (camera, snapshot);
+				}
+
+				fprintf (stderr, "%u features, %u register backed in %u blocks (walk took %lu μs)\n",
+					 snapshot->numberOfEntries, snapshot->numberOfRegisters,
+					 snapshot->numberOfBlocks, snapshot->walkMicroseconds);
+				fprintf (stderr, "Snapshot    : %lu μs per capture (%u block reads, %u feature reads)\n",
+					 snapshot_time / compare_runs, snapshot->blockReads, snapshot->featureReads);
+				fprintf (stderr, "Per feature : %lu μs per pass\n", naive_time / compare_runs);
+				if (snapshot_time > 0)
+					fprintf (stderr, "Speedup     : %0.2fx\n", (double) naive_time / snapshot_time);
+			}
+
+			featureSnapshotDestroy (snapshot);
+		}
+
+		g_clear_object (&camera);
+	}
+
+	if (error != NULL) {
+		/* En error happened, display the correspdonding message */
+		printf ("Error: %s\n", error->message);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
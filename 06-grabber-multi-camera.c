@@ -0,0 +1,642 @@
+/* SPDX-License-Identifier:Unlicense */
+
+/* Aravis header */
+#include <arv.h>
+
+/* Standard headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "sharedMemoryVideoBuffers.h"
+#include "acquisition-core.h"
+
+// To compile :
+//  meson compile -C build
+// To Run :
+//  build/06-grabber-multi-camera --camera <id> --camera <id> ...
+// or, without hardware, with three instances of the Aravis fake camera :
+//  build/06-grabber-multi-camera --fake 3 --maxSets 100 -o multi
+
+#define MAX_CAMERAS 16
+#define MAX_PENDING_FRAMES 64
+#define TRIGGER_LOG_SIZE 256
+
+volatile sig_atomic_t termination_requested = 0;
+
+void sigterm_handler(int signum) {
+    termination_requested = 1;
+}
+
+// A frame that has been received by a camera thread and waits to be grouped into a set
+struct PendingFrame
+{
+    ArvBuffer * buffer;
+    gint64  key;       // Trigger number, or timestamp in nanoseconds, depending on the matching mode
+    guint64 timestamp; // Timestamp in nanoseconds in the clock selected for skew measurements
+    unsigned long arrivalMicroseconds;
+};
+
+struct Matcher;
+
+struct CameraContext
+{
+    struct Matcher * matcher;
+    unsigned int index;
+    const char * id;
+    ArvCamera * camera;
+    ArvStream * stream;
+    pthread_t thread;
+    char threadStarted;
+
+    //Protected by the matcher lock
+    struct PendingFrame pending[MAX_PENDING_FRAMES];
+    unsigned int pendingHead,pendingCount;
+    char haveFirstFrameId;
+    guint64 firstFrameId;
+    gint64  firstTrigger;   // Trigger number the frame firstFrameId answered
+    guint64 lastFrameId;
+
+    unsigned long framesReceived;
+    unsigned long framesFailed;
+    unsigned long framesUnmatched;
+    unsigned long reanchored;
+
+    //Shared memory output
+    struct VideoFrame * shmFrame;
+};
+
+struct Matcher
+{
+    pthread_mutex_t lock;
+    pthread_cond_t  frameArrived;
+
+    struct CameraContext cameras[MAX_CAMERAS];
+    unsigned int numberOfCameras;
+
+    char matchByTrigger;      // Group frames by trigger number instead of by nearest timestamp
+    char useDeviceClock;      // Compare device timestamps instead of host arrival timestamps
+    gint64 tolerance;         // Nanoseconds, only used when matching by timestamp
+    unsigned long setTimeout; // Microseconds before an incomplete set is given up and emitted
+
+    //A camera may lose its very first frame, so frame ids alone do not tell which trigger a frame
+    //answers. Software triggers are logged when they are sent, hardware triggers are not seen by
+    //the host and are counted at --fps from the first frame of any camera
+    char softwareTrigger;
+    unsigned long triggerTimes[TRIGGER_LOG_SIZE];
+    unsigned long triggersSent;
+    unsigned long triggerPeriod;  // Microseconds
+    char haveFirstArrival;
+    unsigned long firstArrival;
+
+    unsigned long completeSets;
+    unsigned long incompleteSets;
+    guint64 maxSkew;
+    double  sumSkew;
+};
+
+// Trigger a frame that arrived at that time answers, the last one sent before it. This holds as long
+// as exposure and transfer take less than a trigger period, which they must for the cameras to keep up.
+// Must be called with the matcher lock held.
+static gint64 triggerAnsweredAt(struct Matcher * matcher,unsigned long arrival)
+{
+    if (matcher->softwareTrigger)
+    {
+        unsigned long n = matcher->triggersSent;
+        while ( (n>0) && (matcher->triggersSent-n<TRIGGER_LOG_SIZE-1) && (matcher->triggerTimes[(n-1)%TRIGGER_LOG_SIZE]>arrival) ) { n-=1; }
+        return (gint64) n - 1;
+    }
+
+    if (!matcher->haveFirstArrival)
+    {
+        matcher->firstArrival     = arrival;
+        matcher->haveFirstArrival = 1;
+    }
+    if ( (matcher->triggerPeriod==0) || (arrival<matcher->firstArrival) ) { return 0; }
+    return (gint64) ((arrival - matcher->firstArrival + matcher->triggerPeriod/2) / matcher->triggerPeriod);
+}
+
+static void *cameraThread(void * ptr)
+{
+    struct CameraContext * context = (struct CameraContext *) ptr;
+    struct Matcher * matcher = context->matcher;
+
+    while (!termination_requested)
+    {
+        ArvBuffer * buffer = arv_stream_timeout_pop_buffer(context->stream,100000);
+        if (buffer==NULL) { continue; }
+
+        if ( (arv_buffer_get_status(buffer)!=ARV_BUFFER_STATUS_SUCCESS) || (arv_buffer_get_image_width(buffer)==0) )
+        {
+            pthread_mutex_lock(&matcher->lock);
+            context->framesFailed+=1;
+            pthread_mutex_unlock(&matcher->lock);
+            arv_stream_push_buffer(context->stream,buffer);
+            continue;
+        }
+
+        struct PendingFrame frame;
+        frame.buffer              = buffer;
+        frame.arrivalMicroseconds = GetTickCountMicroseconds();
+        frame.timestamp           = (matcher->useDeviceClock) ? arv_buffer_get_timestamp(buffer) : arv_buffer_get_system_timestamp(buffer);
+
+        pthread_mutex_lock(&matcher->lock);
+        if (matcher->matchByTrigger)
+        {   //Frame ids count every frame the camera emitted, lost ones included, so once the first
+            //frame is tied to its trigger the distance in frame ids gives the trigger of the others
+            guint64 frameId = arv_buffer_get_frame_id(buffer);
+            gint64 trigger = triggerAnsweredAt(matcher,frame.arrivalMicroseconds);
+            if (!context->haveFirstFrameId)
+            {
+                context->firstFrameId     = frameId;
+                context->firstTrigger     = trigger;
+                context->haveFirstFrameId = 1;
+            }
+            frame.key = context->firstTrigger + (gint64) (frameId - context->firstFrameId);
+
+            //Frame ids that went backwards (a wrap or a restarted stream) or a frame that would answer a
+            //software trigger not sent yet mean the anchor is off, tie this frame to its trigger again
+            if ( (frameId<context->lastFrameId) || ( (matcher->softwareTrigger) && (frame.key>trigger) ) )
+            {
+                context->firstFrameId = frameId;
+                context->firstTrigger = trigger;
+                context->reanchored  += 1;
+                frame.key = trigger;
+            }
+            context->lastFrameId = frameId;
+        } else
+        {
+            frame.key = (gint64) frame.timestamp;
+        }
+
+        ArvBuffer * overflow = NULL;
+        if (context->pendingCount==MAX_PENDING_FRAMES)
+        {   //The matcher is not keeping up, give up on the oldest frame of this camera
+            overflow = context->pending[context->pendingHead].buffer;
+            context->pendingHead  = (context->pendingHead+1) % MAX_PENDING_FRAMES;
+            context->pendingCount-=1;
+            context->framesUnmatched+=1;
+        }
+        context->pending[(context->pendingHead+context->pendingCount) % MAX_PENDING_FRAMES] = frame;
+        context->pendingCount+=1;
+        context->framesReceived+=1;
+        pthread_cond_signal(&matcher->frameArrived);
+        pthread_mutex_unlock(&matcher->lock);
+
+        if (overflow!=NULL) { arv_stream_push_buffer(context->stream,overflow); }
+    }
+    return NULL;
+}
+
+static struct PendingFrame * pendingAt(struct CameraContext * context,unsigned int i)
+{
+    return &context->pending[(context->pendingHead+i) % MAX_PENDING_FRAMES];
+}
+
+static void removePending(struct CameraContext * context,unsigned int i)
+{
+    //Shift the frames after i one place towards the head, queues are short
+    for (; i+1<context->pendingCount; i++)
+    {
+        *pendingAt(context,i) = *pendingAt(context,i+1);
+    }
+    context->pendingCount-=1;
+}
+
+// Try to form one set out of the pending frames. Returns 1 and fills set[] (NULL for cameras
+// that did not contribute) when a set was emitted, 0 when more frames are needed.
+// Must be called with the matcher lock held.
+static int matchSet(struct Matcher * matcher,struct PendingFrame * set,unsigned long now)
+{
+    unsigned int c,i;
+    struct PendingFrame * anchor = NULL;
+
+    //The oldest frame waiting anywhere anchors the next set
+    for (c=0; c<matcher->numberOfCameras; c++)
+    {
+        struct CameraContext * context = &matcher->cameras[c];
+        if (context->pendingCount==0) { continue; }
+        struct PendingFrame * head = pendingAt(context,0);
+        if ( (anchor==NULL) || (head->key<anchor->key) )
+        {
+            anchor = head;
+        }
+    }
+    if (anchor==NULL) { return 0; }
+
+    gint64 tolerance = (matcher->matchByTrigger) ? 0 : matcher->tolerance;
+    int chosen[MAX_CAMERAS];
+    unsigned int found = 0;
+    char waitForMore = 0;
+
+    for (c=0; c<matcher->numberOfCameras; c++)
+    {
+        struct CameraContext * context = &matcher->cameras[c];
+        gint64 bestDistance = tolerance+1;
+        chosen[c] = -1;
+
+        for (i=0; i<context->pendingCount; i++)
+        {
+            gint64 distance = pendingAt(context,i)->key - anchor->key;
+            if (distance<0) { distance=-distance; }
+            if (distance<bestDistance)
+            {
+                bestDistance = distance;
+                chosen[c] = (int) i;
+            }
+        }
+
+        if (chosen[c]>=0) { found+=1; continue; }
+
+        //This camera may still deliver its frame unless it already moved past the anchor
+        if ( (context->pendingCount==0) || (pendingAt(context,context->pendingCount-1)->key <= anchor->key + tolerance) )
+        {
+            waitForMore = 1;
+        }
+    }
+
+    if ( (found<matcher->numberOfCameras) && (waitForMore) && (now-anchor->arrivalMicroseconds<matcher->setTimeout) )
+    {
+        return 0;
+    }
+
+    guint64 minTimestamp=0,maxTimestamp=0;
+    char first=1;
+    for (c=0; c<matcher->numberOfCameras; c++)
+    {
+        struct CameraContext * context = &matcher->cameras[c];
+        set[c].buffer = NULL;
+        if (chosen[c]<0) { continue; }
+
+        set[c] = *pendingAt(context,(unsigned int) chosen[c]);
+
+        //Anything older than the chosen frame can no longer be part of a later set
+        while (chosen[c]>0)
+        {
+            context->framesUnmatched+=1;
+            arv_stream_push_buffer(context->stream,pendingAt(context,0)->buffer);
+            removePending(context,0);
+            chosen[c]-=1;
+        }
+        removePending(context,0);
+
+        if ( (first) || (set[c].timestamp<minTimestamp) ) { minTimestamp = set[c].timestamp; }
+        if ( (first) || (set[c].timestamp>maxTimestamp) ) { maxTimestamp = set[c].timestamp; }
+        first = 0;
+    }
+
+    if (found==matcher->numberOfCameras)
+    {
+        guint64 skew = maxTimestamp - minTimestamp;
+        matcher->completeSets+=1;
+        matcher->sumSkew+=(double) skew;
+        if (skew>matcher->maxSkew) { matcher->maxSkew=skew; }
+    } else
+    {
+        matcher->incompleteSets+=1;
+    }
+    return 1;
+}
+
+static void writeSet(struct Matcher * matcher,struct PendingFrame * set,unsigned int setNumber,const char * dir,char writeFiles,struct SharedMemoryContext * shm)
+{
+    unsigned int c;
+    char filename[1025]= {0};
+
+    for (c=0; c<matcher->numberOfCameras; c++)
+    {
+        struct CameraContext * context = &matcher->cameras[c];
+        if (set[c].buffer==NULL) { continue; }
+
+        struct Image dataAsImage = {0};
+        size_t size;
+        dataAsImage.pixels       = arv_buffer_get_image_data(set[c].buffer,&size);
+        dataAsImage.width        = arv_buffer_get_image_width(set[c].buffer);
+        dataAsImage.height       = arv_buffer_get_image_height(set[c].buffer);
+        dataAsImage.channels     = 1;
+        dataAsImage.bitsperpixel = 8;
+        dataAsImage.image_size   = dataAsImage.width * dataAsImage.height * dataAsImage.channels;
+        dataAsImage.timestamp    = setNumber;
+        if (dataAsImage.image_size>size) { dataAsImage.image_size = (unsigned int) size; }
+
+        //WritePPM() writes whole frames, a short buffer only goes to shared memory
+        if ( (writeFiles) && (dataAsImage.image_size==dataAsImage.width*dataAsImage.height*dataAsImage.channels) )
+        {
+            snprintf(filename,1024,"%s/colorFrame_%u_%05u.pnm",dir,c,setNumber);
+            WritePPM(filename,&dataAsImage);
+        }
+
+        if (shm!=NULL)
+        {
+            if (context->shmFrame==NULL)
+            {
+                char streamName[64];
+                snprintf(streamName,64,"stream%u",c+1);
+                createVideoFrameMetaData(shm,streamName,dataAsImage.width,dataAsImage.height,dataAsImage.channels);
+                context->shmFrame = getVideoBufferPointer(shm,streamName);
+                if ( (context->shmFrame!=NULL) && (map_frame_shared_memory(context->shmFrame,1)==NULL) )
+                {
+                    context->shmFrame = NULL;
+                }
+            }
+            if ( (context->shmFrame!=NULL) && (startWritingToVideoBufferPointer(context->shmFrame)) )
+            {
+                copy_to_shared_memory((void *) context->shmFrame,dataAsImage.pixels,dataAsImage.image_size);
+                stopWritingToVideoBufferPointer(context->shmFrame);
+            }
+        }
+
+        /* Don't destroy the buffer, but put it back into the buffer pool */
+        arv_stream_push_buffer(context->stream,set[c].buffer);
+    }
+}
+
+static int openCamera(struct CameraContext * context,const char * triggerSource,double frameRate,unsigned int numberOfBuffers)
+{
+    GError *error = NULL;
+    unsigned int i;
+
+    context->camera = arv_camera_new(context->id,&error);
+    if ( (context->camera==NULL) || (error!=NULL) )
+    {
+        fprintf(stderr,"Could not open camera %u (%s) : %s\n",context->index,(context->id!=NULL) ? context->id : "first available",(error!=NULL) ? error->message : "?");
+        g_clear_error(&error);
+        return 0;
+    }
+    fprintf(stderr,"Camera %u is '%s'\n",context->index,arv_camera_get_model_name(context->camera,NULL));
+
+    arv_camera_set_acquisition_mode(context->camera,ARV_ACQUISITION_MODE_CONTINUOUS,&error);
+    if (error==NULL)
+    {
+        if (triggerSource!=NULL)
+        {   //Every camera waits for the same trigger, either our software trigger or a shared hardware line
+            arv_camera_set_trigger(context->camera,triggerSource,&error);
+        } else
+        if (frameRate!=0.0)
+        {
+            arv_camera_set_frame_rate(context->camera,frameRate,&error);
+        }
+    }
+    if (error==NULL) { context->stream = arv_camera_create_stream(context->camera,NULL,NULL,NULL,&error); }
+
+    if ( (error==NULL) && (ARV_IS_STREAM(context->stream)) )
+    {
+        size_t payload = arv_camera_get_payload(context->camera,&error);
+        for (i=0; (error==NULL) && (i<numberOfBuffers); i++)
+        {
+            arv_stream_push_buffer(context->stream,arv_buffer_new(payload,NULL));
+        }
+    }
+
+    if (error!=NULL)
+    {
+        fprintf(stderr,"Could not set up camera %u : %s\n",context->index,error->message);
+        g_clear_error(&error);
+        return 0;
+    }
+    return 1;
+}
+
+
+
+
+/*
+ * Connect to several cameras, trigger them together and group their frames into synchronized sets.
+ */
+int main (int argc, char **argv)
+{
+// Set up SIGTERM signal handler
+    struct sigaction action;
+    action.sa_handler = sigterm_handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = 0;
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+
+    char dir[512]= {0};
+    snprintf(dir,512,".");
+
+    struct Matcher matcher;
+    memset(&matcher,0,sizeof(struct Matcher));
+    pthread_mutex_init(&matcher.lock,NULL);
+    pthread_cond_init(&matcher.frameArrived,NULL);
+    matcher.tolerance  = 1000 * 1000; // 1ms
+    matcher.setTimeout = 500 * 1000;  // 0.5s
+
+    unsigned int i=0;
+    unsigned int ARV_VIEWER_N_BUFFERS=10;
+    unsigned int maxSetsToGrab = 10;
+    unsigned int fakeCameras = 0;
+    const char * triggerSource = "Software";
+    const char * matchMode = NULL;
+    double frameRate = 10.0;
+    char writeFiles = 1;
+    char useSharedMemory = 0;
+
+    for (i=0; i<argc; i++)
+    {
+        if (strcmp(argv[i],"-o")==0)
+        {
+            if (argc>i+1)
+            {
+            snprintf(dir,512,"%s",argv[i+1]);
+            char makedircmd[1025]= {0};
+            snprintf(makedircmd,1024,"mkdir -p %s",dir);
+            if (system(makedircmd)==0)
+            {
+                fprintf(stderr,"Output Path set to \"%s\" \n",dir);
+            }
+            else
+            {
+                fprintf(stderr,"Failed setting output Path to \"%s\" \n",dir);
+            }
+            } else
+            {
+                fprintf(stderr,"Failed setting output Path, not enough arguments! \n");
+            }
+        } else if ( (strcmp(argv[i],"--camera")==0) && (argc>i+1) ) {
+            if (matcher.numberOfCameras<MAX_CAMERAS) { matcher.cameras[matcher.numberOfCameras++].id = argv[i+1]; }
+        } else if ( (strcmp(argv[i],"--fake")==0) && (argc>i+1) ) {
+            fakeCameras=atoi(argv[i+1]);
+            fprintf(stderr,"Using %u fake cameras \n",fakeCameras);
+        } else if ( (strcmp(argv[i],"--trigger")==0) && (argc>i+1) ) {
+            triggerSource=argv[i+1];
+            if (strcmp(triggerSource,"none")==0) { triggerSource=NULL; }
+            fprintf(stderr,"Trigger source set to %s \n",(triggerSource!=NULL) ? triggerSource : "none (free running)");
+        } else if ( (strcmp(argv[i],"--match")==0) && (argc>i+1) ) {
+            matchMode=argv[i+1];
+        } else if ( (strcmp(argv[i],"--tolerance")==0) && (argc>i+1) ) {
+            matcher.tolerance=(gint64) atoi(argv[i+1]) * 1000;
+            fprintf(stderr,"Timestamp tolerance set to %s μsec \n",argv[i+1]);
+        } else if ( (strcmp(argv[i],"--clock")==0) && (argc>i+1) ) {
+            matcher.useDeviceClock=(strcmp(argv[i+1],"device")==0);
+        } else if ( (strcmp(argv[i],"--setTimeout")==0) && (argc>i+1) ) {
+            matcher.setTimeout=(unsigned long) atoi(argv[i+1]) * 1000;
+        } else if ( (strcmp(argv[i],"--buffers")==0) && (argc>i+1) ) {
+            ARV_VIEWER_N_BUFFERS=atoi(argv[i+1]);
+            fprintf(stderr,"ARV_VIEWER_N_BUFFERS = %u \n",ARV_VIEWER_N_BUFFERS);
+        } else if ( (strcmp(argv[i],"--fps")==0) && (argc>i+1) ) {
+            frameRate=atof(argv[i+1]);
+            fprintf(stderr,"Trigger rate will be set to %f Hz \n",frameRate);
+        } else if ( (strcmp(argv[i],"--maxSets")==0) && (argc>i+1) ) {
+            maxSetsToGrab=atoi(argv[i+1]);
+            fprintf(stderr,"Setting set grab to %u \n",maxSetsToGrab);
+        } else if (strcmp(argv[i],"--nofiles")==0) {
+            writeFiles=0;
+        } else if (strcmp(argv[i],"--shm")==0) {
+            useSharedMemory=1;
+        }
+    }
+
+    if (fakeCameras>0)
+    {   //Each open of the fake device gets its own independent fake camera
+        arv_enable_interface("Fake");
+        for (i=0; (i<fakeCameras) && (matcher.numberOfCameras<MAX_CAMERAS); i++)
+        {
+            matcher.cameras[matcher.numberOfCameras++].id = "Fake_1";
+        }
+    }
+    if (matcher.numberOfCameras==0)
+    {
+        fprintf(stderr,"No cameras given, use --camera <id> (repeatable) or --fake <number>\n");
+        return EXIT_FAILURE;
+    }
+
+    //Software triggers have no shared timebase in the device clocks, so count triggers by default
+    matcher.softwareTrigger = (triggerSource!=NULL) && (strcmp(triggerSource,"Software")==0);
+    matcher.triggerPeriod   = (frameRate>0.0) ? (unsigned long) (1000000 / frameRate) : 100000;
+    matcher.matchByTrigger  = matcher.softwareTrigger;
+    if (matchMode!=NULL) { matcher.matchByTrigger = (strcmp(matchMode,"trigger")==0); }
+    fprintf(stderr,"Matching frames by %s\n",(matcher.matchByTrigger) ? "trigger number" : "nearest timestamp");
+
+    struct SharedMemoryContext * shm = NULL;
+    if (useSharedMemory)
+    {
+        const char *shm_name = "video_frames.shm";
+        if (createSharedMemoryContextDescriptor(shm_name) == -1)
+        {
+            return EXIT_FAILURE;
+        }
+        shm = connectToSharedMemoryContextDescriptor(shm_name);
+        if (!shm)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    int failed = 0;
+    for (i=0; i<matcher.numberOfCameras; i++)
+    {
+        matcher.cameras[i].index   = i;
+        matcher.cameras[i].matcher = &matcher;
+        if (!openCamera(&matcher.cameras[i],triggerSource,frameRate,ARV_VIEWER_N_BUFFERS)) { failed=1; break; }
+    }
+
+    if (!failed)
+    {
+        for (i=0; i<matcher.numberOfCameras; i++)
+        {
+            arv_camera_start_acquisition(matcher.cameras[i].camera,NULL);
+            matcher.cameras[i].threadStarted = (pthread_create(&matcher.cameras[i].thread,NULL,cameraThread,&matcher.cameras[i])==0);
+        }
+
+        char softwareTrigger = matcher.softwareTrigger;
+        unsigned long triggerPeriod = matcher.triggerPeriod;
+        unsigned long nextTrigger = GetTickCountMicroseconds();
+        unsigned long startTime = nextTrigger;
+        unsigned int setNumber = 0;
+        unsigned long lastTrigger = 0;
+        struct PendingFrame set[MAX_CAMERAS];
+
+        while (!termination_requested && setNumber<maxSetsToGrab)
+        {
+            unsigned long now = GetTickCountMicroseconds();
+            if ( (softwareTrigger) && (now>=nextTrigger) && (matcher.triggersSent<maxSetsToGrab) )
+            {   //Logged before it is sent, no frame can answer it earlier
+                pthread_mutex_lock(&matcher.lock);
+                matcher.triggerTimes[matcher.triggersSent % TRIGGER_LOG_SIZE] = now;
+                matcher.triggersSent+=1;
+                pthread_mutex_unlock(&matcher.lock);
+
+                //Fire all cameras back to back so their exposures start as close together as possible
+                for (i=0; i<matcher.numberOfCameras; i++)
+                {
+                    arv_camera_software_trigger(matcher.cameras[i].camera,NULL);
+                }
+                lastTrigger=now;
+                nextTrigger+=triggerPeriod;
+            }
+            if ( (softwareTrigger) && (matcher.triggersSent>=maxSetsToGrab) && (now-lastTrigger>2*matcher.setTimeout) )
+            {   //Every trigger has been sent and nothing is left to match, some triggers were lost entirely
+                break;
+            }
+
+            pthread_mutex_lock(&matcher.lock);
+            int haveSet = matchSet(&matcher,set,now);
+            if (!haveSet)
+            {
+                unsigned long waitUntil = (softwareTrigger) ? nextTrigger : now + 10000;
+                if (waitUntil>now+10000) { waitUntil=now+10000; }
+                struct timespec deadline;
+                clock_gettime(CLOCK_REALTIME,&deadline);
+                unsigned long waitMicroseconds = (waitUntil>now) ? waitUntil-now : 0;
+                deadline.tv_nsec += (long) (waitMicroseconds%1000000) * 1000;
+                deadline.tv_sec  += (time_t) (waitMicroseconds/1000000) + deadline.tv_nsec/1000000000;
+                deadline.tv_nsec %= 1000000000;
+                pthread_cond_timedwait(&matcher.frameArrived,&matcher.lock,&deadline);
+            }
+            pthread_mutex_unlock(&matcher.lock);
+
+            if (haveSet)
+            {
+                writeSet(&matcher,set,setNumber,dir,writeFiles,shm);
+                setNumber+=1;
+
+                unsigned long elapsed = GetTickCountMicroseconds() - startTime;
+                printf("\r %u Sets (%lu complete/%lu incomplete) - @ %0.2f sets/sec - Skew avg %0.1f μs / max %0.1f μs    ",
+                       setNumber,matcher.completeSets,matcher.incompleteSets,
+                       (elapsed>0) ? (float) setNumber * 1000000 / elapsed : 0.0,
+                       (matcher.completeSets>0) ? matcher.sumSkew / matcher.completeSets / 1000 : 0.0,
+                       (double) matcher.maxSkew / 1000);
+                fflush(stdout);
+            }
+        }
+    }
+
+    termination_requested = 1;
+    for (i=0; i<matcher.numberOfCameras; i++)
+    {
+        struct CameraContext * context = &matcher.cameras[i];
+        if (context->threadStarted) { pthread_join(context->thread,NULL); }
+        if (context->camera!=NULL)
+        {
+            if (context->stream!=NULL) { arv_camera_stop_acquisition(context->camera,NULL); }
+            arv_camera_clear_triggers(context->camera,NULL);
+        }
+        while (context->pendingCount>0)
+        {
+            arv_stream_push_buffer(context->stream,pendingAt(context,0)->buffer);
+            removePending(context,0);
+        }
+        g_clear_object(&context->stream);
+        g_clear_object(&context->camera);
+    }
+
+    printf("\n\nDone\n");
+    printf("Summary : %lu complete sets, %lu incomplete sets, skew avg %0.1f μs max %0.1f μs\n",
+           matcher.completeSets,matcher.incompleteSets,
+           (matcher.completeSets>0) ? matcher.sumSkew / matcher.completeSets / 1000 : 0.0,
+           (double) matcher.maxSkew / 1000);
+    for (i=0; i<matcher.numberOfCameras; i++)
+    {
+        printf("Camera %u : %lu frames received, %lu failed, %lu unmatched, re-anchored %lu times\n",i,
+               matcher.cameras[i].framesReceived,matcher.cameras[i].framesFailed,matcher.cameras[i].framesUnmatched,matcher.cameras[i].reanchored);
+    }
+
+    pthread_cond_destroy(&matcher.frameArrived);
+    pthread_mutex_destroy(&matcher.lock);
+    return (failed) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
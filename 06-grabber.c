@@ -6,7 +6,38 @@
 /* Standard headers */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 #include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "sharedMemoryVideoBuffers.h"
+#include "acquisition-core.h"
+#include "acquisition-stats.h"
+#include "auto-exposure.h"
+#include "change-detection.h"
+#include "clock-mapping.h"
+#include "control-socket.h"
+#include "device-discovery.h"
+#include "frame-ring.h"
+#include "frame-index.h"
+#include "frame-stacking.h"
+#include "frame-correction.h"
+#include "frame-fanout.h"
+#include "frame-loss.h"
+#include "frame-statistics.h"
+#include "gige-transport.h"
+#include "jpeg-sink.h"
+#include "live-config.h"
+#include "pipeline-trace.h"
+#include "pnm.h"
+#include "recording-journal.h"
+#include "shm-sink.h"
+#include "sink-queue.h"
+#include "striped-recording.h"
+#include "time-lapse.h"
+#include "timing.h"
 
 // To compile :
 //  meson compile -C build
@@ -14,145 +45,53 @@
 //  build/06-grabber
 
 volatile sig_atomic_t termination_requested = 0;
+volatile sig_atomic_t trigger_requested = 0;
+volatile sig_atomic_t reload_requested = 0;
+volatile sig_atomic_t trace_requested = 0;
 
 void sigterm_handler(int signum) {
     termination_requested = 1;
 }
 
-struct Image
-{
-    const unsigned char * pixels;
-    unsigned int width;
-    unsigned int height;
-    unsigned int channels;
-    unsigned int bitsperpixel;
-    unsigned int image_size;
-    unsigned int timestamp;
-};
-
-
-struct Settings
-{
-    unsigned int delay,maxFramesToGrab;
-    unsigned int exposure; // 0 means no setting
-    double       gain;
-    double       blackLevel;
-    double       frameRate;
-    char * tickCommand;
-};
-
-#include <sys/time.h>
-#include <unistd.h>
-#include <time.h>
-
-#define EPOCH_YEAR_IN_TM_YEAR 1900
-
-unsigned long tickBase = 0;
-unsigned long GetTickCountMicroseconds()
-{
-    struct timespec ts;
-    if ( clock_gettime(CLOCK_MONOTONIC,&ts) != 0) {
-        return 0;
-    }
-
-    if (tickBase==0)
-    {
-        tickBase = ts.tv_sec*1000000 + ts.tv_nsec/1000;
-        return 0;
-    }
-
-    return ( ts.tv_sec*1000000 + ts.tv_nsec/1000 ) - tickBase;
+void sigusr1_handler(int signum) {
+    trigger_requested = 1;
 }
 
-int writeSettings(const char * filename,struct Settings * settings)
-{
-    FILE * fp = fopen(filename,"w");
-    if (fp!=0)
-    {
-        fprintf(fp,"{\n\"delay\": %u,\n",settings->delay);
-        fprintf(fp,"\"maxFramesToGrab\": %u,\n",settings->maxFramesToGrab);
-        fprintf(fp,"\"exposure\": %u,\n",settings->exposure);
-        fprintf(fp,"\"blackLevel\": %f,\n",settings->blackLevel);
-        fprintf(fp,"\"gain\": %f,\n",settings->gain);
-        fprintf(fp,"\"frameRate\": %f,\n",settings->frameRate);
-        fprintf(fp,"\"tickCommand\": \"%s\"\n}\n",settings->tickCommand);
-        fclose(fp);
-        return 1;
-    }
-    return 0;
+void sighup_handler(int signum) {
+    reload_requested = 1;
 }
 
-
-unsigned int simplePowPPM(unsigned int base,unsigned int exp)
-{
-    if (exp==0) return 1;
-    unsigned int retres=base;
-    unsigned int i=0;
-    for (i=0; i<exp-1; i++)
-    {
-        retres*=base;
-    }
-    return retres;
+void sigusr2_handler(int signum) {
+    trace_requested = 1;
 }
 
+//What the control socket can reach, either may be NULL
+struct ControlTargets
+{
+    struct FrameRing * ring;
+    struct LiveConfig * live;
+};
 
-int WritePPM(const char * filename,struct Image * pic)
+//Commands accepted on --controlSocket (--triggerSocket is the same socket)
+void controlSocketHandler(void * userData,const char * command,char * reply,size_t replySize)
 {
-    //fprintf(stderr,"saveRawImageToFile(%s) called\n",filename);
-    if (pic==0) {
-        return 0;
-    }
-    if ( (pic->width==0) || (pic->height==0) || (pic->channels==0) || (pic->bitsperpixel==0) )
+    struct ControlTargets * targets = (struct ControlTargets *) userData;
+    if ( (strncmp(command,"trigger",7)==0) && (targets->ring!=0) )
     {
-        fprintf(stderr,"saveRawImageToFile(%s) called with zero dimensions ( %ux%u %u channels %u bpp\n",filename,pic->width, pic->height,pic->channels,pic->bitsperpixel);
-        return 0;
-    }
-    if(pic->pixels==0) {
-        fprintf(stderr,"saveRawImageToFile(%s) called for an unallocated (empty) frame , will not write any file output\n",filename);
-        return 0;
-    }
-    if (pic->bitsperpixel>16) {
-        fprintf(stderr,"PNM does not support more than 2 bytes per pixel..!\n");
-        return 0;
-    }
-
-    FILE *fd=0;
-    fd = fopen(filename,"wb");
-
-    if (fd!=0)
+        const char * reason = command+7;
+        while (*reason==' ') { reason++; }
+        unsigned int event = triggerFrameRing(targets->ring,(*reason!=0) ? reason : "socket");
+        snprintf(reply,replySize,"ok event %u\n",event);
+    } else
+    if (targets->live!=0)
     {
-        unsigned int n;
-        if (pic->channels==3) fprintf(fd, "P6\n");
-        else if (pic->channels==1) fprintf(fd, "P5\n");
-        else
-        {
-            fprintf(stderr,"Invalid channels arg (%u) for SaveRawImageToFile\n",pic->channels);
-            fclose(fd);
-            return 1;
-        }
-
-        fprintf(fd, "%d %d\n%u\n", pic->width, pic->height, simplePowPPM(2,pic->bitsperpixel)-1);
-
-        float tmp_n = (float) pic->bitsperpixel/ 8;
-        tmp_n = tmp_n *  pic->width * pic->height * pic->channels ;
-        n = (unsigned int) tmp_n;
-
-        fwrite(pic->pixels, 1, n, fd);
-        fflush(fd);
-        fclose(fd);
-        return 1;
-    }
-    else
+        handleLiveConfigCommand(targets->live,command,reply,replySize);
+    } else
     {
-        fprintf(stderr,"SaveRawImageToFile could not open output file %s\n",filename);
-        return 0;
+        snprintf(reply,replySize,"error unknown command, use trigger [reason]\n");
     }
-    return 0;
 }
 
-
-
-
 /*
  * Connect to the first available camera, then acquire 10 buffers.
  */
@@ -164,6 +103,28 @@ int main (int argc, char **argv)
     sigemptyset(&action.sa_mask);
     action.sa_flags = 0;
     sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL); // Ctrl+C ends the recording cleanly too (--journal)
+
+    // SIGUSR1 dumps the pre-trigger ring (--preTrigger)
+    struct sigaction triggerAction;
+    triggerAction.sa_handler = sigusr1_handler;
+    sigemptyset(&triggerAction.sa_mask);
+    triggerAction.sa_flags = 0;
+    sigaction(SIGUSR1, &triggerAction, NULL);
+
+    // SIGHUP re-reads the settings file while streaming (--settings)
+    struct sigaction reloadAction;
+    reloadAction.sa_handler = sighup_handler;
+    sigemptyset(&reloadAction.sa_mask);
+    reloadAction.sa_flags = 0;
+    sigaction(SIGHUP, &reloadAction, NULL);
+
+    // SIGUSR2 writes the --trace timeline so far
+    struct sigaction traceAction;
+    traceAction.sa_handler = sigusr2_handler;
+    sigemptyset(&traceAction.sa_mask);
+    traceAction.sa_flags = 0;
+    sigaction(SIGUSR2, &traceAction, NULL);
 
     guint64 n_completed_buffers=0, n_failures=0, n_underruns=0;
 
@@ -177,6 +138,75 @@ int main (int argc, char **argv)
     settings.maxFramesToGrab = 10;
     char forceDims = 0;
     char refreshDimsOnEachFrame = 1;
+    const char * deviceId = 0;
+    const char * pixelFormat = 0;
+    const char * statisticsFile = 0;
+    char computeFrameStats = 0;
+    unsigned int frameStatsBudget = 0;
+    struct FrameStatisticsState frameStatsState;
+    char useAutoExposure = 0;
+    unsigned int autoExposureRamp = 0;
+    struct AutoExposureSettings autoExposureSettings;
+    struct AutoExposureController autoExposure;
+    setDefaultAutoExposureSettings(&autoExposureSettings);
+    float preTriggerSeconds = 0.0, postTriggerSeconds = 2.0;
+    unsigned int ringMB = 512;
+    const char * controlSocketPath = 0;
+    const char * settingsFile = 0;
+    const char * traceFile = 0;
+    unsigned int clockWindow = 0;
+    unsigned int traceEvents = 0;
+    int triggerOnTickExit = -1;
+    struct FrameRing frameRing;
+    struct ControlSocket controlSocket;
+    struct ControlTargets controlTargets = {0};
+    struct LiveConfig liveConfig;
+    char useFrameRing = 0;
+    float changeThreshold = 0.0, changeArea = 0.001;
+    unsigned int keyframeInterval = 300;
+    struct ChangeDetector changeDetector;
+    unsigned int jpegQuality = 0;
+    unsigned int jpegWorkers = 0, jpegSlices = 0;
+    struct JpegSink jpegSink;
+    char useJpeg = 0;
+    struct SinkPolicy pnmPolicy, jpegPolicy, shmPolicy;
+    setDefaultSinkPolicy(&pnmPolicy,"pnm",SINK_POLICY_BLOCK);
+    setDefaultSinkPolicy(&jpegPolicy,"jpeg",SINK_POLICY_DROP_NEWEST);
+    setDefaultSinkPolicy(&shmPolicy,"shm",SINK_POLICY_DROP_OLDEST);
+    char usePnmQueue = 0;
+    const char * shmStreamName = 0;
+    struct FrameFanOut fanOut;
+    char useFanOut = 0;
+    int pnmSink = -1;
+    struct PNMSinkContext pnmSinkContext = {0};
+    char useJournal = 0;
+    unsigned int syncInterval = 1000;
+    struct RecordingJournal journal;
+    char writeFrameIndex = 1;
+    unsigned int stackWindow = 0;
+    enum FrameStackMode stackMode = FRAME_STACK_MEAN;
+    struct FrameStack frameStack;
+    struct FrameIndexWriter frameIndex;
+    struct StripedRecording striping;
+    initializeStripedRecording(&striping);
+    char useStriping = 0;
+    double timeLapseInterval = 0.0;
+    struct TimeLapse timeLapse;
+    struct FrameLossTracker frameLoss;
+    struct ClockMapping clockMapping;
+    char useTimeLapse = 0;
+    FILE * timeLapseFile = 0;
+    struct AcquisitionStatistics statistics = {0};
+    struct StartupTimes startupTimes = {0};
+    const char * darkFile = 0;
+    const char * flatFile = 0;
+    struct FrameCorrection frameCorrection;
+    const char * calibrate = 0;
+    unsigned int calibrationFrames = 32;
+    struct GigETransport gigeTransport;
+    setDefaultGigETransport(&gigeTransport);
+    struct DiscoveryOptions discoveryOptions;
+    setDefaultDiscoveryOptions(&discoveryOptions);
 
     for (i=0; i<argc; i++)
     {
@@ -184,17 +214,18 @@ int main (int argc, char **argv)
         {
             if (argc>i+1)
             {
-            snprintf(dir,512,"%s",argv[i+1]);
+            //The first -o holds the recording, every -o gets a stripe of the frame files
+            if (striping.numberOfStripes==0) { snprintf(dir,512,"%s",argv[i+1]); }
             char makedircmd[1025]= {0};
-            snprintf(makedircmd,1024,"mkdir -p %s",dir);
+            snprintf(makedircmd,1024,"mkdir -p %s",argv[i+1]);
             int z = system(makedircmd);
-            if (z==0)
+            if ( (z==0) && (addRecordingRoot(&striping,argv[i+1])) )
             {
-                fprintf(stderr,"Output Path set to \"%s\" \n",dir);
+                fprintf(stderr,"Output Path %u set to \"%s\" \n",striping.numberOfStripes-1,argv[i+1]);
             }
             else
             {
-                fprintf(stderr,"Failed setting output Path to \"%s\" \n",dir);
+                fprintf(stderr,"Failed setting output Path to \"%s\" \n",argv[i+1]);
             }
 
             } else
@@ -232,12 +263,201 @@ int main (int argc, char **argv)
         } else if (strcmp(argv[i],"--maxFrames")==0) {
             settings.maxFramesToGrab=atoi(argv[i+1]);
             fprintf(stderr,"Setting frame grab to %u \n",settings.maxFramesToGrab);
+        } else if (strcmp(argv[i],"--device")==0) {
+            deviceId=argv[i+1];
+            fprintf(stderr,"Device set to %s \n",deviceId);
+        } else if (strcmp(argv[i],"--pixelformat")==0) {
+            pixelFormat=argv[i+1];
+            fprintf(stderr,"Pixel format will be set to %s \n",pixelFormat);
+        } else if (strcmp(argv[i],"--stats")==0) {
+            statisticsFile=argv[i+1];
+            fprintf(stderr,"Statistics will be written to %s \n",statisticsFile);
+        } else if (strcmp(argv[i],"--discoveryTTL")==0) {
+            discoveryOptions.cacheTTL=atoi(argv[i+1]);
+            fprintf(stderr,"Discovery cache TTL set to %u seconds \n",discoveryOptions.cacheTTL);
+        } else if (strcmp(argv[i],"--retries")==0) {
+            discoveryOptions.retries=atoi(argv[i+1]);
+            fprintf(stderr,"Camera open will be retried %u times \n",discoveryOptions.retries);
+        } else if (strcmp(argv[i],"--framestats")==0) {
+            computeFrameStats=1;
+            fprintf(stderr,"Exposure statistics will be computed on every frame \n");
+        } else if (strcmp(argv[i],"--framestatsBudget")==0) {
+            computeFrameStats=1;
+            frameStatsBudget=atoi(argv[i+1]);
+            fprintf(stderr,"Exposure statistics budget set to %u μsec per frame \n",frameStatsBudget);
+        } else if (strcmp(argv[i],"--autoexposure")==0) {
+            useAutoExposure=1;
+            computeFrameStats=1; //The controller is driven by the frame statistics
+            autoExposureSettings.target=atof(argv[i+1]);
+            fprintf(stderr,"Software auto exposure will aim for a mean brightness of %0.2f \n",autoExposureSettings.target);
+        } else if (strcmp(argv[i],"--aeRamp")==0) {
+            autoExposureRamp=atoi(argv[i+1]);
+            fprintf(stderr,"Auto exposure will see a synthetic lighting ramp with a period of %u frames \n",autoExposureRamp);
+        } else if (strcmp(argv[i],"--gvAuto")==0) {
+            gigeTransport.autoTune=1;
+            fprintf(stderr,"GigE packet size, receive buffer and resends will be tuned automatically \n");
+        } else if (strcmp(argv[i],"--gvPacketSize")==0) {
+            gigeTransport.packetSize=atoi(argv[i+1]);
+            fprintf(stderr,"GigE packet size set to %d bytes \n",gigeTransport.packetSize);
+        } else if (strcmp(argv[i],"--gvPacketDelay")==0) {
+            gigeTransport.packetDelay=atol(argv[i+1]);
+            fprintf(stderr,"GigE packet delay set to %ld ns \n",gigeTransport.packetDelay);
+        } else if (strcmp(argv[i],"--gvSocket")==0) {
+            gigeTransport.packetSocket=(strcmp(argv[i+1],"standard")!=0);
+            fprintf(stderr,"GigE stream will use a %s socket \n",(gigeTransport.packetSocket) ? "packet" : "standard UDP");
+        } else if (strcmp(argv[i],"--gvSocketBuffer")==0) {
+            gigeTransport.socketBufferSize=atol(argv[i+1]);
+            fprintf(stderr,"GigE receive buffer set to %ld bytes (0 follows the payload size) \n",gigeTransport.socketBufferSize);
+        } else if (strcmp(argv[i],"--gvResend")==0) {
+            gigeTransport.resend=(strcmp(argv[i+1],"never")!=0);
+            fprintf(stderr,"GigE missing packets will %s be resent \n",(gigeTransport.resend) ? "always" : "never");
+        } else if (strcmp(argv[i],"--gvPacketTimeout")==0) {
+            gigeTransport.packetTimeout=atoi(argv[i+1]);
+            fprintf(stderr,"GigE packet timeout set to %u μsec \n",gigeTransport.packetTimeout);
+        } else if (strcmp(argv[i],"--gvFrameRetention")==0) {
+            gigeTransport.frameRetention=atoi(argv[i+1]);
+            fprintf(stderr,"GigE frame retention set to %u μsec \n",gigeTransport.frameRetention);
+        } else if (strcmp(argv[i],"--dark")==0) {
+            darkFile=argv[i+1];
+            fprintf(stderr,"Dark frame %s will be subtracted \n",darkFile);
+        } else if (strcmp(argv[i],"--flat")==0) {
+            flatFile=argv[i+1];
+            fprintf(stderr,"Flat field %s will be applied \n",flatFile);
+        } else if (strcmp(argv[i],"--calibrate")==0) {
+            if ( (strcmp(argv[i+1],"dark")==0) || (strcmp(argv[i+1],"flat")==0) )
+                { calibrate=argv[i+1]; fprintf(stderr,"Calibration : the average frame will be written to %s.pnm \n",calibrate); } else
+                { fprintf(stderr,"Unknown calibration %s, use dark or flat \n",argv[i+1]); }
+        } else if (strcmp(argv[i],"--calibrationFrames")==0) {
+            calibrationFrames=atoi(argv[i+1]);
+            fprintf(stderr,"Calibration will average %u frames \n",calibrationFrames);
+        } else if (strcmp(argv[i],"--preTrigger")==0) {
+            preTriggerSeconds=atof(argv[i+1]);
+            fprintf(stderr,"Frames will be kept in RAM and written %0.2f seconds before a trigger \n",preTriggerSeconds);
+        } else if (strcmp(argv[i],"--postTrigger")==0) {
+            postTriggerSeconds=atof(argv[i+1]);
+            fprintf(stderr,"Frames will be written %0.2f seconds after a trigger \n",postTriggerSeconds);
+        } else if (strcmp(argv[i],"--ringMB")==0) {
+            ringMB=atoi(argv[i+1]);
+            fprintf(stderr,"Pre-trigger ring budget set to %u MB \n",ringMB);
+        } else if (strcmp(argv[i],"--triggerSocket")==0) {
+            controlSocketPath=argv[i+1];
+            fprintf(stderr,"Triggers will be accepted on %s \n",controlSocketPath);
+        } else if (strcmp(argv[i],"--controlSocket")==0) {
+            controlSocketPath=argv[i+1];
+            fprintf(stderr,"Commands will be accepted on %s \n",controlSocketPath);
+        } else if (strcmp(argv[i],"--clockWindow")==0) {
+            clockWindow=atoi(argv[i+1]);
+            fprintf(stderr,"Camera timestamps are mapped to the host clock over the last %u frames \n",clockWindow);
+        } else if (strcmp(argv[i],"--trace")==0) {
+            traceFile=argv[i+1];
+            fprintf(stderr,"A timeline of the pipeline will be written to %s (kill -USR2 for a snapshot) \n",traceFile);
+        } else if (strcmp(argv[i],"--traceEvents")==0) {
+            traceEvents=atoi(argv[i+1]);
+            fprintf(stderr,"The timeline keeps the last %u events of every thread \n",traceEvents);
+        } else if (strcmp(argv[i],"--settings")==0) {
+            settingsFile=argv[i+1];
+            fprintf(stderr,"SIGHUP will reload settings from %s \n",settingsFile);
+        } else if (strcmp(argv[i],"--triggerOnTickExit")==0) {
+            triggerOnTickExit=atoi(argv[i+1]);
+            fprintf(stderr,"Tick command exit code %d will trigger \n",triggerOnTickExit);
+        } else if (strcmp(argv[i],"--changeThreshold")==0) {
+            changeThreshold=atof(argv[i+1]);
+            fprintf(stderr,"Only frames with blocks changing more than %0.2f levels will be written \n",changeThreshold);
+        } else if (strcmp(argv[i],"--changeArea")==0) {
+            changeArea=atof(argv[i+1]);
+            fprintf(stderr,"At least %0.3f%% of the frame has to change to be written \n",100.0*changeArea);
+        } else if (strcmp(argv[i],"--keyframe")==0) {
+            keyframeInterval=atoi(argv[i+1]);
+            fprintf(stderr,"A frame will be written at least every %u frames \n",keyframeInterval);
+        } else if (strcmp(argv[i],"--stack")==0) {
+            stackWindow=atoi(argv[i+1]);
+            fprintf(stderr,"Every %u frames will be stacked into one \n",stackWindow);
+        } else if (strcmp(argv[i],"--stackMode")==0) {
+            if (parseFrameStackMode(argv[i+1],&stackMode))
+                { fprintf(stderr,"Frames will be stacked with their %s \n",frameStackModeName(stackMode)); } else
+                { fprintf(stderr,"Unknown stacking mode %s, use sum, mean or median \n",argv[i+1]); }
+        } else if (strcmp(argv[i],"--noIndex")==0) {
+            writeFrameIndex=0;
+            fprintf(stderr,"No frame index will be written \n");
+        } else if (strcmp(argv[i],"--jpeg")==0) {
+            jpegQuality=atoi(argv[i+1]);
+            fprintf(stderr,"Frames will be written as JPEG with quality %u \n",jpegQuality);
+        } else if (strcmp(argv[i],"--jpegWorkers")==0) {
+            jpegWorkers=atoi(argv[i+1]);
+            fprintf(stderr,"JPEG encoding will use %u threads \n",jpegWorkers);
+        } else if (strcmp(argv[i],"--jpegSlices")==0) {
+            jpegSlices=atoi(argv[i+1]);
+            fprintf(stderr,"JPEG frames will be cut in up to %u slices \n",jpegSlices);
+        } else if (strcmp(argv[i],"--pnmPolicy")==0) {
+            usePnmQueue=1;
+            if (parseSinkPolicy(&pnmPolicy,argv[i+1]))
+                { fprintf(stderr,"PNM frames will be queued, %s when the disk falls behind \n",argv[i+1]); } else
+                { fprintf(stderr,"Unknown sink policy %s, use block, drop-newest, drop-oldest or decimate:N \n",argv[i+1]); }
+        } else if (strcmp(argv[i],"--pnmQueue")==0) {
+            usePnmQueue=1;
+            pnmPolicy.queueDepth=atoi(argv[i+1]);
+            fprintf(stderr,"Up to %u PNM frames will be queued \n",pnmPolicy.queueDepth);
+        } else if (strcmp(argv[i],"--jpegPolicy")==0) {
+            if (parseSinkPolicy(&jpegPolicy,argv[i+1]))
+                { fprintf(stderr,"JPEG frames will be %s when the encoders fall behind \n",argv[i+1]); } else
+                { fprintf(stderr,"Unknown sink policy %s, use block, drop-newest, drop-oldest or decimate:N \n",argv[i+1]); }
+        } else if (strcmp(argv[i],"--jpegQueue")==0) {
+            jpegPolicy.queueDepth=atoi(argv[i+1]);
+            fprintf(stderr,"Up to %u JPEG frames will be queued \n",jpegPolicy.queueDepth);
+        } else if (strcmp(argv[i],"--shm")==0) {
+            shmStreamName=argv[i+1];
+            fprintf(stderr,"Written frames will also be published to shared memory stream %s \n",shmStreamName);
+        } else if (strcmp(argv[i],"--shmPolicy")==0) {
+            if (parseSinkPolicy(&shmPolicy,argv[i+1]))
+                { fprintf(stderr,"Shared memory frames will be %s when the consumers hold the stream \n",argv[i+1]); } else
+                { fprintf(stderr,"Unknown sink policy %s, use block, drop-newest, drop-oldest or decimate:N \n",argv[i+1]); }
+        } else if (strcmp(argv[i],"--shmQueue")==0) {
+            shmPolicy.queueDepth=atoi(argv[i+1]);
+            fprintf(stderr,"Up to %u shared memory frames will be queued \n",shmPolicy.queueDepth);
+        } else if (strcmp(argv[i],"--journal")==0) {
+            useJournal=1;
+            fprintf(stderr,"Written frames will be journaled \n");
+        } else if (strcmp(argv[i],"--syncInterval")==0) {
+            useJournal=1;
+            syncInterval=atoi(argv[i+1]);
+            fprintf(stderr,"Journaled frames will be made durable every %u ms \n",syncInterval);
+        } else if (strcmp(argv[i],"--timelapse")==0) {
+            timeLapseInterval=atof(argv[i+1]);
+            fprintf(stderr,"One frame will be triggered every %0.3f seconds \n",timeLapseInterval);
         }
 
 
 
     }
 
+    //Calibration averages raw frames with the stacking stage and writes the first stacked frame as the reference
+    if (calibrate!=0)
+    {
+        stackWindow = calibrationFrames;
+        stackMode   = FRAME_STACK_MEAN;
+        darkFile    = 0;
+        flatFile    = 0;
+        changeThreshold = 0.0;
+        preTriggerSeconds = 0.0;
+        jpegQuality = 0;
+        if (settings.maxFramesToGrab<calibrationFrames) { settings.maxFramesToGrab = calibrationFrames; }
+        timeLapseInterval = 0.0;
+    }
+
+    //The triggers set the pace, a frame rate would have the camera run free again
+    if ( (timeLapseInterval>0.0) && (settings.frameRate!=0.0) )
+    {
+        fprintf(stderr,"--fps is ignored with --timelapse\n");
+        settings.frameRate = 0.0;
+    }
+
+
+    //Started before the stream exists so that its thread is traced from the first buffer
+    if (traceFile!=0)
+    {
+        startPipelineTrace(traceEvents);
+        namePipelineTraceThread("acquisition");
+    }
 
     /* Mandatory glib type system initialization */
     //arv_g_type_init ();
@@ -245,9 +465,9 @@ int main (int argc, char **argv)
     ArvCamera *camera = NULL;
     GError *error = NULL;
 
-    /* Connect to the first available camera */
+    /* Connect to the requested camera, or the first available one, through the discovery cache */
     printf ("Trying to connect to camera \n");
-    camera = arv_camera_new (NULL, &error);
+    camera = openCameraFast (deviceId, &discoveryOptions, &startupTimes, &error);
     if ( (camera == NULL) && (error != NULL) )
        {
           fprintf (stderr,"No camera found, terminating streamer\n");
@@ -262,9 +482,34 @@ int main (int argc, char **argv)
 
         arv_camera_set_acquisition_mode (camera, ARV_ACQUISITION_MODE_CONTINUOUS, &error);
 
+        if ( (error == NULL) && (pixelFormat!=0) )
+            arv_camera_set_pixel_format_from_string (camera, pixelFormat, &error);
+
+        if (error == NULL)
+        {   //Region and pixel format decide the payload size, so they have to be set before the buffers are allocated
+            if ( (!refreshDimsOnEachFrame)&& (!forceDims) )
+            {   //Poll dims so that we know them in advance if we dont want to get them from each buffer, and we dont want to force a specific dimension
+                int minvalue=0,maxvalue=0;
+                arv_camera_get_width_bounds(camera,&minvalue,&maxvalue,NULL);
+                dataAsImage.width  = (unsigned int) maxvalue;
+                arv_camera_get_height_bounds(camera,&minvalue,&maxvalue,NULL);
+                dataAsImage.height  = (unsigned int) maxvalue;
+            }
+
+            if ( (!refreshDimsOnEachFrame) || (forceDims) )
+            {   //Attempt to setup region if there is no autorefresh of dimensions, or we want to force a specific dimension
+                arv_camera_set_region(camera,0,0,dataAsImage.width,dataAsImage.height,NULL); //Use full sensor area
+            }
+        }
+
+        unsigned long streamSetupStart = monotonicMicroseconds();
+        //Packet size, delay and socket type have to be set before the stream exists
+        if (error == NULL)
+            applyGigECameraTransport(&gigeTransport,camera,stderr);
+
         if (error == NULL)
             /* Create the stream object without callback */
-            stream = arv_camera_create_stream (camera, NULL, NULL, NULL, &error);
+            stream = arv_camera_create_stream (camera, (traceFile!=0) ? pipelineTraceStreamCallback : NULL, NULL, NULL, &error);
 
         if (ARV_IS_STREAM (stream))
         {
@@ -273,6 +518,8 @@ int main (int argc, char **argv)
 
             /* Retrieve the payload size for buffer creation */
             payload = arv_camera_get_payload (camera, &error);
+            if (error == NULL)
+                applyGigEStreamTransport(&gigeTransport,stream,payload,stderr);
             if (error == NULL) {
                 /* Insert some buffers in the stream buffer pool */
                 for (i = 0; i < ARV_VIEWER_N_BUFFERS; i++)
@@ -282,58 +529,289 @@ int main (int argc, char **argv)
 
             arv_stream_set_emit_signals (stream, TRUE);
             arv_stream_create_buffers(stream, ARV_VIEWER_N_BUFFERS, NULL, NULL, NULL);
+            startupTimes.stream = monotonicMicroseconds() - streamSetupStart;
+
 
+            //Trigger mode can only change while the camera is not acquiring
+            if ( (error == NULL) && (timeLapseInterval>0.0) )
+            {
+                char timeLapsePath[1024];
+                snprintf(timeLapsePath,1024,"%s/timeLapse.csv",dir);
+                timeLapseFile = fopen(timeLapsePath,"w");
+                useTimeLapse = startTimeLapse(&timeLapse,camera,timeLapseInterval,timeLapseFile);
+                if (useTimeLapse) { statistics.timeLapse = &timeLapse; } else
+                                  { settings.frameRate = 1.0 / timeLapseInterval; } //Paced as without --timelapse
+            }
 
             if (error == NULL)
                 /* Start the acquisition */
                 arv_camera_set_acquisition_mode (camera, ARV_ACQUISITION_MODE_CONTINUOUS, NULL);
             arv_camera_start_acquisition (camera, &error);
+            unsigned long acquisitionStart = monotonicMicroseconds();
 
-            if (settings.exposure!=0)
-            {
-                arv_camera_set_exposure_time(camera, settings.exposure, NULL);
-            }
-            if (settings.gain!=0.0)
-            {
-                arv_camera_set_gain (camera, settings.gain, NULL);
-            }
-            if (settings.blackLevel!=0.0)
-            {
-                arv_camera_set_black_level(camera, settings.blackLevel, NULL);
-            }
-            if (settings.frameRate!=0.0)
-            {
-                arv_camera_set_frame_rate (camera, settings.frameRate, NULL);
-            }
+            applyCameraSettings(camera,&settings);
 
 
 
 
             if (error == NULL)
             {
-                if ( (!refreshDimsOnEachFrame)&& (!forceDims) )
-                {   //Poll dims so that we know them in advance if we dont want to get them from each buffer, and we dont want to force a specific dimension
-                    int minvalue=0,maxvalue=0;
-                    arv_camera_get_width_bounds(camera,&minvalue,&maxvalue,NULL);
-                    dataAsImage.width  = (unsigned int) maxvalue;
-                    arv_camera_get_height_bounds(camera,&minvalue,&maxvalue,NULL);
-                    dataAsImage.height  = (unsigned int) maxvalue;
-                }
-
-                if ( (!refreshDimsOnEachFrame) || (forceDims) )
-                {   //Attempt to setup region if there is no autorefresh of dimensions, or we want to force a specific dimension
-                    arv_camera_set_region(camera,0,0,dataAsImage.width,dataAsImage.height,NULL); //Use full sensor area
-                }
-
                 const void *data;
                 char filename[1025]= {0};
                 unsigned int frameNumber = 0;
-                unsigned int brokenFrameNumber = 0;
                 ArvBuffer *buffer;
 
                 snprintf(filename,1024,"%s/info.json",dir);
                 writeSettings(filename,&settings);
 
+                //Dark frame and flat field correction, in place on the Aravis buffer before anything reads it
+                char useFrameCorrection = 0;
+                unsigned int correctionBitsPerPixel = 8, correctionSignificantBits = 8;
+                if ( (darkFile!=0) || (flatFile!=0) )
+                {
+                    const char * currentPixelFormat = arv_camera_get_pixel_format_as_string(camera,NULL);
+                    if (!frameStatisticsLayout(currentPixelFormat,&correctionBitsPerPixel,&correctionSignificantBits))
+                        { correctionBitsPerPixel = 8; correctionSignificantBits = 8; }
+                    useFrameCorrection = loadFrameCorrection(&frameCorrection,darkFile,flatFile,correctionSignificantBits);
+                    if (useFrameCorrection)
+                    {
+                        statistics.frameCorrection = &frameCorrection;
+                        fprintf(stderr,"Correcting %ux%u:%u frames with the %s kernel\n",frameCorrection.width,frameCorrection.height,frameCorrection.channels,frameCorrectionKernel());
+                    }
+                }
+
+                //Per frame exposure statistics go to a CSV next to the frames, their totals to --stats
+                struct FrameStatistics * frameStats = 0;
+                FILE * frameStatsFile = 0;
+                unsigned int frameStatsBitsPerPixel = 8, frameStatsSignificantBits = 8;
+                if (computeFrameStats)
+                {
+                    const char * currentPixelFormat = arv_camera_get_pixel_format_as_string(camera,NULL);
+                    if (!frameStatisticsLayout(currentPixelFormat,&frameStatsBitsPerPixel,&frameStatsSignificantBits))
+                    {
+                        fprintf(stderr,"Exposure statistics do not support pixel format %s, disabling them\n",(currentPixelFormat!=0) ? currentPixelFormat : "?");
+                    } else
+                    {
+                        if (frameStatsBudget==0)
+                        {   //Default to a quarter of the frame period so that the statistics never become the bottleneck
+                            frameStatsBudget = (settings.frameRate!=0.0) ? (unsigned int) (250000 / settings.frameRate) : 2000;
+                        }
+                        initializeFrameStatistics(&frameStatsState,frameStatsBudget);
+                        frameStats = (struct FrameStatistics *) malloc(sizeof(struct FrameStatistics));
+                        snprintf(filename,1024,"%s/frameStatistics.csv",dir);
+                        frameStatsFile = fopen(filename,"w");
+                        writeFrameStatisticsHeader(frameStatsFile);
+                        statistics.frameStatistics = &frameStatsState;
+                        fprintf(stderr,"Exposure statistics using the %s kernel, budget %u μsec\n",frameStatisticsKernel(),frameStatsBudget);
+                    }
+                }
+
+                //Software auto exposure, feature writes happen on the controller thread
+                FILE * autoExposureLog = 0;
+                char autoExposureRunning = 0;
+                if ( (useAutoExposure) && (frameStats!=0) )
+                {
+                    if (settings.frameRate!=0.0)
+                        { autoExposureSettings.maxExposure = 1000000.0 / settings.frameRate; }
+                    snprintf(filename,1024,"%s/autoExposure.log",dir);
+                    autoExposureLog = fopen(filename,"w");
+                    autoExposureRunning = startAutoExposure(&autoExposure,camera,&autoExposureSettings,autoExposureLog);
+                    if (autoExposureRunning) { statistics.autoExposure = &autoExposure; }
+                }
+                //Live reconfiguration from the control socket and SIGHUP, the camera keeps streaming
+                char settingsPath[1025]= {0};
+                if (settingsFile!=0) { snprintf(settingsPath,1024,"%s",settingsFile); } else
+                                     { snprintf(settingsPath,1024,"%s/info.json",dir); }
+                snprintf(filename,1024,"%s/liveConfig.csv",dir);
+                FILE * liveConfigLog = fopen(filename,"w");
+                char liveConfigRunning = startLiveConfig(&liveConfig,camera,settingsPath,liveConfigLog,autoExposureRunning,useTimeLapse);
+                if (liveConfigRunning)
+                {
+                    statistics.liveConfig = &liveConfig;
+                    controlTargets.live   = &liveConfig;
+                }
+
+                //Pre-trigger ring, frames only reach the disk around a trigger
+                if (preTriggerSeconds>0.0)
+                {
+                    useFrameRing = createFrameRing(&frameRing,dir,ringMB,preTriggerSeconds,postTriggerSeconds);
+                    if (useFrameRing)
+                    {
+                        statistics.frameRing = &frameRing;
+                        controlTargets.ring  = &frameRing;
+                    }
+                }
+
+                char controlSocketRunning = 0;
+                if (controlSocketPath!=0)
+                    { controlSocketRunning = startControlSocket(&controlSocket,controlSocketPath,controlSocketHandler,&controlTargets); }
+                if (useFrameRing)
+                    { fprintf(stderr,"Waiting for SIGUSR1%s to write frames (kill -USR1 %d)\n",(controlSocketRunning) ? " or a socket trigger" : "",getpid()); }
+
+                //Change detection, frames too close to the last written one are only logged
+                FILE * skippedFramesFile = 0;
+                if (changeThreshold>0.0)
+                {
+                    initializeChangeDetector(&changeDetector,changeThreshold,changeArea,keyframeInterval);
+                    statistics.changeDetector = &changeDetector;
+                    snprintf(filename,1024,"%s/skippedFrames.csv",dir);
+                    skippedFramesFile = fopen(filename,"w");
+                    if (skippedFramesFile!=0) { fprintf(skippedFramesFile,"frame,changedBlocks,blocks,maxBlockDifference\n"); }
+                    fprintf(stderr,"Change detection using the %s kernel\n",changeDetectionKernel());
+                }
+
+                //Frame files striped over every -o directory, see common/striped-recording.h
+                useStriping = (striping.numberOfStripes>1);
+                if ( (useStriping) && (jpegQuality!=0) )
+                {
+                    fprintf(stderr,"JPEG files are not striped, they all go to %s\n",dir);
+                    useStriping = 0;
+                }
+                if ( (useStriping) && (useJournal) )
+                {   //One syncfs() per group commit covers the file system of the journal only
+                    fprintf(stderr,"The journal cannot cover frame files on several disks, --journal is ignored\n");
+                    useJournal = 0;
+                }
+
+                //Crash safe recording, sinks journal every file they complete, see tools/recording-recover.c
+                if (useJournal)
+                {
+                    useJournal = openRecordingJournal(&journal,dir,syncInterval);
+                    if (useJournal) { statistics.journal = &journal; }
+                }
+
+                //Frames a sink policy discarded, one line each, see common/sink-queue.h
+                FILE * sinkDropsFile = 0;
+                if ( (usePnmQueue) || (jpegQuality!=0) || (shmStreamName!=0) || (useStriping) )
+                {
+                    snprintf(filename,1024,"%s/sinkDrops.csv",dir);
+                    sinkDropsFile = fopen(filename,"w");
+                    if (sinkDropsFile!=0) { fprintf(sinkDropsFile,"sink,frame,reason\n"); }
+                    pnmPolicy.dropLog  = sinkDropsFile;
+                    jpegPolicy.dropLog = sinkDropsFile;
+                    shmPolicy.dropLog  = sinkDropsFile;
+                }
+
+                //JPEG output instead of PNM, encoded by a worker pool
+                if (jpegQuality!=0)
+                {
+                    if (jpegWorkers==0)
+                    {
+                        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+                        jpegWorkers = (cores>1) ? (unsigned int) cores-1 : 1; //Leave one core to the acquisition
+                    }
+                    if (jpegSlices==0) { jpegSlices = jpegWorkers; }
+                    useJpeg = createJpegSink(&jpegSink,dir,jpegQuality,jpegWorkers,jpegSlices,2*jpegWorkers,&jpegPolicy);
+                    if (useJpeg)
+                    {
+                        if (useJournal) { jpegSink.journal = &journal; }
+                        statistics.jpegSink = &jpegSink;
+                        statistics.sinkPolicies[statistics.numberOfSinkPolicies++] = &jpegSink.policy;
+                    }
+                }
+
+                //Camera timestamps in the host clock, for the index and the shared memory consumers
+                if (createClockMapping(&clockMapping,clockWindow)) { statistics.clockMapping = &clockMapping; }
+
+                //PNM files and shared memory fed from one copy of the frame, each by its own thread
+                struct SharedMemoryContext * shmContext = 0;
+                struct VideoFrame * shmFrame = 0;
+                struct ClockMappingPublisher clockPublisher = {0};
+                struct SharedMemorySink shmSink = {0};
+                if (shmStreamName!=0)
+                {
+                    if ( (createSharedMemoryContextDescriptor("video_frames.shm")!=-1) &&
+                         ((shmContext=connectToSharedMemoryContextDescriptor("video_frames.shm"))!=0) )
+                    {
+                        createVideoFrameMetaData(shmContext,shmStreamName,dataAsImage.width,dataAsImage.height,1);
+                        shmFrame = getVideoBufferPointer(shmContext,shmStreamName);
+                        if ( (shmFrame!=0) && (map_frame_shared_memory(shmFrame,1)==NULL) ) { shmFrame=0; }
+                    }
+                    if (shmFrame==0) { fprintf(stderr,"Could not publish to shared memory stream %s\n",shmStreamName); } else
+                    {
+                        shmSink.frame = shmFrame;
+                        if (openClockMappingPublisher(&clockPublisher,shmStreamName)) { shmSink.clock = &clockPublisher; }
+                    }
+                }
+                if ( (usePnmQueue) || (shmFrame!=0) || (useStriping) )
+                {
+                    createFrameFanOut(&fanOut);
+                    if (useStriping)
+                    {   //One sink per root, each frame is only offered to the sink of its root
+                        startStripedRecording(&striping,&fanOut,&pnmPolicy);
+                        for (i=0; i<striping.numberOfStripes; i++)
+                        {
+                            if (striping.stripes[i].fanOutSink<0) { continue; }
+                            if (pnmSink<0) { pnmSink = striping.stripes[i].fanOutSink; }
+                            statistics.sinkPolicies[statistics.numberOfSinkPolicies++] = &striping.stripes[i].policy;
+                        }
+                        if (pnmSink>=0) { statistics.stripedRecording = &striping; } else
+                                        { useStriping = 0; }
+                    } else
+                    if (jpegQuality==0)
+                    {   //Without a queue policy the PNM sink blocks, no file is lost as before
+                        pnmSinkContext.directory = dir;
+                        pnmSinkContext.journal   = (useJournal) ? &journal : 0;
+                        pnmSink = addFrameFanOutSink(&fanOut,&pnmPolicy,0,writePNMSinkFrame,&pnmSinkContext,1);
+                        if (pnmSink>=0) { statistics.sinkPolicies[statistics.numberOfSinkPolicies++] = &pnmPolicy; }
+                    }
+                    if ( (shmFrame!=0) && (addFrameFanOutSink(&fanOut,&shmPolicy,0,writeSharedMemorySinkFrame,&shmSink,1)>=0) )
+                        { statistics.sinkPolicies[statistics.numberOfSinkPolicies++] = &shmPolicy; }
+                    useFanOut = startFrameFanOut(&fanOut);
+                    if (useFanOut) { statistics.fanOut = &fanOut; } else
+                                   { pnmSink = -1; useStriping = 0; statistics.stripedRecording = 0; destroyFrameFanOut(&fanOut); }
+                }
+
+                //Camera and host timestamps and the status of every buffer, see tools/frame-index-tool.c
+                if (writeFrameIndex)
+                {
+                    char filename[1024];
+                    snprintf(filename,1024,"%s/frameIndex.bin",dir);
+                    writeFrameIndex = openFrameIndex(&frameIndex,filename);
+                }
+
+                //Temporal stacking, the sinks below only see one frame per window
+                char useFrameStack = 0;
+                unsigned int stackBitsPerPixel = 8, stackSignificantBits = 8;
+                if (stackWindow>1)
+                {
+                    const char * currentPixelFormat = arv_camera_get_pixel_format_as_string(camera,NULL);
+                    if (!frameStatisticsLayout(currentPixelFormat,&stackBitsPerPixel,&stackSignificantBits))
+                    {
+                        stackBitsPerPixel = 8;
+                        fprintf(stderr,"Pixel format %s will be stacked as 8 bit samples\n",(currentPixelFormat!=0) ? currentPixelFormat : "?");
+                    }
+                    useFrameStack = initializeFrameStack(&frameStack,stackWindow,stackMode);
+                    if (useFrameStack)
+                    {
+                        statistics.frameStack = &frameStack;
+                        fprintf(stderr,"Stacking %u frames (%s) with the %s kernel\n",stackWindow,frameStackModeName(stackMode),frameStackingKernel());
+                    } else
+                    {
+                        fprintf(stderr,"Cannot stack %u frames with the %s, stacking disabled\n",stackWindow,frameStackModeName(stackMode));
+                    }
+                }
+
+                //Per second failures and resends of the GigE stream
+                FILE * gigeTransportFile = 0;
+                if (gigeTransport.isGigE)
+                {
+                    snprintf(filename,1024,"%s/gigeTransport.csv",dir);
+                    gigeTransportFile = fopen(filename,"w");
+                    statistics.gigeTransport = &gigeTransport;
+                }
+
+                //Lost frames by cause, one line per loss, see common/frame-loss.h
+                snprintf(filename,1024,"%s/frameLoss.csv",dir);
+                FILE * frameLossFile = fopen(filename,"w");
+                initializeFrameLossTracker(&frameLoss,frameLossFile);
+                statistics.frameLoss = &frameLoss;
+
+                float brightnessFullScale = (float) ((1u << frameStatsSignificantBits) - 1);
+
+                //Read once, asking the camera on every frame costs a control channel round trip
+                float frameRate = arv_camera_get_frame_rate (camera, NULL);
+
                 unsigned long startTime = GetTickCountMicroseconds();
 
                 unsigned long startGrab, endGrab;
@@ -353,26 +831,110 @@ int main (int argc, char **argv)
                 while  (!termination_requested && frameNumber<settings.maxFramesToGrab)
                 {
                     startGrab = GetTickCountMicroseconds();
-                    buffer = arv_stream_pop_buffer (stream);
+                    if (reload_requested)
+                    {
+                        reload_requested = 0;
+                        requestLiveConfigReload(&liveConfig);
+                    }
+                    if (trace_requested)
+                    {
+                        trace_requested = 0;
+                        writePipelineTrace(traceFile);
+                    }
+                    if (useTimeLapse)
+                    {   //A signal cuts the wait short, it is handled at the top of the loop and the deadline stays
+                        if (!triggerTimeLapse(&timeLapse,camera,stream)) { continue; }
+                        traceBegin("pop",frameNumber);
+                        buffer = popTimeLapseBuffer(&timeLapse,stream);
+                        traceEnd("pop",frameNumber);
+                    } else
+                    {
+                        traceBegin("pop",frameNumber);
+                        buffer = arv_stream_pop_buffer (stream);
+                        traceEnd("pop",frameNumber);
+                    }
+                    reportGigETransport(&gigeTransport,stream,gigeTransportFile);
+                    if (useStriping) { reportStripedRecording(&striping); }
                     if (ARV_IS_BUFFER(buffer))
                     {
+                        struct FrameIndexRecord indexRecord = {0};
+                        indexRecord.frameId         = arv_buffer_get_frame_id(buffer);
+                        indexRecord.deviceTimestamp = arv_buffer_get_timestamp(buffer);
+                        indexRecord.systemTimestamp = systemTimestampToMonotonic(arv_buffer_get_system_timestamp(buffer));
+                        indexRecord.status          = arv_buffer_get_status(buffer);
+                        indexRecord.outputNumber    = FRAME_INDEX_NOT_WRITTEN;
+                        char usable = checkFrameLoss(&frameLoss,stream,buffer);
+                        struct FrameTimestamps timestamps;
+                        timestamps.device = indexRecord.deviceTimestamp;
+                        timestamps.system = indexRecord.systemTimestamp;
+                        timestamps.host   = (usable) ? mapClockMapping(&clockMapping,timestamps.device,timestamps.system) : timestamps.system;
+                        indexRecord.hostTimestamp = timestamps.host;
+
                         if (refreshDimsOnEachFrame)
                         {
                             dataAsImage.width        = arv_buffer_get_image_width (buffer);
                             dataAsImage.height       = arv_buffer_get_image_height (buffer);
                         }
 
-                        if ((dataAsImage.width!=0) && (dataAsImage.height!=0))
+                        if ((usable) && (dataAsImage.width!=0) && (dataAsImage.height!=0))
                         {
+                            if (frameNumber==0)
+                            {
+                                startupTimes.firstFrame = monotonicMicroseconds() - acquisitionStart;
+                                printStartupTimes(stderr,&startupTimes);
+                            }
+
                             size_t size;
                             data = arv_buffer_get_image_data(buffer,&size);
                             //printf ("Size =  %lu\n",size);
                             dataAsImage.pixels       = data;
+                            if ( (liveConfigRunning) && (liveConfigFrame(&liveConfig,frameNumber,indexRecord.systemTimestamp,frameLoss.lost,(useTimeLapse) ? 0 : &settings.frameRate)!=0) )
+                            {   //First frame with the new settings, the software rate limiter follows a new frame rate
+                                indexRecord.flags |= FRAME_INDEX_RECONFIGURED;
+                                if (settings.frameRate!=0.0) { frameRate = settings.frameRate; }
+                            }
+
+                            if ( (useFrameCorrection) && (size >= frameCorrection.samples*(correctionBitsPerPixel/8)) )
+                            {
+                                traceBegin("correct",frameNumber);
+                                applyFrameCorrection(&frameCorrection,(void *) data,dataAsImage.width,dataAsImage.height,frameCorrection.channels,correctionBitsPerPixel);
+                                traceEnd("correct",frameNumber);
+                            }
 
                             dataAsImage.channels     = 1;
                             dataAsImage.bitsperpixel = 8;
                             dataAsImage.image_size   = dataAsImage.width  * dataAsImage.height * dataAsImage.channels;
-                            dataAsImage.timestamp    = i;
+                            dataAsImage.timestamp    = frameNumber;
+                            indexRecord.payloadSize  = (uint32_t) size;
+
+                            if ( (frameStats!=0) && (size >= (size_t) dataAsImage.width * dataAsImage.height * (frameStatsBitsPerPixel/8)) )
+                            {
+                                traceBegin("statistics",frameNumber);
+                                char haveFrameStats = computeFrameStatistics(&frameStatsState,data,dataAsImage.width,dataAsImage.height,frameStatsBitsPerPixel,frameStatsSignificantBits,frameStats);
+                                traceEnd("statistics",frameNumber);
+                                if (haveFrameStats)
+                                {
+                                    writeFrameStatisticsRow(frameStatsFile,frameNumber,frameStats);
+                                    indexRecord.flags         |= FRAME_INDEX_STATISTICS;
+                                    indexRecord.exposureMean   = (float) frameStats->mean;
+                                    indexRecord.exposureMedian = frameStats->median;
+                                    if (frameStats->pixelsSampled!=0)
+                                    {
+                                        indexRecord.underExposedRatio = (float) frameStats->underExposed / frameStats->pixelsSampled;
+                                        indexRecord.overExposedRatio  = (float) frameStats->overExposed  / frameStats->pixelsSampled;
+                                    }
+                                    if (autoExposureRunning)
+                                    {
+                                        float brightness = frameStats->mean / brightnessFullScale;
+                                        if (autoExposureRamp!=0)
+                                        {   //Simulated lighting going from 100% down to 20% and back, to exercise the loop with the fake camera
+                                            float phase = (float) (frameNumber % (2*autoExposureRamp)) / autoExposureRamp;
+                                            brightness *= 0.2f + 0.8f * fabsf(phase - 1.0f);
+                                        }
+                                        submitAutoExposureMeasurement(&autoExposure,frameNumber,brightness);
+                                    }
+                                }
+                            }
 
                             /* Display some informations about the retrieved buffer */
                             //printf ("Acquired %d×%d buffer\n",dataAsImage.width,dataAsImage.height);
@@ -380,26 +942,143 @@ int main (int argc, char **argv)
 
 
                             arv_stream_get_statistics (stream,&n_completed_buffers,&n_failures,&n_underruns);
-                            float frameRate = arv_camera_get_frame_rate (camera, NULL);
-                            printf("\r %u Frames Grabbed (%u dropped) - @ %0.2f FPS (set %0.2f) ",frameNumber,brokenFrameNumber,(float) frameNumber / ((endTime-startTime)/1000000), frameRate );
+                            printf("\r %u Frames Grabbed (%lu lost) - @ %0.2f FPS (set %0.2f) ",frameNumber,frameLoss.lost,(float) frameNumber / ((endTime-startTime)/1000000), frameRate );
                             printf("Ok %lu/Fail %lu/Under %lu    \r",n_completed_buffers,n_failures,n_underruns);
 
-                            snprintf(filename,1024,"%s/colorFrame_0_%05u.pnm",dir,frameNumber);
-                            WritePPM(filename,&dataAsImage);
+                            char stackComplete = 1;
+                            if ( (useFrameStack) && (size >= (size_t) dataAsImage.width * dataAsImage.height * dataAsImage.channels * (stackBitsPerPixel/8)) )
+                            {
+                                traceBegin("stack",frameNumber);
+                                stackComplete = pushFrameStack(&frameStack,data,dataAsImage.width,dataAsImage.height,dataAsImage.channels,stackBitsPerPixel);
+                                traceEnd("stack",frameNumber);
+                                if (stackComplete)
+                                {
+                                    dataAsImage.pixels       = frameStack.output;
+                                    dataAsImage.bitsperpixel = frameStack.outputBitsPerPixel;
+                                    dataAsImage.image_size   = frameStack.outputSize;
+                                }
+                            }
+
+                            char keepFrame = 1;
+                            if ( (changeThreshold>0.0) && (stackComplete) )
+                            {
+                                traceBegin("detect",frameNumber);
+                                keepFrame = changeDetectorKeepFrame(&changeDetector,dataAsImage.pixels,dataAsImage.image_size/dataAsImage.height,dataAsImage.height);
+                                traceEnd("detect",frameNumber);
+                                if ( (!keepFrame) && (skippedFramesFile!=0) )
+                                {
+                                    fprintf(skippedFramesFile,"%u,%u,%u,%0.2f\n",frameNumber,changeDetector.changedBlocks,changeDetector.blocks,changeDetector.maxBlockDifference);
+                                }
+                            }
+
+                            unsigned long sinkStart = monotonicMicroseconds();
+                            char frameInRing = 0;
+                            if (!stackComplete)
+                            {
+                                //Accumulated, the stacked frame is written with the last frame of the window
+                                indexRecord.flags |= FRAME_INDEX_STACKED;
+                            } else
+                            if (calibrate!=0)
+                            {
+                                snprintf(filename,1024,"%s/%s.pnm",dir,calibrate);
+                                if (WritePPM(filename,&dataAsImage))
+                                    { fprintf(stderr,"\nWrote %s, the average of %u frames\n",filename,calibrationFrames); }
+                                termination_requested = 1;
+                            } else
+                            if (!keepFrame)
+                            {
+                                //Nothing to write, the frame id is in skippedFrames.csv
+                                indexRecord.flags |= FRAME_INDEX_SKIPPED;
+                            } else
+                            if (useFrameRing)
+                            {
+                                indexRecord.flags |= FRAME_INDEX_RING;
+                                if (trigger_requested)
+                                {
+                                    trigger_requested = 0;
+                                    triggerFrameRing(&frameRing,"SIGUSR1");
+                                }
+                                traceBegin("ring",frameNumber);
+                                if (pushFrameRing(&frameRing,dataAsImage.pixels,dataAsImage.image_size,dataAsImage.width,dataAsImage.height,dataAsImage.channels,dataAsImage.bitsperpixel,frameNumber))
+                                    { frameInRing = 1; }
+                                traceEnd("ring",frameNumber);
+                            } else
+                            {
+                                if (useFanOut)
+                                {   //Accepted by the PNM policy, a drop-oldest eviction shows up in sinkDrops.csv
+                                    unsigned int sinks = ~0u;
+                                    int recordingSink = pnmSink;
+                                    if (useStriping)
+                                    {
+                                        indexRecord.outputRoot = nextRecordingStripe(&striping);
+                                        recordingSink = striping.stripes[indexRecord.outputRoot].fanOutSink;
+                                        sinks = stripedRecordingSinks(&striping,indexRecord.outputRoot);
+                                    }
+                                    traceBegin("submit",frameNumber);
+                                    unsigned int admitted = submitFrameFanOutTo(&fanOut,sinks,dataAsImage.pixels,dataAsImage.image_size,dataAsImage.width,dataAsImage.height,dataAsImage.channels,dataAsImage.bitsperpixel,frameNumber,&timestamps);
+                                    traceEnd("submit",frameNumber);
+                                    if ( (recordingSink>=0) && (admitted & (1u<<recordingSink)) )
+                                    {
+                                        indexRecord.flags       |= FRAME_INDEX_WRITTEN;
+                                        indexRecord.outputNumber = frameNumber;
+                                    }
+                                }
+
+                                if ( (useJpeg) && (dataAsImage.bitsperpixel==8) ) //Deeper frames stay PNM, baseline JPEG is 8 bit
+                                {
+                                    traceBegin("jpeg submit",frameNumber);
+                                    int submitted = submitJpegFrame(&jpegSink,dataAsImage.pixels,dataAsImage.width,dataAsImage.height,dataAsImage.channels,frameNumber);
+                                    traceEnd("jpeg submit",frameNumber);
+                                    if (submitted)
+                                    {
+                                        indexRecord.flags       |= FRAME_INDEX_WRITTEN;
+                                        indexRecord.outputNumber = frameNumber;
+                                    }
+                                } else
+                                if (pnmSink<0)
+                                {
+                                    snprintf(filename,1024,"%s/colorFrame_0_%05u.pnm",dir,frameNumber);
+                                    traceBegin("write",frameNumber);
+                                    int written = WritePPM(filename,&dataAsImage);
+                                    traceEnd("write",frameNumber);
+                                    if (written)
+                                    {
+                                        indexRecord.flags       |= FRAME_INDEX_WRITTEN;
+                                        indexRecord.outputNumber = frameNumber;
+                                        if (useJournal) { journalFrame(&journal,frameNumber,strrchr(filename,'/')+1); }
+                                    }
+                                }
+                            }
+
+                            //Only a frame a sink took is compared against from now on, one a policy dropped is retried with the next frame
+                            if ( (changeThreshold>0.0) && (stackComplete) && (keepFrame) && ( (frameInRing) || (indexRecord.flags & FRAME_INDEX_WRITTEN) ) )
+                                { changeDetectorFrameKept(&changeDetector,dataAsImage.pixels,dataAsImage.image_size/dataAsImage.height,dataAsImage.height); }
                             frameNumber = frameNumber+1;
 
                             if (settings.tickCommand!=0)
                             {
-                                system(settings.tickCommand);
+                                traceBegin("tick",frameNumber);
+                                int tickStatus = system(settings.tickCommand);
+                                traceEnd("tick",frameNumber);
+                                if ( (useFrameRing) && (triggerOnTickExit>=0) && (WIFEXITED(tickStatus)) && (WEXITSTATUS(tickStatus)==triggerOnTickExit) )
+                                {
+                                    triggerFrameRing(&frameRing,"tick command");
+                                }
                             }
+                            frameLossSinkTime(&frameLoss,monotonicMicroseconds()-sinkStart);
 
                         } else
                         {
-                            brokenFrameNumber = brokenFrameNumber + 1;
+                            if (usable) { addFrameLoss(&frameLoss,indexRecord.frameId,1,FRAME_LOSS_OTHER); } //Complete, but no image in it
+                            indexRecord.flags |= FRAME_INDEX_INCOMPLETE;
                         }
 
+                        if (writeFrameIndex) { appendFrameIndex(&frameIndex,&indexRecord); }
+
                         /* Don't destroy the buffer, but put it back into the buffer pool */
+                        traceBegin("push",frameNumber);
                         arv_stream_push_buffer (stream, buffer);
+                        traceEnd("push",frameNumber);
                     } else
                     {
                         usleep(timeToSleepToWaitFor1Frame);
@@ -418,12 +1097,44 @@ int main (int argc, char **argv)
                         }
                     }//We have a framerate set
                 } //While loop
+
+                statistics.framesGrabbed       = frameNumber;
+                statistics.framesDropped       = frameLoss.lost;
+                statistics.elapsedMicroseconds = GetTickCountMicroseconds() - startTime;
+
+                if (autoExposureRunning) { stopAutoExposure(&autoExposure); }
+                if (useFrameCorrection)  { destroyFrameCorrection(&frameCorrection); }
+                if (gigeTransportFile!=0) { fclose(gigeTransportFile); }
+                finishFrameLossTracker(&frameLoss);
+                if (frameLossFile!=0)     { fclose(frameLossFile); }
+                if (controlSocketRunning) { stopControlSocket(&controlSocket); }
+                if (liveConfigRunning)    { stopLiveConfig(&liveConfig); }
+                if (liveConfigLog!=0)     { fclose(liveConfigLog); }
+                if (useFrameRing)         { destroyFrameRing(&frameRing); }
+                if (useJpeg)              { destroyJpegSink(&jpegSink); }
+                if (useFanOut)            { destroyFrameFanOut(&fanOut); }
+                if (useStriping)          { finishStripedRecording(&striping); } //After its sinks
+                closeClockMappingPublisher(&clockPublisher); //After the shared memory sink
+                destroyClockMapping(&clockMapping);
+                if (useJournal)           { closeRecordingJournal(&journal); } //After every sink that journals
+                if (sinkDropsFile!=0)     { fclose(sinkDropsFile); }
+                if (writeFrameIndex)      { closeFrameIndex(&frameIndex); }
+                if (skippedFramesFile!=0) { fclose(skippedFramesFile); }
+                if (changeThreshold>0.0)  { destroyChangeDetector(&changeDetector); }
+                if (useFrameStack)        { destroyFrameStack(&frameStack); }
+                if (autoExposureLog!=0)  { fclose(autoExposureLog); }
+                if (frameStatsFile!=0) { fclose(frameStatsFile); }
+                free(frameStats);
             } // No initialization error
 
             if (error == NULL)
                 /* Stop the acquisition */
                 arv_stream_set_emit_signals (stream, FALSE);
             arv_camera_stop_acquisition (camera, &error);
+            if (useTimeLapse) { stopTimeLapse(&timeLapse,camera); }
+            if (timeLapseFile!=0) { fclose(timeLapseFile); }
+
+            arv_stream_get_statistics (stream,&n_completed_buffers,&n_failures,&n_underruns);
 
             /* Destroy the stream object */
             g_clear_object (&stream);
@@ -433,6 +1144,31 @@ int main (int argc, char **argv)
         g_clear_object (&camera);
     }
 
+    //Every traced thread is gone by now
+    if (traceFile!=0)
+    {
+        writePipelineTrace(traceFile);
+        stopPipelineTrace();
+    }
+
+    if (statisticsFile!=0)
+    {
+        statistics.completedBuffers   = n_completed_buffers;
+        statistics.failures           = n_failures;
+        statistics.underruns          = n_underruns;
+        statistics.width              = dataAsImage.width;
+        statistics.height             = dataAsImage.height;
+        statistics.buffers            = ARV_VIEWER_N_BUFFERS;
+        statistics.requestedFrameRate = (useTimeLapse) ? 1.0 / timeLapseInterval : settings.frameRate;
+        statistics.pixelFormat        = pixelFormat;
+        statistics.startupDiscovery   = startupTimes.discovery;
+        statistics.startupOpen        = startupTimes.open;
+        statistics.startupGenicam     = startupTimes.genicam;
+        statistics.startupStream      = startupTimes.stream;
+        statistics.startupFirstFrame  = startupTimes.firstFrame;
+        writeAcquisitionStatistics(statisticsFile,&statistics);
+    }
+
     if (error != NULL) {
         /* En error happened, display the correspdonding message */
         printf ("Error: %s\n", error->message);
@@ -0,0 +1,485 @@
+/* SPDX-License-Identifier:Unlicense */
+
+/* Standard headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <dirent.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sharedMemoryVideoBuffers.h"
+#include "frame-index.h"
+#include "pnm.h"
+#include "shm-ring.h"
+#include "timing.h"
+
+// Replays a 06-grabber recording into the same shared memory stream 07-streamer
+// publishes to, so shm consumers can be tested and load tested without a camera.
+//
+// Every colorFrame_0_NNNNN.pnm of the directory is memory mapped (and faulted in
+// up front unless --lazy), then published in file number order :
+//  - with the original timing, from the camera timestamps of frameIndex.bin
+//    (host timestamps when the camera has none), scaled by --speed
+//  - at a fixed rate with --fps
+//  - as fast as possible with --fast
+// Frames are released at absolute deadlines so a late frame does not delay the
+// ones after it. The summary reports the sustained rate and how late frames were.
+// With --shmRing N frames also go to /<stream>.frames for zero copy consumers
+// like 08-consumer.
+//
+// A recording striped over several -o directories (recordingRoots.csv, see
+// common/striped-recording.h) is replayed from frameIndex.bin : every written
+// frame is read from the directory its outputRoot names.
+//
+// To compile :
+//  meson compile -C build
+// To Run :
+//  build/07-streamer-replay -i recording [--fps 30 | --fast | --speed 2] [--loops N] [--shmRing N] [--stats replay.json]
+
+volatile sig_atomic_t termination_requested = 0;
+
+void sigterm_handler(int signum) {
+    termination_requested = 1;
+}
+
+#define MAX_RECORDING_ROOTS 8
+
+struct ReplayFrame
+{
+    unsigned int number;
+    unsigned int root;            // Directory in the roots of the recording, 0 unless striped
+    unsigned long long timestamp; // Nanoseconds, 0 when unknown
+    struct MappedPNM pnm;
+};
+
+struct ReplayStatistics
+{
+    unsigned long framesPublished;
+    unsigned long framesSkipped;   // Different size than the stream
+    unsigned long framesLate;      // Published more than a millisecond after their deadline
+    unsigned long totalLatenessMicroseconds;
+    unsigned long maxLatenessMicroseconds;
+    unsigned long long bytesPublished;
+    unsigned long elapsedMicroseconds;
+};
+
+static int compareReplayFrames(const void * a,const void * b)
+{
+    unsigned int x = ((const struct ReplayFrame *) a)->number;
+    unsigned int y = ((const struct ReplayFrame *) b)->number;
+    return (x>y) - (x<y);
+}
+
+// colorFrame_0_NNNNN.pnm file numbers of a recording, sorted. Returns the number of frames
+static unsigned int listRecording(const char * dir,struct ReplayFrame ** frames)
+{
+    *frames = 0;
+    DIR * directory = opendir(dir);
+    if (directory==0)
+    {
+        fprintf(stderr,"Could not open recording %s (%s)\n",dir,strerror(errno));
+        return 0;
+    }
+
+    unsigned int count = 0, capacity = 0;
+    struct dirent * entry;
+    while ( (entry=readdir(directory))!=0 )
+    {
+        unsigned int number = 0;
+        char extension[8] = {0};
+        if (sscanf(entry->d_name,"colorFrame_0_%u.%7s",&number,extension)!=2) { continue; }
+        if (strcmp(extension,"pnm")!=0) { continue; }
+
+        if (count==capacity)
+        {
+            capacity = (capacity==0) ? 1024 : capacity*2;
+            struct ReplayFrame * grown = (struct ReplayFrame *) realloc(*frames,sizeof(struct ReplayFrame)*capacity);
+            if (grown==0) { break; }
+            *frames = grown;
+        }
+        memset(&(*frames)[count],0,sizeof(struct ReplayFrame));
+        (*frames)[count].number = number;
+        count += 1;
+    }
+    closedir(directory);
+
+    if (count!=0) { qsort(*frames,count,sizeof(struct ReplayFrame),compareReplayFrames); }
+    return count;
+}
+
+// -o directories of a recording by outputRoot number, from the recordingRoots.csv in the first one.
+// Root 0 is dir itself, wherever the recording was moved to. Returns 1 for a recording that is not striped
+static unsigned int loadRecordingRoots(const char * dir,char roots[][512])
+{
+    unsigned int count = 1, root = 0;
+    for (root=0; root<MAX_RECORDING_ROOTS; root++) { roots[root][0]=0; }
+    snprintf(roots[0],512,"%s",dir);
+
+    char filename[1024];
+    snprintf(filename,1024,"%s/recordingRoots.csv",dir);
+    FILE * fp = fopen(filename,"r");
+    if (fp==0) { return 1; }
+
+    char line[1024], directory[512];
+    while (fgets(line,1024,fp)!=0)
+    {
+        line[strcspn(line,"\n")] = 0;
+        if (sscanf(line,"%u,%511[^\n]",&root,directory)!=2) { continue; } //The header
+        if ( (root==0) || (root>=MAX_RECORDING_ROOTS) ) { continue; }
+        snprintf(roots[root],512,"%s",directory);
+        if (root+1>count) { count=root+1; }
+    }
+    fclose(fp);
+    return count;
+}
+
+// The written frames of a striped recording and their timestamps, from frameIndex.bin, sorted.
+// Returns the number of frames, timestamps how many of them have one
+static unsigned int listStripedRecording(const char * dir,char roots[][512],unsigned int numberOfRoots,struct ReplayFrame ** frames,unsigned int * timestamps)
+{
+    *frames     = 0;
+    *timestamps = 0;
+    char filename[1024];
+    snprintf(filename,1024,"%s/frameIndex.bin",dir);
+    FILE * fp = fopen(filename,"rb");
+    if (fp==0)
+    {
+        fprintf(stderr,"A striped recording is replayed from its frameIndex.bin, %s is missing\n",filename);
+        return 0;
+    }
+
+    struct FrameIndexHeader header;
+    if ( (!readFrameIndexHeader(fp,&header)) || (header.version<3) )
+    {
+        fprintf(stderr,"%s has no output roots, it cannot locate the frames of a striped recording\n",filename);
+        fclose(fp);
+        return 0;
+    }
+
+    unsigned int count = 0, capacity = 0, unknownRoot = 0;
+    struct FrameIndexRecord record;
+    while (readFrameIndexRecord(fp,&header,&record))
+    {
+        if ( (!(record.flags & FRAME_INDEX_WRITTEN)) || (record.outputNumber==FRAME_INDEX_NOT_WRITTEN) ) { continue; }
+        if ( (record.outputRoot>=numberOfRoots) || (roots[record.outputRoot][0]==0) ) { unknownRoot += 1; continue; }
+
+        if (count==capacity)
+        {
+            capacity = (capacity==0) ? 1024 : capacity*2;
+            struct ReplayFrame * grown = (struct ReplayFrame *) realloc(*frames,sizeof(struct ReplayFrame)*capacity);
+            if (grown==0) { break; }
+            *frames = grown;
+        }
+        memset(&(*frames)[count],0,sizeof(struct ReplayFrame));
+        (*frames)[count].number    = record.outputNumber;
+        (*frames)[count].root      = record.outputRoot;
+        (*frames)[count].timestamp = (record.deviceTimestamp!=0) ? record.deviceTimestamp : record.systemTimestamp;
+        if ((*frames)[count].timestamp!=0) { *timestamps += 1; }
+        count += 1;
+    }
+    fclose(fp);
+
+    if (unknownRoot!=0) { fprintf(stderr,"%u frames are in a root recordingRoots.csv does not list, they will be skipped\n",unknownRoot); }
+    if (count!=0) { qsort(*frames,count,sizeof(struct ReplayFrame),compareReplayFrames); }
+    return count;
+}
+
+// Timestamps of the written frames from frameIndex.bin, returns how many frames got one
+static unsigned int loadTimestamps(const char * dir,struct ReplayFrame * frames,unsigned int count)
+{
+    char filename[1024];
+    snprintf(filename,1024,"%s/frameIndex.bin",dir);
+    FILE * fp = fopen(filename,"rb");
+    if (fp==0) { return 0; }
+
+    struct FrameIndexHeader header;
+    if (!readFrameIndexHeader(fp,&header))
+    {
+        fprintf(stderr,"%s is not a frame index, ignoring it\n",filename);
+        fclose(fp);
+        return 0;
+    }
+
+    //Both lists are in recording order, walk them together
+    unsigned int matched = 0, f = 0;
+    struct FrameIndexRecord record;
+    while ( (f<count) && (readFrameIndexRecord(fp,&header,&record)) )
+    {
+        if ( (!(record.flags & FRAME_INDEX_WRITTEN)) || (record.outputNumber==FRAME_INDEX_NOT_WRITTEN) ) { continue; }
+        while ( (f<count) && (frames[f].number<record.outputNumber) ) { f++; }
+        if ( (f<count) && (frames[f].number==record.outputNumber) )
+        {
+            frames[f].timestamp = (record.deviceTimestamp!=0) ? record.deviceTimestamp : record.systemTimestamp;
+            matched += 1;
+            f++;
+        }
+    }
+    fclose(fp);
+    return matched;
+}
+
+static void sleepUntil(unsigned long deadline)
+{
+    struct timespec ts;
+    ts.tv_sec  = deadline / 1000000;
+    ts.tv_nsec = (deadline % 1000000) * 1000;
+    while ( (clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&ts,0)==EINTR) && (!termination_requested) ) { }
+}
+
+static int writeReplayStatistics(const char * filename,const char * mode,const struct ReplayStatistics * statistics)
+{
+    FILE * fp = fopen(filename,"w");
+    if (fp==0) { return 0; }
+
+    double seconds = statistics->elapsedMicroseconds / 1000000.0;
+    fprintf(fp,"{\n");
+    fprintf(fp,"\"mode\": \"%s\",\n",mode);
+    fprintf(fp,"\"framesPublished\": %lu,\n",statistics->framesPublished);
+    fprintf(fp,"\"framesSkipped\": %lu,\n",statistics->framesSkipped);
+    fprintf(fp,"\"framesLate\": %lu,\n",statistics->framesLate);
+    fprintf(fp,"\"averageLatenessMicroseconds\": %f,\n",(statistics->framesPublished!=0) ? (double) statistics->totalLatenessMicroseconds/statistics->framesPublished : 0.0);
+    fprintf(fp,"\"maxLatenessMicroseconds\": %lu,\n",statistics->maxLatenessMicroseconds);
+    fprintf(fp,"\"elapsedMicroseconds\": %lu,\n",statistics->elapsedMicroseconds);
+    fprintf(fp,"\"fps\": %f,\n",(seconds>0.0) ? statistics->framesPublished/seconds : 0.0);
+    fprintf(fp,"\"megabytesPerSecond\": %f\n",(seconds>0.0) ? statistics->bytesPublished/seconds/1000000.0 : 0.0);
+    fprintf(fp,"}\n");
+    fclose(fp);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    struct sigaction action;
+    action.sa_handler = sigterm_handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = 0;
+    sigaction(SIGINT,  &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    char dir[512] = {0};
+    snprintf(dir,512,".");
+    const char * shm_name    = "video_frames.shm";
+    const char * stream_name = "stream1";
+    const char * statisticsFile = 0;
+    double fixedFrameRate = 0.0;
+    double speed = 1.0;
+    char asFastAsPossible = 0;
+    char populate = 1;
+    unsigned int loops = 1;
+    unsigned int shmRingSlots = 0;
+    unsigned int i=0;
+
+    for (i=0; i<argc; i++)
+    {
+        if ( (strcmp(argv[i],"-i")==0) && (i+1<argc) ) {
+            snprintf(dir,512,"%s",argv[i+1]);
+            fprintf(stderr,"Replaying recording %s \n",dir);
+        } else if ( (strcmp(argv[i],"--fps")==0) && (i+1<argc) ) {
+            fixedFrameRate=atof(argv[i+1]);
+            fprintf(stderr,"Frames will be published at %0.2f fps \n",fixedFrameRate);
+        } else if ( (strcmp(argv[i],"--speed")==0) && (i+1<argc) ) {
+            speed=atof(argv[i+1]);
+            fprintf(stderr,"Original timing will be played at %0.2fx \n",speed);
+        } else if (strcmp(argv[i],"--fast")==0) {
+            asFastAsPossible=1;
+            fprintf(stderr,"Frames will be published as fast as possible \n");
+        } else if ( (strcmp(argv[i],"--loops")==0) && (i+1<argc) ) {
+            loops=atoi(argv[i+1]);
+            fprintf(stderr,"Recording will be played %u times (0 until stopped) \n",loops);
+        } else if (strcmp(argv[i],"--lazy")==0) {
+            populate=0;
+            fprintf(stderr,"Frames will be read from disk as they are published \n");
+        } else if ( (strcmp(argv[i],"--stream")==0) && (i+1<argc) ) {
+            stream_name=argv[i+1];
+            fprintf(stderr,"Shared memory stream will be called %s \n",stream_name);
+        } else if ( (strcmp(argv[i],"--shmRing")==0) && (i+1<argc) ) {
+            shmRingSlots=atoi(argv[i+1]);
+            fprintf(stderr,"Frames will also be published for zero copy consumers in %u slots \n",shmRingSlots);
+        } else if ( (strcmp(argv[i],"--stats")==0) && (i+1<argc) ) {
+            statisticsFile=argv[i+1];
+            fprintf(stderr,"Statistics will be written to %s \n",statisticsFile);
+        }
+    }
+    if (speed<=0.0) { speed=1.0; }
+
+    char roots[MAX_RECORDING_ROOTS][512];
+    unsigned int numberOfRoots = loadRecordingRoots(dir,roots);
+    char striped = (numberOfRoots>1);
+    unsigned int timestamps = 0;
+
+    struct ReplayFrame * frames = 0;
+    unsigned int count = (striped) ? listStripedRecording(dir,roots,numberOfRoots,&frames,&timestamps) : listRecording(dir,&frames);
+    if (striped) { fprintf(stderr,"Recording striped over %u directories, %u frames in its index\n",numberOfRoots,count); }
+    if (count==0)
+    {
+        fprintf(stderr,"No colorFrame_0_*.pnm files in %s\n",dir);
+        free(frames);
+        return EXIT_FAILURE;
+    }
+
+    //Map everything before the first frame goes out, so the disk does not set the pace
+    unsigned long loadStart = monotonicMicroseconds();
+    unsigned long long mappedBytes = 0;
+    unsigned int mapped = 0;
+    for (i=0; i<count; i++)
+    {
+        char filename[1024];
+        snprintf(filename,1024,"%s/colorFrame_0_%05u.pnm",roots[frames[i].root],frames[i].number);
+        if (mapPNM(filename,&frames[i].pnm,populate))
+        {
+            mappedBytes += frames[i].pnm.pixelBytes;
+            mapped += 1;
+        } else
+        {
+            fprintf(stderr,"Could not read %s, it will be skipped\n",filename);
+        }
+    }
+    fprintf(stderr,"Mapped %u of %u frames (%0.1f MB) in %lu ms\n",mapped,count,mappedBytes/1000000.0,(monotonicMicroseconds()-loadStart)/1000);
+
+    //Original timing needs a timestamp for every frame
+    char originalTiming = ( (fixedFrameRate==0.0) && (!asFastAsPossible) );
+    if (originalTiming)
+    {
+        if (!striped) { timestamps = loadTimestamps(dir,frames,count); }
+        if (timestamps<count)
+        {
+            fixedFrameRate = 30.0;
+            originalTiming = 0;
+            fprintf(stderr,"frameIndex.bin has timestamps for %u of %u frames, publishing at %0.2f fps instead\n",timestamps,count,fixedFrameRate);
+        }
+    }
+    const char * mode = (asFastAsPossible) ? "fast" : (originalTiming) ? "original" : "fixed";
+
+    //The stream takes the size of the first readable frame
+    struct MappedPNM * first = 0;
+    for (i=0; i<count; i++)
+    {
+        if (frames[i].pnm.pixels!=0) { first=&frames[i].pnm; break; }
+    }
+    if (first==0)
+    {
+        free(frames);
+        return EXIT_FAILURE;
+    }
+
+    if (createSharedMemoryContextDescriptor(shm_name) == -1)
+    {
+        return EXIT_FAILURE;
+    }
+
+    struct SharedMemoryContext *context = connectToSharedMemoryContextDescriptor(shm_name);
+    if (!context)
+    {
+        return EXIT_FAILURE;
+    }
+
+    createVideoFrameMetaData(context,stream_name,first->width,first->height,first->channels);
+    fprintf(stderr,"Creating video stream %s, %ux%u:%u\n",stream_name,first->width,first->height,first->channels);
+
+    struct VideoFrame *frame = getVideoBufferPointer(context,stream_name);
+    if (!frame)
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (map_frame_shared_memory(frame,1) == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    struct SharedFrameRing frameRing;
+    char useFrameRing = ( (shmRingSlots!=0) && (createSharedFrameRing(&frameRing,stream_name,shmRingSlots,first->pixelBytes)) );
+
+    struct ReplayStatistics statistics = {0};
+    unsigned long frameInterval = (fixedFrameRate>0.0) ? (unsigned long) (1000000.0/fixedFrameRate) : 0;
+    unsigned long startTime = monotonicMicroseconds();
+    unsigned long loopStart = startTime;
+    unsigned int loop = 0;
+
+    while ( (!termination_requested) && ( (loops==0) || (loop<loops) ) )
+    {
+        unsigned long long firstTimestamp = frames[0].timestamp;
+        unsigned long deadline = loopStart;
+
+        for (i=0; (i<count) && (!termination_requested); i++)
+        {
+            struct MappedPNM * pnm = &frames[i].pnm;
+
+            if (!asFastAsPossible)
+            {
+                if (originalTiming)
+                {   //A camera clock that went backwards keeps the previous deadline
+                    if (frames[i].timestamp>=firstTimestamp) { deadline = loopStart + (unsigned long) ((frames[i].timestamp - firstTimestamp) / 1000.0 / speed); }
+                } else
+                {
+                    deadline = loopStart + (unsigned long) i * frameInterval;
+                }
+                sleepUntil(deadline);
+            }
+
+            if ( (pnm->pixels==0) || (pnm->width!=first->width) || (pnm->height!=first->height) || (pnm->channels!=first->channels) )
+            {
+                statistics.framesSkipped += 1;
+                continue;
+            }
+
+            if (startWritingToVideoBufferPointer(frame))
+            {
+                copy_to_shared_memory((void *)frame,pnm->pixels,pnm->pixelBytes);
+                stopWritingToVideoBufferPointer(frame);
+            }
+            if (useFrameRing)
+            {
+                publishSharedFrame(&frameRing,pnm->pixels,pnm->pixelBytes,pnm->width,pnm->height,pnm->channels,(pnm->bitsPerPixel>8) ? 16 : 8,frames[i].number,0);
+            }
+
+            unsigned long now = monotonicMicroseconds();
+            statistics.framesPublished += 1;
+            statistics.bytesPublished  += pnm->pixelBytes;
+            if (!asFastAsPossible)
+            {
+                unsigned long lateness = (now>deadline) ? now-deadline : 0;
+                statistics.totalLatenessMicroseconds += lateness;
+                if (lateness>statistics.maxLatenessMicroseconds) { statistics.maxLatenessMicroseconds=lateness; }
+                if (lateness>1000) { statistics.framesLate += 1; }
+            }
+
+            if ( (statistics.framesPublished % 100)==0 )
+            {
+                double seconds = (now-startTime) / 1000000.0;
+                printf("\r %lu Frames Published (%lu late) - @ %0.2f FPS    \r",statistics.framesPublished,statistics.framesLate,(seconds>0.0) ? statistics.framesPublished/seconds : 0.0);
+                fflush(stdout);
+            }
+        }
+
+        //The next loop starts one interval after the last frame
+        unsigned long lastInterval = frameInterval;
+        if ( (originalTiming) && (count>1) && (frames[count-1].timestamp>frames[count-2].timestamp) ) { lastInterval = (unsigned long) ((frames[count-1].timestamp - frames[count-2].timestamp) / 1000.0 / speed); }
+        loopStart = (asFastAsPossible) ? monotonicMicroseconds() : deadline + lastInterval;
+        loop += 1;
+    }
+    statistics.elapsedMicroseconds = monotonicMicroseconds() - startTime;
+
+    double seconds = statistics.elapsedMicroseconds / 1000000.0;
+    fprintf(stderr,"\n\nReplayed %lu frames (%lu skipped) in %0.2f s, %s timing\n",statistics.framesPublished,statistics.framesSkipped,seconds,mode);
+    fprintf(stderr,"Sustained %0.2f FPS, %0.1f MB/s\n",
+            (seconds>0.0) ? statistics.framesPublished/seconds : 0.0,
+            (seconds>0.0) ? statistics.bytesPublished/seconds/1000000.0 : 0.0);
+    if (!asFastAsPossible)
+    {
+        fprintf(stderr,"%lu frames more than 1 ms late, average %0.1f μs, worst %lu μs\n",statistics.framesLate,
+                (statistics.framesPublished!=0) ? (double) statistics.totalLatenessMicroseconds/statistics.framesPublished : 0.0,
+                statistics.maxLatenessMicroseconds);
+    }
+
+    if (statisticsFile!=0) { writeReplayStatistics(statisticsFile,mode,&statistics); }
+
+    if (useFrameRing) { destroySharedFrameRing(&frameRing); }
+
+    for (i=0; i<count; i++) { unmapPNM(&frames[i].pnm); }
+    free(frames);
+    return EXIT_SUCCESS;
+}
@@ -17,6 +17,24 @@
 #include <unistd.h>
 
 #include "sharedMemoryVideoBuffers.h"
+#include "acquisition-core.h"
+#include "acquisition-stats.h"
+#include "auto-exposure.h"
+#include "clock-mapping.h"
+#include "color-convert.h"
+#include "control-socket.h"
+#include "device-discovery.h"
+#include "frame-correction.h"
+#include "frame-fanout.h"
+#include "frame-loss.h"
+#include "frame-statistics.h"
+#include "gige-transport.h"
+#include "live-config.h"
+#include "pipeline-trace.h"
+#include "shm-ring.h"
+#include "shm-sink.h"
+#include "sink-queue.h"
+#include "timing.h"
 
 // To compile :
 //  meson compile -C build
@@ -24,145 +42,21 @@
 //  build/06-grabber
 
 volatile sig_atomic_t termination_requested = 0;
+volatile sig_atomic_t reload_requested = 0;
+volatile sig_atomic_t trace_requested = 0;
 
 void sigterm_handler(int signum) {
     termination_requested = 1;
 }
 
-struct Image
-{
-    const unsigned char * pixels;
-    unsigned int width;
-    unsigned int height;
-    unsigned int channels;
-    unsigned int bitsperpixel;
-    unsigned int image_size;
-    unsigned int timestamp;
-};
-
-
-struct Settings
-{
-    unsigned int delay,maxFramesToGrab;
-    unsigned int exposure; // 0 means no setting
-    double       gain;
-    double       blackLevel;
-    double       frameRate;
-    char * tickCommand;
-};
-
-#include <sys/time.h>
-#include <unistd.h>
-#include <time.h>
-
-#define EPOCH_YEAR_IN_TM_YEAR 1900
-
-unsigned long tickBase = 0;
-unsigned long GetTickCountMicroseconds()
-{
-    struct timespec ts;
-    if ( clock_gettime(CLOCK_MONOTONIC,&ts) != 0) {
-        return 0;
-    }
-
-    if (tickBase==0)
-    {
-        tickBase = ts.tv_sec*1000000 + ts.tv_nsec/1000;
-        return 0;
-    }
-
-    return ( ts.tv_sec*1000000 + ts.tv_nsec/1000 ) - tickBase;
-}
-
-int writeSettings(const char * filename,struct Settings * settings)
-{
-    FILE * fp = fopen(filename,"w");
-    if (fp!=0)
-    {
-        fprintf(fp,"{\n\"delay\": %u\n",settings->delay);
-        fprintf(fp,"\"maxFramesToGrab\": %u,\n",settings->maxFramesToGrab);
-        fprintf(fp,"\"exposure\": %u,\n",settings->exposure);
-        fprintf(fp,"\"blackLevel\": %f,\n",settings->blackLevel);
-        fprintf(fp,"\"gain\": %f,\n",settings->gain);
-        fprintf(fp,"\"frameRate\": %f,\n",settings->frameRate);
-        fprintf(fp,"\"tickCommand\": \"%s\",\n}\n",settings->tickCommand);
-        fclose(fp);
-        return 1;
-    }
-    return 0;
+void sighup_handler(int signum) {
+    reload_requested = 1;
 }
 
-
-unsigned int simplePowPPM(unsigned int base,unsigned int exp)
-{
-    if (exp==0) return 1;
-    unsigned int retres=base;
-    unsigned int i=0;
-    for (i=0; i<exp-1; i++)
-    {
-        retres*=base;
-    }
-    return retres;
-}
-
-
-int WritePPM(const char * filename,struct Image * pic)
-{
-    //fprintf(stderr,"saveRawImageToFile(%s) called\n",filename);
-    if (pic==0) {
-        return 0;
-    }
-    if ( (pic->width==0) || (pic->height==0) || (pic->channels==0) || (pic->bitsperpixel==0) )
-    {
-        fprintf(stderr,"saveRawImageToFile(%s) called with zero dimensions ( %ux%u %u channels %u bpp\n",filename,pic->width, pic->height,pic->channels,pic->bitsperpixel);
-        return 0;
-    }
-    if(pic->pixels==0) {
-        fprintf(stderr,"saveRawImageToFile(%s) called for an unallocated (empty) frame , will not write any file output\n",filename);
-        return 0;
-    }
-    if (pic->bitsperpixel>16) {
-        fprintf(stderr,"PNM does not support more than 2 bytes per pixel..!\n");
-        return 0;
-    }
-
-    FILE *fd=0;
-    fd = fopen(filename,"wb");
-
-    if (fd!=0)
-    {
-        unsigned int n;
-        if (pic->channels==3) fprintf(fd, "P6\n");
-        else if (pic->channels==1) fprintf(fd, "P5\n");
-        else
-        {
-            fprintf(stderr,"Invalid channels arg (%u) for SaveRawImageToFile\n",pic->channels);
-            fclose(fd);
-            return 1;
-        }
-
-        fprintf(fd, "%d %d\n%u\n", pic->width, pic->height, simplePowPPM(2,pic->bitsperpixel)-1);
-
-        float tmp_n = (float) pic->bitsperpixel/ 8;
-        tmp_n = tmp_n *  pic->width * pic->height * pic->channels ;
-        n = (unsigned int) tmp_n;
-
-        fwrite(pic->pixels, 1, n, fd);
-        fflush(fd);
-        fclose(fd);
-        return 1;
-    }
-    else
-    {
-        fprintf(stderr,"SaveRawImageToFile could not open output file %s\n",filename);
-        return 0;
-    }
-    return 0;
+void sigusr2_handler(int signum) {
+    trace_requested = 1;
 }
 
-
-
-
 /*
  * Connect to the first available camera, then acquire 10 buffers.
  */
@@ -175,6 +69,20 @@ int main (int argc, char **argv)
     action.sa_flags = 0;
     sigaction(SIGTERM, &action, NULL);
 
+    // SIGHUP re-reads the settings file while streaming (--settings)
+    struct sigaction reloadAction;
+    reloadAction.sa_handler = sighup_handler;
+    sigemptyset(&reloadAction.sa_mask);
+    reloadAction.sa_flags = 0;
+    sigaction(SIGHUP, &reloadAction, NULL);
+
+    // SIGUSR2 writes the --trace timeline so far
+    struct sigaction traceAction;
+    traceAction.sa_handler = sigusr2_handler;
+    sigemptyset(&traceAction.sa_mask);
+    traceAction.sa_flags = 0;
+    sigaction(SIGUSR2, &traceAction, NULL);
+
     guint64 n_completed_buffers=0, n_failures=0, n_underruns=0;
 
     char dir[512]= {0};
@@ -188,6 +96,48 @@ int main (int argc, char **argv)
     settings.maxFramesToGrab = 10;
     char forceDims = 0;
     char refreshDimsOnEachFrame = 1;
+    const char * deviceId = 0;
+    const char * pixelFormat = 0;
+    const char * statisticsFile = 0;
+    char computeFrameStats = 0;
+    unsigned int frameStatsBudget = 0;
+    struct FrameStatisticsState frameStatsState;
+    char useAutoExposure = 0;
+    unsigned int autoExposureRamp = 0;
+    struct AutoExposureSettings autoExposureSettings;
+    struct AutoExposureController autoExposure;
+    setDefaultAutoExposureSettings(&autoExposureSettings);
+    struct AcquisitionStatistics statistics = {0};
+    struct StartupTimes startupTimes = {0};
+    const char * darkFile = 0;
+    const char * flatFile = 0;
+    struct FrameCorrection frameCorrection;
+    struct SinkPolicy shmPolicy, pnmPolicy, tickPolicy, yuvPolicy;
+    setDefaultSinkPolicy(&shmPolicy,"shm",SINK_POLICY_BLOCK);
+    setDefaultSinkPolicy(&pnmPolicy,"pnm",SINK_POLICY_BLOCK);
+    setDefaultSinkPolicy(&tickPolicy,"tick",SINK_POLICY_BLOCK);
+    setDefaultSinkPolicy(&yuvPolicy,"yuv",SINK_POLICY_DROP_OLDEST);
+    tickPolicy.queueDepth = 1;
+    char useShmQueue = 0;
+    char recordFrames = 0;
+    struct FrameFanOut fanOut;
+    char useFanOut = 0;
+    struct PNMSinkContext pnmSinkContext = {0};
+    const char * controlSocketPath = 0;
+    const char * settingsFile = 0;
+    const char * traceFile = 0;
+    unsigned int clockWindow = 0;
+    unsigned int traceEvents = 0;
+    enum ColorConvertFormat yuvFormat = COLOR_FORMAT_NONE;
+    unsigned int yuvWorkers = 2;
+    unsigned int shmRingSlots = 0;
+    struct ControlSocket controlSocket;
+    struct LiveConfig liveConfig;
+    struct FrameLossTracker frameLoss;
+    struct GigETransport gigeTransport;
+    setDefaultGigETransport(&gigeTransport);
+    struct DiscoveryOptions discoveryOptions;
+    setDefaultDiscoveryOptions(&discoveryOptions);
 
     for (i=0; i<argc; i++)
     {
@@ -243,10 +193,126 @@ int main (int argc, char **argv)
         } else if (strcmp(argv[i],"--maxFrames")==0) {
             settings.maxFramesToGrab=atoi(argv[i+1]);
             fprintf(stderr,"Setting frame grab to %u \n",settings.maxFramesToGrab);
+        } else if (strcmp(argv[i],"--device")==0) {
+            deviceId=argv[i+1];
+            fprintf(stderr,"Device set to %s \n",deviceId);
+        } else if (strcmp(argv[i],"--pixelformat")==0) {
+            pixelFormat=argv[i+1];
+            fprintf(stderr,"Pixel format will be set to %s \n",pixelFormat);
+        } else if (strcmp(argv[i],"--stats")==0) {
+            statisticsFile=argv[i+1];
+            fprintf(stderr,"Statistics will be written to %s \n",statisticsFile);
+        } else if (strcmp(argv[i],"--discoveryTTL")==0) {
+            discoveryOptions.cacheTTL=atoi(argv[i+1]);
+            fprintf(stderr,"Discovery cache TTL set to %u seconds \n",discoveryOptions.cacheTTL);
+        } else if (strcmp(argv[i],"--retries")==0) {
+            discoveryOptions.retries=atoi(argv[i+1]);
+            fprintf(stderr,"Camera open will be retried %u times \n",discoveryOptions.retries);
+        } else if (strcmp(argv[i],"--framestats")==0) {
+            computeFrameStats=1;
+            fprintf(stderr,"Exposure statistics will be computed on every frame \n");
+        } else if (strcmp(argv[i],"--framestatsBudget")==0) {
+            computeFrameStats=1;
+            frameStatsBudget=atoi(argv[i+1]);
+            fprintf(stderr,"Exposure statistics budget set to %u μsec per frame \n",frameStatsBudget);
+        } else if (strcmp(argv[i],"--autoexposure")==0) {
+            useAutoExposure=1;
+            computeFrameStats=1; //The controller is driven by the frame statistics
+            autoExposureSettings.target=atof(argv[i+1]);
+            fprintf(stderr,"Software auto exposure will aim for a mean brightness of %0.2f \n",autoExposureSettings.target);
+        } else if (strcmp(argv[i],"--aeRamp")==0) {
+            autoExposureRamp=atoi(argv[i+1]);
+            fprintf(stderr,"Auto exposure will see a synthetic lighting ramp with a period of %u frames \n",autoExposureRamp);
+        } else if (strcmp(argv[i],"--gvAuto")==0) {
+            gigeTransport.autoTune=1;
+            fprintf(stderr,"GigE packet size, receive buffer and resends will be tuned automatically \n");
+        } else if (strcmp(argv[i],"--gvPacketSize")==0) {
+            gigeTransport.packetSize=atoi(argv[i+1]);
+            fprintf(stderr,"GigE packet size set to %d bytes \n",gigeTransport.packetSize);
+        } else if (strcmp(argv[i],"--gvPacketDelay")==0) {
+            gigeTransport.packetDelay=atol(argv[i+1]);
+            fprintf(stderr,"GigE packet delay set to %ld ns \n",gigeTransport.packetDelay);
+        } else if (strcmp(argv[i],"--gvSocket")==0) {
+            gigeTransport.packetSocket=(strcmp(argv[i+1],"standard")!=0);
+            fprintf(stderr,"GigE stream will use a %s socket \n",(gigeTransport.packetSocket) ? "packet" : "standard UDP");
+        } else if (strcmp(argv[i],"--gvSocketBuffer")==0) {
+            gigeTransport.socketBufferSize=atol(argv[i+1]);
+            fprintf(stderr,"GigE receive buffer set to %ld bytes (0 follows the payload size) \n",gigeTransport.socketBufferSize);
+        } else if (strcmp(argv[i],"--gvResend")==0) {
+            gigeTransport.resend=(strcmp(argv[i+1],"never")!=0);
+            fprintf(stderr,"GigE missing packets will %s be resent \n",(gigeTransport.resend) ? "always" : "never");
+        } else if (strcmp(argv[i],"--gvPacketTimeout")==0) {
+            gigeTransport.packetTimeout=atoi(argv[i+1]);
+            fprintf(stderr,"GigE packet timeout set to %u μsec \n",gigeTransport.packetTimeout);
+        } else if (strcmp(argv[i],"--gvFrameRetention")==0) {
+            gigeTransport.frameRetention=atoi(argv[i+1]);
+            fprintf(stderr,"GigE frame retention set to %u μsec \n",gigeTransport.frameRetention);
+        } else if (strcmp(argv[i],"--dark")==0) {
+            darkFile=argv[i+1];
+            fprintf(stderr,"Dark frame %s will be subtracted \n",darkFile);
+        } else if (strcmp(argv[i],"--flat")==0) {
+            flatFile=argv[i+1];
+            fprintf(stderr,"Flat field %s will be applied \n",flatFile);
+        } else if (strcmp(argv[i],"--shmPolicy")==0) {
+            useShmQueue=1;
+            if (parseSinkPolicy(&shmPolicy,argv[i+1]))
+                { fprintf(stderr,"Shared memory frames will be queued, %s when the consumers hold the stream \n",argv[i+1]); } else
+                { fprintf(stderr,"Unknown sink policy %s, use block, drop-newest, drop-oldest or decimate:N \n",argv[i+1]); }
+        } else if (strcmp(argv[i],"--shmQueue")==0) {
+            useShmQueue=1;
+            shmPolicy.queueDepth=atoi(argv[i+1]);
+            fprintf(stderr,"Up to %u shared memory frames will be queued \n",shmPolicy.queueDepth);
+        } else if (strcmp(argv[i],"--record")==0) {
+            recordFrames=1;
+            fprintf(stderr,"Frames will also be recorded as PNM files \n");
+        } else if (strcmp(argv[i],"--pnmPolicy")==0) {
+            if (parseSinkPolicy(&pnmPolicy,argv[i+1]))
+                { fprintf(stderr,"Recorded frames will be %s when the disk falls behind \n",argv[i+1]); } else
+                { fprintf(stderr,"Unknown sink policy %s, use block, drop-newest, drop-oldest or decimate:N \n",argv[i+1]); }
+        } else if (strcmp(argv[i],"--pnmQueue")==0) {
+            pnmPolicy.queueDepth=atoi(argv[i+1]);
+            fprintf(stderr,"Up to %u PNM frames will be queued \n",pnmPolicy.queueDepth);
+        } else if (strcmp(argv[i],"--controlSocket")==0) {
+            controlSocketPath=argv[i+1];
+            fprintf(stderr,"Commands will be accepted on %s \n",controlSocketPath);
+        } else if (strcmp(argv[i],"--clockWindow")==0) {
+            clockWindow=atoi(argv[i+1]);
+            fprintf(stderr,"Camera timestamps are mapped to the host clock over the last %u frames \n",clockWindow);
+        } else if (strcmp(argv[i],"--trace")==0) {
+            traceFile=argv[i+1];
+            fprintf(stderr,"A timeline of the pipeline will be written to %s (kill -USR2 for a snapshot) \n",traceFile);
+        } else if (strcmp(argv[i],"--traceEvents")==0) {
+            traceEvents=atoi(argv[i+1]);
+            fprintf(stderr,"The timeline keeps the last %u events of every thread \n",traceEvents);
+        } else if (strcmp(argv[i],"--yuv")==0) {
+            yuvFormat=colorConvertFormat(argv[i+1]);
+            if (yuvFormat!=COLOR_FORMAT_NONE)
+                { fprintf(stderr,"Frames will also be published as %s \n",colorConvertFormatName(yuvFormat)); } else
+                { fprintf(stderr,"Unknown YUV format %s, use nv12 or yuv420 \n",argv[i+1]); }
+        } else if (strcmp(argv[i],"--yuvWorkers")==0) {
+            yuvWorkers=atoi(argv[i+1]);
+            fprintf(stderr,"YUV conversion will use %u worker threads \n",yuvWorkers);
+        } else if (strcmp(argv[i],"--yuvPolicy")==0) {
+            if (parseSinkPolicy(&yuvPolicy,argv[i+1]))
+                { fprintf(stderr,"YUV frames will be %s when the conversion falls behind \n",argv[i+1]); } else
+                { fprintf(stderr,"Unknown sink policy %s, use block, drop-newest, drop-oldest or decimate:N \n",argv[i+1]); }
+        } else if (strcmp(argv[i],"--shmRing")==0) {
+            shmRingSlots=atoi(argv[i+1]);
+            fprintf(stderr,"Frames will also be published for zero copy consumers in %u slots \n",shmRingSlots);
+        } else if (strcmp(argv[i],"--settings")==0) {
+            settingsFile=argv[i+1];
+            fprintf(stderr,"SIGHUP will reload settings from %s \n",settingsFile);
         }
     }
 
 
+    //Started before the stream exists so that its thread is traced from the first buffer
+    if (traceFile!=0)
+    {
+        startPipelineTrace(traceEvents);
+        namePipelineTraceThread("acquisition");
+    }
+
     /* Mandatory glib type system initialization */
     //arv_g_type_init ();
 
@@ -254,9 +320,9 @@ int main (int argc, char **argv)
     ArvCamera *camera = NULL;
     GError *error = NULL;
 
-    /* Connect to the first available camera */
+    /* Connect to the requested camera, or the first available one, through the discovery cache */
     printf ("Trying to connect to camera \n");
-    camera = arv_camera_new (NULL, &error);
+    camera = openCameraFast (deviceId, &discoveryOptions, &startupTimes, &error);
     if ( (camera == NULL) && (error != NULL) )
        {
           fprintf (stderr,"No camera found, terminating streamer\n");
@@ -278,9 +344,34 @@ int main (int argc, char **argv)
 
         arv_camera_set_acquisition_mode (camera, ARV_ACQUISITION_MODE_CONTINUOUS, &error);
 
+        if ( (error == NULL) && (pixelFormat!=0) )
+            arv_camera_set_pixel_format_from_string (camera, pixelFormat, &error);
+
+        if (error == NULL)
+        {   //Region and pixel format decide the payload size, so they have to be set before the buffers are allocated
+            if ( (!refreshDimsOnEachFrame)&& (!forceDims) )
+            {   //Poll dims so that we know them in advance if we dont want to get them from each buffer, and we dont want to force a specific dimension
+                int minvalue=0,maxvalue=0;
+                arv_camera_get_width_bounds(camera,&minvalue,&maxvalue,NULL);
+                dataAsImage.width  = (unsigned int) maxvalue;
+                arv_camera_get_height_bounds(camera,&minvalue,&maxvalue,NULL);
+                dataAsImage.height  = (unsigned int) maxvalue;
+            }
+
+            if ( (!refreshDimsOnEachFrame) || (forceDims) )
+            {   //Attempt to setup region if there is no autorefresh of dimensions, or we want to force a specific dimension
+                arv_camera_set_region(camera,0,0,dataAsImage.width,dataAsImage.height,NULL); //Use full sensor area
+            }
+        }
+
+        unsigned long streamSetupStart = monotonicMicroseconds();
+        //Packet size, delay and socket type have to be set before the stream exists
+        if (error == NULL)
+            applyGigECameraTransport(&gigeTransport,camera,stderr);
+
         if (error == NULL)
             /* Create the stream object without callback */
-            stream = arv_camera_create_stream (camera, NULL, NULL, NULL, &error);
+            stream = arv_camera_create_stream (camera, (traceFile!=0) ? pipelineTraceStreamCallback : NULL, NULL, NULL, &error);
 
         if (ARV_IS_STREAM (stream))
         {
@@ -289,6 +380,8 @@ int main (int argc, char **argv)
 
             /* Retrieve the payload size for buffer creation */
             payload = arv_camera_get_payload (camera, &error);
+            if (error == NULL)
+                applyGigEStreamTransport(&gigeTransport,stream,payload,stderr);
             if (error == NULL) {
                 /* Insert some buffers in the stream buffer pool */
                 for (i = 0; i < ARV_VIEWER_N_BUFFERS; i++)
@@ -298,58 +391,120 @@ int main (int argc, char **argv)
 
             arv_stream_set_emit_signals (stream, TRUE);
             arv_stream_create_buffers(stream, ARV_VIEWER_N_BUFFERS, NULL, NULL, NULL);
+            startupTimes.stream = monotonicMicroseconds() - streamSetupStart;
 
 
             if (error == NULL)
                 /* Start the acquisition */
                 arv_camera_set_acquisition_mode (camera, ARV_ACQUISITION_MODE_CONTINUOUS, NULL);
             arv_camera_start_acquisition (camera, &error);
+            unsigned long acquisitionStart = monotonicMicroseconds();
 
-            if (settings.exposure!=0)
-            {
-                arv_camera_set_exposure_time(camera, settings.exposure, NULL);
-            }
-            if (settings.gain!=0.0)
-            {
-                arv_camera_set_gain (camera, settings.gain, NULL);
-            }
-            if (settings.blackLevel!=0.0)
-            {
-                arv_camera_set_black_level(camera, settings.blackLevel, NULL);
-            }
-            if (settings.frameRate!=0.0)
-            {
-                arv_camera_set_frame_rate (camera, settings.frameRate, NULL);
-            }
+            applyCameraSettings(camera,&settings);
 
 
 
 
             if (error == NULL)
             {
-                if ( (!refreshDimsOnEachFrame)&& (!forceDims) )
-                {   //Poll dims so that we know them in advance if we dont want to get them from each buffer, and we dont want to force a specific dimension
-                    int minvalue=0,maxvalue=0;
-                    arv_camera_get_width_bounds(camera,&minvalue,&maxvalue,NULL);
-                    dataAsImage.width  = (unsigned int) maxvalue;
-                    arv_camera_get_height_bounds(camera,&minvalue,&maxvalue,NULL);
-                    dataAsImage.height  = (unsigned int) maxvalue;
-                }
-
-                if ( (!refreshDimsOnEachFrame) || (forceDims) )
-                {   //Attempt to setup region if there is no autorefresh of dimensions, or we want to force a specific dimension
-                    arv_camera_set_region(camera,0,0,dataAsImage.width,dataAsImage.height,NULL); //Use full sensor area
-                }
-
                 const void *data;
                 char filename[1025]= {0};
                 unsigned int frameNumber = 0;
-                unsigned int brokenFrameNumber = 0;
                 ArvBuffer *buffer;
 
                 snprintf(filename,1024,"%s/info.json",dir);
                 writeSettings(filename,&settings);
 
+                //Dark frame and flat field correction, in place on the Aravis buffer before anything reads it
+                char useFrameCorrection = 0;
+                unsigned int correctionBitsPerPixel = 8, correctionSignificantBits = 8;
+                if ( (darkFile!=0) || (flatFile!=0) )
+                {
+                    const char * currentPixelFormat = arv_camera_get_pixel_format_as_string(camera,NULL);
+                    if (!frameStatisticsLayout(currentPixelFormat,&correctionBitsPerPixel,&correctionSignificantBits))
+                        { correctionBitsPerPixel = 8; correctionSignificantBits = 8; }
+                    useFrameCorrection = loadFrameCorrection(&frameCorrection,darkFile,flatFile,correctionSignificantBits);
+                    if (useFrameCorrection)
+                    {
+                        statistics.frameCorrection = &frameCorrection;
+                        fprintf(stderr,"Correcting %ux%u:%u frames with the %s kernel\n",frameCorrection.width,frameCorrection.height,frameCorrection.channels,frameCorrectionKernel());
+                    }
+                }
+
+                //Per frame exposure statistics go to a CSV next to the frames, their totals to --stats
+                struct FrameStatistics * frameStats = 0;
+                FILE * frameStatsFile = 0;
+                unsigned int frameStatsBitsPerPixel = 8, frameStatsSignificantBits = 8;
+                if (computeFrameStats)
+                {
+                    const char * currentPixelFormat = arv_camera_get_pixel_format_as_string(camera,NULL);
+                    if (!frameStatisticsLayout(currentPixelFormat,&frameStatsBitsPerPixel,&frameStatsSignificantBits))
+                    {
+                        fprintf(stderr,"Exposure statistics do not support pixel format %s, disabling them\n",(currentPixelFormat!=0) ? currentPixelFormat : "?");
+                    } else
+                    {
+                        if (frameStatsBudget==0)
+                        {   //Default to a quarter of the frame period so that the statistics never become the bottleneck
+                            frameStatsBudget = (settings.frameRate!=0.0) ? (unsigned int) (250000 / settings.frameRate) : 2000;
+                        }
+                        initializeFrameStatistics(&frameStatsState,frameStatsBudget);
+                        frameStats = (struct FrameStatistics *) malloc(sizeof(struct FrameStatistics));
+                        snprintf(filename,1024,"%s/frameStatistics.csv",dir);
+                        frameStatsFile = fopen(filename,"w");
+                        writeFrameStatisticsHeader(frameStatsFile);
+                        statistics.frameStatistics = &frameStatsState;
+                        fprintf(stderr,"Exposure statistics using the %s kernel, budget %u μsec\n",frameStatisticsKernel(),frameStatsBudget);
+                    }
+                }
+
+                //Software auto exposure, feature writes happen on the controller thread
+                FILE * autoExposureLog = 0;
+                char autoExposureRunning = 0;
+                if ( (useAutoExposure) && (frameStats!=0) )
+                {
+                    if (settings.frameRate!=0.0)
+                        { autoExposureSettings.maxExposure = 1000000.0 / settings.frameRate; }
+                    snprintf(filename,1024,"%s/autoExposure.log",dir);
+                    autoExposureLog = fopen(filename,"w");
+                    autoExposureRunning = startAutoExposure(&autoExposure,camera,&autoExposureSettings,autoExposureLog);
+                    if (autoExposureRunning) { statistics.autoExposure = &autoExposure; }
+                }
+
+                //Live reconfiguration from the control socket and SIGHUP, consumers keep receiving frames
+                char settingsPath[1025]= {0};
+                if (settingsFile!=0) { snprintf(settingsPath,1024,"%s",settingsFile); } else
+                                     { snprintf(settingsPath,1024,"%s/info.json",dir); }
+                snprintf(filename,1024,"%s/liveConfig.csv",dir);
+                FILE * liveConfigLog = fopen(filename,"w");
+                char liveConfigRunning = startLiveConfig(&liveConfig,camera,settingsPath,liveConfigLog,autoExposureRunning,0);
+                char controlSocketRunning = 0;
+                if (liveConfigRunning)
+                {
+                    statistics.liveConfig = &liveConfig;
+                    if (controlSocketPath!=0)
+                        { controlSocketRunning = startControlSocket(&controlSocket,controlSocketPath,handleLiveConfigCommand,&liveConfig); }
+                }
+
+                //Per second failures and resends of the GigE stream
+                FILE * gigeTransportFile = 0;
+                if (gigeTransport.isGigE)
+                {
+                    snprintf(filename,1024,"%s/gigeTransport.csv",dir);
+                    gigeTransportFile = fopen(filename,"w");
+                    statistics.gigeTransport = &gigeTransport;
+                }
+
+                //Lost frames by cause, one line per loss, see common/frame-loss.h
+                snprintf(filename,1024,"%s/frameLoss.csv",dir);
+                FILE * frameLossFile = fopen(filename,"w");
+                initializeFrameLossTracker(&frameLoss,frameLossFile);
+                statistics.frameLoss = &frameLoss;
+
+                float brightnessFullScale = (float) ((1u << frameStatsSignificantBits) - 1);
+
+                //Read once, asking the camera on every frame costs a control channel round trip
+                float frameRate = arv_camera_get_frame_rate (camera, NULL);
+
                 unsigned long startTime = GetTickCountMicroseconds();
 
                 unsigned long startGrab, endGrab;
@@ -396,6 +551,98 @@ int main (int argc, char **argv)
     {
         return EXIT_FAILURE;
     }
+
+    //Camera timestamps in the host clock, published after every frame in /<stream>.clock
+    struct ClockMapping clockMapping;
+    if (createClockMapping(&clockMapping,clockWindow)) { statistics.clockMapping = &clockMapping; }
+    struct ClockMappingPublisher clockPublisher = {0};
+    struct SharedMemorySink shmSink = {0};
+    shmSink.frame = frame;
+    if (openClockMappingPublisher(&clockPublisher,stream_name)) { shmSink.clock = &clockPublisher; }
+
+    //Frames in /<stream>.frames for consumers that read them in place, see 08-consumer.c
+    struct SharedFrameRing frameRing;
+    if (shmRingSlots!=0)
+    {
+        gint regionX=0, regionY=0, ringWidth=dataAsImage.width, ringHeight=dataAsImage.height;
+        if ( (ringWidth==0) || (ringHeight==0) ) { arv_camera_get_region(camera,&regionX,&regionY,&ringWidth,&ringHeight,NULL); }
+        if (createSharedFrameRing(&frameRing,stream_name,shmRingSlots,(unsigned long) ringWidth*ringHeight*dataAsImage.channels))
+        {
+            shmSink.ring = &frameRing;
+            statistics.shmRing = &frameRing;
+        } else
+        {
+            fprintf(stderr,"Could not create /%s.frames, zero copy consumers will not get frames\n",stream_name);
+        }
+    }
+
+    //Frames converted once to NV12 or YUV420 for the consumers, in their own stream with the plane layout in /<stream>.format
+    struct ColorConverter yuvConverter;
+    struct ColorConvertPublisher yuvFormatPublisher = {0};
+    struct ClockMappingPublisher yuvClockPublisher = {0};
+    struct SharedMemoryYUVSink yuvSink = {0};
+    char yuvStreamName[64] = {0};
+    char useYUV = 0;
+    if (yuvFormat!=COLOR_FORMAT_NONE)
+    {
+        const char * currentPixelFormat = arv_camera_get_pixel_format_as_string(camera,NULL);
+        enum ColorConvertInput yuvInput = colorConvertInput(currentPixelFormat);
+        gint regionX=0, regionY=0, yuvWidth=dataAsImage.width, yuvHeight=dataAsImage.height;
+        if ( (yuvWidth==0) || (yuvHeight==0) ) { arv_camera_get_region(camera,&regionX,&regionY,&yuvWidth,&yuvHeight,NULL); }
+        if (yuvInput==COLOR_INPUT_RGB8)
+        {   //The frames handed to the sinks are one byte per pixel
+            fprintf(stderr,"YUV conversion of %s frames is not available in the streamer, use Mono8 or an 8 bit Bayer format\n",currentPixelFormat);
+        } else
+        if (createColorConverter(&yuvConverter,yuvInput,yuvFormat,(unsigned int) yuvWidth,(unsigned int) yuvHeight,yuvWorkers))
+        {
+            snprintf(yuvStreamName,64,"%s.%s",stream_name,colorConvertFormatName(yuvFormat));
+            createVideoFrameMetaData(context,yuvStreamName,yuvConverter.layout.stride[0],yuvConverter.layout.rows,1);
+            yuvSink.converter = &yuvConverter;
+            yuvSink.frame     = getVideoBufferPointer(context,yuvStreamName);
+            if ( (yuvSink.frame!=0) && (map_frame_shared_memory(yuvSink.frame,1)!=NULL) && (openColorConvertPublisher(&yuvFormatPublisher,yuvStreamName,&yuvConverter.layout)) )
+            {
+                if (openClockMappingPublisher(&yuvClockPublisher,yuvStreamName)) { yuvSink.clock = &yuvClockPublisher; }
+                useYUV = 1;
+                statistics.colorConverter = &yuvConverter;
+                fprintf(stderr,"Publishing %s frames as %s in video stream %s, %u bytes per row, with the %s kernel and %u workers\n",
+                        colorConvertInputName(yuvInput),colorConvertFormatName(yuvFormat),yuvStreamName,yuvConverter.layout.stride[0],colorConvertKernel(),yuvConverter.threadsStarted);
+            } else
+            {
+                fprintf(stderr,"Could not create video stream %s\n",yuvStreamName);
+                destroyColorConverter(&yuvConverter);
+            }
+        }
+    }
+
+    //Publishing, recording and the tick command from their own threads, all fed from one copy of the frame
+    FILE * sinkDropsFile = 0;
+    if ( (useShmQueue) || (recordFrames) || (settings.tickCommand!=0) || (useYUV) )
+    {
+        snprintf(filename,1024,"%s/sinkDrops.csv",dir);
+        sinkDropsFile = fopen(filename,"w");
+        if (sinkDropsFile!=0) { fprintf(sinkDropsFile,"sink,frame,reason\n"); }
+        shmPolicy.dropLog  = sinkDropsFile;
+        pnmPolicy.dropLog  = sinkDropsFile;
+        tickPolicy.dropLog = sinkDropsFile;
+        yuvPolicy.dropLog  = sinkDropsFile;
+
+        createFrameFanOut(&fanOut);
+        if (addFrameFanOutSink(&fanOut,&shmPolicy,0,writeSharedMemorySinkFrame,&shmSink,1)>=0)
+            { statistics.sinkPolicies[statistics.numberOfSinkPolicies++] = &shmPolicy; }
+        if (recordFrames)
+        {
+            pnmSinkContext.directory = dir;
+            if (addFrameFanOutSink(&fanOut,&pnmPolicy,0,writePNMSinkFrame,&pnmSinkContext,1)>=0)
+                { statistics.sinkPolicies[statistics.numberOfSinkPolicies++] = &pnmPolicy; }
+        }
+        if ( (settings.tickCommand!=0) && (addFrameFanOutSink(&fanOut,&tickPolicy,0,runTickSinkFrame,settings.tickCommand,0)>=0) )
+            { statistics.sinkPolicies[statistics.numberOfSinkPolicies++] = &tickPolicy; }
+        if ( (useYUV) && (addFrameFanOutSink(&fanOut,&yuvPolicy,0,writeSharedMemoryYUVSinkFrame,&yuvSink,1)>=0) )
+            { statistics.sinkPolicies[statistics.numberOfSinkPolicies++] = &yuvPolicy; }
+        useFanOut = startFrameFanOut(&fanOut);
+        if (useFanOut) { statistics.fanOut = &fanOut; } else
+                       { destroyFrameFanOut(&fanOut); }
+    }
    //----------------------------------------------------------------------------------------
    //----------------------------------------------------------------------------------------
    //----------------------------------------------------------------------------------------
@@ -405,26 +652,84 @@ int main (int argc, char **argv)
                 while  (!termination_requested)// && frameNumber<settings.maxFramesToGrab)
                 {
                     startGrab = GetTickCountMicroseconds();
+                    if (reload_requested)
+                    {
+                        reload_requested = 0;
+                        requestLiveConfigReload(&liveConfig);
+                    }
+                    if (trace_requested)
+                    {
+                        trace_requested = 0;
+                        writePipelineTrace(traceFile);
+                    }
+                    traceBegin("pop",frameNumber);
                     buffer = arv_stream_pop_buffer (stream);
+                    traceEnd("pop",frameNumber);
+                    reportGigETransport(&gigeTransport,stream,gigeTransportFile);
                     if (ARV_IS_BUFFER(buffer))
                     {
+                        char usable = checkFrameLoss(&frameLoss,stream,buffer);
+                        struct FrameTimestamps timestamps;
+                        timestamps.device = arv_buffer_get_timestamp(buffer);
+                        timestamps.system = systemTimestampToMonotonic(arv_buffer_get_system_timestamp(buffer));
+                        timestamps.host   = (usable) ? mapClockMapping(&clockMapping,timestamps.device,timestamps.system) : timestamps.system;
                         if (refreshDimsOnEachFrame)
                         {
                             dataAsImage.width        = arv_buffer_get_image_width (buffer);
                             dataAsImage.height       = arv_buffer_get_image_height (buffer);
                         }
 
-                        if ((dataAsImage.width!=0) && (dataAsImage.height!=0))
+                        if ((usable) && (dataAsImage.width!=0) && (dataAsImage.height!=0))
                         {
+                            if (frameNumber==0)
+                            {
+                                startupTimes.firstFrame = monotonicMicroseconds() - acquisitionStart;
+                                printStartupTimes(stderr,&startupTimes);
+                            }
+
                             size_t size;
                             data = arv_buffer_get_image_data(buffer,&size);
                             //printf ("Size =  %lu\n",size);
                             dataAsImage.pixels       = data;
 
+                            //The shared memory metadata has no flags, the first reconfigured frame is in liveConfig.csv
+                            if ( (liveConfigRunning) && (liveConfigFrame(&liveConfig,frameNumber,timestamps.system,frameLoss.lost,&settings.frameRate)!=0) )
+                            {
+                                if (settings.frameRate!=0.0) { frameRate = settings.frameRate; }
+                            }
+
+                            if ( (useFrameCorrection) && (size >= frameCorrection.samples*(correctionBitsPerPixel/8)) )
+                            {
+                                traceBegin("correct",frameNumber);
+                                applyFrameCorrection(&frameCorrection,(void *) data,dataAsImage.width,dataAsImage.height,frameCorrection.channels,correctionBitsPerPixel);
+                                traceEnd("correct",frameNumber);
+                            }
+
                             dataAsImage.channels     = 1;
                             dataAsImage.bitsperpixel = 8;
                             dataAsImage.image_size   = dataAsImage.width  * dataAsImage.height * dataAsImage.channels;
-                            dataAsImage.timestamp    = i;
+                            dataAsImage.timestamp    = frameNumber;
+
+                            if ( (frameStats!=0) && (size >= (size_t) dataAsImage.width * dataAsImage.height * (frameStatsBitsPerPixel/8)) )
+                            {
+                                traceBegin("statistics",frameNumber);
+                                char haveFrameStats = computeFrameStatistics(&frameStatsState,data,dataAsImage.width,dataAsImage.height,frameStatsBitsPerPixel,frameStatsSignificantBits,frameStats);
+                                traceEnd("statistics",frameNumber);
+                                if (haveFrameStats)
+                                {
+                                    writeFrameStatisticsRow(frameStatsFile,frameNumber,frameStats);
+                                    if (autoExposureRunning)
+                                    {
+                                        float brightness = frameStats->mean / brightnessFullScale;
+                                        if (autoExposureRamp!=0)
+                                        {   //Simulated lighting going from 100% down to 20% and back, to exercise the loop with the fake camera
+                                            float phase = (float) (frameNumber % (2*autoExposureRamp)) / autoExposureRamp;
+                                            brightness *= 0.2f + 0.8f * fabsf(phase - 1.0f);
+                                        }
+                                        submitAutoExposureMeasurement(&autoExposure,frameNumber,brightness);
+                                    }
+                                }
+                            }
 
                             /* Display some informations about the retrieved buffer */
                             //printf ("Acquired %d×%d buffer\n",dataAsImage.width,dataAsImage.height);
@@ -432,36 +737,55 @@ int main (int argc, char **argv)
 
 
                             arv_stream_get_statistics (stream,&n_completed_buffers,&n_failures,&n_underruns);
-                            float frameRate = arv_camera_get_frame_rate (camera, NULL);
-                            printf("\r %u Frames Grabbed (%u dropped) - @ %0.2f FPS (set %0.2f) ",frameNumber,brokenFrameNumber,(float) frameNumber / ((endTime-startTime)/1000000), frameRate );
+                            printf("\r %u Frames Grabbed (%lu lost) - @ %0.2f FPS (set %0.2f) ",frameNumber,frameLoss.lost,(float) frameNumber / ((endTime-startTime)/1000000), frameRate );
                             printf("Ok %lu/Fail %lu/Under %lu    \r",n_completed_buffers,n_failures,n_underruns);
 
                             //snprintf(filename,1024,"%s/colorFrame_0_%05u.pnm",dir,frameNumber);
                             //WritePPM(filename,&dataAsImage);
 
 
+    unsigned long sinkStart = monotonicMicroseconds();
+    if (useFanOut)
+    {
+        traceBegin("submit",frameNumber);
+        submitFrameFanOut(&fanOut,dataAsImage.pixels,dataAsImage.image_size,dataAsImage.width,dataAsImage.height,dataAsImage.channels,dataAsImage.bitsperpixel,frameNumber,&timestamps);
+        traceEnd("submit",frameNumber);
+    } else
     if (startWritingToVideoBufferPointer(frame))
     {
+        traceBegin("shm publish",frameNumber);
         copy_to_shared_memory((void *)frame, dataAsImage.pixels ,dataAsImage.image_size);
         stopWritingToVideoBufferPointer(frame);
+        publishClockMapping(&clockPublisher,frameNumber,&timestamps);
+        if (shmSink.ring!=0)
+        {
+            publishSharedFrame(shmSink.ring,dataAsImage.pixels,dataAsImage.image_size,dataAsImage.width,dataAsImage.height,dataAsImage.channels,dataAsImage.bitsperpixel,
+                               frameNumber,&timestamps);
+        }
+        traceEnd("shm publish",frameNumber);
     }
 
 
 
                             frameNumber = frameNumber+1;
 
-                            if (settings.tickCommand!=0)
+                            if ( (settings.tickCommand!=0) && (!useFanOut) )
                             {
+                                traceBegin("tick",frameNumber);
                                 system(settings.tickCommand);
+                                traceEnd("tick",frameNumber);
                             }
+                            frameLossSinkTime(&frameLoss,monotonicMicroseconds()-sinkStart);
 
                         } else
                         {
-                            brokenFrameNumber = brokenFrameNumber + 1;
+                            if (usable) { addFrameLoss(&frameLoss,arv_buffer_get_frame_id(buffer),1,FRAME_LOSS_OTHER); } //Complete, but no image in it
                         }
 
                         /* Don't destroy the buffer, but put it back into the buffer pool */
+                        traceBegin("push",frameNumber);
                         arv_stream_push_buffer (stream, buffer);
+                        traceEnd("push",frameNumber);
                     } else
                     {
                         usleep(timeToSleepToWaitFor1Frame);
@@ -480,6 +804,33 @@ int main (int argc, char **argv)
                         }
                     }//We have a framerate set
                 } //While loop
+
+                statistics.framesGrabbed       = frameNumber;
+                statistics.framesDropped       = frameLoss.lost;
+                statistics.elapsedMicroseconds = GetTickCountMicroseconds() - startTime;
+
+                if (autoExposureRunning) { stopAutoExposure(&autoExposure); }
+                if (useFrameCorrection)  { destroyFrameCorrection(&frameCorrection); }
+                if (gigeTransportFile!=0) { fclose(gigeTransportFile); }
+                finishFrameLossTracker(&frameLoss);
+                if (frameLossFile!=0)     { fclose(frameLossFile); }
+                if (controlSocketRunning) { stopControlSocket(&controlSocket); }
+                if (liveConfigRunning)    { stopLiveConfig(&liveConfig); }
+                if (liveConfigLog!=0)     { fclose(liveConfigLog); }
+                if (useFanOut)            { destroyFrameFanOut(&fanOut); }
+                if (useYUV)
+                {   //Only after the fan-out, its sink thread converts
+                    destroyColorConverter(&yuvConverter);
+                    closeColorConvertPublisher(&yuvFormatPublisher);
+                    closeClockMappingPublisher(&yuvClockPublisher);
+                }
+                closeClockMappingPublisher(&clockPublisher); //After the shared memory sink
+                if (shmSink.ring!=0)      { destroySharedFrameRing(&frameRing); }
+                destroyClockMapping(&clockMapping);
+                if (sinkDropsFile!=0)     { fclose(sinkDropsFile); }
+                if (autoExposureLog!=0)  { fclose(autoExposureLog); }
+                if (frameStatsFile!=0) { fclose(frameStatsFile); }
+                free(frameStats);
             } // No initialization error
 
             if (error == NULL)
@@ -487,6 +838,8 @@ int main (int argc, char **argv)
                 arv_stream_set_emit_signals (stream, FALSE);
             arv_camera_stop_acquisition (camera, &error);
 
+            arv_stream_get_statistics (stream,&n_completed_buffers,&n_failures,&n_underruns);
+
             /* Destroy the stream object */
             g_clear_object (&stream);
         }
@@ -495,6 +848,31 @@ int main (int argc, char **argv)
         g_clear_object (&camera);
     }
 
+    //Every traced thread is gone by now
+    if (traceFile!=0)
+    {
+        writePipelineTrace(traceFile);
+        stopPipelineTrace();
+    }
+
+    if (statisticsFile!=0)
+    {
+        statistics.completedBuffers   = n_completed_buffers;
+        statistics.failures           = n_failures;
+        statistics.underruns          = n_underruns;
+        statistics.width              = dataAsImage.width;
+        statistics.height             = dataAsImage.height;
+        statistics.buffers            = ARV_VIEWER_N_BUFFERS;
+        statistics.requestedFrameRate = settings.frameRate;
+        statistics.pixelFormat        = pixelFormat;
+        statistics.startupDiscovery   = startupTimes.discovery;
+        statistics.startupOpen        = startupTimes.open;
+        statistics.startupGenicam     = startupTimes.genicam;
+        statistics.startupStream      = startupTimes.stream;
+        statistics.startupFirstFrame  = startupTimes.firstFrame;
+        writeAcquisitionStatistics(statisticsFile,&statistics);
+    }
+
     if (error != NULL) {
         /* En error happened, display the correspdonding message */
         printf ("Error: %s\n", error->message);
@@ -0,0 +1,195 @@
+/* SPDX-License-Identifier:Unlicense */
+
+/* Standard headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "shm-ring.h"
+#include "timing.h"
+
+// Reads the frames 07-streamer --shmRing (or 07-streamer-replay --shmRing)
+// publishes, in place in shared memory, with the consumer API of
+// common/shm-ring.h. Every frame is acquired, its mean brightness is computed
+// straight from the shared pixels, and it is released. Frames the consumer was
+// too slow for are counted as missed.
+//
+//  - frames in order with acquireNextFrame(), or only the newest with --latest
+//  - --hold N keeps every frame N μs, like a consumer doing real work
+//  - --wait waits for the publisher to appear, and to come back after it stops
+//
+// To compile :
+//  meson compile -C build
+// To Run :
+//  build/07-streamer --shmRing 4 &
+//  build/08-consumer [--stream stream1] [--latest] [--frames N] [--timeout ms] [--hold μs] [--wait] [--stats consumer.json]
+
+volatile sig_atomic_t termination_requested = 0;
+
+void sigterm_handler(int signum) {
+    termination_requested = 1;
+}
+
+struct ConsumerStatistics
+{
+    unsigned long frames;
+    unsigned long missed;
+    unsigned long timeouts;
+    unsigned long reattached;
+    unsigned long totalLatencyMicroseconds;  // From the publisher completing the frame to the consumer having read it
+    unsigned long maxLatencyMicroseconds;
+    unsigned long elapsedMicroseconds;
+};
+
+// Mean of every 16th sample, 8 or 16 bit
+static double meanBrightness(const struct SharedFrameView * view)
+{
+    unsigned long samples = (view->bitsPerPixel==16) ? view->size/2 : view->size;
+    unsigned long long sum = 0;
+    unsigned long count = 0, i = 0;
+    for (i=0; i<samples; i+=16)
+    {
+        sum += (view->bitsPerPixel==16) ? ((const unsigned short *) view->pixels)[i] : view->pixels[i];
+        count += 1;
+    }
+    return (count!=0) ? (double) sum/count : 0.0;
+}
+
+static int writeConsumerStatistics(const char * filename,const char * mode,const struct ConsumerStatistics * statistics,const struct SharedFrameConsumer * consumer)
+{
+    FILE * fp = fopen(filename,"w");
+    if (fp==0) { return 0; }
+
+    double seconds = statistics->elapsedMicroseconds / 1000000.0;
+    fprintf(fp,"{\n");
+    fprintf(fp,"\"mode\": \"%s\",\n",mode);
+    fprintf(fp,"\"frames\": %lu,\n",statistics->frames);
+    fprintf(fp,"\"missed\": %lu,\n",statistics->missed);
+    fprintf(fp,"\"timeouts\": %lu,\n",statistics->timeouts);
+    fprintf(fp,"\"retries\": %lu,\n",consumer->retries);
+    fprintf(fp,"\"reattached\": %lu,\n",statistics->reattached);
+    fprintf(fp,"\"averageLatencyMicroseconds\": %f,\n",(statistics->frames!=0) ? (double) statistics->totalLatencyMicroseconds/statistics->frames : 0.0);
+    fprintf(fp,"\"maxLatencyMicroseconds\": %lu,\n",statistics->maxLatencyMicroseconds);
+    fprintf(fp,"\"elapsedMicroseconds\": %lu,\n",statistics->elapsedMicroseconds);
+    fprintf(fp,"\"fps\": %f\n",(seconds>0.0) ? statistics->frames/seconds : 0.0);
+    fprintf(fp,"}\n");
+    fclose(fp);
+    return 1;
+}
+
+// Retries every 100 ms while waiting is allowed
+static int attachConsumer(struct SharedFrameConsumer * consumer,const char * streamName,char wait)
+{
+    while (!termination_requested)
+    {
+        if (attachSharedFrameConsumer(consumer,streamName)) { return 1; }
+        if (!wait) { break; }
+        usleep(100000);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct sigaction action;
+    action.sa_handler = sigterm_handler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = 0;
+    sigaction(SIGINT,  &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    const char * stream_name = "stream1";
+    const char * statisticsFile = 0;
+    char latest = 0;
+    char wait = 0;
+    unsigned long maxFrames = 0;
+    int timeoutMilliseconds = 1000;
+    unsigned int holdMicroseconds = 0;
+    unsigned int i=0;
+
+    for (i=0; i<argc; i++)
+    {
+        if ( (strcmp(argv[i],"--stream")==0) && (i+1<argc) ) {
+            stream_name=argv[i+1];
+            fprintf(stderr,"Reading shared memory stream %s \n",stream_name);
+        } else if (strcmp(argv[i],"--latest")==0) {
+            latest=1;
+            fprintf(stderr,"Only the newest frame will be read \n");
+        } else if ( (strcmp(argv[i],"--frames")==0) && (i+1<argc) ) {
+            maxFrames=atol(argv[i+1]);
+            fprintf(stderr,"Stopping after %lu frames \n",maxFrames);
+        } else if ( (strcmp(argv[i],"--timeout")==0) && (i+1<argc) ) {
+            timeoutMilliseconds=atoi(argv[i+1]);
+            fprintf(stderr,"Waiting up to %d ms for a frame \n",timeoutMilliseconds);
+        } else if ( (strcmp(argv[i],"--hold")==0) && (i+1<argc) ) {
+            holdMicroseconds=atoi(argv[i+1]);
+            fprintf(stderr,"Every frame will be held %u μsec \n",holdMicroseconds);
+        } else if (strcmp(argv[i],"--wait")==0) {
+            wait=1;
+            fprintf(stderr,"Waiting for the publisher \n");
+        } else if ( (strcmp(argv[i],"--stats")==0) && (i+1<argc) ) {
+            statisticsFile=argv[i+1];
+            fprintf(stderr,"Statistics will be written to %s \n",statisticsFile);
+        }
+    }
+
+    struct SharedFrameConsumer consumer;
+    if (!attachConsumer(&consumer,stream_name,wait))
+    {
+        fprintf(stderr,"Nobody publishes /%s.frames, start 07-streamer with --shmRing\n",stream_name);
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr,"Attached to /%s.frames, %u slots of %lu bytes\n",stream_name,consumer.header->numberOfSlots,(unsigned long) consumer.header->slotSize);
+
+    struct ConsumerStatistics statistics = {0};
+    struct SharedFrameView view;
+    unsigned long startTime = monotonicMicroseconds();
+
+    while ( (!termination_requested) && ( (maxFrames==0) || (statistics.frames<maxFrames) ) )
+    {
+        int result = (latest) ? acquireLatestFrame(&consumer,&view,timeoutMilliseconds) : acquireNextFrame(&consumer,&view,timeoutMilliseconds);
+        if (result==0)
+        {
+            statistics.timeouts += 1;
+            fprintf(stderr,"\nNo frame for %d ms\n",timeoutMilliseconds);
+            continue;
+        }
+        if (result<0)
+        {   //The publisher stopped, a new one creates a new ring
+            detachSharedFrameConsumer(&consumer);
+            fprintf(stderr,"\nThe publisher of /%s.frames has gone\n",stream_name);
+            if ( (!wait) || (!attachConsumer(&consumer,stream_name,wait)) ) { break; }
+            statistics.reattached += 1;
+            continue;
+        }
+
+        double brightness = meanBrightness(&view);
+        unsigned long latency = (monotonicNanoseconds() - view.publishTime) / 1000;
+        if (holdMicroseconds!=0) { usleep(holdMicroseconds); }
+        unsigned int frameNumber = view.frameNumber;
+        unsigned int width = view.width, height = view.height;
+        releaseFrame(&consumer,&view);
+
+        statistics.frames += 1;
+        statistics.missed += view.missed;
+        statistics.totalLatencyMicroseconds += latency;
+        if (latency>statistics.maxLatencyMicroseconds) { statistics.maxLatencyMicroseconds=latency; }
+
+        double seconds = (monotonicMicroseconds()-startTime) / 1000000.0;
+        printf("\r Frame %u %ux%u mean %6.2f - %lu read (%lu missed) @ %0.2f FPS, %lu μs after publishing    \r",
+               frameNumber,width,height,brightness,statistics.frames,statistics.missed,(seconds>0.0) ? statistics.frames/seconds : 0.0,latency);
+        fflush(stdout);
+    }
+    statistics.elapsedMicroseconds = monotonicMicroseconds() - startTime;
+
+    fprintf(stderr,"\n\nRead %lu frames, missed %lu, %lu timeouts, average %0.1f μs from publishing to reading, worst %lu μs\n",
+            statistics.frames,statistics.missed,statistics.timeouts,
+            (statistics.frames!=0) ? (double) statistics.totalLatencyMicroseconds/statistics.frames : 0.0,
+            statistics.maxLatencyMicroseconds);
+
+    if (statisticsFile!=0) { writeConsumerStatistics(statisticsFile,(latest) ? "latest" : "next",&statistics,&consumer); }
+    detachSharedFrameConsumer(&consumer);
+    return EXIT_SUCCESS;
+}
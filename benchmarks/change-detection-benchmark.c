@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier:Unlicense */
+
+/* Standard headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "change-detection.h"
+#include "timing.h"
+
+// Throughput of the change detection kernels on one core, without a camera.
+//
+// Every kernel this CPU can run compares two synthetic frames that differ in a
+// small moving patch, the way a mostly static scene does. The run fails when
+// the kernel the grabber would pick is slower than --min (GB/s, default 1.0)
+// or cannot keep up with --fps frames per second at the given size.
+//
+// Usage : change-detection-benchmark [--size width height] [--iterations N] [--min GB/s] [--fps N]
+
+static double runKernel(const char * kernel,unsigned char * frameA,unsigned char * frameB,unsigned int width,unsigned int height,unsigned int iterations)
+{
+    struct ChangeDetector detector;
+    selectChangeDetectionKernel(kernel);
+    initializeChangeDetector(&detector,4.0,0.001,0);
+
+    changeDetectorFrameKept(&detector,frameA,width,height);
+
+    unsigned long kept = 0;
+    unsigned long startTime = monotonicMicroseconds();
+    unsigned int i=0;
+    for (i=0; i<iterations; i++)
+    {
+        //Mostly the static frame, every 10th frame the changed patch appears or disappears
+        unsigned char * frame = ((i/10)&1) ? frameB : frameA;
+        if (changeDetectorKeepFrame(&detector,frame,width,height))
+        {
+            changeDetectorFrameKept(&detector,frame,width,height);
+            kept += 1;
+        }
+    }
+    unsigned long elapsed = monotonicMicroseconds() - startTime;
+
+    double bytes = (double) width * height * iterations;
+    double gigabytesPerSecond = (elapsed!=0) ? bytes / elapsed / 1000.0 : 0.0;
+    double framesPerSecond    = (elapsed!=0) ? iterations * 1000000.0 / elapsed : 0.0;
+
+    fprintf(stdout,"%-7s : %8.2f GB/s, %8.1f μs per %ux%u frame, %9.1f fps (%lu of %u kept)\n",
+            kernel,gigabytesPerSecond,(double) elapsed/iterations,width,height,framesPerSecond,kept,iterations);
+
+    destroyChangeDetector(&detector);
+    return gigabytesPerSecond;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int width=1920,height=1080;
+    unsigned int iterations=500;
+    double minimumThroughput=1.0;
+    double requiredFrameRate=0.0;
+    unsigned int i=0;
+
+    for (i=0; i<argc; i++)
+    {
+        if ( (strcmp(argv[i],"--size")==0) && (i+2<argc) ) {
+            width=atoi(argv[i+1]);
+            height=atoi(argv[i+2]);
+        } else if ( (strcmp(argv[i],"--iterations")==0) && (i+1<argc) ) {
+            iterations=atoi(argv[i+1]);
+        } else if ( (strcmp(argv[i],"--min")==0) && (i+1<argc) ) {
+            minimumThroughput=atof(argv[i+1]);
+        } else if ( (strcmp(argv[i],"--fps")==0) && (i+1<argc) ) {
+            requiredFrameRate=atof(argv[i+1]);
+        }
+    }
+
+    unsigned char * frameA = (unsigned char *) malloc((size_t) width*height);
+    unsigned char * frameB = (unsigned char *) malloc((size_t) width*height);
+    if ( (frameA==0) || (frameB==0) || (width==0) || (height==0) || (iterations==0) )
+    {
+        fprintf(stderr,"Could not allocate a %ux%u frame\n",width,height);
+        free(frameA);
+        free(frameB);
+        return EXIT_FAILURE;
+    }
+
+    //A static gradient with a little noise, and the same frame with a bright 64x64 patch
+    unsigned int seed = 12345;
+    unsigned int x,y;
+    for (y=0; y<height; y++)
+    {
+        for (x=0; x<width; x++)
+        {
+            seed = seed * 1103515245 + 12345;
+            frameA[y*width+x] = (unsigned char) (((x+y)/8 + ((seed>>16)&0x3)) & 0xFF);
+        }
+    }
+    memcpy(frameB,frameA,(size_t) width*height);
+    for (y=height/2; (y<height/2+64) && (y<height); y++)
+    {
+        for (x=width/2; (x<width/2+64) && (x<width); x++)
+            { frameB[y*width+x] = 255; }
+    }
+
+    char defaultKernel[32];
+    snprintf(defaultKernel,32,"%s",changeDetectionKernel());
+
+    const char * kernelNames[] = { "avx2", "sse2", "scalar" };
+    double defaultThroughput=0.0;
+    for (i=0; i<sizeof(kernelNames)/sizeof(kernelNames[0]); i++)
+    {
+        if (!selectChangeDetectionKernel(kernelNames[i])) { continue; }
+        double throughput = runKernel(kernelNames[i],frameA,frameB,width,height,iterations);
+        if (strcmp(kernelNames[i],defaultKernel)==0) { defaultThroughput=throughput; }
+    }
+
+    free(frameA);
+    free(frameB);
+
+    double defaultFrameRate = defaultThroughput * 1000000000.0 / ((double) width*height);
+    fprintf(stdout,"Default kernel %s : %0.2f GB/s, %0.1f fps at %ux%u, required %0.2f GB/s\n",
+            defaultKernel,defaultThroughput,defaultFrameRate,width,height,minimumThroughput);
+
+    if ( (defaultThroughput<minimumThroughput) || (defaultFrameRate<requiredFrameRate) )
+    {
+        fprintf(stderr,"Change detection kernel is below the required throughput\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,174 @@
+/* SPDX-License-Identifier:Unlicense */
+
+/* Standard headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "color-convert.h"
+#include "timing.h"
+
+// Throughput of the --yuv conversion kernels, without a camera.
+//
+// Every kernel this CPU can run converts a synthetic Bayer mosaic and a mono
+// frame to NV12 and YUV420 on one core, and has to give the same planes as
+// the portable kernel. The kernel the streamer would pick then converts the
+// Bayer frame to NV12 again with --workers threads besides the calling one,
+// which has to give the same planes as well. The run fails on a mismatch, or
+// when the picked kernel on one core is slower than --min (GB/s of raw
+// pixels, default 1.0).
+//
+// Usage : color-convert-benchmark [--size width height] [--iterations N] [--workers N] [--min GB/s]
+
+// Compares the rows of every plane, not the padding after them
+static int samePlanes(const struct ColorConvertLayout * layout,const unsigned char * a,const unsigned char * b)
+{
+    unsigned int plane, row;
+    for (plane=0; plane<layout->planes; plane++)
+    {
+        unsigned int rows  = (plane==0) ? layout->height : layout->height/2;
+        unsigned int bytes = (layout->planes==3) ? ((plane==0) ? layout->width : layout->width/2) : layout->width;
+        for (row=0; row<rows; row++)
+        {
+            unsigned long start = layout->offset[plane] + (unsigned long) row*layout->stride[plane];
+            if (memcmp(a+start,b+start,bytes)!=0) { return 0; }
+        }
+    }
+    return 1;
+}
+
+static double runKernel(const char * kernel,struct ColorConverter * converter,const unsigned char * source,unsigned long frameBytes,unsigned int iterations)
+{
+    selectColorConvertKernel(kernel);
+
+    unsigned long startTime = monotonicMicroseconds();
+    unsigned int i=0;
+    for (i=0; i<iterations; i++)
+    {
+        convertColorFrame(converter,source,frameBytes,converter->layout.width,converter->layout.height);
+    }
+    unsigned long elapsed = monotonicMicroseconds() - startTime;
+
+    double gigabytesPerSecond = (elapsed!=0) ? (double) frameBytes * iterations / elapsed / 1000.0 : 0.0;
+    fprintf(stdout,"%-7s %-8s -> %-6s : %8.2f GB/s, %8.1f μs per %ux%u frame\n",
+            kernel,colorConvertInputName(converter->input),colorConvertFormatName(converter->layout.format),
+            gigabytesPerSecond,(double) elapsed/iterations,converter->layout.width,converter->layout.height);
+    return gigabytesPerSecond;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int width=1920,height=1080;
+    unsigned int iterations=200;
+    unsigned int workers=3;
+    double minimumThroughput=1.0;
+    unsigned int i=0;
+
+    for (i=0; i<argc; i++)
+    {
+        if ( (strcmp(argv[i],"--size")==0) && (i+2<argc) ) {
+            width=atoi(argv[i+1]);
+            height=atoi(argv[i+2]);
+        } else if ( (strcmp(argv[i],"--iterations")==0) && (i+1<argc) ) {
+            iterations=atoi(argv[i+1]);
+        } else if ( (strcmp(argv[i],"--workers")==0) && (i+1<argc) ) {
+            workers=atoi(argv[i+1]);
+        } else if ( (strcmp(argv[i],"--min")==0) && (i+1<argc) ) {
+            minimumThroughput=atof(argv[i+1]);
+        }
+    }
+
+    unsigned long frameBytes = (unsigned long) width*height;
+    unsigned char * source = (unsigned char *) malloc(frameBytes);
+    unsigned char * result = 0;
+    struct ColorConvertLayout layout;
+    if ( (source==0) || (iterations==0) || (!colorConvertLayout(COLOR_FORMAT_NV12,width,height,&layout)) || ((result=(unsigned char *) malloc(layout.size))==0) )
+    {
+        fprintf(stderr,"Could not allocate a %ux%u frame, width and height have to be even\n",width,height);
+        return EXIT_FAILURE;
+    }
+
+    //A smooth scene with noise on top, so that every site of the mosaic takes the whole range
+    unsigned int seed = 12345;
+    unsigned long s;
+    for (s=0; s<frameBytes; s++)
+    {
+        seed = seed * 1103515245 + 12345;
+        unsigned int x = s % width, y = s / width;
+        source[s] = (unsigned char) ((x*255/width + y*255/height)/2 + ((seed>>16)%64) - 32 + 32*((x^y)&1)) ;
+    }
+
+    char defaultKernel[32];
+    snprintf(defaultKernel,32,"%s",colorConvertKernel());
+    const char * kernelNames[] = { "avx2", "sse2", "scalar" };
+    const enum ColorConvertInput inputs[]   = { COLOR_INPUT_BAYER_RG8, COLOR_INPUT_BAYER_GB8, COLOR_INPUT_MONO8 };
+    const enum ColorConvertFormat formats[] = { COLOR_FORMAT_NV12, COLOR_FORMAT_YUV420 };
+    double defaultThroughput = -1.0;
+    int mismatch = 0;
+
+    unsigned int input, format;
+    for (input=0; input<sizeof(inputs)/sizeof(inputs[0]); input++)
+    {
+        for (format=0; format<sizeof(formats)/sizeof(formats[0]); format++)
+        {
+            struct ColorConverter converter;
+            if (!createColorConverter(&converter,inputs[input],formats[format],width,height,0))
+            {
+                fprintf(stderr,"Could not create the converter\n");
+                return EXIT_FAILURE;
+            }
+
+            //Reference result of the portable kernel
+            selectColorConvertKernel("scalar");
+            convertColorFrame(&converter,source,frameBytes,width,height);
+            memcpy(result,converter.output,converter.layout.size);
+
+            for (i=0; i<sizeof(kernelNames)/sizeof(kernelNames[0]); i++)
+            {
+                if (!selectColorConvertKernel(kernelNames[i])) { continue; }
+                memset(converter.output,0,converter.layout.size);
+                double throughput = runKernel(kernelNames[i],&converter,source,frameBytes,iterations);
+                if (!samePlanes(&converter.layout,converter.output,result))
+                {
+                    fprintf(stderr,"%s %s to %s kernel does not match the portable kernel\n",kernelNames[i],colorConvertInputName(inputs[input]),colorConvertFormatName(formats[format]));
+                    mismatch = 1;
+                }
+                if ( (strcmp(kernelNames[i],defaultKernel)==0) && ( (defaultThroughput<0.0) || (throughput<defaultThroughput) ) )
+                    { defaultThroughput=throughput; }
+            }
+            destroyColorConverter(&converter);
+        }
+    }
+
+    //The same frame cut into bands for the worker pool
+    selectColorConvertKernel(defaultKernel);
+    struct ColorConverter pooled;
+    if (createColorConverter(&pooled,COLOR_INPUT_BAYER_RG8,COLOR_FORMAT_NV12,width,height,0))
+    {
+        convertColorFrame(&pooled,source,frameBytes,width,height);
+        memcpy(result,pooled.output,pooled.layout.size);
+        destroyColorConverter(&pooled);
+    }
+    if (createColorConverter(&pooled,COLOR_INPUT_BAYER_RG8,COLOR_FORMAT_NV12,width,height,workers))
+    {
+        fprintf(stdout,"%u workers and the calling thread, %u rows per band :\n",pooled.threadsStarted,pooled.rowsPerBand);
+        runKernel(defaultKernel,&pooled,source,frameBytes,iterations);
+        if (!samePlanes(&pooled.layout,pooled.output,result))
+        {
+            fprintf(stderr,"Converting in bands does not match converting the whole frame\n");
+            mismatch = 1;
+        }
+        destroyColorConverter(&pooled);
+    }
+
+    free(source);
+    free(result);
+
+    fprintf(stdout,"Default kernel %s : %0.2f GB/s at worst on one core, required %0.2f GB/s\n",defaultKernel,defaultThroughput,minimumThroughput);
+    if ( (mismatch) || (defaultThroughput<minimumThroughput) )
+    {
+        fprintf(stderr,"Color conversion kernels failed\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier:Unlicense
+#
+# Compare two result files of fake-camera-benchmark.py and flag regressions.
+#
+#   benchmarks/compare-benchmarks.py baseline.json current.json [--threshold 10]
+#
+# Runs are matched on tool, resolution, pixel format, frame rate and buffer count.
+# A run regresses when its sustained fps drops, or its CPU% or peak RSS grows, by
+# more than --threshold percent, or when its drop ratio grows by more than
+# --drop-threshold percentage points. The exit code is 1 when anything regressed,
+# so the script can gate a CI job.
+
+import argparse
+import json
+import sys
+
+RESULT_FORMAT = "aravis-c-examples-benchmark"
+
+
+def load(filename):
+    with open(filename) as fp:
+        document = json.load(fp)
+    if document.get("format") != RESULT_FORMAT:
+        sys.exit("%s is not a benchmark result file" % filename)
+    runs = {}
+    for result in document.get("results", []):
+        key = (result["tool"], result["width"], result["height"], result["pixelFormat"],
+               float(result["frameRate"]), result["buffers"])
+        runs[key] = result
+    return runs
+
+
+def relative_change(before, after):
+    if before == 0:
+        return 0.0 if after == 0 else float("inf")
+    return 100.0 * (after - before) / before
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare two fake camera benchmark result files")
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="allowed relative change of fps, CPU%% and peak RSS in percent (default 10)")
+    parser.add_argument("--drop-threshold", type=float, default=1.0,
+                        help="allowed growth of the drop ratio in percentage points (default 1)")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+
+    regressions = 0
+    for key in sorted(set(baseline) & set(current)):
+        before = baseline[key]
+        after = current[key]
+        problems = []
+
+        fps_change = relative_change(before["fps"], after["fps"])
+        if fps_change < -args.threshold:
+            problems.append("fps %.2f -> %.2f (%+.1f%%)" % (before["fps"], after["fps"], fps_change))
+
+        cpu_change = relative_change(before["cpuPercent"], after["cpuPercent"])
+        if cpu_change > args.threshold:
+            problems.append("CPU %.1f%% -> %.1f%% (%+.1f%%)" % (before["cpuPercent"], after["cpuPercent"], cpu_change))
+
+        rss_change = relative_change(before["peakRssKiB"], after["peakRssKiB"])
+        if rss_change > args.threshold:
+            problems.append("RSS %u -> %u KiB (%+.1f%%)" % (before["peakRssKiB"], after["peakRssKiB"], rss_change))
+
+        drop_change = 100.0 * (after["dropRatio"] - before["dropRatio"])
+        if drop_change > args.drop_threshold:
+            problems.append("drops %.2f%% -> %.2f%%" % (100.0 * before["dropRatio"], 100.0 * after["dropRatio"]))
+
+        if "error" in after and "error" not in before:
+            problems.append(after["error"])
+
+        label = "%s %ux%u %s %.1f Hz %u buffers" % key
+        if problems:
+            regressions += 1
+            print("REGRESSION %s : %s" % (label, ", ".join(problems)))
+        else:
+            print("ok         %s : %.2f fps, CPU %.1f%%" % (label, after["fps"], after["cpuPercent"]))
+
+    for key in sorted(set(baseline) - set(current)):
+        print("missing    %s %ux%u %s %.1f Hz %u buffers" % key)
+
+    print("%u of %u runs regressed" % (regressions, len(set(baseline) & set(current))))
+    return 1 if regressions > 0 else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,206 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier:Unlicense
+#
+# End-to-end benchmark of 06-grabber and 07-streamer against the Aravis fake camera.
+#
+# Every tool is run through a matrix of resolutions, pixel formats, frame rates and
+# buffer counts for a fixed duration, then stopped with SIGTERM. Sustained fps and
+# drops come from the --stats file the tool writes on exit, CPU% and peak RSS from
+# the rusage of the child process.
+#
+# Run through meson :
+#   meson test -C build --benchmark
+# or directly :
+#   benchmarks/fake-camera-benchmark.py --grabber build/06-grabber --output results.json
+#
+# Compare two result files with benchmarks/compare-benchmarks.py
+
+import argparse
+import itertools
+import json
+import os
+import platform
+import signal
+import sys
+import tempfile
+import time
+
+RESULT_FORMAT = "aravis-c-examples-benchmark"
+RESULT_VERSION = 1
+
+MATRICES = {
+    "quick": {
+        "resolutions": ["640x480", "1920x1080"],
+        "pixelFormats": ["Mono8", "Mono16"],
+        "frameRates": [30, 120],
+        "buffers": [4, 16],
+    },
+    "full": {
+        "resolutions": ["640x480", "1280x1024", "1920x1080", "4096x3000"],
+        "pixelFormats": ["Mono8", "Mono16", "BayerGR8", "RGB8"],
+        "frameRates": [10, 30, 60, 120, 240],
+        "buffers": [2, 4, 8, 16, 32],
+    },
+}
+
+
+def parse_list(text, convert=str):
+    return [convert(item) for item in text.split(",") if item]
+
+
+def run_tool(name, executable, width, height, pixel_format, frame_rate, buffers, duration, grace):
+    with tempfile.TemporaryDirectory(prefix="aravis-bench-") as workdir:
+        stats_file = os.path.join(workdir, "stats.json")
+        output_dir = os.path.join(workdir, "frames")
+        command = [
+            executable,
+            "--device", "Fake_1",
+            "--size", str(width), str(height),
+            "--pixelformat", pixel_format,
+            "--fps", str(frame_rate),
+            "--buffers", str(buffers),
+            "--maxFrames", "1000000000",
+            "--stats", stats_file,
+            "-o", output_dir,
+        ]
+
+        # Fork by hand rather than through subprocess so that wait4() can hand us the
+        # rusage of this one child, the tools also print a progress line per frame
+        # which is silenced here
+        start = time.monotonic()
+        pid = os.fork()
+        if pid == 0:
+            try:
+                os.chdir(workdir)
+                devnull = os.open(os.devnull, os.O_WRONLY)
+                os.dup2(devnull, 1)
+                os.dup2(devnull, 2)
+                os.execv(executable, command)
+            finally:
+                os._exit(127)
+
+        rusage = None
+        status = 0
+        stopped = False
+        killed = False
+        while rusage is None:
+            waited_pid, status, usage = os.wait4(pid, os.WNOHANG)
+            if waited_pid == pid:
+                rusage = usage
+                break
+            elapsed = time.monotonic() - start
+            if not stopped and elapsed >= duration:
+                os.kill(pid, signal.SIGTERM)
+                stopped = True
+            elif stopped and not killed and elapsed >= duration + grace:
+                os.kill(pid, signal.SIGKILL)
+                killed = True
+            time.sleep(0.05)
+        wall = time.monotonic() - start
+
+        result = {
+            "tool": name,
+            "width": width,
+            "height": height,
+            "pixelFormat": pixel_format,
+            "frameRate": frame_rate,
+            "buffers": buffers,
+            "durationSeconds": round(wall, 3),
+            "exitStatus": os.waitstatus_to_exitcode(status),
+            "killed": killed,
+            "cpuPercent": round(100.0 * (rusage.ru_utime + rusage.ru_stime) / wall, 2) if wall > 0 else 0.0,
+            "peakRssKiB": rusage.ru_maxrss,
+            "fps": 0.0,
+            "framesGrabbed": 0,
+            "framesDropped": 0,
+            "failures": 0,
+            "underruns": 0,
+            "dropRatio": 1.0,
+        }
+
+        try:
+            with open(stats_file) as fp:
+                stats = json.load(fp)
+        except (OSError, ValueError):
+            result["error"] = "no statistics written"
+            return result
+
+        grabbed = stats.get("framesGrabbed", 0)
+        # framesDropped is every lost frame (frameLoss.lost), failed buffers and underruns included
+        lost = stats.get("framesDropped", 0)
+        result.update({
+            "fps": round(stats.get("fps", 0.0), 3),
+            "framesGrabbed": grabbed,
+            "framesDropped": stats.get("framesDropped", 0),
+            "failures": stats.get("failures", 0),
+            "underruns": stats.get("underruns", 0),
+            "dropRatio": round(lost / (grabbed + lost), 6) if grabbed + lost > 0 else 1.0,
+            "startupMicroseconds": sum(stats.get("startup", {}).values()),
+        })
+        return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Fake camera benchmark of the grabber and streamer")
+    parser.add_argument("--grabber", help="path to 06-grabber")
+    parser.add_argument("--streamer", help="path to 07-streamer")
+    parser.add_argument("--output", default="benchmark-results.json")
+    parser.add_argument("--matrix", choices=sorted(MATRICES), default="quick")
+    parser.add_argument("--resolutions", help="comma separated WIDTHxHEIGHT list, overrides the matrix")
+    parser.add_argument("--pixel-formats", help="comma separated list, overrides the matrix")
+    parser.add_argument("--frame-rates", help="comma separated list, overrides the matrix")
+    parser.add_argument("--buffers", help="comma separated list, overrides the matrix")
+    parser.add_argument("--duration", type=float, default=float(os.environ.get("BENCHMARK_DURATION", "3")),
+                        help="seconds per run (default 3, or $BENCHMARK_DURATION)")
+    parser.add_argument("--grace", type=float, default=5.0, help="seconds to wait after SIGTERM before SIGKILL")
+    args = parser.parse_args()
+
+    matrix = dict(MATRICES[args.matrix])
+    if args.resolutions:
+        matrix["resolutions"] = parse_list(args.resolutions)
+    if args.pixel_formats:
+        matrix["pixelFormats"] = parse_list(args.pixel_formats)
+    if args.frame_rates:
+        matrix["frameRates"] = parse_list(args.frame_rates, float)
+    if args.buffers:
+        matrix["buffers"] = parse_list(args.buffers, int)
+
+    tools = []
+    if args.grabber:
+        tools.append(("06-grabber", os.path.abspath(args.grabber)))
+    if args.streamer:
+        tools.append(("07-streamer", os.path.abspath(args.streamer)))
+    if not tools:
+        parser.error("give at least one of --grabber or --streamer")
+
+    results = []
+    for (name, executable), resolution, pixel_format, frame_rate, buffers in itertools.product(
+            tools, matrix["resolutions"], matrix["pixelFormats"], matrix["frameRates"], matrix["buffers"]):
+        width, height = (int(value) for value in resolution.lower().split("x"))
+        result = run_tool(name, executable, width, height, pixel_format, frame_rate, buffers,
+                          args.duration, args.grace)
+        results.append(result)
+        print("%-12s %5ux%-5u %-8s %6.1f Hz %3u buffers : %8.2f fps, drop %6.2f%%, CPU %6.1f%%, RSS %7u KiB%s" % (
+            name, width, height, pixel_format, frame_rate, buffers, result["fps"], 100.0 * result["dropRatio"],
+            result["cpuPercent"], result["peakRssKiB"], "  (" + result["error"] + ")" if "error" in result else ""))
+        sys.stdout.flush()
+
+    document = {
+        "format": RESULT_FORMAT,
+        "version": RESULT_VERSION,
+        "machine": platform.machine(),
+        "host": platform.node(),
+        "matrix": matrix,
+        "durationSeconds": args.duration,
+        "results": results,
+    }
+    with open(args.output, "w") as fp:
+        json.dump(document, fp, indent=2, sort_keys=True)
+        fp.write("\n")
+    print("Results written to %s" % args.output)
+
+    return 1 if any("error" in result for result in results) else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
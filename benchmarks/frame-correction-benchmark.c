@@ -0,0 +1,137 @@
+/* SPDX-License-Identifier:Unlicense */
+
+/* Standard headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "frame-correction.h"
+#include "timing.h"
+
+// Throughput of the dark frame / flat field correction kernels on one core,
+// without a camera.
+//
+// Every kernel this CPU can run corrects synthetic 8 bit and 12-in-16 bit frames
+// with a random dark frame and gain map, and has to give the same pixels as the
+// portable kernel. The run fails on a mismatch, or when the kernel the grabber
+// would pick is slower than --min (GB/s of raw pixels, default 1.0).
+//
+// Usage : frame-correction-benchmark [--size width height] [--iterations N] [--min GB/s]
+
+static double runKernel(const char * kernel,struct FrameCorrection * correction,const void * source,void * frame,unsigned long frameBytes,unsigned int iterations)
+{
+    selectFrameCorrectionKernel(kernel);
+
+    unsigned long elapsed = 0;
+    unsigned int i=0;
+    for (i=0; i<iterations; i++)
+    {
+        //Corrections are in place, start every iteration from the raw frame
+        memcpy(frame,source,frameBytes);
+        unsigned long startTime = monotonicMicroseconds();
+        applyFrameCorrection(correction,frame,correction->width,correction->height,correction->channels,correction->bitsPerPixel);
+        elapsed += monotonicMicroseconds() - startTime;
+    }
+
+    double gigabytesPerSecond = (elapsed!=0) ? (double) frameBytes * iterations / elapsed / 1000.0 : 0.0;
+    fprintf(stdout,"%-7s %2u bit : %8.2f GB/s, %8.1f μs per %ux%u frame\n",
+            kernel,correction->bitsPerPixel,gigabytesPerSecond,(double) elapsed/iterations,correction->width,correction->height);
+    return gigabytesPerSecond;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int width=1920,height=1080;
+    unsigned int iterations=200;
+    double minimumThroughput=1.0;
+    unsigned int i=0;
+
+    for (i=0; i<argc; i++)
+    {
+        if ( (strcmp(argv[i],"--size")==0) && (i+2<argc) ) {
+            width=atoi(argv[i+1]);
+            height=atoi(argv[i+2]);
+        } else if ( (strcmp(argv[i],"--iterations")==0) && (i+1<argc) ) {
+            iterations=atoi(argv[i+1]);
+        } else if ( (strcmp(argv[i],"--min")==0) && (i+1<argc) ) {
+            minimumThroughput=atof(argv[i+1]);
+        }
+    }
+
+    unsigned long samples = (unsigned long) width*height;
+    unsigned short * dark   = (unsigned short *) malloc(samples*sizeof(unsigned short));
+    unsigned short * gain   = (unsigned short *) malloc(samples*sizeof(unsigned short));
+    unsigned short * source = (unsigned short *) malloc(samples*sizeof(unsigned short));
+    unsigned short * frame  = (unsigned short *) malloc(samples*sizeof(unsigned short));
+    unsigned short * result = (unsigned short *) malloc(samples*sizeof(unsigned short));
+    if ( (dark==0) || (gain==0) || (source==0) || (frame==0) || (result==0) || (samples==0) || (iterations==0) )
+    {
+        fprintf(stderr,"Could not allocate a %ux%u frame\n",width,height);
+        return EXIT_FAILURE;
+    }
+
+    char defaultKernel[32];
+    snprintf(defaultKernel,32,"%s",frameCorrectionKernel());
+    const char * kernelNames[] = { "avx2", "sse2", "scalar" };
+    double defaultThroughput = -1.0;
+    int mismatch = 0;
+
+    unsigned int bitsPerPixel;
+    for (bitsPerPixel=8; bitsPerPixel<=16; bitsPerPixel+=8)
+    {
+        //Dark levels around 2% of full scale, gains between 0.75 and 1.5, pixels over the whole range
+        unsigned int fullScale = (bitsPerPixel==8) ? 255 : 4095;
+        unsigned int seed = 12345;
+        unsigned long s;
+        for (s=0; s<samples; s++)
+        {
+            seed = seed * 1103515245 + 12345;
+            dark[s] = (unsigned short) (fullScale/50 + ((seed>>16) % (fullScale/50+1)));
+            gain[s] = (unsigned short) (FRAME_CORRECTION_UNITY_GAIN*3/4 + ((seed>>8) % (FRAME_CORRECTION_UNITY_GAIN*3/4)));
+            unsigned int level = (seed>>4) % (fullScale+1);
+            if (bitsPerPixel==8) { ((unsigned char *) source)[s] = (unsigned char) level; } else
+                                 { source[s] = (unsigned short) level; }
+        }
+
+        struct FrameCorrection correction;
+        if (!setFrameCorrectionReferences(&correction,width,height,1,bitsPerPixel,(bitsPerPixel==8) ? 8 : 12,dark,gain))
+        {
+            fprintf(stderr,"Could not allocate the correction references\n");
+            return EXIT_FAILURE;
+        }
+        unsigned long frameBytes = samples*(bitsPerPixel/8);
+
+        //Reference result of the portable kernel
+        selectFrameCorrectionKernel("scalar");
+        memcpy(result,source,frameBytes);
+        applyFrameCorrection(&correction,result,width,height,1,bitsPerPixel);
+
+        for (i=0; i<sizeof(kernelNames)/sizeof(kernelNames[0]); i++)
+        {
+            if (!selectFrameCorrectionKernel(kernelNames[i])) { continue; }
+            double throughput = runKernel(kernelNames[i],&correction,source,frame,frameBytes,iterations);
+            if (memcmp(frame,result,frameBytes)!=0)
+            {
+                fprintf(stderr,"%s %u bit kernel does not match the portable kernel\n",kernelNames[i],bitsPerPixel);
+                mismatch = 1;
+            }
+            if ( (strcmp(kernelNames[i],defaultKernel)==0) && ( (defaultThroughput<0.0) || (throughput<defaultThroughput) ) )
+                { defaultThroughput=throughput; }
+        }
+        destroyFrameCorrection(&correction);
+    }
+
+    free(dark);
+    free(gain);
+    free(source);
+    free(frame);
+    free(result);
+
+    fprintf(stdout,"Default kernel %s : %0.2f GB/s at worst, required %0.2f GB/s\n",defaultKernel,defaultThroughput,minimumThroughput);
+    if ( (mismatch) || (defaultThroughput<minimumThroughput) )
+    {
+        fprintf(stderr,"Frame correction kernels failed\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,133 @@
+/* SPDX-License-Identifier:Unlicense */
+
+/* Standard headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "frame-statistics.h"
+#include "timing.h"
+
+// Throughput of the frame statistics kernels on one core, without a camera.
+//
+// Every kernel this CPU can run is timed on a synthetic 8 bit and 12 bit frame
+// with every row analysed. The run fails when the kernel the grabber would pick
+// is slower than --min (GB/s, default 1.0), so it doubles as a regression check
+// through meson test --benchmark.
+//
+// Usage : frame-statistics-benchmark [--size width height] [--iterations N] [--min GB/s]
+
+static void fillFrame(unsigned char * pixels,unsigned int width,unsigned int height,unsigned int bitsPerPixel)
+{
+    //A gradient with some noise, so that the histogram is neither flat nor a single spike
+    unsigned int seed = 12345;
+    unsigned int x,y;
+    for (y=0; y<height; y++)
+    {
+        for (x=0; x<width; x++)
+        {
+            seed = seed * 1103515245 + 12345;
+            unsigned int noise = (seed >> 16) & 0x1F;
+            if (bitsPerPixel==8)
+            {
+                pixels[y*width+x] = (unsigned char) (((x*255)/width + noise) & 0xFF);
+            } else
+            {
+                ((unsigned short *) pixels)[y*width+x] = (unsigned short) (((x*4095)/width + (noise<<4)) & 0xFFF);
+            }
+        }
+    }
+}
+
+static double runKernel(const char * kernel,const void * pixels,unsigned int width,unsigned int height,unsigned int bitsPerPixel,unsigned int significantBits,unsigned int iterations)
+{
+    struct FrameStatisticsState state;
+    struct FrameStatistics * result = (struct FrameStatistics *) malloc(sizeof(struct FrameStatistics));
+    if (result==0) { return 0.0; }
+
+    selectFrameStatisticsKernel(kernel);
+    initializeFrameStatistics(&state,0); //No budget, every row is analysed
+
+    //Warm up the caches and the histogram pages
+    computeFrameStatistics(&state,pixels,width,height,bitsPerPixel,significantBits,result);
+
+    unsigned long startTime = monotonicMicroseconds();
+    unsigned int i=0;
+    for (i=0; i<iterations; i++)
+    {
+        computeFrameStatistics(&state,pixels,width,height,bitsPerPixel,significantBits,result);
+    }
+    unsigned long elapsed = monotonicMicroseconds() - startTime;
+
+    double bytes = (double) width * height * (bitsPerPixel/8) * iterations;
+    double gigabytesPerSecond = (elapsed!=0) ? bytes / elapsed / 1000.0 : 0.0;
+
+    fprintf(stdout,"%-7s %2u bit : %8.2f GB/s, %8.1f μs per %ux%u frame (mean %0.2f, median %u)\n",
+            kernel,significantBits,gigabytesPerSecond,(double) elapsed/iterations,width,height,result->mean,result->median);
+
+    free(result);
+    return gigabytesPerSecond;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int width=1920,height=1080;
+    unsigned int iterations=200;
+    double minimumThroughput=1.0;
+    unsigned int i=0;
+
+    for (i=0; i<argc; i++)
+    {
+        if ( (strcmp(argv[i],"--size")==0) && (i+2<argc) ) {
+            width=atoi(argv[i+1]);
+            height=atoi(argv[i+2]);
+        } else if ( (strcmp(argv[i],"--iterations")==0) && (i+1<argc) ) {
+            iterations=atoi(argv[i+1]);
+        } else if ( (strcmp(argv[i],"--min")==0) && (i+1<argc) ) {
+            minimumThroughput=atof(argv[i+1]);
+        }
+    }
+
+    unsigned char * frame8  = (unsigned char *) malloc((size_t) width*height);
+    unsigned char * frame16 = (unsigned char *) malloc((size_t) width*height*2);
+    if ( (frame8==0) || (frame16==0) || (width==0) || (height==0) || (iterations==0) )
+    {
+        fprintf(stderr,"Could not allocate a %ux%u frame\n",width,height);
+        free(frame8);
+        free(frame16);
+        return EXIT_FAILURE;
+    }
+    fillFrame(frame8,width,height,8);
+    fillFrame(frame16,width,height,16);
+
+    //The default kernel has to be asked for before any other one is forced
+    char defaultKernel[32];
+    snprintf(defaultKernel,32,"%s",frameStatisticsKernel());
+
+    const char * kernelNames[] = { "avx2", "sse2", "scalar" };
+    double defaultThroughput8=0.0, defaultThroughput16=0.0;
+    for (i=0; i<sizeof(kernelNames)/sizeof(kernelNames[0]); i++)
+    {
+        if (!selectFrameStatisticsKernel(kernelNames[i])) { continue; }
+        double throughput8  = runKernel(kernelNames[i],frame8,width,height,8,8,iterations);
+        double throughput16 = runKernel(kernelNames[i],frame16,width,height,16,12,iterations);
+        if (strcmp(kernelNames[i],defaultKernel)==0)
+        {
+            defaultThroughput8  = throughput8;
+            defaultThroughput16 = throughput16;
+        }
+    }
+
+    free(frame8);
+    free(frame16);
+
+    fprintf(stdout,"Default kernel %s : %0.2f GB/s (8 bit), %0.2f GB/s (12 bit), required %0.2f GB/s\n",
+            defaultKernel,defaultThroughput8,defaultThroughput16,minimumThroughput);
+
+    if ( (defaultThroughput8<minimumThroughput) || (defaultThroughput16<minimumThroughput) )
+    {
+        fprintf(stderr,"Frame statistics kernel is below the required throughput\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
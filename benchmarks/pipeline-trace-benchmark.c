@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier:Unlicense */
+
+/* Standard headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "pipeline-trace.h"
+#include "timing.h"
+
+// Cost of the --trace events, without a camera.
+//
+// The acquisition loop records about two dozen events per frame (begin and end
+// of every stage, plus the stream thread and the sinks), so what matters is
+// the time one event takes against the frame period. The same loop of
+// traceBegin()/traceEnd() pairs runs with the trace disabled and enabled,
+// while a second thread keeps recording into its own ring and a snapshot is
+// written halfway to check that the writers are never held up.
+//
+// The run fails when --eventsPerFrame events at --fps take more than --max
+// percent of the frame period (default 24 events at 1000 fps within 1%).
+//
+// Usage : pipeline-trace-benchmark [--events N] [--fps F] [--eventsPerFrame N] [--max percent] [--output trace.json]
+
+static int stopOtherThread = 0;
+
+static void * otherThread(void * argument)
+{
+    namePipelineTraceThread("benchmark sink");
+    unsigned int frame=0;
+    while (!__atomic_load_n(&stopOtherThread,__ATOMIC_RELAXED))
+    {
+        traceBegin("sink write",frame);
+        traceEnd("sink write",frame);
+        frame += 1;
+    }
+    return 0;
+}
+
+// Nanoseconds per event over that many traceBegin()/traceEnd() pairs
+static double timeEvents(unsigned long pairs,const char * snapshot)
+{
+    unsigned long i=0;
+    unsigned long startTime = monotonicMicroseconds();
+    for (i=0; i<pairs; i++)
+    {
+        traceBegin("stage",(unsigned int) i);
+        traceEnd("stage",(unsigned int) i);
+        if ( (snapshot!=0) && (i==pairs/2) )
+        {   //Written by the recording thread, like on SIGUSR2
+            unsigned long pause = monotonicMicroseconds();
+            writePipelineTrace(snapshot);
+            startTime += monotonicMicroseconds() - pause;
+        }
+    }
+    unsigned long elapsed = monotonicMicroseconds() - startTime;
+    return (elapsed*1000.0) / (2.0*pairs);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long events=20000000;
+    double fps=1000.0;
+    unsigned int eventsPerFrame=24;
+    double maximumPercent=1.0;
+    const char * output="pipeline-trace-benchmark.json";
+    unsigned int i=0;
+
+    for (i=0; i<argc; i++)
+    {
+        if ( (strcmp(argv[i],"--events")==0) && (i+1<argc) ) {
+            events=atol(argv[i+1]);
+        } else if ( (strcmp(argv[i],"--fps")==0) && (i+1<argc) ) {
+            fps=atof(argv[i+1]);
+        } else if ( (strcmp(argv[i],"--eventsPerFrame")==0) && (i+1<argc) ) {
+            eventsPerFrame=atoi(argv[i+1]);
+        } else if ( (strcmp(argv[i],"--max")==0) && (i+1<argc) ) {
+            maximumPercent=atof(argv[i+1]);
+        } else if ( (strcmp(argv[i],"--output")==0) && (i+1<argc) ) {
+            output=argv[i+1];
+        }
+    }
+    if ( (events<2) || (fps<=0.0) )
+    {
+        fprintf(stderr,"Nothing to measure, check --events and --fps\n");
+        return EXIT_FAILURE;
+    }
+
+    double disabled = timeEvents(events/2,0);
+
+    startPipelineTrace(0);
+    namePipelineTraceThread("benchmark");
+    pthread_t other;
+    char otherStarted = (pthread_create(&other,NULL,otherThread,NULL)==0);
+    double enabled = timeEvents(events/2,output);
+    __atomic_store_n(&stopOtherThread,1,__ATOMIC_RELAXED);
+    if (otherStarted) { pthread_join(other,NULL); }
+    int written = writePipelineTrace(output);
+    stopPipelineTrace();
+
+    double percent = (enabled*eventsPerFrame*fps) / 1e7;
+    fprintf(stdout,"Trace events : %0.2f ns disabled, %0.2f ns enabled, %u events per frame at %0.0f fps take %0.3f%% of the frame period, allowed %0.2f%%\n",
+            disabled,enabled,eventsPerFrame,fps,percent,maximumPercent);
+    if (!written)
+    {
+        fprintf(stderr,"Could not write the trace\n");
+        return EXIT_FAILURE;
+    }
+    if (percent>maximumPercent)
+    {
+        fprintf(stderr,"Tracing is too slow\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
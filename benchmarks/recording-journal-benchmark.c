@@ -0,0 +1,152 @@
+/* SPDX-License-Identifier:Unlicense */
+
+/* Standard headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include "pnm.h"
+#include "recording-journal.h"
+#include "timing.h"
+
+// Sustained recording throughput with and without the --journal durability,
+// without a camera.
+//
+// The same synthetic PNM frames are written one after the other, like the
+// grabber does without --pnmPolicy, three times :
+//
+//  - none  : no journal, one sync() at the end
+//  - frame : every frame made durable on its own (--syncInterval 0)
+//  - group : group commits every --interval milliseconds (default 1000)
+//
+// Every run is timed until its frames are on the disk, so this compares the
+// sustained rates rather than the speed of the page cache, and an untimed run
+// comes first to settle the disk. The run fails when group commits keep less
+// than --minRatio of the throughput without a journal (default 0.8). It
+// writes to a scratch
+// directory inside --dir (default the current directory, which has to be on
+// the disk to measure, not on a tmpfs) and removes it afterwards.
+//
+// Usage : recording-journal-benchmark [--dir path] [--size width height] [--frames N] [--interval ms] [--minRatio r]
+
+static void removeRecording(const char * directory)
+{
+    char filename[1100];
+    DIR * listing = opendir(directory);
+    if (listing!=0)
+    {
+        struct dirent * entry;
+        while ( (entry=readdir(listing))!=0 )
+        {
+            if (entry->d_name[0]=='.') { continue; }
+            snprintf(filename,sizeof(filename),"%s/%s",directory,entry->d_name);
+            unlink(filename);
+        }
+        closedir(listing);
+    }
+    rmdir(directory);
+}
+
+// Frames per second of one run, -1 when it could not record
+static double runRecording(const char * mode,const char * parent,const unsigned char * pixels,unsigned int width,unsigned int height,unsigned int frames,int interval)
+{
+    char directory[600], filename[1100], name[64];
+    snprintf(directory,sizeof(directory),"%s/journal-benchmark-XXXXXX",parent);
+    if (mkdtemp(directory)==0)
+    {
+        fprintf(stderr,"Could not create a scratch directory in %s\n",parent);
+        return -1.0;
+    }
+
+    struct RecordingJournal journal;
+    char useJournal = (interval>=0);
+    if ( (useJournal) && (!openRecordingJournal(&journal,directory,(unsigned int) interval)) )
+    {
+        removeRecording(directory);
+        return -1.0;
+    }
+
+    unsigned long startTime = monotonicMicroseconds();
+    unsigned int i=0;
+    for (i=0; i<frames; i++)
+    {
+        snprintf(name,sizeof(name),"colorFrame_0_%05u.pnm",i);
+        snprintf(filename,sizeof(filename),"%s/%s",directory,name);
+        if (!writePNM(filename,pixels,width,height,1,8)) { fprintf(stderr,"Could not write %s\n",filename); break; }
+        if (useJournal) { journalFrame(&journal,i,name); }
+    }
+    //Durable means durable, the last group commit is part of the run
+    if (useJournal) { closeRecordingJournal(&journal); } else
+                    { sync(); }
+    unsigned long elapsed = monotonicMicroseconds() - startTime;
+
+    double framesPerSecond = (elapsed!=0) ? (double) i * 1000000.0 / elapsed : 0.0;
+    fprintf(stdout,"%-6s : %8.1f fps, %8.1f MB/s",mode,framesPerSecond,framesPerSecond*width*height/1000000.0);
+    if (useJournal)
+    {
+        fprintf(stdout,", %u commits of %0.1f ms, %lu of %u frames durable",journal.commits,
+                (journal.commits!=0) ? journal.syncMicroseconds/1000.0/journal.commits : 0.0,journal.framesCommitted,i);
+    }
+    fprintf(stdout,"\n");
+
+    removeRecording(directory);
+    if ( (useJournal) && (journal.framesCommitted!=i) ) { return -1.0; }
+    return framesPerSecond;
+}
+
+int main(int argc, char **argv)
+{
+    const char * parent = ".";
+    unsigned int width=1920,height=1080;
+    unsigned int frames=600;
+    int interval=1000;
+    double minimumRatio=0.8;
+    unsigned int i=0;
+
+    for (i=0; i<argc; i++)
+    {
+        if ( (strcmp(argv[i],"--dir")==0) && (i+1<argc) ) {
+            parent=argv[i+1];
+        } else if ( (strcmp(argv[i],"--size")==0) && (i+2<argc) ) {
+            width=atoi(argv[i+1]);
+            height=atoi(argv[i+2]);
+        } else if ( (strcmp(argv[i],"--frames")==0) && (i+1<argc) ) {
+            frames=atoi(argv[i+1]);
+        } else if ( (strcmp(argv[i],"--interval")==0) && (i+1<argc) ) {
+            interval=atoi(argv[i+1]);
+        } else if ( (strcmp(argv[i],"--minRatio")==0) && (i+1<argc) ) {
+            minimumRatio=atof(argv[i+1]);
+        }
+    }
+
+    unsigned char * pixels = (unsigned char *) malloc((size_t) width*height);
+    if ( (pixels==0) || (frames==0) || (interval<1) )
+    {
+        fprintf(stderr,"Nothing to record, check --size, --frames and --interval\n");
+        return EXIT_FAILURE;
+    }
+    unsigned long p=0;
+    for (p=0; p<(unsigned long) width*height; p++) { pixels[p] = (unsigned char) (p*7 + p/width); }
+
+    runRecording("warmup",parent,pixels,width,height,frames,-1);
+    double none  = runRecording("none", parent,pixels,width,height,frames,-1);
+    double frame = runRecording("frame",parent,pixels,width,height,frames,0);
+    double group = runRecording("group",parent,pixels,width,height,frames,interval);
+    free(pixels);
+
+    if ( (none<=0.0) || (frame<0.0) || (group<0.0) )
+    {
+        fprintf(stderr,"Recording failed\n");
+        return EXIT_FAILURE;
+    }
+    fprintf(stdout,"Group commits keep %0.2f of the throughput without a journal (per frame syncs %0.2f), required %0.2f\n",
+            group/none,frame/none,minimumRatio);
+    if (group/none<minimumRatio)
+    {
+        fprintf(stderr,"Journaled recording is too slow\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,177 @@
+/* SPDX-License-Identifier:Unlicense */
+
+/* Standard headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "shm-ring.h"
+#include "timing.h"
+
+// Latency of the zero copy consumer API, without a camera.
+//
+// A child process publishes --frames frames of --size at --fps into a
+// /<stream>.frames ring, every frame filled with its frame number. This
+// process consumes them with acquireNextFrame(), reads the first and the last
+// pixel, checks them, and releases the frame. It sleeps a random part of the
+// frame period in between, so that some frames are already waiting when it
+// asks for them and some are not, and holds every 50th frame for three
+// periods to make the publisher go around a pinned slot. Two latencies come
+// out :
+//
+//  - acquire to pixel : from calling acquireNextFrame() on a frame that was
+//    already published, to having read its pixels
+//  - publish to pixel : from the publisher completing a frame the consumer
+//    was waiting for, to the consumer having read it, the futex wake up and
+//    the scheduler included
+//
+// The run fails when a held frame changed under the consumer, or when the 99th
+// percentile of acquire to pixel is over --max (μs, default 10).
+//
+// Usage : shm-ring-benchmark [--size width height] [--frames N] [--fps F] [--slots N] [--max μs]
+
+#define BENCHMARK_STREAM "shm-ring-benchmark"
+
+static int compareUnsignedLongs(const void * a,const void * b)
+{
+    unsigned long x = *(const unsigned long *) a, y = *(const unsigned long *) b;
+    return (x>y) - (x<y);
+}
+
+// Percentile in microseconds of samples in nanoseconds, sorts them
+static double percentile(unsigned long * samples,unsigned long count,double fraction)
+{
+    if (count==0) { return 0.0; }
+    qsort(samples,count,sizeof(unsigned long),compareUnsignedLongs);
+    unsigned long index = (unsigned long) (fraction*(count-1));
+    return samples[index]/1000.0;
+}
+
+static int publisher(unsigned int width,unsigned int height,unsigned int frames,double fps,unsigned int slots)
+{
+    unsigned long size = (unsigned long) width*height;
+    unsigned char * pixels = (unsigned char *) malloc(size);
+    struct SharedFrameRing ring;
+    if ( (pixels==0) || (!createSharedFrameRing(&ring,BENCHMARK_STREAM,slots,size)) ) { return EXIT_FAILURE; }
+    usleep(200000); //The consumer attaches
+
+    unsigned long period = (unsigned long) (1000000.0/fps);
+    unsigned long next = monotonicMicroseconds();
+    unsigned int frameNumber=0;
+    for (frameNumber=1; frameNumber<=frames; frameNumber++)
+    {
+        memset(pixels,frameNumber&0xFF,size);
+        publishSharedFrame(&ring,pixels,size,width,height,1,8,frameNumber,0);
+        next += period;
+        unsigned long now = monotonicMicroseconds();
+        if (next>now) { usleep(next-now); }
+    }
+    usleep(100000);
+    fprintf(stdout,"Publisher : %lu frames, %lu pinned slots skipped, %lu dropped, %lu wake ups\n",ring.published,ring.pinnedSkips,ring.dropped,ring.wakeups);
+    destroySharedFrameRing(&ring);
+    free(pixels);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int width=1920,height=1080;
+    unsigned int frames=2000;
+    double fps=500.0;
+    unsigned int slots=4;
+    double maximumMicroseconds=10.0;
+    unsigned int i=0;
+
+    for (i=0; i<argc; i++)
+    {
+        if ( (strcmp(argv[i],"--size")==0) && (i+2<argc) ) {
+            width=atoi(argv[i+1]);
+            height=atoi(argv[i+2]);
+        } else if ( (strcmp(argv[i],"--frames")==0) && (i+1<argc) ) {
+            frames=atoi(argv[i+1]);
+        } else if ( (strcmp(argv[i],"--fps")==0) && (i+1<argc) ) {
+            fps=atof(argv[i+1]);
+        } else if ( (strcmp(argv[i],"--slots")==0) && (i+1<argc) ) {
+            slots=atoi(argv[i+1]);
+        } else if ( (strcmp(argv[i],"--max")==0) && (i+1<argc) ) {
+            maximumMicroseconds=atof(argv[i+1]);
+        }
+    }
+    if ( (width==0) || (height==0) || (frames==0) || (fps<=0.0) || (slots<2) )
+    {
+        fprintf(stderr,"Nothing to measure, check --size, --frames, --fps and --slots\n");
+        return EXIT_FAILURE;
+    }
+
+    pid_t child = fork();
+    if (child<0) { return EXIT_FAILURE; }
+    if (child==0) { exit(publisher(width,height,frames,fps,slots)); }
+
+    struct SharedFrameConsumer consumer;
+    unsigned int attempt=0;
+    while ( (!attachSharedFrameConsumer(&consumer,BENCHMARK_STREAM)) && (attempt++<100) ) { usleep(10000); }
+    if (consumer.header==0)
+    {
+        fprintf(stderr,"Could not attach to the publisher\n");
+        waitpid(child,NULL,0);
+        return EXIT_FAILURE;
+    }
+
+    unsigned long * acquireSamples = (unsigned long *) malloc(sizeof(unsigned long)*frames);
+    unsigned long * publishSamples = (unsigned long *) malloc(sizeof(unsigned long)*frames);
+    unsigned long acquireCount=0, publishCount=0, corrupted=0, checksum=0;
+    unsigned long period = (unsigned long) (1000000.0/fps);
+    unsigned int seed = 12345;
+
+    struct SharedFrameView view;
+    for (;;)
+    {
+        unsigned long startTime = monotonicNanoseconds();
+        int result = acquireNextFrame(&consumer,&view,1000);
+        if (result<=0) { break; }
+        unsigned char first = view.pixels[0];
+        unsigned char last  = view.pixels[view.size-1];
+        unsigned long endTime = monotonicNanoseconds();
+        checksum += first + last;
+
+        if (view.publishTime<=startTime) { if (acquireCount<frames) { acquireSamples[acquireCount++] = endTime-startTime; } } else
+                                         { if (publishCount<frames) { publishSamples[publishCount++] = endTime-view.publishTime; } }
+
+        if (view.frameNumber%50==0) { usleep(3*period); } //Held, the publisher has to go around it
+        if ( (view.pixels[0]!=(view.frameNumber&0xFF)) || (view.pixels[view.size-1]!=(view.frameNumber&0xFF)) ) { corrupted+=1; }
+        releaseFrame(&consumer,&view);
+
+        seed = seed * 1103515245 + 12345;
+        usleep((seed>>16) % period);
+    }
+    int status = 0;
+    waitpid(child,&status,0);
+
+    fprintf(stdout,"Consumer : %lu frames acquired, %lu missed, %lu timeouts, %lu retries, %lu changed while held (checksum %lu)\n",
+            consumer.acquired,consumer.missed,consumer.timeouts,consumer.retries,corrupted,checksum);
+    detachSharedFrameConsumer(&consumer);
+
+    double acquireMedian = percentile(acquireSamples,acquireCount,0.5);
+    double acquire99     = percentile(acquireSamples,acquireCount,0.99);
+    double publishMedian = percentile(publishSamples,publishCount,0.5);
+    double publish99     = percentile(publishSamples,publishCount,0.99);
+    fprintf(stdout,"Acquire to pixel : median %0.2f μs, 99%% %0.2f μs over %lu frames\n",acquireMedian,acquire99,acquireCount);
+    fprintf(stdout,"Publish to pixel : median %0.2f μs, 99%% %0.2f μs over %lu frames\n",publishMedian,publish99,publishCount);
+    fprintf(stdout,"Allowed %0.2f μs acquire to pixel at the 99th percentile\n",maximumMicroseconds);
+    free(acquireSamples);
+    free(publishSamples);
+
+    if ( (!WIFEXITED(status)) || (WEXITSTATUS(status)!=EXIT_SUCCESS) || (consumer.acquired==0) )
+    {
+        fprintf(stderr,"The publisher failed\n");
+        return EXIT_FAILURE;
+    }
+    if ( (corrupted!=0) || (acquire99>maximumMicroseconds) )
+    {
+        fprintf(stderr,"Zero copy consumer failed\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "acquisition-core.h"
+#include "frame-fanout.h"
+#include "pnm.h"
+#include "recording-journal.h"
+
+/* Standard headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+static unsigned long tickBase = 0;
+unsigned long GetTickCountMicroseconds()
+{
+    struct timespec ts;
+    if ( clock_gettime(CLOCK_MONOTONIC,&ts) != 0) {
+        return 0;
+    }
+
+    if (tickBase==0)
+    {
+        tickBase = ts.tv_sec*1000000 + ts.tv_nsec/1000;
+        return 0;
+    }
+
+    return ( ts.tv_sec*1000000 + ts.tv_nsec/1000 ) - tickBase;
+}
+
+int writeSettings(const char * filename,struct Settings * settings)
+{
+    FILE * fp = fopen(filename,"w");
+    if (fp!=0)
+    {
+        fprintf(fp,"{\n\"delay\": %u,\n",settings->delay);
+        fprintf(fp,"\"maxFramesToGrab\": %u,\n",settings->maxFramesToGrab);
+        fprintf(fp,"\"exposure\": %u,\n",settings->exposure);
+        fprintf(fp,"\"blackLevel\": %f,\n",settings->blackLevel);
+        fprintf(fp,"\"gain\": %f,\n",settings->gain);
+        fprintf(fp,"\"frameRate\": %f,\n",settings->frameRate);
+        fprintf(fp,"\"tickCommand\": \"%s\"\n}\n",settings->tickCommand);
+        fclose(fp);
+        return 1;
+    }
+    return 0;
+}
+
+
+int WritePPM(const char * filename,struct Image * pic)
+{
+    if (pic==0) {
+        return 0;
+    }
+    if (!writePNM(filename,pic->pixels,pic->width,pic->height,pic->channels,pic->bitsperpixel))
+    {
+        fprintf(stderr,"WritePPM(%s) could not write a %ux%u frame with %u channels at %u bpp\n",filename,pic->width,pic->height,pic->channels,pic->bitsperpixel);
+        return 0;
+    }
+    return 1;
+}
+
+void applyCameraSettings(ArvCamera * camera,struct Settings * settings)
+{
+    if (settings->exposure!=0)
+    {
+        arv_camera_set_exposure_time(camera, settings->exposure, NULL);
+    }
+    if (settings->gain!=0.0)
+    {
+        arv_camera_set_gain (camera, settings->gain, NULL);
+    }
+    if (settings->blackLevel!=0.0)
+    {
+        arv_camera_set_black_level(camera, settings->blackLevel, NULL);
+    }
+    if (settings->frameRate!=0.0)
+    {
+        arv_camera_set_frame_rate (camera, settings->frameRate, NULL);
+    }
+}
+
+int writePNMSinkFrame(void * context,const struct FanOutFrame * frame)
+{
+    struct PNMSinkContext * sink = (struct PNMSinkContext *) context;
+    char filename[1024], name[RECORDING_JOURNAL_NAME_LENGTH];
+    snprintf(name,sizeof(name),"colorFrame_0_%05u.pnm",frame->frameNumber);
+    snprintf(filename,1024,"%s/%s",sink->directory,name);
+    if (!writePNM(filename,frame->pixels,frame->width,frame->height,frame->channels,frame->bitsPerPixel)) { return 0; }
+    if (sink->journal!=0) { journalFrame(sink->journal,frame->frameNumber,name); }
+    return 1;
+}
+
+int runTickSinkFrame(void * context,const struct FanOutFrame * frame)
+{
+    const char * command = (const char *) context;
+    return (system(command)==0);
+}
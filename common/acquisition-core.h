@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef ACQUISITION_CORE_H_INCLUDED
+#define ACQUISITION_CORE_H_INCLUDED
+
+/* Aravis header */
+#include <arv.h>
+
+struct RecordingJournal;
+struct FanOutFrame;
+
+// What 06-grabber and 07-streamer used to carry each in their own copy : the
+// frame and settings structures, the tick clock, info.json, the PNM writer and
+// the camera settings applied once the acquisition runs. Frames that leave the
+// acquisition loop go through frame-fanout.h, the writers of its file sink are
+// here, the shared memory one is in shm-sink.h.
+
+struct Image
+{
+    const unsigned char * pixels;
+    unsigned int width;
+    unsigned int height;
+    unsigned int channels;
+    unsigned int bitsperpixel;
+    unsigned int image_size;
+    unsigned int timestamp;
+};
+
+struct Settings
+{
+    unsigned int delay,maxFramesToGrab;
+    unsigned int exposure; // 0 means no setting
+    double       gain;
+    double       blackLevel;
+    double       frameRate;
+    char * tickCommand;
+};
+
+// Microseconds since the first call of the process
+unsigned long GetTickCountMicroseconds();
+
+// info.json, also what live-config.h reloads on SIGHUP
+int writeSettings(const char * filename,struct Settings * settings);
+
+// writePNM() (pnm.h) of a struct Image, 0 when nothing was written
+int WritePPM(const char * filename,struct Image * pic);
+
+// Exposure, gain, black level and frame rate of the settings that are not 0
+void applyCameraSettings(ArvCamera * camera,struct Settings * settings);
+
+// File sink of a fan-out, writes colorFrame_0_NNNNN.pnm files
+struct PNMSinkContext
+{
+    const char * directory;
+    struct RecordingJournal * journal;  // NULL without --journal
+};
+
+int writePNMSinkFrame(void * context,const struct FanOutFrame * frame);
+
+// Tick sink of a fan-out, runs the --tick command off the acquisition thread, context is the command
+int runTickSinkFrame(void * context,const struct FanOutFrame * frame);
+
+#endif // ACQUISITION_CORE_H_INCLUDED
@@ -0,0 +1,352 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "acquisition-stats.h"
+#include "auto-exposure.h"
+#include "change-detection.h"
+#include "clock-mapping.h"
+#include "color-convert.h"
+#include "frame-correction.h"
+#include "frame-fanout.h"
+#include "frame-loss.h"
+#include "frame-ring.h"
+#include "frame-stacking.h"
+#include "gige-transport.h"
+#include "jpeg-sink.h"
+#include "live-config.h"
+#include "recording-journal.h"
+#include "shm-ring.h"
+#include "sink-queue.h"
+#include "striped-recording.h"
+#include "time-lapse.h"
+
+/* Standard headers */
+#include <stdio.h>
+
+int writeAcquisitionStatistics(const char * filename,struct AcquisitionStatistics * statistics)
+{
+    if ( (filename==0) || (statistics==0) ) { return 0; }
+
+    FILE * fp = fopen(filename,"w");
+    if (fp!=0)
+    {
+        double fps = 0.0;
+        if (statistics->elapsedMicroseconds!=0) { fps = (double) statistics->framesGrabbed * 1000000.0 / statistics->elapsedMicroseconds; }
+
+        fprintf(fp,"{\n\"framesGrabbed\": %lu,\n",statistics->framesGrabbed);
+        fprintf(fp,"\"framesDropped\": %lu,\n",statistics->framesDropped);
+        fprintf(fp,"\"elapsedMicroseconds\": %lu,\n",statistics->elapsedMicroseconds);
+        fprintf(fp,"\"fps\": %f,\n",fps);
+        fprintf(fp,"\"completedBuffers\": %lu,\n",statistics->completedBuffers);
+        fprintf(fp,"\"failures\": %lu,\n",statistics->failures);
+        fprintf(fp,"\"underruns\": %lu,\n",statistics->underruns);
+        fprintf(fp,"\"width\": %u,\n",statistics->width);
+        fprintf(fp,"\"height\": %u,\n",statistics->height);
+        fprintf(fp,"\"buffers\": %u,\n",statistics->buffers);
+        fprintf(fp,"\"requestedFrameRate\": %f,\n",statistics->requestedFrameRate);
+        fprintf(fp,"\"pixelFormat\": \"%s\",\n",(statistics->pixelFormat!=0) ? statistics->pixelFormat : "");
+        if (statistics->frameStatistics!=0)
+        {
+            struct FrameStatisticsState * frameStatistics = statistics->frameStatistics;
+            double frames  = (frameStatistics->frames!=0)        ? frameStatistics->frames        : 1.0;
+            double sampled = (frameStatistics->pixelsSampled!=0) ? frameStatistics->pixelsSampled : 1.0;
+            fprintf(fp,"\"frameStatistics\": {\n");
+            fprintf(fp,"  \"kernel\": \"%s\",\n",frameStatisticsKernel());
+            fprintf(fp,"  \"frames\": %lu,\n",frameStatistics->frames);
+            fprintf(fp,"  \"subsampledFrames\": %lu,\n",frameStatistics->subsampledFrames);
+            fprintf(fp,"  \"budgetMicroseconds\": %u,\n",frameStatistics->budgetMicroseconds);
+            fprintf(fp,"  \"averageMicroseconds\": %f,\n",frameStatistics->totalMicroseconds / frames);
+            fprintf(fp,"  \"maxMicroseconds\": %lu,\n",frameStatistics->maxMicroseconds);
+            fprintf(fp,"  \"meanLevel\": %f,\n",frameStatistics->sumOfMeans / frames);
+            fprintf(fp,"  \"underExposedRatio\": %f,\n",frameStatistics->underExposed / sampled);
+            fprintf(fp,"  \"overExposedRatio\": %f\n",frameStatistics->overExposed / sampled);
+            fprintf(fp,"},\n");
+        }
+        if (statistics->autoExposure!=0)
+        {
+            struct AutoExposureController * autoExposure = statistics->autoExposure;
+            fprintf(fp,"\"autoExposure\": {\n");
+            fprintf(fp,"  \"target\": %f,\n",autoExposure->settings.target);
+            fprintf(fp,"  \"measurements\": %lu,\n",autoExposure->measurements);
+            fprintf(fp,"  \"skippedMeasurements\": %lu,\n",autoExposure->skippedMeasurements);
+            fprintf(fp,"  \"corrections\": %lu,\n",autoExposure->corrections);
+            fprintf(fp,"  \"featureWrites\": %lu,\n",autoExposure->featureWrites);
+            fprintf(fp,"  \"averageWriteMicroseconds\": %f,\n",(autoExposure->corrections!=0) ? (double) autoExposure->writeMicroseconds/autoExposure->corrections : 0.0);
+            fprintf(fp,"  \"averageLatencyFrames\": %f,\n",(autoExposure->settled!=0) ? (double) autoExposure->latencyFrames/autoExposure->settled : 0.0);
+            fprintf(fp,"  \"maxLatencyFrames\": %lu,\n",autoExposure->maxLatencyFrames);
+            fprintf(fp,"  \"notVisible\": %lu,\n",autoExposure->timeouts);
+            fprintf(fp,"  \"exposure\": %f,\n",autoExposure->exposure);
+            fprintf(fp,"  \"gain\": %f\n",autoExposure->gain);
+            fprintf(fp,"},\n");
+        }
+        if (statistics->frameRing!=0)
+        {
+            struct FrameRing * frameRing = statistics->frameRing;
+            fprintf(fp,"\"preTrigger\": {\n");
+            fprintf(fp,"  \"capacityFrames\": %u,\n",frameRing->capacity);
+            fprintf(fp,"  \"budgetBytes\": %lu,\n",frameRing->budgetBytes);
+            fprintf(fp,"  \"events\": %u,\n",frameRing->event);
+            fprintf(fp,"  \"framesPushed\": %lu,\n",frameRing->framesPushed);
+            fprintf(fp,"  \"framesWritten\": %lu,\n",frameRing->framesPersisted);
+            fprintf(fp,"  \"overruns\": %lu,\n",frameRing->overruns);
+            fprintf(fp,"  \"oversized\": %lu,\n",frameRing->oversized);
+            fprintf(fp,"  \"averageWriteMicroseconds\": %f\n",(frameRing->framesPersisted!=0) ? (double) frameRing->writeMicroseconds/frameRing->framesPersisted : 0.0);
+            fprintf(fp,"},\n");
+        }
+        if (statistics->changeDetector!=0)
+        {
+            struct ChangeDetector * changeDetector = statistics->changeDetector;
+            unsigned long compared = changeDetector->framesCompared;
+            fprintf(fp,"\"changeDetection\": {\n");
+            fprintf(fp,"  \"kernel\": \"%s\",\n",changeDetectionKernel());
+            fprintf(fp,"  \"threshold\": %f,\n",changeDetector->threshold);
+            fprintf(fp,"  \"keyframeInterval\": %u,\n",changeDetector->keyframeInterval);
+            fprintf(fp,"  \"framesCompared\": %lu,\n",changeDetector->framesCompared);
+            fprintf(fp,"  \"framesKept\": %lu,\n",changeDetector->framesKept);
+            fprintf(fp,"  \"framesSkipped\": %lu,\n",changeDetector->framesSkipped);
+            fprintf(fp,"  \"keyframes\": %lu,\n",changeDetector->keyframes);
+            fprintf(fp,"  \"averageMicroseconds\": %f,\n",(compared!=0) ? (double) changeDetector->totalMicroseconds/compared : 0.0);
+            fprintf(fp,"  \"maxMicroseconds\": %lu\n",changeDetector->maxMicroseconds);
+            fprintf(fp,"},\n");
+        }
+        if (statistics->frameCorrection!=0)
+        {
+            struct FrameCorrection * frameCorrection = statistics->frameCorrection;
+            fprintf(fp,"\"frameCorrection\": {\n");
+            fprintf(fp,"  \"kernel\": \"%s\",\n",frameCorrectionKernel());
+            fprintf(fp,"  \"dark\": %u,\n",frameCorrection->hasDark);
+            fprintf(fp,"  \"flat\": %u,\n",frameCorrection->hasFlat);
+            fprintf(fp,"  \"frames\": %lu,\n",frameCorrection->frames);
+            fprintf(fp,"  \"mismatchedFrames\": %lu,\n",frameCorrection->mismatchedFrames);
+            fprintf(fp,"  \"averageMicroseconds\": %f,\n",(frameCorrection->frames!=0) ? (double) frameCorrection->totalMicroseconds/frameCorrection->frames : 0.0);
+            fprintf(fp,"  \"maxMicroseconds\": %lu\n",frameCorrection->maxMicroseconds);
+            fprintf(fp,"},\n");
+        }
+        if (statistics->frameStack!=0)
+        {
+            struct FrameStack * frameStack = statistics->frameStack;
+            fprintf(fp,"\"stacking\": {\n");
+            fprintf(fp,"  \"kernel\": \"%s\",\n",frameStackingKernel());
+            fprintf(fp,"  \"mode\": \"%s\",\n",frameStackModeName(frameStack->mode));
+            fprintf(fp,"  \"window\": %u,\n",frameStack->window);
+            fprintf(fp,"  \"framesIn\": %lu,\n",frameStack->framesIn);
+            fprintf(fp,"  \"framesOut\": %lu,\n",frameStack->framesOut);
+            fprintf(fp,"  \"restarts\": %lu,\n",frameStack->restarts);
+            fprintf(fp,"  \"averageMicroseconds\": %f,\n",(frameStack->framesIn!=0) ? (double) frameStack->totalMicroseconds/frameStack->framesIn : 0.0);
+            fprintf(fp,"  \"maxMicroseconds\": %lu\n",frameStack->maxMicroseconds);
+            fprintf(fp,"},\n");
+        }
+        if (statistics->colorConverter!=0)
+        {
+            struct ColorConverter * colorConverter = statistics->colorConverter;
+            fprintf(fp,"\"yuv\": {\n");
+            fprintf(fp,"  \"kernel\": \"%s\",\n",colorConvertKernel());
+            fprintf(fp,"  \"input\": \"%s\",\n",colorConvertInputName(colorConverter->input));
+            fprintf(fp,"  \"format\": \"%s\",\n",colorConvertFormatName(colorConverter->layout.format));
+            fprintf(fp,"  \"workers\": %u,\n",colorConverter->workers);
+            fprintf(fp,"  \"rowsPerBand\": %u,\n",colorConverter->rowsPerBand);
+            fprintf(fp,"  \"frames\": %lu,\n",colorConverter->frames);
+            fprintf(fp,"  \"mismatchedFrames\": %lu,\n",colorConverter->mismatchedFrames);
+            fprintf(fp,"  \"averageMicroseconds\": %f,\n",(colorConverter->frames!=0) ? (double) colorConverter->totalMicroseconds/colorConverter->frames : 0.0);
+            fprintf(fp,"  \"maxMicroseconds\": %lu\n",colorConverter->maxMicroseconds);
+            fprintf(fp,"},\n");
+        }
+        if (statistics->shmRing!=0)
+        {
+            struct SharedFrameRing * shmRing = statistics->shmRing;
+            fprintf(fp,"\"shmRing\": {\n");
+            fprintf(fp,"  \"slots\": %u,\n",shmRing->slots);
+            fprintf(fp,"  \"published\": %lu,\n",shmRing->published);
+            fprintf(fp,"  \"pinnedSkips\": %lu,\n",shmRing->pinnedSkips);
+            fprintf(fp,"  \"dropped\": %lu,\n",shmRing->dropped);
+            fprintf(fp,"  \"oversized\": %lu,\n",shmRing->oversized);
+            fprintf(fp,"  \"wakeups\": %lu\n",shmRing->wakeups);
+            fprintf(fp,"},\n");
+        }
+        if (statistics->gigeTransport!=0)
+        {
+            struct GigETransport * gigeTransport = statistics->gigeTransport;
+            fprintf(fp,"\"gigeTransport\": {\n");
+            fprintf(fp,"  \"autoTune\": %u,\n",gigeTransport->autoTune);
+            fprintf(fp,"  \"packetSize\": %u,\n",gigeTransport->appliedPacketSize);
+            fprintf(fp,"  \"packetDelay\": %ld,\n",gigeTransport->appliedPacketDelay);
+            fprintf(fp,"  \"resentPackets\": %lu,\n",(unsigned long) gigeTransport->resentPackets);
+            fprintf(fp,"  \"missingPackets\": %lu,\n",(unsigned long) gigeTransport->missingPackets);
+            fprintf(fp,"  \"worstSecondFailures\": %lu\n",(unsigned long) gigeTransport->worstSecondFailures);
+            fprintf(fp,"},\n");
+        }
+        if (statistics->jpegSink!=0)
+        {
+            struct JpegSink * jpegSink = statistics->jpegSink;
+            fprintf(fp,"\"jpeg\": {\n");
+            fprintf(fp,"  \"quality\": %u,\n",jpegSink->quality);
+            fprintf(fp,"  \"workers\": %u,\n",jpegSink->workers);
+            fprintf(fp,"  \"slices\": %u,\n",jpegSink->slices);
+            fprintf(fp,"  \"framesWritten\": %lu,\n",jpegSink->framesEncoded);
+            fprintf(fp,"  \"framesDropped\": %lu,\n",jpegSink->framesDropped);
+            fprintf(fp,"  \"failures\": %lu,\n",jpegSink->failures);
+            fprintf(fp,"  \"fps\": %f,\n",jpegSinkFrameRate(jpegSink));
+            fprintf(fp,"  \"averageLatencyMicroseconds\": %f,\n",(jpegSink->framesEncoded!=0) ? (double) jpegSink->totalLatencyMicroseconds/jpegSink->framesEncoded : 0.0);
+            fprintf(fp,"  \"maxLatencyMicroseconds\": %lu,\n",jpegSink->maxLatencyMicroseconds);
+            fprintf(fp,"  \"compressionRatio\": %f\n",(jpegSink->encodedBytes!=0) ? (double) jpegSink->rawBytes/jpegSink->encodedBytes : 0.0);
+            fprintf(fp,"},\n");
+        }
+        if (statistics->journal!=0)
+        {
+            struct RecordingJournal * journal = statistics->journal;
+            fprintf(fp,"\"journal\": {\n");
+            fprintf(fp,"  \"syncIntervalMilliseconds\": %u,\n",journal->syncIntervalMilliseconds);
+            fprintf(fp,"  \"framesJournaled\": %lu,\n",journal->framesJournaled);
+            fprintf(fp,"  \"framesCommitted\": %lu,\n",journal->framesCommitted);
+            fprintf(fp,"  \"commits\": %u,\n",journal->commits);
+            fprintf(fp,"  \"bytesCommitted\": %llu,\n",journal->bytesCommitted);
+            fprintf(fp,"  \"averageCommitMicroseconds\": %f,\n",(journal->commits!=0) ? (double) journal->syncMicroseconds/journal->commits : 0.0);
+            fprintf(fp,"  \"maxCommitMicroseconds\": %lu,\n",journal->maxSyncMicroseconds);
+            fprintf(fp,"  \"maxCommitLagMicroseconds\": %lu,\n",journal->maxCommitLagMicroseconds);
+            fprintf(fp,"  \"failures\": %lu\n",journal->failures);
+            fprintf(fp,"},\n");
+        }
+        if (statistics->liveConfig!=0)
+        {
+            struct LiveConfig * live = statistics->liveConfig;
+            fprintf(fp,"\"liveConfig\": {\n");
+            fprintf(fp,"  \"requests\": %lu,\n",live->requests);
+            fprintf(fp,"  \"applied\": %lu,\n",live->applied);
+            fprintf(fp,"  \"failures\": %lu,\n",live->failures);
+            fprintf(fp,"  \"reloads\": %lu,\n",live->reloads);
+            fprintf(fp,"  \"lastChange\": %u,\n",live->appliedChange);
+            fprintf(fp,"  \"lastTaggedChange\": %u,\n",live->taggedChange);
+            fprintf(fp,"  \"averageWriteMicroseconds\": %f,\n",(live->applied!=0) ? (double) live->writeMicroseconds/live->applied : 0.0);
+            fprintf(fp,"  \"maxWriteMicroseconds\": %lu\n",live->maxWriteMicroseconds);
+            fprintf(fp,"},\n");
+        }
+        if (statistics->fanOut!=0)
+        {
+            struct FrameFanOut * fanOut = statistics->fanOut;
+            fprintf(fp,"\"fanOut\": {\n");
+            fprintf(fp,"  \"sinks\": %u,\n",fanOut->numberOfSinks);
+            fprintf(fp,"  \"framesSubmitted\": %lu,\n",fanOut->framesSubmitted);
+            fprintf(fp,"  \"framesCopied\": %lu,\n",fanOut->framesCopied);
+            fprintf(fp,"  \"bytesCopied\": %llu,\n",fanOut->bytesCopied);
+            fprintf(fp,"  \"pooledFrames\": %u,\n",fanOut->numberOfFrames);
+            fprintf(fp,"  \"maxFramesInUse\": %u\n",fanOut->maxFramesInUse);
+            fprintf(fp,"},\n");
+        }
+        if ( (statistics->stripedRecording!=0) && (statistics->stripedRecording->fanOut!=0) )
+        {
+            struct StripedRecording * striping = statistics->stripedRecording;
+            fprintf(fp,"\"stripedRecording\": [\n");
+            unsigned int i=0;
+            for (i=0; i<striping->numberOfStripes; i++)
+            {
+                struct RecordingStripe * stripe = &striping->stripes[i];
+                unsigned long writeMicroseconds = (stripe->fanOutSink>=0) ? striping->fanOut->sinks[stripe->fanOutSink].writeMicroseconds : 0;
+                fprintf(fp,"  {\n");
+                fprintf(fp,"    \"root\": %u,\n",i);
+                fprintf(fp,"    \"directory\": \"%s\",\n",stripe->directory);
+                fprintf(fp,"    \"sink\": \"%s\",\n",stripe->policy.name);
+                fprintf(fp,"    \"frames\": %lu,\n",stripe->frames);
+                fprintf(fp,"    \"bytes\": %llu,\n",stripe->bytes);
+                fprintf(fp,"    \"writeMBps\": %f,\n",(writeMicroseconds!=0) ? (double) stripe->bytes/writeMicroseconds : 0.0);
+                fprintf(fp,"    \"worstSecondMB\": %f,\n",stripe->worstSecondBytes/1000000.0);
+                fprintf(fp,"    \"bestSecondMB\": %f,\n",stripe->bestSecondBytes/1000000.0);
+                fprintf(fp,"    \"maxQueued\": %u,\n",stripe->policy.maxQueued);
+                fprintf(fp,"    \"discarded\": %lu\n",sinkPolicyDiscarded(&stripe->policy));
+                fprintf(fp,"  }%s\n",(i+1<striping->numberOfStripes) ? "," : "");
+            }
+            fprintf(fp,"],\n");
+        }
+        if (statistics->clockMapping!=0)
+        {
+            struct ClockMapping * clockMapping = statistics->clockMapping;
+            fprintf(fp,"\"clockMapping\": {\n");
+            fprintf(fp,"  \"window\": %u,\n",clockMapping->window);
+            fprintf(fp,"  \"frames\": %lu,\n",clockMapping->frames);
+            fprintf(fp,"  \"mapped\": %lu,\n",clockMapping->mapped);
+            fprintf(fp,"  \"resets\": %lu,\n",clockMapping->resets);
+            fprintf(fp,"  \"refits\": %lu,\n",clockMapping->refits);
+            fprintf(fp,"  \"driftPpm\": %f,\n",(clockMapping->valid) ? (clockMapping->fit.drift-1.0)*1000000.0 : 0.0);
+            fprintf(fp,"  \"residualMicroseconds\": %f,\n",(clockMapping->valid) ? clockMapping->fit.residual/1000.0 : 0.0);
+            fprintf(fp,"  \"maxResidualMicroseconds\": %f,\n",clockMapping->maxResidual/1000.0);
+            fprintf(fp,"  \"averageLatencyMicroseconds\": %f,\n",(clockMapping->mapped!=0) ? clockMapping->totalLatency/clockMapping->mapped/1000.0 : 0.0);
+            fprintf(fp,"  \"maxLatencyMicroseconds\": %f\n",clockMapping->maxLatency/1000.0);
+            fprintf(fp,"},\n");
+        }
+        if (statistics->timeLapse!=0)
+        {
+            struct TimeLapse * timeLapse = statistics->timeLapse;
+            fprintf(fp,"\"timeLapse\": {\n");
+            fprintf(fp,"  \"intervalMicroseconds\": %lu,\n",timeLapse->intervalMicroseconds);
+            fprintf(fp,"  \"triggers\": %lu,\n",timeLapse->triggers);
+            fprintf(fp,"  \"frames\": %lu,\n",timeLapse->frames);
+            fprintf(fp,"  \"timeouts\": %lu,\n",timeLapse->timeouts);
+            fprintf(fp,"  \"staleFrames\": %lu,\n",timeLapse->staleFrames);
+            fprintf(fp,"  \"missedDeadlines\": %lu,\n",timeLapse->missedDeadlines);
+            fprintf(fp,"  \"failures\": %lu,\n",timeLapse->failures);
+            fprintf(fp,"  \"averageLatencyMicroseconds\": %f,\n",(timeLapse->frames!=0) ? (double) timeLapse->totalLatencyMicroseconds/timeLapse->frames : 0.0);
+            fprintf(fp,"  \"minLatencyMicroseconds\": %lu,\n",timeLapse->minLatencyMicroseconds);
+            fprintf(fp,"  \"maxLatencyMicroseconds\": %lu,\n",timeLapse->maxLatencyMicroseconds);
+            fprintf(fp,"  \"averageLatenessMicroseconds\": %f,\n",(timeLapse->triggers!=0) ? (double) timeLapse->totalLatenessMicroseconds/timeLapse->triggers : 0.0);
+            fprintf(fp,"  \"maxLatenessMicroseconds\": %lu\n",timeLapse->maxLatenessMicroseconds);
+            fprintf(fp,"},\n");
+        }
+        if (statistics->frameLoss!=0)
+        {
+            struct FrameLossTracker * frameLoss = statistics->frameLoss;
+            unsigned long sinkDiscarded = 0;
+            unsigned int i=0;
+            for (i=0; i<statistics->numberOfSinkPolicies; i++) { sinkDiscarded += sinkPolicyDiscarded(statistics->sinkPolicies[i]); }
+            fprintf(fp,"\"frameLoss\": {\n");
+            fprintf(fp,"  \"buffers\": %lu,\n",frameLoss->buffers);
+            fprintf(fp,"  \"lost\": %lu,\n",frameLoss->lost);
+            for (i=0; i<FRAME_LOSS_CAUSES; i++)
+                { fprintf(fp,"  \"%s\": %lu,\n",frameLossCauseName((enum FrameLossCause) i),frameLoss->lostByCause[i]); }
+            fprintf(fp,"  \"sinkDiscarded\": %lu,\n",sinkDiscarded);
+            fprintf(fp,"  \"gaps\": %lu,\n",frameLoss->gaps);
+            fprintf(fp,"  \"longestGap\": %lu,\n",frameLoss->longestGap);
+            fprintf(fp,"  \"idResets\": %lu,\n",frameLoss->idResets);
+            fprintf(fp,"  \"gapHistogram\": {");
+            for (i=0; i<FRAME_LOSS_HISTOGRAM_BINS; i++)
+            {
+                char label[32];
+                frameLossHistogramLabel(i,label,sizeof(label));
+                fprintf(fp,"%s\"%s\": %lu",(i==0) ? " " : ", ",label,frameLoss->gapHistogram[i]);
+            }
+            fprintf(fp," }\n");
+            fprintf(fp,"},\n");
+        }
+        if (statistics->numberOfSinkPolicies!=0)
+        {
+            fprintf(fp,"\"sinks\": {\n");
+            unsigned int i=0;
+            for (i=0; i<statistics->numberOfSinkPolicies; i++)
+            {
+                struct SinkPolicy * policy = statistics->sinkPolicies[i];
+                fprintf(fp,"  \"%s\": {\n",policy->name);
+                fprintf(fp,"    \"policy\": \"%s\",\n",sinkPolicyName(policy->type));
+                fprintf(fp,"    \"decimation\": %u,\n",(policy->type==SINK_POLICY_DECIMATE) ? policy->decimation : 1);
+                fprintf(fp,"    \"submitted\": %lu,\n",policy->submitted);
+                fprintf(fp,"    \"accepted\": %lu,\n",policy->accepted);
+                fprintf(fp,"    \"decimated\": %lu,\n",policy->decimated);
+                fprintf(fp,"    \"droppedNewest\": %lu,\n",policy->droppedNewest);
+                fprintf(fp,"    \"droppedOldest\": %lu,\n",policy->droppedOldest);
+                fprintf(fp,"    \"blocked\": %lu,\n",policy->blocked);
+                fprintf(fp,"    \"blockedMicroseconds\": %lu,\n",policy->blockedMicroseconds);
+                fprintf(fp,"    \"maxBlockedMicroseconds\": %lu,\n",policy->maxBlockedMicroseconds);
+                fprintf(fp,"    \"maxQueued\": %u\n",policy->maxQueued);
+                fprintf(fp,"  }%s\n",(i+1<statistics->numberOfSinkPolicies) ? "," : "");
+            }
+            fprintf(fp,"},\n");
+        }
+        fprintf(fp,"\"startup\": {\n");
+        fprintf(fp,"  \"discoveryMicroseconds\": %lu,\n",statistics->startupDiscovery);
+        fprintf(fp,"  \"openMicroseconds\": %lu,\n",statistics->startupOpen);
+        fprintf(fp,"  \"genicamMicroseconds\": %lu,\n",statistics->startupGenicam);
+        fprintf(fp,"  \"streamMicroseconds\": %lu,\n",statistics->startupStream);
+        fprintf(fp,"  \"firstFrameMicroseconds\": %lu\n",statistics->startupFirstFrame);
+        fprintf(fp,"}\n}\n");
+        fclose(fp);
+        return 1;
+    }
+    fprintf(stderr,"Could not write statistics to %s\n",filename);
+    return 0;
+}
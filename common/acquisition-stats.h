@@ -0,0 +1,114 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef ACQUISITION_STATS_H_INCLUDED
+#define ACQUISITION_STATS_H_INCLUDED
+
+#include "frame-statistics.h"
+
+struct AutoExposureController;
+struct FrameCorrection;
+struct FrameFanOut;
+struct FrameLossTracker;
+struct FrameRing;
+struct FrameStack;
+struct GigETransport;
+struct ChangeDetector;
+struct ClockMapping;
+struct ColorConverter;
+struct JpegSink;
+struct LiveConfig;
+struct RecordingJournal;
+struct SharedFrameRing;
+struct SinkPolicy;
+struct StripedRecording;
+struct TimeLapse;
+
+#define ACQUISITION_MAX_SINKS 8
+
+// Summary of one acquisition run, written by the grabber and the streamer
+// through --stats <file> so that scripts (see benchmarks/) can consume it.
+// Keep the field names stable, they are part of the benchmark result format.
+struct AcquisitionStatistics
+{
+    unsigned long framesGrabbed;
+    unsigned long framesDropped;
+    unsigned long elapsedMicroseconds;
+
+    //Counters of the Aravis stream
+    unsigned long completedBuffers;
+    unsigned long failures;
+    unsigned long underruns;
+
+    //What the run was asked to do
+    unsigned int  width;
+    unsigned int  height;
+    unsigned int  buffers;
+    double        requestedFrameRate;
+    const char *  pixelFormat;
+
+    //Startup breakdown in microseconds, see struct StartupTimes
+    unsigned long startupDiscovery;
+    unsigned long startupOpen;
+    unsigned long startupGenicam;
+    unsigned long startupStream;
+    unsigned long startupFirstFrame;
+
+    //Totals of the per frame exposure statistics, NULL when --framestats was not given
+    struct FrameStatisticsState * frameStatistics;
+
+    //Software auto exposure controller, NULL when --autoexposure was not given
+    struct AutoExposureController * autoExposure;
+
+    //Pre-trigger ring, NULL when --preTrigger was not given
+    struct FrameRing * frameRing;
+
+    //Change detection recording, NULL when --changeThreshold was not given
+    struct ChangeDetector * changeDetector;
+
+    //JPEG output, NULL when --jpeg was not given
+    struct JpegSink * jpegSink;
+
+    //Dark frame and flat field correction, NULL without --dark or --flat
+    struct FrameCorrection * frameCorrection;
+
+    //Temporal stacking, NULL when --stack was not given
+    struct FrameStack * frameStack;
+
+    //NV12 / YUV420 shared memory stream, NULL when --yuv was not given
+    struct ColorConverter * colorConverter;
+
+    //Zero copy consumer ring, NULL when --shmRing was not given
+    struct SharedFrameRing * shmRing;
+
+    //Crash safe recording, NULL when --journal was not given
+    struct RecordingJournal * journal;
+
+    //Live reconfiguration, NULL when it could not start
+    struct LiveConfig * liveConfig;
+
+    //Camera timestamps mapped to the host clock
+    struct ClockMapping * clockMapping;
+
+    //Software triggered time-lapse, NULL without --timelapse or when the camera could not be triggered
+    struct TimeLapse * timeLapse;
+
+    //Lost frames by cause and gap length, see frame-loss.h
+    struct FrameLossTracker * frameLoss;
+
+    //Frames shared by the sinks below, NULL when no sink runs on its own thread
+    struct FrameFanOut * fanOut;
+
+    //Frame files striped over several -o roots, NULL with one root
+    struct StripedRecording * stripedRecording;
+
+    //Backpressure policy of every queued sink, see sink-queue.h
+    struct SinkPolicy * sinkPolicies[ACQUISITION_MAX_SINKS];
+    unsigned int numberOfSinkPolicies;
+
+    //GigE transport tuning, NULL unless a --gv option was given for a GigE camera
+    struct GigETransport * gigeTransport;
+};
+
+int writeAcquisitionStatistics(const char * filename,struct AcquisitionStatistics * statistics);
+
+#endif // ACQUISITION_STATS_H_INCLUDED
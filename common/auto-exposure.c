@@ -0,0 +1,259 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "auto-exposure.h"
+#include "timing.h"
+
+/* Standard headers */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Smallest changes worth a feature write
+#define EXPOSURE_RESOLUTION 0.005 // Relative
+#define GAIN_RESOLUTION     0.05  // dB
+
+void setDefaultAutoExposureSettings(struct AutoExposureSettings * settings)
+{
+    memset(settings,0,sizeof(struct AutoExposureSettings));
+    settings->target       = 0.45;
+    settings->deadband     = 0.04;
+    settings->maxStepRatio = 2.0;
+    settings->settleFrames = 8;
+}
+
+static double clampDouble(double value,double minimum,double maximum)
+{
+    if (value<minimum) { return minimum; }
+    if (value>maximum) { return maximum; }
+    return value;
+}
+
+// Gain is handled in dB as the SFNC defines it, exposure in μsec
+static double gainToRatio(double dB)
+{
+    return pow(10.0,dB/20.0);
+}
+
+static double ratioToGain(double ratio)
+{
+    return 20.0 * log10(ratio);
+}
+
+static void checkPendingCorrection(struct AutoExposureController * controller,unsigned long frameNumber,float brightness)
+{
+    float expectedChange = controller->brightnessExpected - controller->brightnessBefore;
+    float change         = brightness - controller->brightnessBefore;
+    unsigned long waited = frameNumber - controller->pendingFrame;
+
+    //Half of the expected change in the right direction means the new values reached the sensor
+    if ( (waited>0) && (change*expectedChange>0) && (fabsf(change) >= 0.5 * fabsf(expectedChange)) )
+    {
+        controller->pending = 0;
+        controller->settled += 1;
+        controller->latencyFrames += waited;
+        if (waited>controller->maxLatencyFrames) { controller->maxLatencyFrames=waited; }
+        if (controller->log!=0)
+            { fprintf(controller->log,"frame %lu brightness %0.3f : correction of frame %lu applied, latency %lu frames\n",frameNumber,brightness,controller->pendingFrame,waited); }
+    } else
+    if (waited>controller->settings.settleFrames)
+    {
+        controller->pending = 0;
+        controller->timeouts += 1;
+        if (controller->log!=0)
+            { fprintf(controller->log,"frame %lu brightness %0.3f : correction of frame %lu not visible after %lu frames\n",frameNumber,brightness,controller->pendingFrame,waited); }
+    }
+}
+
+static void controlStep(struct AutoExposureController * controller,unsigned long frameNumber,float brightness)
+{
+    struct AutoExposureSettings * settings = &controller->settings;
+
+    if (controller->pending)
+    {
+        checkPendingCorrection(controller,frameNumber,brightness);
+        if (controller->pending) { return; }
+    }
+
+    //Hysteresis, start correcting outside of the deadband and stop well inside of it
+    float error = fabsf(brightness - settings->target);
+    if (!controller->correcting)
+    {
+        if (error<=settings->deadband) { return; }
+        controller->correcting = 1;
+    } else
+    if (error<settings->deadband/2)
+    {
+        controller->correcting = 0;
+        return;
+    }
+
+    double ratio = (brightness>0.001) ? settings->target / brightness : settings->maxStepRatio;
+    ratio = clampDouble(ratio,1.0/settings->maxStepRatio,settings->maxStepRatio);
+
+    double exposure = controller->exposure;
+    double gain     = controller->gain;
+    if (ratio>1.0)
+    {   //Brighter : exposure first, the rest with gain
+        exposure = clampDouble(controller->exposure*ratio,settings->minExposure,settings->maxExposure);
+        double rest = ratio * controller->exposure / exposure;
+        if (rest>1.0)
+            { gain = clampDouble(controller->gain + ratioToGain(rest),settings->minGain,settings->maxGain); }
+    } else
+    {   //Darker : gain first, the rest with exposure
+        gain = clampDouble(controller->gain + ratioToGain(ratio),settings->minGain,settings->maxGain);
+        double rest = ratio / gainToRatio(gain - controller->gain);
+        if (rest<1.0)
+            { exposure = clampDouble(controller->exposure*rest,settings->minExposure,settings->maxExposure); }
+    }
+
+    char writeExposure = (fabs(exposure - controller->exposure) > controller->exposure*EXPOSURE_RESOLUTION);
+    char writeGain     = (fabs(gain - controller->gain) > GAIN_RESOLUTION);
+    if ( (!writeExposure) && (!writeGain) ) { return; } //At the limits
+
+    //Both writes go out back to back on this thread, the acquisition thread never waits for them
+    unsigned long startTime = monotonicMicroseconds();
+    GError * error_ = NULL;
+    if (writeExposure)
+    {
+        arv_camera_set_exposure_time(controller->camera,exposure,&error_);
+        if (error_==NULL) { controller->featureWrites += 1; } else { exposure=controller->exposure; g_clear_error(&error_); writeExposure=0; }
+    }
+    if (writeGain)
+    {
+        arv_camera_set_gain(controller->camera,gain,&error_);
+        if (error_==NULL) { controller->featureWrites += 1; } else { gain=controller->gain; g_clear_error(&error_); writeGain=0; }
+    }
+    unsigned long writeTime = monotonicMicroseconds() - startTime;
+    controller->writeMicroseconds += writeTime;
+    if ( (!writeExposure) && (!writeGain) ) { return; }
+
+    double applied = (exposure / controller->exposure) * gainToRatio(gain - controller->gain);
+    controller->exposure = exposure;
+    controller->gain     = gain;
+    controller->corrections += 1;
+
+    controller->pending            = 1;
+    controller->pendingFrame       = frameNumber;
+    controller->brightnessBefore   = brightness;
+    controller->brightnessExpected = (float) clampDouble(brightness*applied,0.0,1.0);
+
+    if (controller->log!=0)
+    {
+        fprintf(controller->log,"frame %lu brightness %0.3f : exposure %0.1f μsec, gain %0.2f dB (x%0.3f, written in %lu μsec)\n",
+                frameNumber,brightness,exposure,gain,applied,writeTime);
+        fflush(controller->log);
+    }
+}
+
+static void * autoExposureThread(void * argument)
+{
+    struct AutoExposureController * controller = (struct AutoExposureController *) argument;
+
+    pthread_mutex_lock(&controller->lock);
+    while (!controller->stop)
+    {
+        if (!controller->hasMeasurement)
+        {
+            pthread_cond_wait(&controller->wake,&controller->lock);
+            continue;
+        }
+
+        unsigned long frameNumber = controller->measurementFrame;
+        float brightness          = controller->measurementBrightness;
+        controller->hasMeasurement = 0;
+
+        pthread_mutex_unlock(&controller->lock);
+        controlStep(controller,frameNumber,brightness);
+        pthread_mutex_lock(&controller->lock);
+    }
+    pthread_mutex_unlock(&controller->lock);
+    return 0;
+}
+
+int startAutoExposure(struct AutoExposureController * controller,ArvCamera * camera,struct AutoExposureSettings * settings,FILE * log)
+{
+    if ( (controller==0) || (camera==0) || (settings==0) ) { return 0; }
+    memset(controller,0,sizeof(struct AutoExposureController));
+    controller->camera   = camera;
+    controller->settings = *settings;
+    controller->log      = log;
+
+    //The on-board loops would fight this one
+    if (arv_camera_is_exposure_auto_available(camera,NULL))
+        { arv_camera_set_exposure_time_auto(camera,ARV_AUTO_OFF,NULL); }
+    if (arv_camera_is_gain_auto_available(camera,NULL))
+        { arv_camera_set_gain_auto(camera,ARV_AUTO_OFF,NULL); }
+
+    GError * error = NULL;
+    double minimum=0.0,maximum=0.0;
+    arv_camera_get_exposure_time_bounds(camera,&minimum,&maximum,&error);
+    if (error!=NULL)
+    {
+        fprintf(stderr,"Auto exposure : could not read the exposure bounds (%s)\n",error->message);
+        g_clear_error(&error);
+        return 0;
+    }
+    if ( (controller->settings.minExposure==0.0) || (controller->settings.minExposure<minimum) ) { controller->settings.minExposure=minimum; }
+    if ( (controller->settings.maxExposure==0.0) || (controller->settings.maxExposure>maximum) ) { controller->settings.maxExposure=maximum; }
+
+    //Cameras without gain are driven with exposure only
+    arv_camera_get_gain_bounds(camera,&minimum,&maximum,&error);
+    if (error!=NULL) { g_clear_error(&error); minimum=0.0; maximum=0.0; }
+    if ( (controller->settings.minGain==0.0) || (controller->settings.minGain<minimum) ) { controller->settings.minGain=minimum; }
+    if ( (controller->settings.maxGain==0.0) || (controller->settings.maxGain>maximum) ) { controller->settings.maxGain=maximum; }
+
+    controller->exposure = arv_camera_get_exposure_time(camera,NULL);
+    controller->gain     = arv_camera_get_gain(camera,NULL);
+    controller->exposure = clampDouble(controller->exposure,controller->settings.minExposure,controller->settings.maxExposure);
+
+    pthread_mutex_init(&controller->lock,NULL);
+    pthread_cond_init(&controller->wake,NULL);
+    if (pthread_create(&controller->thread,NULL,autoExposureThread,controller)!=0)
+    {
+        fprintf(stderr,"Auto exposure : could not start the controller thread\n");
+        pthread_cond_destroy(&controller->wake);
+        pthread_mutex_destroy(&controller->lock);
+        return 0;
+    }
+    controller->threadStarted = 1;
+
+    fprintf(stderr,"Auto exposure : target %0.2f, exposure %0.1f μsec [%0.1f..%0.1f], gain %0.2f dB [%0.2f..%0.2f]\n",
+            controller->settings.target,
+            controller->exposure,controller->settings.minExposure,controller->settings.maxExposure,
+            controller->gain,controller->settings.minGain,controller->settings.maxGain);
+    return 1;
+}
+
+void submitAutoExposureMeasurement(struct AutoExposureController * controller,unsigned long frameNumber,float brightness)
+{
+    if ( (controller==0) || (!controller->threadStarted) ) { return; }
+
+    pthread_mutex_lock(&controller->lock);
+    if (controller->hasMeasurement) { controller->skippedMeasurements += 1; } //The controller is still busy with the camera
+    controller->hasMeasurement        = 1;
+    controller->measurementFrame      = frameNumber;
+    controller->measurementBrightness = brightness;
+    controller->measurements += 1;
+    pthread_cond_signal(&controller->wake);
+    pthread_mutex_unlock(&controller->lock);
+}
+
+void stopAutoExposure(struct AutoExposureController * controller)
+{
+    if ( (controller==0) || (!controller->threadStarted) ) { return; }
+
+    pthread_mutex_lock(&controller->lock);
+    controller->stop = 1;
+    pthread_cond_signal(&controller->wake);
+    pthread_mutex_unlock(&controller->lock);
+
+    pthread_join(controller->thread,NULL);
+    pthread_cond_destroy(&controller->wake);
+    pthread_mutex_destroy(&controller->lock);
+    controller->threadStarted = 0;
+
+    fprintf(stderr,"Auto exposure : %lu corrections over %lu frames (%lu skipped while busy), %lu applied after %0.2f frames on average (max %lu), %lu not visible\n",
+            controller->corrections,controller->measurements,controller->skippedMeasurements,
+            controller->settled,(controller->settled!=0) ? (double) controller->latencyFrames/controller->settled : 0.0,
+            controller->maxLatencyFrames,controller->timeouts);
+}
@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef AUTO_EXPOSURE_H_INCLUDED
+#define AUTO_EXPOSURE_H_INCLUDED
+
+/* Aravis header */
+#include <arv.h>
+
+/* Standard headers */
+#include <stdio.h>
+#include <pthread.h>
+
+// Software auto exposure / auto gain for cameras without a usable on-board one.
+//
+// The acquisition thread hands the brightness of every frame (see
+// frame-statistics.h) to submitAutoExposureMeasurement(), which only copies it
+// and wakes the controller thread. The controller always works on the newest
+// measurement, so a slow control channel makes it skip frames instead of
+// stalling acquisition, and writes exposure and gain together from its own
+// thread. Brightness is raised with exposure first, then gain, and lowered
+// with gain first, then exposure.
+//
+// A correction starts once the brightness is further than the deadband from the
+// target and stops when it is back within half of it, each correction changes
+// exposure x gain by at most maxStepRatio, and no new correction is written
+// until the previous one showed up in the frames (or settleFrames went by).
+// The number of frames that took is logged as the control latency.
+
+struct AutoExposureSettings
+{
+    float target;                  // Wanted mean brightness, fraction of full scale
+    float deadband;                // Tolerated distance from the target before correcting
+    float maxStepRatio;            // Largest exposure x gain change of one correction
+    unsigned int settleFrames;     // Frames to wait for a correction to show before the next one
+    double minExposure,maxExposure; // μsec, 0 uses the camera bounds
+    double minGain,maxGain;         // dB, 0 uses the camera bounds
+};
+
+struct AutoExposureController
+{
+    ArvCamera * camera;
+    struct AutoExposureSettings settings;
+    FILE * log;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;
+    char threadStarted;
+    char stop;
+
+    //Newest measurement, written by the acquisition thread
+    char hasMeasurement;
+    unsigned long measurementFrame;
+    float measurementBrightness;
+
+    //Controller state, only touched by the controller thread
+    double exposure;
+    double gain;
+    char correcting;
+    char pending;
+    unsigned long pendingFrame;
+    float brightnessBefore;
+    float brightnessExpected;
+
+    //Totals for the --stats output
+    unsigned long measurements;
+    unsigned long skippedMeasurements;
+    unsigned long corrections;
+    unsigned long featureWrites;
+    unsigned long writeMicroseconds;
+    unsigned long settled;
+    unsigned long timeouts;
+    unsigned long latencyFrames;
+    unsigned long maxLatencyFrames;
+};
+
+void setDefaultAutoExposureSettings(struct AutoExposureSettings * settings);
+
+// Reads the current exposure, gain and their bounds, turns the on-board auto modes off and starts the controller thread
+int startAutoExposure(struct AutoExposureController * controller,ArvCamera * camera,struct AutoExposureSettings * settings,FILE * log);
+
+// Never blocks on the camera, brightness is the mean level as a fraction of full scale
+void submitAutoExposureMeasurement(struct AutoExposureController * controller,unsigned long frameNumber,float brightness);
+
+void stopAutoExposure(struct AutoExposureController * controller);
+
+#endif // AUTO_EXPOSURE_H_INCLUDED
@@ -0,0 +1,282 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "change-detection.h"
+#include "timing.h"
+
+/* Standard headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CHANGE_DETECTION_X86 1
+#endif
+
+// Sum of absolute differences of one 32 pixel wide block column, over rows rows
+typedef unsigned int (*BlockKernel)(const unsigned char * a,const unsigned char * b,unsigned int stride,unsigned int rows);
+
+//----------------------------------------------------------------------------------------
+// Kernels
+//----------------------------------------------------------------------------------------
+static unsigned int blockSADScalar(const unsigned char * a,const unsigned char * b,unsigned int stride,unsigned int rows)
+{
+    unsigned int sum = 0;
+    unsigned int x,y;
+    for (y=0; y<rows; y++)
+    {
+        for (x=0; x<CHANGE_DETECTION_BLOCK; x++)
+        {
+            int difference = (int) a[x] - (int) b[x];
+            sum += (difference<0) ? -difference : difference;
+        }
+        a += stride;
+        b += stride;
+    }
+    return sum;
+}
+
+#if CHANGE_DETECTION_X86
+__attribute__((target("sse2")))
+static unsigned int blockSADSSE2(const unsigned char * a,const unsigned char * b,unsigned int stride,unsigned int rows)
+{
+    __m128i accumulator = _mm_setzero_si128();
+    unsigned int y;
+    for (y=0; y<rows; y++)
+    {
+        __m128i a0 = _mm_loadu_si128((const __m128i *) a);
+        __m128i a1 = _mm_loadu_si128((const __m128i *) (a+16));
+        __m128i b0 = _mm_loadu_si128((const __m128i *) b);
+        __m128i b1 = _mm_loadu_si128((const __m128i *) (b+16));
+        accumulator = _mm_add_epi64(accumulator,_mm_sad_epu8(a0,b0));
+        accumulator = _mm_add_epi64(accumulator,_mm_sad_epu8(a1,b1));
+        a += stride;
+        b += stride;
+    }
+    return (unsigned int) (_mm_cvtsi128_si32(accumulator) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(accumulator,accumulator)));
+}
+
+__attribute__((target("avx2")))
+static unsigned int blockSADAVX2(const unsigned char * a,const unsigned char * b,unsigned int stride,unsigned int rows)
+{
+    __m256i accumulator = _mm256_setzero_si256();
+    unsigned int y;
+    for (y=0; y<rows; y++)
+    {
+        __m256i va = _mm256_loadu_si256((const __m256i *) a);
+        __m256i vb = _mm256_loadu_si256((const __m256i *) b);
+        accumulator = _mm256_add_epi64(accumulator,_mm256_sad_epu8(va,vb));
+        a += stride;
+        b += stride;
+    }
+    __m128i folded = _mm_add_epi64(_mm256_castsi256_si128(accumulator),_mm256_extracti128_si256(accumulator,1));
+    return (unsigned int) (_mm_cvtsi128_si32(folded) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(folded,folded)));
+}
+#endif // CHANGE_DETECTION_X86
+
+struct ChangeDetectionKernel
+{
+    const char * name;
+    BlockKernel block;
+};
+
+static const struct ChangeDetectionKernel kernels[] =
+{
+#if CHANGE_DETECTION_X86
+    { "avx2",   blockSADAVX2   },
+    { "sse2",   blockSADSSE2   },
+#endif
+    { "scalar", blockSADScalar }
+};
+#define NUMBER_OF_KERNELS (sizeof(kernels)/sizeof(kernels[0]))
+
+static const struct ChangeDetectionKernel * selectedKernel = 0;
+
+static int cpuCanRun(const struct ChangeDetectionKernel * kernel)
+{
+#if CHANGE_DETECTION_X86
+    if (strcmp(kernel->name,"avx2")==0) { return __builtin_cpu_supports("avx2"); }
+    if (strcmp(kernel->name,"sse2")==0) { return __builtin_cpu_supports("sse2"); }
+#endif
+    return 1;
+}
+
+static const struct ChangeDetectionKernel * currentKernel()
+{
+    if (selectedKernel==0)
+    {
+        //Kernels are listed fastest first
+        unsigned int i=0;
+        for (i=0; i<NUMBER_OF_KERNELS; i++)
+        {
+            if (cpuCanRun(&kernels[i])) { selectedKernel=&kernels[i]; break; }
+        }
+    }
+    return selectedKernel;
+}
+
+const char * changeDetectionKernel()
+{
+    return currentKernel()->name;
+}
+
+int selectChangeDetectionKernel(const char * name)
+{
+    unsigned int i=0;
+    for (i=0; i<NUMBER_OF_KERNELS; i++)
+    {
+        if ( (strcmp(kernels[i].name,name)==0) && (cpuCanRun(&kernels[i])) )
+        {
+            selectedKernel=&kernels[i];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void computeBlockDifferences(const unsigned char * a,const unsigned char * b,unsigned int width,unsigned int height,unsigned int * blockSums)
+{
+    const struct ChangeDetectionKernel * kernel = currentKernel();
+    unsigned int blocksX = (width  + CHANGE_DETECTION_BLOCK-1) / CHANGE_DETECTION_BLOCK;
+    unsigned int fullBlocksX = width / CHANGE_DETECTION_BLOCK;
+    unsigned int y,bx;
+
+    for (y=0; y<height; y+=CHANGE_DETECTION_BLOCK)
+    {
+        unsigned int rows = (y+CHANGE_DETECTION_BLOCK<=height) ? CHANGE_DETECTION_BLOCK : height-y;
+        const unsigned char * rowA = a + (size_t) y*width;
+        const unsigned char * rowB = b + (size_t) y*width;
+        unsigned int * sums = blockSums + (y/CHANGE_DETECTION_BLOCK)*blocksX;
+
+        for (bx=0; bx<fullBlocksX; bx++)
+        {
+            sums[bx] = kernel->block(rowA + bx*CHANGE_DETECTION_BLOCK,rowB + bx*CHANGE_DETECTION_BLOCK,width,rows);
+        }
+
+        //Narrower block on the right edge
+        if (fullBlocksX<blocksX)
+        {
+            unsigned int x0 = fullBlocksX*CHANGE_DETECTION_BLOCK;
+            unsigned int sum = 0;
+            unsigned int r,x;
+            for (r=0; r<rows; r++)
+            {
+                for (x=x0; x<width; x++)
+                {
+                    int difference = (int) rowA[(size_t) r*width+x] - (int) rowB[(size_t) r*width+x];
+                    sum += (difference<0) ? -difference : difference;
+                }
+            }
+            sums[fullBlocksX] = sum;
+        }
+    }
+}
+
+//----------------------------------------------------------------------------------------
+void initializeChangeDetector(struct ChangeDetector * detector,float threshold,float minChangedFraction,unsigned int keyframeInterval)
+{
+    memset(detector,0,sizeof(struct ChangeDetector));
+    detector->threshold          = threshold;
+    detector->minChangedFraction = minChangedFraction;
+    detector->keyframeInterval   = keyframeInterval;
+    currentKernel();
+}
+
+static int keepAsReference(struct ChangeDetector * detector,const unsigned char * pixels,unsigned int width,unsigned int height)
+{
+    unsigned long size = (unsigned long) width*height;
+    if (size>detector->referenceSize)
+    {
+        unsigned char * reference = (unsigned char *) realloc(detector->reference,size);
+        if (reference==0) { return 0; }
+        detector->reference     = reference;
+        detector->referenceSize = size;
+    }
+    memcpy(detector->reference,pixels,size);
+    detector->width  = width;
+    detector->height = height;
+    detector->framesSinceKept = 0;
+    return 1;
+}
+
+int changeDetectorKeepFrame(struct ChangeDetector * detector,const unsigned char * pixels,unsigned int width,unsigned int height)
+{
+    if ( (detector==0) || (pixels==0) || (width==0) || (height==0) ) { return 1; }
+
+    unsigned long startTime = monotonicMicroseconds();
+    detector->framesCompared    += 1;
+    detector->changedBlocks      = 0;
+    detector->maxBlockDifference = 0.0;
+    detector->keyframe           = 0;
+
+    //Nothing to compare against, or the frame size changed
+    if ( (detector->reference==0) || (detector->width!=width) || (detector->height!=height) )
+    {
+        detector->keyframe = 1;
+        return 1;
+    }
+
+    unsigned int blocksX = (width  + CHANGE_DETECTION_BLOCK-1) / CHANGE_DETECTION_BLOCK;
+    unsigned int blocksY = (height + CHANGE_DETECTION_BLOCK-1) / CHANGE_DETECTION_BLOCK;
+    unsigned int blocks  = blocksX*blocksY;
+    if (blocks>detector->allocatedBlocks)
+    {
+        unsigned int * blockSums = (unsigned int *) realloc(detector->blockSums,sizeof(unsigned int)*blocks);
+        if (blockSums==0) { return 1; }
+        detector->blockSums       = blockSums;
+        detector->allocatedBlocks = blocks;
+    }
+    detector->blocks = blocks;
+
+    computeBlockDifferences(pixels,detector->reference,width,height,detector->blockSums);
+
+    //Compare sums against the threshold scaled by the pixel count of each block, edge blocks are smaller
+    unsigned int bx,by;
+    for (by=0; by<blocksY; by++)
+    {
+        unsigned int blockHeight = (by<blocksY-1) ? CHANGE_DETECTION_BLOCK : height - by*CHANGE_DETECTION_BLOCK;
+        for (bx=0; bx<blocksX; bx++)
+        {
+            unsigned int blockWidth = (bx<blocksX-1) ? CHANGE_DETECTION_BLOCK : width - bx*CHANGE_DETECTION_BLOCK;
+            float difference = (float) detector->blockSums[by*blocksX+bx] / (blockWidth*blockHeight);
+            if (difference>detector->threshold)           { detector->changedBlocks += 1; }
+            if (difference>detector->maxBlockDifference)  { detector->maxBlockDifference = difference; }
+        }
+    }
+
+    unsigned int requiredBlocks = (unsigned int) (detector->minChangedFraction * blocks + 0.999);
+    if (requiredBlocks==0) { requiredBlocks=1; }
+
+    detector->framesSinceKept += 1;
+    int keep = (detector->changedBlocks>=requiredBlocks);
+    if ( (!keep) && (detector->keyframeInterval!=0) && (detector->framesSinceKept>=detector->keyframeInterval) )
+    {
+        keep = 1;
+        detector->keyframe = 1;
+    }
+    if (!keep) { detector->framesSkipped += 1; }
+
+    unsigned long elapsed = monotonicMicroseconds() - startTime;
+    detector->totalMicroseconds += elapsed;
+    if (elapsed>detector->maxMicroseconds) { detector->maxMicroseconds=elapsed; }
+    return keep;
+}
+
+void changeDetectorFrameKept(struct ChangeDetector * detector,const unsigned char * pixels,unsigned int width,unsigned int height)
+{
+    if ( (detector==0) || (pixels==0) || (width==0) || (height==0) ) { return; }
+    if (!keepAsReference(detector,pixels,width,height)) { return; }
+    detector->framesKept += 1;
+    if (detector->keyframe) { detector->keyframes += 1; }
+}
+
+void destroyChangeDetector(struct ChangeDetector * detector)
+{
+    if (detector==0) { return; }
+    free(detector->reference);
+    free(detector->blockSums);
+    detector->reference = 0;
+    detector->blockSums = 0;
+    detector->referenceSize   = 0;
+    detector->allocatedBlocks = 0;
+}
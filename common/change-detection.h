@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef CHANGE_DETECTION_H_INCLUDED
+#define CHANGE_DETECTION_H_INCLUDED
+
+// Change detection recording : a frame is only worth writing when it differs
+// from the last frame that was written. Both frames are cut in 32x32 pixel
+// blocks and the sum of absolute differences of every block is computed with
+// an AVX2 or SSE2 kernel picked at runtime. A block changed when its mean
+// absolute difference is above the threshold, the frame changed when at least
+// the given fraction of its blocks (and at least one) did. Every
+// keyframeInterval frames a frame is kept no matter what.
+//
+// Deciding and keeping are two steps : a frame only becomes the reference
+// once a sink took it (changeDetectorFrameKept()). A changed frame that a sink
+// policy then dropped would otherwise become the reference, the frames after
+// it would compare as unchanged and the change would never reach the disk.
+//
+// The comparison works on the raw bytes of the frame, like WritePPM writes
+// them, and needs nothing from Aravis (see benchmarks/change-detection-benchmark.c).
+
+#define CHANGE_DETECTION_BLOCK 32
+
+struct ChangeDetector
+{
+    float threshold;             // Mean absolute difference of a block, in levels
+    float minChangedFraction;    // Of all the blocks
+    unsigned int keyframeInterval; // 0 never forces a frame
+
+    unsigned char * reference;   // Copy of the last kept frame
+    unsigned long referenceSize;
+    unsigned int width;
+    unsigned int height;
+    unsigned int * blockSums;
+    unsigned int allocatedBlocks;
+    unsigned int framesSinceKept; // Compared since the last kept frame
+
+    //Last decision
+    unsigned int changedBlocks;
+    unsigned int blocks;
+    float maxBlockDifference;
+    char keyframe;
+
+    //Totals for the --stats output
+    unsigned long framesCompared;
+    unsigned long framesKept;
+    unsigned long framesSkipped;
+    unsigned long keyframes;
+    unsigned long totalMicroseconds;
+    unsigned long maxMicroseconds;
+};
+
+void initializeChangeDetector(struct ChangeDetector * detector,float threshold,float minChangedFraction,unsigned int keyframeInterval);
+
+// Returns 1 when the frame has to be kept, the reference does not change
+int changeDetectorKeepFrame(struct ChangeDetector * detector,const unsigned char * pixels,unsigned int width,unsigned int height);
+
+// The frame changeDetectorKeepFrame() just kept was written or admitted by a sink, it becomes the new reference
+void changeDetectorFrameKept(struct ChangeDetector * detector,const unsigned char * pixels,unsigned int width,unsigned int height);
+
+// Per block sums of absolute differences of two width x height byte frames, blockSums holds one value per 32x32 block
+void computeBlockDifferences(const unsigned char * a,const unsigned char * b,unsigned int width,unsigned int height,unsigned int * blockSums);
+
+// Name of the kernel picked for this CPU, "avx2", "sse2" or "scalar"
+const char * changeDetectionKernel();
+
+// Force a kernel, for benchmarking. Returns 0 if this CPU cannot run it
+int selectChangeDetectionKernel(const char * name);
+
+void destroyChangeDetector(struct ChangeDetector * detector);
+
+#endif // CHANGE_DETECTION_H_INCLUDED
@@ -0,0 +1,290 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "clock-mapping.h"
+
+/* Standard headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define CLOCK_MAPPING_OUTLIER_SIGMAS 3.0
+#define MAD_TO_SIGMA 1.4826
+
+static int compareDoubles(const void * a,const void * b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x>y) - (x<y);
+}
+
+// Least squares line through the samples kept, returns 0 when they are all at the same device time
+static int fitLine(const double * device,const double * host,const char * keep,unsigned int count,double * intercept,double * slope)
+{
+    double n=0.0, meanDevice=0.0, meanHost=0.0;
+    unsigned int i=0;
+    for (i=0; i<count; i++)
+    {
+        if ( (keep!=0) && (!keep[i]) ) { continue; }
+        n += 1.0; meanDevice += device[i]; meanHost += host[i];
+    }
+    if (n<2.0) { return 0; }
+    meanDevice /= n; meanHost /= n;
+
+    double covariance=0.0, variance=0.0;
+    for (i=0; i<count; i++)
+    {
+        if ( (keep!=0) && (!keep[i]) ) { continue; }
+        double dx = device[i]-meanDevice;
+        covariance += dx*(host[i]-meanHost);
+        variance   += dx*dx;
+    }
+    if (variance<=0.0) { return 0; }
+    *slope     = covariance/variance;
+    *intercept = meanHost - (*slope)*meanDevice;
+    return 1;
+}
+
+int fitClockMapping(const double * device,const double * host,unsigned int count,double * scratch,struct ClockFit * fit)
+{
+    if ( (device==0) || (host==0) || (scratch==0) || (fit==0) || (count<CLOCK_MAPPING_MIN_SAMPLES) ) { return 0; }
+
+    double intercept=0.0, slope=1.0;
+    if (!fitLine(device,host,0,count,&intercept,&slope)) { return 0; }
+
+    //Median and median absolute deviation of the residuals
+    double * residuals = scratch;
+    double * sorted    = scratch+count;
+    unsigned int i=0;
+    for (i=0; i<count; i++) { residuals[i] = host[i] - (intercept + slope*device[i]); sorted[i]=residuals[i]; }
+    qsort(sorted,count,sizeof(double),compareDoubles);
+    double median = sorted[count/2];
+    for (i=0; i<count; i++) { sorted[i] = fabs(residuals[i]-median); }
+    qsort(sorted,count,sizeof(double),compareDoubles);
+    double limit = CLOCK_MAPPING_OUTLIER_SIGMAS * MAD_TO_SIGMA * sorted[count/2];
+    if (limit<1.0) { limit=1.0; } //Nanosecond clocks that agree exactly
+
+    //The residuals are not needed any more, their space holds what is kept
+    char * keep = (char *) sorted;
+    unsigned int inliers = 0;
+    for (i=0; i<count; i++)
+    {
+        keep[i] = (fabs(residuals[i]-median)<=limit);
+        inliers += keep[i];
+    }
+    if ( (inliers>=CLOCK_MAPPING_MIN_SAMPLES) && (inliers<count) )
+        { fitLine(device,host,keep,count,&intercept,&slope); }
+
+    //Down to the fastest arrival kept
+    double lowest=0.0, sum=0.0, sumOfSquares=0.0, highest=0.0;
+    char first = 1;
+    for (i=0; i<count; i++)
+    {
+        if (!keep[i]) { continue; }
+        double residual = host[i] - (intercept + slope*device[i]);
+        if ( (first) || (residual<lowest) )  { lowest=residual; }
+        if ( (first) || (residual>highest) ) { highest=residual; }
+        first = 0;
+        sum          += residual;
+        sumOfSquares += residual*residual;
+    }
+    double mean = sum/inliers;
+    fit->offset     = intercept + lowest;
+    fit->drift      = slope;
+    fit->residual   = sqrt( fmax(0.0,sumOfSquares/inliers - mean*mean) );
+    fit->latency    = mean - lowest;
+    fit->maxLatency = highest - lowest;
+    fit->inliers    = inliers;
+    fit->samples    = count;
+    return 1;
+}
+
+uint64_t systemTimestampToMonotonic(uint64_t systemTimestamp)
+{
+    if (systemTimestamp==0) { return 0; }
+
+    //The realtime reading is taken between two monotonic ones, the offset is to their middle
+    struct timespec before, realtime, after;
+    if ( (clock_gettime(CLOCK_MONOTONIC,&before)!=0) || (clock_gettime(CLOCK_REALTIME,&realtime)!=0) ||
+         (clock_gettime(CLOCK_MONOTONIC,&after)!=0) ) { return 0; }
+    int64_t monotonic = ((int64_t) before.tv_sec + after.tv_sec) * 500000000LL + ((int64_t) before.tv_nsec + after.tv_nsec) / 2;
+    int64_t offset    = (int64_t) realtime.tv_sec * 1000000000LL + realtime.tv_nsec - monotonic;
+
+    int64_t converted = (int64_t) systemTimestamp - offset;
+    return (converted>0) ? (uint64_t) converted : 0;
+}
+
+int createClockMapping(struct ClockMapping * mapping,unsigned int window)
+{
+    if (mapping==0) { return 0; }
+    memset(mapping,0,sizeof(struct ClockMapping));
+    if (window==0) { window=CLOCK_MAPPING_DEFAULT_WINDOW; }
+    if (window<CLOCK_MAPPING_MIN_SAMPLES) { window=CLOCK_MAPPING_MIN_SAMPLES; }
+    mapping->device  = (double *) malloc(sizeof(double)*window);
+    mapping->host    = (double *) malloc(sizeof(double)*window);
+    mapping->scratch = (double *) malloc(sizeof(double)*window*2);
+    if ( (mapping->device==0) || (mapping->host==0) || (mapping->scratch==0) )
+    {
+        destroyClockMapping(mapping);
+        return 0;
+    }
+    mapping->window        = window;
+    mapping->refitInterval = window / CLOCK_MAPPING_REFITS_PER_WINDOW;
+    if (mapping->refitInterval==0) { mapping->refitInterval=1; }
+    return 1;
+}
+
+uint64_t clockMappingToHost(const struct ClockMapping * mapping,uint64_t deviceTimestamp)
+{
+    if ( (mapping==0) || (!mapping->valid) ) { return 0; }
+    double host = mapping->fit.offset + mapping->fit.drift * ((double) deviceTimestamp - (double) mapping->deviceOrigin);
+    if (host < -(double) mapping->hostOrigin) { return 0; }
+    return mapping->hostOrigin + (int64_t) llround(host);
+}
+
+uint64_t mapClockMapping(struct ClockMapping * mapping,uint64_t deviceTimestamp,uint64_t systemTimestamp)
+{
+    if ( (mapping==0) || (mapping->device==0) ) { return systemTimestamp; }
+    mapping->frames += 1;
+    if (deviceTimestamp==0) { return systemTimestamp; } //No camera clock
+
+    if ( (mapping->count==0) || (deviceTimestamp<mapping->lastDevice) )
+    {
+        if (mapping->count!=0) { mapping->resets += 1; }
+        mapping->count        = 0;
+        mapping->next         = 0;
+        mapping->valid        = 0;
+        mapping->sinceFit     = 0;
+        mapping->deviceOrigin = deviceTimestamp;
+        mapping->hostOrigin   = systemTimestamp;
+    }
+    mapping->lastDevice = deviceTimestamp;
+
+    mapping->device[mapping->next] = (double) deviceTimestamp - (double) mapping->deviceOrigin;
+    mapping->host[mapping->next]   = (double) systemTimestamp - (double) mapping->hostOrigin;
+    mapping->next = (mapping->next+1) % mapping->window;
+    if (mapping->count<mapping->window) { mapping->count += 1; }
+
+    //Between refits the frame is mapped with the line of the last fit
+    mapping->sinceFit += 1;
+    if ( (!mapping->valid) || (mapping->sinceFit>=mapping->refitInterval) )
+    {
+        if (fitClockMapping(mapping->device,mapping->host,mapping->count,mapping->scratch,&mapping->fit))
+        {
+            mapping->valid    = 1;
+            mapping->sinceFit = 0;
+            mapping->refits  += 1;
+        }
+    }
+    if (!mapping->valid) { return systemTimestamp; }
+
+    uint64_t hostTimestamp = clockMappingToHost(mapping,deviceTimestamp);
+    if (hostTimestamp==0) { return systemTimestamp; }
+    double latency = (double) systemTimestamp - (double) hostTimestamp;
+    if (latency<0.0) { latency=0.0; } //Faster than every frame of the window so far
+    mapping->mapped       += 1;
+    mapping->totalLatency += latency;
+    if (latency>mapping->maxLatency) { mapping->maxLatency=latency; }
+    if (mapping->fit.residual>mapping->maxResidual) { mapping->maxResidual=mapping->fit.residual; }
+    return hostTimestamp;
+}
+
+void destroyClockMapping(struct ClockMapping * mapping)
+{
+    if (mapping==0) { return; }
+    free(mapping->device);
+    free(mapping->host);
+    free(mapping->scratch);
+    mapping->device  = 0;
+    mapping->host    = 0;
+    mapping->scratch = 0;
+    //window and the fit stay for the --stats output
+}
+
+//----------------------------------------------------------------------------------------
+// Publishing next to a shared memory stream
+//----------------------------------------------------------------------------------------
+int openClockMappingPublisher(struct ClockMappingPublisher * publisher,const char * streamName)
+{
+    if ( (publisher==0) || (streamName==0) ) { return 0; }
+    memset(publisher,0,sizeof(struct ClockMappingPublisher));
+    snprintf(publisher->name,sizeof(publisher->name),"/%s.clock",streamName);
+
+    int fd = shm_open(publisher->name,O_CREAT|O_RDWR,0644);
+    if (fd<0)
+    {
+        fprintf(stderr,"Could not create the shared memory object %s\n",publisher->name);
+        return 0;
+    }
+    if (ftruncate(fd,sizeof(struct ClockMappingShared))!=0)
+    {
+        close(fd);
+        return 0;
+    }
+    void * shared = mmap(NULL,sizeof(struct ClockMappingShared),PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+    close(fd);
+    if (shared==MAP_FAILED) { return 0; }
+    publisher->shared = (struct ClockMappingShared *) shared;
+    memset(publisher->shared,0,sizeof(struct ClockMappingShared));
+    fprintf(stderr,"Camera timestamps mapped to the host clock are published in %s\n",publisher->name);
+    return 1;
+}
+
+void publishClockMapping(struct ClockMappingPublisher * publisher,unsigned int frameNumber,const struct FrameTimestamps * timestamps)
+{
+    if ( (publisher==0) || (publisher->shared==0) || (timestamps==0) ) { return; }
+    struct ClockMappingShared * shared = publisher->shared;
+
+    uint32_t sequence = shared->sequence;
+    __atomic_store_n(&shared->sequence,sequence+1,__ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    shared->frameNumber     = frameNumber;
+    shared->deviceTimestamp = timestamps->device;
+    shared->systemTimestamp = timestamps->system;
+    shared->hostTimestamp   = timestamps->host;
+    __atomic_store_n(&shared->sequence,sequence+2,__ATOMIC_RELEASE);
+}
+
+void closeClockMappingPublisher(struct ClockMappingPublisher * publisher)
+{
+    if ( (publisher==0) || (publisher->shared==0) ) { return; }
+    munmap(publisher->shared,sizeof(struct ClockMappingShared));
+    shm_unlink(publisher->name);
+    publisher->shared = 0;
+}
+
+const struct ClockMappingShared * attachClockMappingShared(const char * streamName)
+{
+    if (streamName==0) { return 0; }
+    char name[80];
+    snprintf(name,sizeof(name),"/%s.clock",streamName);
+    int fd = shm_open(name,O_RDONLY,0);
+    if (fd<0) { return 0; }
+    void * shared = mmap(NULL,sizeof(struct ClockMappingShared),PROT_READ,MAP_SHARED,fd,0);
+    close(fd);
+    if (shared==MAP_FAILED) { return 0; }
+    return (const struct ClockMappingShared *) shared;
+}
+
+void detachClockMappingShared(const struct ClockMappingShared * shared)
+{
+    if (shared!=0) { munmap((void *) shared,sizeof(struct ClockMappingShared)); }
+}
+
+int readClockMappingShared(const struct ClockMappingShared * shared,struct ClockMappingShared * copy)
+{
+    if ( (shared==0) || (copy==0) ) { return 0; }
+    unsigned int attempt=0;
+    for (attempt=0; attempt<1000; attempt++)
+    {
+        uint32_t before = __atomic_load_n(&shared->sequence,__ATOMIC_ACQUIRE);
+        if (before & 1) { continue; }
+        memcpy(copy,(const void *) shared,sizeof(struct ClockMappingShared));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shared->sequence,__ATOMIC_RELAXED)==before) { return 1; }
+    }
+    return 0;
+}
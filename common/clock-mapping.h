@@ -0,0 +1,155 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef CLOCK_MAPPING_H_INCLUDED
+#define CLOCK_MAPPING_H_INCLUDED
+
+/* Standard headers */
+#include <stdint.h>
+
+// Camera to host clock mapping. arv_buffer_get_timestamp() counts in the
+// camera clock, arv_buffer_get_system_timestamp() is when the host got the
+// buffer, which adds the readout, the transport and the scheduling of the
+// stream thread to the moment the camera took the frame, with all their
+// jitter. Neither is what a consumer wants to line frames up with other
+// host events.
+//
+// mapClockMapping() keeps the pairs of the last --clockWindow frames and fits
+//
+//     host = hostOrigin + offset + drift * (device - deviceOrigin)
+//
+// through them : a least squares line, refitted without the pairs further
+// than 3 robust standard deviations (median absolute deviation) from it, so
+// a frame stuck behind a burst of retransmissions does not tilt the line.
+// The line is then moved down to the lower envelope of the arrivals, the
+// frames that came through the fastest. The mapped timestamp is the camera
+// timestamp in the host clock with the transport jitter removed, and what an
+// arrival lies above the envelope is its transport latency beyond the
+// minimum. The fixed part of the latency cannot be told apart from the clock
+// offset without a synchronized (PTP) camera clock.
+//
+// The robust fit sorts the window twice, so the acquisition thread only runs
+// it every window/CLOCK_MAPPING_REFITS_PER_WINDOW frames (16 with the default
+// window), and right away while there is no fit yet. Frames in between are
+// mapped with the current line.
+//
+// The same fit runs offline over a whole frameIndex.bin in frame-index-tool.
+//
+// Camera timestamps that go backwards (a camera restart) start a new window,
+// and cameras without timestamps get their host timestamps back unchanged.
+//
+// The host clock is CLOCK_MONOTONIC in nanoseconds, the clock of
+// GetTickCountMicroseconds(), pipeline-trace.h and the shm-ring.h publish
+// times. arv_buffer_get_system_timestamp() is CLOCK_REALTIME, which NTP steps
+// and slews : a step would land in the window as a burst of outliers or tilt
+// the line. systemTimestampToMonotonic() moves it over before it is fitted.
+
+#define CLOCK_MAPPING_DEFAULT_WINDOW 128
+#define CLOCK_MAPPING_MIN_SAMPLES    8
+#define CLOCK_MAPPING_REFITS_PER_WINDOW 8
+
+struct ClockFit
+{
+    double offset;            // Nanoseconds, host minus device at the origins, lower envelope
+    double drift;             // Host nanoseconds per camera nanosecond
+    double residual;          // Nanoseconds, RMS of the kept arrivals around the least squares line
+    double latency;           // Nanoseconds, mean arrival above the envelope
+    double maxLatency;
+    unsigned int inliers;
+    unsigned int samples;
+};
+
+// Fits host against device, both relative to an origin. scratch holds
+// 2*count doubles, returns 0 with fewer than CLOCK_MAPPING_MIN_SAMPLES
+int fitClockMapping(const double * device,const double * host,unsigned int count,double * scratch,struct ClockFit * fit);
+
+struct ClockMapping
+{
+    unsigned int window;
+    unsigned int refitInterval;   // Pairs added between two fits
+    unsigned int sinceFit;
+
+    //The last window pairs relative to the origins, a ring
+    double * device;
+    double * host;
+    double * scratch;
+    unsigned int count;
+    unsigned int next;
+    uint64_t deviceOrigin;
+    uint64_t hostOrigin;
+    uint64_t lastDevice;
+
+    char valid;               // fit is usable
+    struct ClockFit fit;
+
+    //Totals for the --stats output
+    unsigned long frames;
+    unsigned long mapped;     // Frames that got a fitted timestamp
+    unsigned long resets;     // Camera clock went backwards
+    unsigned long refits;
+    double maxResidual;
+    double totalLatency;      // Nanoseconds, arrival minus mapped timestamp, mapped frames
+    double maxLatency;
+};
+
+// An arv_buffer_get_system_timestamp() in CLOCK_MONOTONIC, with the REALTIME
+// minus MONOTONIC offset sampled now. Call it as the buffer is popped, a step
+// of the realtime clock between the arrival and the call still gets through
+uint64_t systemTimestampToMonotonic(uint64_t systemTimestamp);
+
+// window 0 uses CLOCK_MAPPING_DEFAULT_WINDOW, returns 0 on failure
+int createClockMapping(struct ClockMapping * mapping,unsigned int window);
+
+// Adds the pair of a buffer and returns its camera timestamp in the host
+// clock, systemTimestamp until enough pairs are known
+uint64_t mapClockMapping(struct ClockMapping * mapping,uint64_t deviceTimestamp,uint64_t systemTimestamp);
+
+// Any camera timestamp with the current fit, 0 when there is none
+uint64_t clockMappingToHost(const struct ClockMapping * mapping,uint64_t deviceTimestamp);
+
+// The totals and the last fit stay readable
+void destroyClockMapping(struct ClockMapping * mapping);
+
+// What travels with a frame to its sinks, nanoseconds
+struct FrameTimestamps
+{
+    uint64_t device;          // Camera clock, 0 without one
+    uint64_t system;          // Host clock, when the buffer arrived (systemTimestampToMonotonic())
+    uint64_t host;            // device mapped to the host clock
+};
+
+
+// The timestamps of the frame last published to a shared memory stream, in
+// the POSIX shared memory object /<stream>.clock, written by the thread that
+// publishes the pixels right after them. Written under a sequence counter :
+// read it, copy, and read it again, an odd or changed value means the copy is
+// torn (readClockMappingShared() does that).
+struct ClockMappingShared
+{
+    uint32_t sequence;
+    uint32_t frameNumber;
+    uint64_t deviceTimestamp;
+    uint64_t systemTimestamp;
+    uint64_t hostTimestamp;   // deviceTimestamp in the host clock
+};
+
+struct ClockMappingPublisher
+{
+    char name[80];
+    struct ClockMappingShared * shared;
+};
+
+int openClockMappingPublisher(struct ClockMappingPublisher * publisher,const char * streamName);
+
+void publishClockMapping(struct ClockMappingPublisher * publisher,unsigned int frameNumber,const struct FrameTimestamps * timestamps);
+
+void closeClockMappingPublisher(struct ClockMappingPublisher * publisher);
+
+// Read only view of /<stream>.clock for a consumer, NULL while nobody publishes it
+const struct ClockMappingShared * attachClockMappingShared(const char * streamName);
+
+void detachClockMappingShared(const struct ClockMappingShared * shared);
+
+// Consistent copy of a published mapping, 0 when it kept changing
+int readClockMappingShared(const struct ClockMappingShared * shared,struct ClockMappingShared * copy);
+
+#endif // CLOCK_MAPPING_H_INCLUDED
@@ -0,0 +1,717 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "color-convert.h"
+#include "timing.h"
+
+/* Standard headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define COLOR_CONVERT_X86 1
+#endif
+
+// Bands a frame is cut into per thread, so that a slow thread does not hold the frame up
+#define BANDS_PER_THREAD 4
+
+// BT.601 limited range in 8.8 fixed point. The green weight of luma is split
+// over the two green sites of a 2x2 window, 65 on the upper row and 64 on the
+// lower one, so that the weights of a window add up to 66+129+25
+#define LUMA_RED           66
+#define LUMA_GREEN_UPPER   65
+#define LUMA_GREEN_LOWER   64
+#define LUMA_BLUE          25
+#define LUMA_GRAY          (LUMA_RED+LUMA_GREEN_UPPER+LUMA_GREEN_LOWER+LUMA_BLUE)
+
+static const short chromaU[3] = { -38, -37, 112 };  // Red, each of two greens, blue
+static const short chromaV[3] = { 112, -47, -18 };
+
+enum BayerSite { SITE_RED=0, SITE_GREEN, SITE_BLUE };
+
+// Weights of the 2x2 window of a pixel : [cell][x&1], cells are the pixel, its
+// right neighbour, the pixel below and the one below right
+typedef unsigned short LumaWeights[4][2];
+
+// Luma of the pixels of one row, returns how many were done from the left, the rest is left to the portable code
+typedef unsigned int (*LumaKernel)(const unsigned char * row,const unsigned char * below,unsigned char * luma,unsigned int width,const LumaWeights weights);
+
+// Chroma of one row of 2x2 cells, coefficients of the upper left, upper right, lower left and lower right sites.
+// v is NULL for NV12, u then gets interleaved U,V. Returns how many chroma samples were done
+typedef unsigned int (*ChromaKernel)(const unsigned char * upper,const unsigned char * lower,unsigned char * u,unsigned char * v,unsigned int chromaWidth,const short coefficientsU[4],const short coefficientsV[4]);
+
+//----------------------------------------------------------------------------------------
+// Kernels
+//----------------------------------------------------------------------------------------
+static unsigned int lumaScalar(const unsigned char * row,const unsigned char * below,unsigned char * luma,unsigned int width,const LumaWeights weights)
+{
+    return 0; //Everything is done by lumaRowTail()
+}
+
+static unsigned int chromaScalar(const unsigned char * upper,const unsigned char * lower,unsigned char * u,unsigned char * v,unsigned int chromaWidth,const short coefficientsU[4],const short coefficientsV[4])
+{
+    return 0; //Everything is done by chromaRowTail()
+}
+
+#if COLOR_CONVERT_X86
+__attribute__((target("sse2")))
+static unsigned int lumaSSE2(const unsigned char * row,const unsigned char * below,unsigned char * luma,unsigned int width,const LumaWeights weights)
+{
+    const __m128i zero    = _mm_setzero_si128();
+    const __m128i rounding = _mm_set1_epi16(128);
+    const __m128i offset  = _mm_set1_epi16(16);
+    __m128i w[4];
+    unsigned int c, x=0;
+    //Even pixels in the low half of every 32 bit lane
+    for (c=0; c<4; c++) { w[c] = _mm_set1_epi32((int) (weights[c][0] | ((unsigned int) weights[c][1]<<16))); }
+
+    //The right neighbours of the last pixel done are read, x+16 stays inside the row
+    for (x=0; x+16<width; x+=16)
+    {
+        __m128i cells[4];
+        cells[0] = _mm_loadu_si128((const __m128i *) (row+x));
+        cells[1] = _mm_loadu_si128((const __m128i *) (row+x+1));
+        cells[2] = _mm_loadu_si128((const __m128i *) (below+x));
+        cells[3] = _mm_loadu_si128((const __m128i *) (below+x+1));
+        __m128i low = rounding, high = rounding;
+        for (c=0; c<4; c++)
+        {
+            low  = _mm_add_epi16(low, _mm_mullo_epi16(_mm_unpacklo_epi8(cells[c],zero),w[c]));
+            high = _mm_add_epi16(high,_mm_mullo_epi16(_mm_unpackhi_epi8(cells[c],zero),w[c]));
+        }
+        low  = _mm_add_epi16(_mm_srli_epi16(low,8),offset);
+        high = _mm_add_epi16(_mm_srli_epi16(high,8),offset);
+        _mm_storeu_si128((__m128i *) (luma+x),_mm_packus_epi16(low,high));
+    }
+    return x;
+}
+
+__attribute__((target("sse2")))
+static unsigned int chromaSSE2(const unsigned char * upper,const unsigned char * lower,unsigned char * u,unsigned char * v,unsigned int chromaWidth,const short coefficientsU[4],const short coefficientsV[4])
+{
+    const __m128i evenMask = _mm_set1_epi16(0x00FF);
+    const __m128i rounding = _mm_set1_epi16(128);
+    __m128i cu[4], cv[4];
+    unsigned int c, i=0;
+    for (c=0; c<4; c++) { cu[c] = _mm_set1_epi16(coefficientsU[c]); cv[c] = _mm_set1_epi16(coefficientsV[c]); }
+
+    for (i=0; i+8<=chromaWidth; i+=8)
+    {
+        __m128i top    = _mm_loadu_si128((const __m128i *) (upper+2*i));
+        __m128i bottom = _mm_loadu_si128((const __m128i *) (lower+2*i));
+        __m128i sites[4];
+        sites[0] = _mm_and_si128(top,evenMask);
+        sites[1] = _mm_srli_epi16(top,8);
+        sites[2] = _mm_and_si128(bottom,evenMask);
+        sites[3] = _mm_srli_epi16(bottom,8);
+        __m128i sumU = rounding, sumV = rounding;
+        for (c=0; c<4; c++)
+        {
+            sumU = _mm_add_epi16(sumU,_mm_mullo_epi16(sites[c],cu[c]));
+            sumV = _mm_add_epi16(sumV,_mm_mullo_epi16(sites[c],cv[c]));
+        }
+        sumU = _mm_add_epi16(_mm_srai_epi16(sumU,8),rounding);
+        sumV = _mm_add_epi16(_mm_srai_epi16(sumV,8),rounding);
+        __m128i packed = _mm_packus_epi16(sumU,sumV);   // U0..U7 V0..V7
+        if (v==0)
+        {
+            _mm_storeu_si128((__m128i *) (u+2*i),_mm_unpacklo_epi8(packed,_mm_srli_si128(packed,8)));
+        } else
+        {
+            _mm_storel_epi64((__m128i *) (u+i),packed);
+            _mm_storel_epi64((__m128i *) (v+i),_mm_srli_si128(packed,8));
+        }
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static unsigned int lumaAVX2(const unsigned char * row,const unsigned char * below,unsigned char * luma,unsigned int width,const LumaWeights weights)
+{
+    const __m256i zero     = _mm256_setzero_si256();
+    const __m256i rounding = _mm256_set1_epi16(128);
+    const __m256i offset   = _mm256_set1_epi16(16);
+    __m256i w[4];
+    unsigned int c, x=0;
+    for (c=0; c<4; c++) { w[c] = _mm256_set1_epi32((int) (weights[c][0] | ((unsigned int) weights[c][1]<<16))); }
+
+    for (x=0; x+32<width; x+=32)
+    {
+        __m256i cells[4];
+        cells[0] = _mm256_loadu_si256((const __m256i *) (row+x));
+        cells[1] = _mm256_loadu_si256((const __m256i *) (row+x+1));
+        cells[2] = _mm256_loadu_si256((const __m256i *) (below+x));
+        cells[3] = _mm256_loadu_si256((const __m256i *) (below+x+1));
+        //Unpacking and packing back within the 128 bit lanes keeps the pixel order
+        __m256i low = rounding, high = rounding;
+        for (c=0; c<4; c++)
+        {
+            low  = _mm256_add_epi16(low, _mm256_mullo_epi16(_mm256_unpacklo_epi8(cells[c],zero),w[c]));
+            high = _mm256_add_epi16(high,_mm256_mullo_epi16(_mm256_unpackhi_epi8(cells[c],zero),w[c]));
+        }
+        low  = _mm256_add_epi16(_mm256_srli_epi16(low,8),offset);
+        high = _mm256_add_epi16(_mm256_srli_epi16(high,8),offset);
+        _mm256_storeu_si256((__m256i *) (luma+x),_mm256_packus_epi16(low,high));
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static unsigned int chromaAVX2(const unsigned char * upper,const unsigned char * lower,unsigned char * u,unsigned char * v,unsigned int chromaWidth,const short coefficientsU[4],const short coefficientsV[4])
+{
+    const __m256i evenMask = _mm256_set1_epi16(0x00FF);
+    const __m256i rounding = _mm256_set1_epi16(128);
+    __m256i cu[4], cv[4];
+    unsigned int c, i=0;
+    for (c=0; c<4; c++) { cu[c] = _mm256_set1_epi16(coefficientsU[c]); cv[c] = _mm256_set1_epi16(coefficientsV[c]); }
+
+    for (i=0; i+16<=chromaWidth; i+=16)
+    {
+        __m256i top    = _mm256_loadu_si256((const __m256i *) (upper+2*i));
+        __m256i bottom = _mm256_loadu_si256((const __m256i *) (lower+2*i));
+        __m256i sites[4];
+        sites[0] = _mm256_and_si256(top,evenMask);
+        sites[1] = _mm256_srli_epi16(top,8);
+        sites[2] = _mm256_and_si256(bottom,evenMask);
+        sites[3] = _mm256_srli_epi16(bottom,8);
+        __m256i sumU = rounding, sumV = rounding;
+        for (c=0; c<4; c++)
+        {
+            sumU = _mm256_add_epi16(sumU,_mm256_mullo_epi16(sites[c],cu[c]));
+            sumV = _mm256_add_epi16(sumV,_mm256_mullo_epi16(sites[c],cv[c]));
+        }
+        sumU = _mm256_add_epi16(_mm256_srai_epi16(sumU,8),rounding);
+        sumV = _mm256_add_epi16(_mm256_srai_epi16(sumV,8),rounding);
+        __m256i packed = _mm256_packus_epi16(sumU,sumV);   // U0..U7 V0..V7 | U8..U15 V8..V15
+        if (v==0)
+        {
+            _mm256_storeu_si256((__m256i *) (u+2*i),_mm256_unpacklo_epi8(packed,_mm256_srli_si256(packed,8)));
+        } else
+        {
+            packed = _mm256_permute4x64_epi64(packed,0xD8);  // U0..U15 | V0..V15
+            _mm_storeu_si128((__m128i *) (u+i),_mm256_castsi256_si128(packed));
+            _mm_storeu_si128((__m128i *) (v+i),_mm256_extracti128_si256(packed,1));
+        }
+    }
+    return i;
+}
+#endif // COLOR_CONVERT_X86
+
+struct ColorConvertKernel
+{
+    const char * name;
+    LumaKernel luma;
+    ChromaKernel chroma;
+};
+
+static const struct ColorConvertKernel kernels[] =
+{
+#if COLOR_CONVERT_X86
+    { "avx2",   lumaAVX2,   chromaAVX2   },
+    { "sse2",   lumaSSE2,   chromaSSE2   },
+#endif
+    { "scalar", lumaScalar, chromaScalar }
+};
+#define NUMBER_OF_KERNELS (sizeof(kernels)/sizeof(kernels[0]))
+
+static const struct ColorConvertKernel * selectedKernel = 0;
+
+static int cpuCanRun(const struct ColorConvertKernel * kernel)
+{
+#if COLOR_CONVERT_X86
+    if (strcmp(kernel->name,"avx2")==0) { return __builtin_cpu_supports("avx2"); }
+    if (strcmp(kernel->name,"sse2")==0) { return __builtin_cpu_supports("sse2"); }
+#endif
+    return 1;
+}
+
+static const struct ColorConvertKernel * currentKernel()
+{
+    if (selectedKernel==0)
+    {
+        //Kernels are listed fastest first
+        unsigned int i=0;
+        for (i=0; i<NUMBER_OF_KERNELS; i++)
+        {
+            if (cpuCanRun(&kernels[i])) { selectedKernel=&kernels[i]; break; }
+        }
+    }
+    return selectedKernel;
+}
+
+const char * colorConvertKernel()
+{
+    return currentKernel()->name;
+}
+
+int selectColorConvertKernel(const char * name)
+{
+    unsigned int i=0;
+    for (i=0; i<NUMBER_OF_KERNELS; i++)
+    {
+        if ( (strcmp(kernels[i].name,name)==0) && (cpuCanRun(&kernels[i])) )
+        {
+            selectedKernel=&kernels[i];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//----------------------------------------------------------------------------------------
+// Portable code, the edges and what the kernels leave
+//----------------------------------------------------------------------------------------
+static void lumaRowTail(const unsigned char * row,const unsigned char * below,unsigned char * luma,unsigned int width,const LumaWeights weights,unsigned int x)
+{
+    for (; x<width; x++)
+    {
+        unsigned int right = (x+1<width) ? x+1 : x-1; // Same site as x+1
+        unsigned int parity = x&1;
+        unsigned int sum = weights[0][parity]*row[x]   + weights[1][parity]*row[right] +
+                           weights[2][parity]*below[x] + weights[3][parity]*below[right];
+        luma[x] = (unsigned char) (16 + ((sum+128)>>8));
+    }
+}
+
+static unsigned char clampChroma(int sum)
+{
+    int value = 128 + ((sum+128)>>8);
+    return (unsigned char) ( (value<0) ? 0 : (value>255) ? 255 : value );
+}
+
+static void chromaRowTail(const unsigned char * upper,const unsigned char * lower,unsigned char * u,unsigned char * v,unsigned int chromaWidth,const short coefficientsU[4],const short coefficientsV[4],unsigned int i)
+{
+    for (; i<chromaWidth; i++)
+    {
+        const int sites[4] = { upper[2*i], upper[2*i+1], lower[2*i], lower[2*i+1] };
+        int sumU=0, sumV=0;
+        unsigned int c;
+        for (c=0; c<4; c++) { sumU += coefficientsU[c]*sites[c]; sumV += coefficientsV[c]*sites[c]; }
+        if (v==0) { u[2*i]=clampChroma(sumU); u[2*i+1]=clampChroma(sumV); } else
+                  { u[i]=clampChroma(sumU);   v[i]=clampChroma(sumV); }
+    }
+}
+
+// Sites of the 2x2 cell at the origin of the mosaic, upper left, upper right, lower left, lower right
+static int bayerSites(enum ColorConvertInput input,enum BayerSite sites[4])
+{
+    static const enum BayerSite patterns[4][4] =
+    {
+        { SITE_RED,   SITE_GREEN, SITE_GREEN, SITE_BLUE  },  // RG
+        { SITE_GREEN, SITE_RED,   SITE_BLUE,  SITE_GREEN },  // GR
+        { SITE_GREEN, SITE_BLUE,  SITE_RED,   SITE_GREEN },  // GB
+        { SITE_BLUE,  SITE_GREEN, SITE_GREEN, SITE_RED   }   // BG
+    };
+    if ( (input<COLOR_INPUT_BAYER_RG8) || (input>COLOR_INPUT_BAYER_BG8) ) { return 0; }
+    memcpy(sites,patterns[input-COLOR_INPUT_BAYER_RG8],sizeof(patterns[0]));
+    return 1;
+}
+
+static unsigned short lumaWeight(enum BayerSite site,char lowerRow)
+{
+    if (site==SITE_RED)  { return LUMA_RED; }
+    if (site==SITE_BLUE) { return LUMA_BLUE; }
+    return (lowerRow) ? LUMA_GREEN_LOWER : LUMA_GREEN_UPPER;
+}
+
+// Window weights of the pixels of an even or odd row
+static void lumaWeights(enum ColorConvertInput input,unsigned int rowParity,LumaWeights weights)
+{
+    enum BayerSite sites[4];
+    memset(weights,0,sizeof(LumaWeights));
+    if (!bayerSites(input,sites))
+    {
+        weights[0][0] = weights[0][1] = LUMA_GRAY; // Mono8, the pixel alone
+        return;
+    }
+    unsigned int parity;
+    for (parity=0; parity<2; parity++)
+    {
+        weights[0][parity] = lumaWeight(sites[rowParity*2     + parity    ],0);
+        weights[1][parity] = lumaWeight(sites[rowParity*2     + (1-parity)],0);
+        weights[2][parity] = lumaWeight(sites[(1-rowParity)*2 + parity    ],1);
+        weights[3][parity] = lumaWeight(sites[(1-rowParity)*2 + (1-parity)],1);
+    }
+}
+
+static void chromaCoefficients(enum ColorConvertInput input,short coefficientsU[4],short coefficientsV[4])
+{
+    enum BayerSite sites[4];
+    unsigned int c;
+    if (!bayerSites(input,sites)) { sites[0]=SITE_RED; sites[1]=sites[2]=SITE_GREEN; sites[3]=SITE_BLUE; }
+    for (c=0; c<4; c++) { coefficientsU[c]=chromaU[sites[c]]; coefficientsV[c]=chromaV[sites[c]]; }
+}
+
+static void convertRGBBand(struct ColorConverter * converter,unsigned int firstRow,unsigned int rows)
+{
+    const struct ColorConvertLayout * layout = &converter->layout;
+    unsigned int width = layout->width;
+    unsigned int x,y;
+    for (y=firstRow; y<firstRow+rows; y+=2)
+    {
+        const unsigned char * upper = converter->source + (size_t) y*width*3;
+        const unsigned char * lower = upper + width*3;
+        unsigned char * luma = converter->output + layout->offset[0] + (size_t) y*layout->stride[0];
+        unsigned char * u = converter->output + layout->offset[1] + (size_t) (y/2)*layout->stride[1];
+        unsigned char * v = (layout->planes==3) ? converter->output + layout->offset[2] + (size_t) (y/2)*layout->stride[2] : 0;
+        for (x=0; x<width; x+=2)
+        {
+            int red=0, green=0, blue=0;
+            unsigned int j;
+            for (j=0; j<4; j++)
+            {
+                const unsigned char * pixel = ((j<2) ? upper : lower) + (x+(j&1))*3;
+                luma[(j<2) ? x+(j&1) : layout->stride[0]+x+(j&1)] =
+                    (unsigned char) (16 + ((LUMA_RED*pixel[0] + (LUMA_GREEN_UPPER+LUMA_GREEN_LOWER)*pixel[1] + LUMA_BLUE*pixel[2] + 128)>>8));
+                red += pixel[0]; green += pixel[1]; blue += pixel[2];
+            }
+            //Averages of the four pixels, the green coefficient is per green site
+            int sumU = (chromaU[SITE_RED]*red + 2*chromaU[SITE_GREEN]*green + chromaU[SITE_BLUE]*blue + 2) >> 2;
+            int sumV = (chromaV[SITE_RED]*red + 2*chromaV[SITE_GREEN]*green + chromaV[SITE_BLUE]*blue + 2) >> 2;
+            if (v==0) { u[x]=clampChroma(sumU); u[x+1]=clampChroma(sumV); } else
+                      { u[x/2]=clampChroma(sumU); v[x/2]=clampChroma(sumV); }
+        }
+    }
+}
+
+// Converts the rows of one band, firstRow and rows are even
+static void convertBand(struct ColorConverter * converter,unsigned int firstRow,unsigned int rows)
+{
+    if (converter->input==COLOR_INPUT_RGB8) { convertRGBBand(converter,firstRow,rows); return; }
+
+    const struct ColorConvertKernel * kernel = currentKernel();
+    const struct ColorConvertLayout * layout = &converter->layout;
+    unsigned int width  = layout->width;
+    unsigned int height = layout->height;
+    LumaWeights weights[2];
+    lumaWeights(converter->input,0,weights[0]);
+    lumaWeights(converter->input,1,weights[1]);
+
+    unsigned int y;
+    for (y=firstRow; y<firstRow+rows; y++)
+    {
+        const unsigned char * row   = converter->source + (size_t) y*width;
+        const unsigned char * below = (y+1<height) ? row+width : row-width; // Same sites as the row below
+        unsigned char * luma = converter->output + layout->offset[0] + (size_t) y*layout->stride[0];
+        unsigned int done = kernel->luma(row,below,luma,width,(const unsigned short (*)[2]) weights[y&1]);
+        lumaRowTail(row,below,luma,width,(const unsigned short (*)[2]) weights[y&1],done);
+    }
+
+    unsigned int chromaWidth = width/2;
+    for (y=firstRow/2; y<(firstRow+rows)/2; y++)
+    {
+        unsigned char * u = converter->output + layout->offset[1] + (size_t) y*layout->stride[1];
+        unsigned char * v = (layout->planes==3) ? converter->output + layout->offset[2] + (size_t) y*layout->stride[2] : 0;
+        if (converter->input==COLOR_INPUT_MONO8)
+        {
+            memset(u,128,(v==0) ? 2*chromaWidth : chromaWidth);
+            if (v!=0) { memset(v,128,chromaWidth); }
+            continue;
+        }
+        short coefficientsU[4], coefficientsV[4];
+        chromaCoefficients(converter->input,coefficientsU,coefficientsV);
+        const unsigned char * upper = converter->source + (size_t) (2*y)*width;
+        const unsigned char * lower = upper + width;
+        unsigned int done = kernel->chroma(upper,lower,u,v,chromaWidth,coefficientsU,coefficientsV);
+        chromaRowTail(upper,lower,u,v,chromaWidth,coefficientsU,coefficientsV,done);
+    }
+}
+
+//----------------------------------------------------------------------------------------
+// Names and layouts
+//----------------------------------------------------------------------------------------
+enum ColorConvertInput colorConvertInput(const char * pixelFormat)
+{
+    if (pixelFormat==0) { return COLOR_INPUT_UNSUPPORTED; }
+    if (strcmp(pixelFormat,"Mono8")==0)     { return COLOR_INPUT_MONO8; }
+    if (strcmp(pixelFormat,"BayerRG8")==0)  { return COLOR_INPUT_BAYER_RG8; }
+    if (strcmp(pixelFormat,"BayerGR8")==0)  { return COLOR_INPUT_BAYER_GR8; }
+    if (strcmp(pixelFormat,"BayerGB8")==0)  { return COLOR_INPUT_BAYER_GB8; }
+    if (strcmp(pixelFormat,"BayerBG8")==0)  { return COLOR_INPUT_BAYER_BG8; }
+    if ( (strcmp(pixelFormat,"RGB8")==0) || (strcmp(pixelFormat,"RGB8Packed")==0) ) { return COLOR_INPUT_RGB8; }
+    return COLOR_INPUT_UNSUPPORTED;
+}
+
+const char * colorConvertInputName(enum ColorConvertInput input)
+{
+    switch (input)
+    {
+        case COLOR_INPUT_MONO8     : return "Mono8";
+        case COLOR_INPUT_BAYER_RG8 : return "BayerRG8";
+        case COLOR_INPUT_BAYER_GR8 : return "BayerGR8";
+        case COLOR_INPUT_BAYER_GB8 : return "BayerGB8";
+        case COLOR_INPUT_BAYER_BG8 : return "BayerBG8";
+        case COLOR_INPUT_RGB8      : return "RGB8";
+        default : break;
+    };
+    return "unsupported";
+}
+
+enum ColorConvertFormat colorConvertFormat(const char * name)
+{
+    if (name==0) { return COLOR_FORMAT_NONE; }
+    if (strcmp(name,"nv12")==0)   { return COLOR_FORMAT_NV12; }
+    if ( (strcmp(name,"yuv420")==0) || (strcmp(name,"i420")==0) ) { return COLOR_FORMAT_YUV420; }
+    return COLOR_FORMAT_NONE;
+}
+
+const char * colorConvertFormatName(enum ColorConvertFormat format)
+{
+    switch (format)
+    {
+        case COLOR_FORMAT_NV12   : return "nv12";
+        case COLOR_FORMAT_YUV420 : return "yuv420";
+        default : break;
+    };
+    return "none";
+}
+
+int colorConvertLayout(enum ColorConvertFormat format,unsigned int width,unsigned int height,struct ColorConvertLayout * layout)
+{
+    if (layout==0) { return 0; }
+    memset(layout,0,sizeof(struct ColorConvertLayout));
+    if ( (width==0) || (height==0) || (width&1) || (height&1) ) { return 0; }
+    if ( (format!=COLOR_FORMAT_NV12) && (format!=COLOR_FORMAT_YUV420) ) { return 0; }
+
+    unsigned int stride = (width + COLOR_CONVERT_ALIGNMENT-1) & ~(COLOR_CONVERT_ALIGNMENT-1);
+    unsigned long lumaSize = (unsigned long) stride*height;
+    layout->format    = format;
+    layout->width     = width;
+    layout->height    = height;
+    layout->stride[0] = stride;
+    layout->offset[0] = 0;
+    if (format==COLOR_FORMAT_NV12)
+    {
+        layout->planes    = 2;
+        layout->stride[1] = stride;
+        layout->offset[1] = lumaSize;
+    } else
+    {
+        //Half the luma stride keeps both chroma planes on 32 byte boundaries
+        layout->planes    = 3;
+        layout->stride[1] = stride/2;
+        layout->stride[2] = stride/2;
+        layout->offset[1] = lumaSize;
+        layout->offset[2] = lumaSize + (unsigned long) (stride/2)*(height/2);
+    }
+    layout->rows = height + height/2;
+    layout->size = (unsigned long) stride*layout->rows;
+    return 1;
+}
+
+//----------------------------------------------------------------------------------------
+// Worker pool
+//----------------------------------------------------------------------------------------
+// Called with the lock held, converts bands until none is left to start
+static void convertBands(struct ColorConverter * converter)
+{
+    while (converter->nextBand<converter->bands)
+    {
+        unsigned int band = converter->nextBand++;
+        pthread_mutex_unlock(&converter->lock);
+
+        unsigned int firstRow = band*converter->rowsPerBand;
+        unsigned int rows = converter->rowsPerBand;
+        if (firstRow+rows>converter->layout.height) { rows = converter->layout.height - firstRow; }
+        convertBand(converter,firstRow,rows);
+
+        pthread_mutex_lock(&converter->lock);
+        converter->bandsDone += 1;
+        if (converter->bandsDone==converter->bands) { pthread_cond_signal(&converter->done); }
+    }
+}
+
+static void * colorConvertWorkerThread(void * argument)
+{
+    struct ColorConverter * converter = (struct ColorConverter *) argument;
+
+    pthread_mutex_lock(&converter->lock);
+    while (!converter->stop)
+    {
+        if (converter->nextBand<converter->bands) { convertBands(converter); } else
+                                                  { pthread_cond_wait(&converter->work,&converter->lock); }
+    }
+    pthread_mutex_unlock(&converter->lock);
+    return 0;
+}
+
+int createColorConverter(struct ColorConverter * converter,enum ColorConvertInput input,enum ColorConvertFormat format,unsigned int width,unsigned int height,unsigned int workers)
+{
+    if (converter==0) { return 0; }
+    memset(converter,0,sizeof(struct ColorConverter));
+    if (input==COLOR_INPUT_UNSUPPORTED)
+    {
+        fprintf(stderr,"Frames can only be converted to YUV from Mono8, BayerRG8, BayerGR8, BayerGB8, BayerBG8 or RGB8\n");
+        return 0;
+    }
+    if (!colorConvertLayout(format,width,height,&converter->layout))
+    {
+        fprintf(stderr,"Cannot convert %ux%u frames to %s, 4:2:0 needs an even width and height\n",width,height,colorConvertFormatName(format));
+        return 0;
+    }
+    if (posix_memalign((void **) &converter->output,COLOR_CONVERT_ALIGNMENT,converter->layout.size)!=0)
+    {
+        converter->output = 0;
+        return 0;
+    }
+    //The padding of the rows stays black
+    memset(converter->output,16,converter->layout.offset[1]);
+    memset(converter->output+converter->layout.offset[1],128,converter->layout.size-converter->layout.offset[1]);
+
+    converter->input   = input;
+    converter->workers = workers;
+    unsigned int targetBands = (workers==0) ? 1 : BANDS_PER_THREAD*(workers+1);
+    converter->rowsPerBand = ((height/targetBands) + 1) & ~1u;
+    if (converter->rowsPerBand<2) { converter->rowsPerBand=2; }
+
+    pthread_mutex_init(&converter->lock,NULL);
+    pthread_cond_init(&converter->work,NULL);
+    pthread_cond_init(&converter->done,NULL);
+    if (workers!=0)
+    {
+        converter->threads = (pthread_t *) calloc(workers,sizeof(pthread_t));
+        unsigned int i=0;
+        for (i=0; (converter->threads!=0) && (i<workers); i++)
+        {
+            if (pthread_create(&converter->threads[i],NULL,colorConvertWorkerThread,converter)!=0) { break; }
+            converter->threadsStarted += 1;
+        }
+    }
+    currentKernel();
+    return 1;
+}
+
+int convertColorFrame(struct ColorConverter * converter,const void * pixels,unsigned long size,unsigned int width,unsigned int height)
+{
+    if ( (converter==0) || (converter->output==0) || (pixels==0) ) { return 0; }
+    unsigned long expected = (unsigned long) width*height*((converter->input==COLOR_INPUT_RGB8) ? 3 : 1);
+    if ( (width!=converter->layout.width) || (height!=converter->layout.height) || (size<expected) )
+    {
+        converter->mismatchedFrames += 1;
+        return 0;
+    }
+
+    unsigned long startTime = monotonicMicroseconds();
+    pthread_mutex_lock(&converter->lock);
+    converter->source    = (const unsigned char *) pixels;
+    converter->bands     = (height + converter->rowsPerBand-1) / converter->rowsPerBand;
+    converter->nextBand  = 0;
+    converter->bandsDone = 0;
+    if (converter->threadsStarted!=0) { pthread_cond_broadcast(&converter->work); }
+
+    //The calling thread takes bands too, then waits for the ones still being converted
+    convertBands(converter);
+    while (converter->bandsDone<converter->bands) { pthread_cond_wait(&converter->done,&converter->lock); }
+    converter->source = 0;
+    pthread_mutex_unlock(&converter->lock);
+
+    unsigned long elapsed = monotonicMicroseconds() - startTime;
+    converter->frames            += 1;
+    converter->totalMicroseconds += elapsed;
+    if (elapsed>converter->maxMicroseconds) { converter->maxMicroseconds=elapsed; }
+    return 1;
+}
+
+void destroyColorConverter(struct ColorConverter * converter)
+{
+    if ( (converter==0) || (converter->output==0) ) { return; }
+    pthread_mutex_lock(&converter->lock);
+    converter->stop = 1;
+    pthread_cond_broadcast(&converter->work);
+    pthread_mutex_unlock(&converter->lock);
+
+    unsigned int i=0;
+    for (i=0; i<converter->threadsStarted; i++) { pthread_join(converter->threads[i],NULL); }
+    free(converter->threads);
+    converter->threads        = 0;
+    converter->threadsStarted = 0;
+
+    pthread_mutex_destroy(&converter->lock);
+    pthread_cond_destroy(&converter->work);
+    pthread_cond_destroy(&converter->done);
+    free(converter->output);
+    converter->output = 0;
+}
+
+//----------------------------------------------------------------------------------------
+// Publishing the plane layout next to a shared memory stream
+//----------------------------------------------------------------------------------------
+static uint32_t fourcc(char a,char b,char c,char d)
+{
+    return (uint32_t) a | ((uint32_t) b<<8) | ((uint32_t) c<<16) | ((uint32_t) d<<24);
+}
+
+int openColorConvertPublisher(struct ColorConvertPublisher * publisher,const char * streamName,const struct ColorConvertLayout * layout)
+{
+    if ( (publisher==0) || (streamName==0) || (layout==0) ) { return 0; }
+    memset(publisher,0,sizeof(struct ColorConvertPublisher));
+    snprintf(publisher->name,sizeof(publisher->name),"/%s.format",streamName);
+
+    int fd = shm_open(publisher->name,O_CREAT|O_RDWR,0644);
+    if (fd<0)
+    {
+        fprintf(stderr,"Could not create the shared memory object %s\n",publisher->name);
+        return 0;
+    }
+    if (ftruncate(fd,sizeof(struct ColorConvertShared))!=0)
+    {
+        close(fd);
+        return 0;
+    }
+    void * shared = mmap(NULL,sizeof(struct ColorConvertShared),PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+    close(fd);
+    if (shared==MAP_FAILED) { return 0; }
+    publisher->shared = (struct ColorConvertShared *) shared;
+
+    struct ColorConvertShared * format = publisher->shared;
+    memset(format,0,sizeof(struct ColorConvertShared));
+    format->fourcc = (layout->format==COLOR_FORMAT_NV12) ? fourcc('N','V','1','2') : fourcc('I','4','2','0');
+    format->width  = layout->width;
+    format->height = layout->height;
+    format->planes = layout->planes;
+    unsigned int i=0;
+    for (i=0; i<COLOR_CONVERT_MAX_PLANES; i++)
+    {
+        format->stride[i] = layout->stride[i];
+        format->offset[i] = layout->offset[i];
+    }
+    format->size = layout->size;
+    //Consumers check the magic last
+    __atomic_store_n(&format->magic,COLOR_CONVERT_SHARED_MAGIC,__ATOMIC_RELEASE);
+    return 1;
+}
+
+void closeColorConvertPublisher(struct ColorConvertPublisher * publisher)
+{
+    if ( (publisher==0) || (publisher->shared==0) ) { return; }
+    munmap(publisher->shared,sizeof(struct ColorConvertShared));
+    shm_unlink(publisher->name);
+    publisher->shared = 0;
+}
+
+const struct ColorConvertShared * attachColorConvertShared(const char * streamName)
+{
+    if (streamName==0) { return 0; }
+    char name[80];
+    snprintf(name,sizeof(name),"/%s.format",streamName);
+    int fd = shm_open(name,O_RDONLY,0);
+    if (fd<0) { return 0; }
+    void * shared = mmap(NULL,sizeof(struct ColorConvertShared),PROT_READ,MAP_SHARED,fd,0);
+    close(fd);
+    if (shared==MAP_FAILED) { return 0; }
+    if (__atomic_load_n(&((const struct ColorConvertShared *) shared)->magic,__ATOMIC_ACQUIRE)!=COLOR_CONVERT_SHARED_MAGIC)
+    {
+        munmap(shared,sizeof(struct ColorConvertShared));
+        return 0;
+    }
+    return (const struct ColorConvertShared *) shared;
+}
+
+void detachColorConvertShared(const struct ColorConvertShared * shared)
+{
+    if (shared!=0) { munmap((void *) shared,sizeof(struct ColorConvertShared)); }
+}
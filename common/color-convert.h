@@ -0,0 +1,157 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef COLOR_CONVERT_H_INCLUDED
+#define COLOR_CONVERT_H_INCLUDED
+
+/* Standard headers */
+#include <pthread.h>
+#include <stdint.h>
+
+// Conversion of camera frames to 4:2:0 YUV for shared memory consumers, so
+// that every encoder and viewer reading the stream does not demosaic and
+// convert the same frame again.
+//
+// Mono8, the four 8 bit Bayer patterns and RGB8 become NV12 (a luma plane
+// followed by one plane of interleaved U,V) or planar YUV420 (I420 : luma,
+// then U, then V), BT.601 limited range. Luma is computed at full resolution
+// from the 2x2 window below and to the right of every pixel, which always
+// holds one red, one blue and two green sites of a Bayer mosaic (the last
+// row and column mirror their neighbour), and chroma from the 2x2 cell of
+// the mosaic it covers. That is cheaper than a full demosaic and good enough
+// for previews and encoders, it is not meant for measurements.
+//
+// Planes start on 64 byte boundaries with a luma stride of the width rounded
+// up to 64 bytes, the chroma strides follow from it, see ColorConvertLayout.
+// Width and height have to be even.
+//
+// The frame is cut into bands of rows that a pool of worker threads and the
+// calling thread convert together, convertColorFrame() returns when the
+// whole frame is done. The Bayer and mono kernels are AVX2 or SSE2, picked
+// at runtime, with a portable fallback giving the same results, RGB8 always
+// uses the portable one. Nothing in here depends on Aravis
+// (see benchmarks/color-convert-benchmark.c).
+
+#define COLOR_CONVERT_MAX_PLANES 3
+#define COLOR_CONVERT_ALIGNMENT  64
+
+enum ColorConvertInput
+{
+    COLOR_INPUT_UNSUPPORTED = 0,
+    COLOR_INPUT_MONO8,
+    COLOR_INPUT_BAYER_RG8,
+    COLOR_INPUT_BAYER_GR8,
+    COLOR_INPUT_BAYER_GB8,
+    COLOR_INPUT_BAYER_BG8,
+    COLOR_INPUT_RGB8
+};
+
+enum ColorConvertFormat
+{
+    COLOR_FORMAT_NONE = 0,
+    COLOR_FORMAT_NV12,
+    COLOR_FORMAT_YUV420
+};
+
+struct ColorConvertLayout
+{
+    enum ColorConvertFormat format;
+    unsigned int width;
+    unsigned int height;
+    unsigned int planes;
+    unsigned long offset[COLOR_CONVERT_MAX_PLANES];  // Bytes from the start of the frame
+    unsigned int stride[COLOR_CONVERT_MAX_PLANES];   // Bytes per row of every plane
+    unsigned int rows;                               // Total rows of stride[0] bytes, height*3/2
+    unsigned long size;
+};
+
+struct ColorConverter
+{
+    enum ColorConvertInput input;
+    struct ColorConvertLayout layout;
+    unsigned char * output;           // layout.size bytes, 64 byte aligned
+    unsigned int rowsPerBand;         // Even
+
+    //Frame being converted, under lock
+    pthread_t * threads;
+    unsigned int workers;
+    unsigned int threadsStarted;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    char stop;
+    const unsigned char * source;
+    unsigned int bands;
+    unsigned int nextBand;
+    unsigned int bandsDone;
+
+    //Totals for the --stats output
+    unsigned long frames;
+    unsigned long mismatchedFrames;   // Different size than the converter, not converted
+    unsigned long totalMicroseconds;
+    unsigned long maxMicroseconds;
+};
+
+// "Mono8", "BayerRG8" .. "RGB8", COLOR_INPUT_UNSUPPORTED for anything else
+enum ColorConvertInput colorConvertInput(const char * pixelFormat);
+
+const char * colorConvertInputName(enum ColorConvertInput input);
+
+// "nv12" or "yuv420", COLOR_FORMAT_NONE for anything else
+enum ColorConvertFormat colorConvertFormat(const char * name);
+
+const char * colorConvertFormatName(enum ColorConvertFormat format);
+
+// Returns 0 for odd sizes
+int colorConvertLayout(enum ColorConvertFormat format,unsigned int width,unsigned int height,struct ColorConvertLayout * layout);
+
+// workers threads besides the one calling convertColorFrame(), 0 converts on it alone. Returns 0 on failure
+int createColorConverter(struct ColorConverter * converter,enum ColorConvertInput input,enum ColorConvertFormat format,unsigned int width,unsigned int height,unsigned int workers);
+
+// Converts pixels into converter->output, returns 0 when they are not width x height.
+// One frame at a time, from one thread
+int convertColorFrame(struct ColorConverter * converter,const void * pixels,unsigned long size,unsigned int width,unsigned int height);
+
+// Stops the workers, the totals stay readable
+void destroyColorConverter(struct ColorConverter * converter);
+
+// Name of the kernel picked for this CPU, "avx2", "sse2" or "scalar"
+const char * colorConvertKernel();
+
+// Force a kernel, for benchmarking. Returns 0 if this CPU cannot run it
+int selectColorConvertKernel(const char * name);
+
+
+// The plane layout of a converted shared memory stream, which only knows a
+// width, a height and a number of channels (published as one channel of
+// stride[0] x rows bytes), in the POSIX shared memory object /<stream>.format.
+// Written once before the first frame and not changed while it is published.
+#define COLOR_CONVERT_SHARED_MAGIC 0x56555941  // "AYUV"
+
+struct ColorConvertShared
+{
+    uint32_t magic;
+    uint32_t fourcc;          // 'NV12' or 'I420', little endian like V4L2 and FFmpeg
+    uint32_t width;
+    uint32_t height;
+    uint32_t planes;
+    uint32_t stride[COLOR_CONVERT_MAX_PLANES];
+    uint64_t offset[COLOR_CONVERT_MAX_PLANES];
+    uint64_t size;
+};
+
+struct ColorConvertPublisher
+{
+    char name[80];
+    struct ColorConvertShared * shared;
+};
+
+int openColorConvertPublisher(struct ColorConvertPublisher * publisher,const char * streamName,const struct ColorConvertLayout * layout);
+
+void closeColorConvertPublisher(struct ColorConvertPublisher * publisher);
+
+// Read only view of /<stream>.format for a consumer, NULL while nobody publishes it
+const struct ColorConvertShared * attachColorConvertShared(const char * streamName);
+
+void detachColorConvertShared(const struct ColorConvertShared * shared);
+
+#endif // COLOR_CONVERT_H_INCLUDED
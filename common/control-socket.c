@@ -0,0 +1,143 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "control-socket.h"
+
+/* Standard headers */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// How often the serving thread looks at the stop flag
+#define CONTROL_SOCKET_POLL_MILLISECONDS 200
+
+static void serveClient(struct ControlSocket * controlSocket,int client)
+{
+    char line[CONTROL_SOCKET_MAX_LINE];
+    char reply[CONTROL_SOCKET_MAX_LINE];
+    size_t used = 0;
+
+    while (!controlSocket->stop)
+    {
+        struct pollfd pfd = { client, POLLIN, 0 };
+        int ready = poll(&pfd,1,CONTROL_SOCKET_POLL_MILLISECONDS);
+        if (ready<0)  { if (errno==EINTR) { continue; } return; }
+        if (ready==0) { continue; }
+
+        ssize_t received = read(client,line+used,sizeof(line)-1-used);
+        if (received<=0) { return; } // Client closed the connection
+        used += (size_t) received;
+        line[used] = 0;
+
+        //Hand over every complete line, keep a partial one for the next read
+        char * start = line;
+        char * end = 0;
+        while ( (end=strchr(start,'\n'))!=0 )
+        {
+            *end = 0;
+            if ( (end>start) && (end[-1]=='\r') ) { end[-1]=0; }
+            if (*start!=0)
+            {
+                reply[0] = 0;
+                controlSocket->handler(controlSocket->userData,start,reply,sizeof(reply));
+                controlSocket->commands += 1;
+                size_t length = strlen(reply);
+                if ( (length>0) && (write(client,reply,length)<0) ) { return; }
+            }
+            start = end+1;
+        }
+        used = strlen(start);
+        memmove(line,start,used+1);
+
+        if (used==sizeof(line)-1)
+        {   //Nobody sends lines that long, drop it rather than stall
+            used = 0;
+        }
+    }
+}
+
+static void * controlSocketThread(void * argument)
+{
+    struct ControlSocket * controlSocket = (struct ControlSocket *) argument;
+
+    while (!controlSocket->stop)
+    {
+        struct pollfd pfd = { controlSocket->fd, POLLIN, 0 };
+        int ready = poll(&pfd,1,CONTROL_SOCKET_POLL_MILLISECONDS);
+        if (ready<=0) { continue; }
+
+        int client = accept(controlSocket->fd,NULL,NULL);
+        if (client<0) { continue; }
+        serveClient(controlSocket,client);
+        close(client);
+    }
+    return 0;
+}
+
+int startControlSocket(struct ControlSocket * controlSocket,const char * path,ControlCommandHandler handler,void * userData)
+{
+    if ( (controlSocket==0) || (path==0) || (handler==0) ) { return 0; }
+    memset(controlSocket,0,sizeof(struct ControlSocket));
+    controlSocket->fd       = -1;
+    controlSocket->handler  = handler;
+    controlSocket->userData = userData;
+
+    struct sockaddr_un address;
+    memset(&address,0,sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path)>=sizeof(address.sun_path))
+    {
+        fprintf(stderr,"Control socket path %s is too long\n",path);
+        return 0;
+    }
+    snprintf(address.sun_path,sizeof(address.sun_path),"%s",path);
+    snprintf(controlSocket->path,sizeof(controlSocket->path),"%s",path);
+
+    controlSocket->fd = socket(AF_UNIX,SOCK_STREAM,0);
+    if (controlSocket->fd<0)
+    {
+        fprintf(stderr,"Could not create control socket (%s)\n",strerror(errno));
+        return 0;
+    }
+
+    unlink(path); //Left over by a previous run that was killed
+    if ( (bind(controlSocket->fd,(struct sockaddr *) &address,sizeof(address))!=0) || (listen(controlSocket->fd,4)!=0) )
+    {
+        fprintf(stderr,"Could not listen on control socket %s (%s)\n",path,strerror(errno));
+        close(controlSocket->fd);
+        controlSocket->fd = -1;
+        return 0;
+    }
+
+    if (pthread_create(&controlSocket->thread,NULL,controlSocketThread,controlSocket)!=0)
+    {
+        fprintf(stderr,"Could not start the control socket thread\n");
+        close(controlSocket->fd);
+        unlink(path);
+        controlSocket->fd = -1;
+        return 0;
+    }
+    controlSocket->threadStarted = 1;
+    fprintf(stderr,"Listening for commands on %s\n",path);
+    return 1;
+}
+
+void stopControlSocket(struct ControlSocket * controlSocket)
+{
+    if (controlSocket==0) { return; }
+    controlSocket->stop = 1;
+    if (controlSocket->threadStarted)
+    {
+        pthread_join(controlSocket->thread,NULL);
+        controlSocket->threadStarted = 0;
+    }
+    if (controlSocket->fd>=0)
+    {
+        close(controlSocket->fd);
+        unlink(controlSocket->path);
+        controlSocket->fd = -1;
+    }
+}
@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef CONTROL_SOCKET_H_INCLUDED
+#define CONTROL_SOCKET_H_INCLUDED
+
+/* Standard headers */
+#include <stddef.h>
+#include <pthread.h>
+
+// A line based command channel on a Unix stream socket, served by its own
+// thread so that acquisition never waits for a client. Every line received is
+// handed to the handler, whatever it writes into reply is sent back.
+//
+//   echo "trigger door opened" | socat - UNIX-CONNECT:/tmp/grabber.sock
+
+#define CONTROL_SOCKET_MAX_LINE 1024
+
+typedef void (*ControlCommandHandler)(void * userData,const char * command,char * reply,size_t replySize);
+
+struct ControlSocket
+{
+    int fd;
+    char path[108];
+    pthread_t thread;
+    char threadStarted;
+    volatile int stop;
+    ControlCommandHandler handler;
+    void * userData;
+    unsigned long commands;
+};
+
+int startControlSocket(struct ControlSocket * controlSocket,const char * path,ControlCommandHandler handler,void * userData);
+void stopControlSocket(struct ControlSocket * controlSocket);
+
+#endif // CONTROL_SOCKET_H_INCLUDED
@@ -0,0 +1,384 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "device-discovery.h"
+#include "timing.h"
+
+/* Standard headers */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#define MAX_DISCOVERED_DEVICES 64
+
+struct DiscoveredDevice
+{
+    char id[256];
+    char address[64];
+    char serial[128];
+    char protocol[32];
+};
+
+struct InterfaceProbe
+{
+    const char * name;
+    ArvInterface * interface;
+    pthread_t thread;
+    char threadStarted;
+    struct DiscoveredDevice devices[MAX_DISCOVERED_DEVICES];
+    unsigned int numberOfDevices;
+    unsigned long microseconds;
+};
+
+void setDefaultDiscoveryOptions(struct DiscoveryOptions * options)
+{
+    options->cacheTTL   = 300;
+    options->retries    = 3;
+    options->retryDelay = 250;
+    options->cacheFile  = NULL;
+}
+
+static void copyString(char * target,size_t targetSize,const char * source)
+{
+    snprintf(target,targetSize,"%s",(source!=NULL) ? source : "");
+}
+
+static ArvInterface * interfaceForProtocol(const char * protocol)
+{
+    if (strcmp(protocol,"GigEVision")==0) { return arv_gv_interface_get_instance();   }
+    if (strcmp(protocol,"Fake")==0)       { return arv_fake_interface_get_instance(); }
+#ifdef HAVE_ARAVIS_USB
+    if (strcmp(protocol,"USB3Vision")==0) { return arv_uv_interface_get_instance();   }
+#endif
+    return NULL;
+}
+
+static int deviceMatches(struct DiscoveredDevice * device,const char * requested)
+{
+    if (requested==NULL) { return 1; }
+    return ( (strcmp(device->id,requested)==0) || (strcmp(device->address,requested)==0) || (strcmp(device->serial,requested)==0) );
+}
+
+static int looksLikeAddress(const char * requested)
+{
+    struct in_addr address;
+    return ( (requested!=NULL) && (inet_pton(AF_INET,requested,&address)==1) );
+}
+
+//----------------------------------------------------------------------------------------
+// Discovery cache, one tab separated line per device :
+// <unix time of the discovery> <protocol> <address> <serial> <device id>
+//----------------------------------------------------------------------------------------
+static void getCacheFilename(struct DiscoveryOptions * options,char * filename,size_t filenameSize,int createDirectory)
+{
+    if (options->cacheFile!=NULL)
+    {
+        copyString(filename,filenameSize,options->cacheFile);
+        return;
+    }
+
+    char directory[544]; //Room for the parent and /aravis-c-examples
+    const char * cacheHome = getenv("XDG_CACHE_HOME");
+    if ( (cacheHome!=NULL) && (cacheHome[0]!=0) )
+    {
+        snprintf(directory,sizeof(directory),"%s/aravis-c-examples",cacheHome);
+    } else
+    {
+        const char * home = getenv("HOME");
+        if (home==NULL) { home="/tmp"; }
+        char parent[512];
+        snprintf(parent,512,"%s/.cache",home);
+        if (createDirectory) { mkdir(parent,0755); }
+        snprintf(directory,sizeof(directory),"%s/aravis-c-examples",parent);
+    }
+    if (createDirectory) { mkdir(directory,0755); }
+    snprintf(filename,filenameSize,"%s/devices",directory);
+}
+
+static int findInCache(struct DiscoveryOptions * options,const char * requested,struct DiscoveredDevice * found)
+{
+    char filename[600];
+    getCacheFilename(options,filename,600,0);
+
+    FILE * fp = fopen(filename,"r");
+    if (fp==NULL) { return 0; }
+
+    char line[1024];
+    int result = 0;
+    long now = (long) time(NULL);
+    while ( (!result) && (fgets(line,1024,fp)!=NULL) )
+    {
+        struct DiscoveredDevice device;
+        long discoveredAt = 0;
+        line[strcspn(line,"\n")] = 0;
+        if (sscanf(line,"%ld\t%31[^\t]\t%63[^\t]\t%127[^\t]\t%255[^\t]",&discoveredAt,device.protocol,device.address,device.serial,device.id)!=5) { continue; }
+        if (now-discoveredAt>(long) options->cacheTTL) { continue; }
+        //The fake camera is only ever opened by name, not as the first camera of a plain run
+        if ( (strcmp(device.protocol,"Fake")==0) && ( (requested==NULL) || (strncmp(requested,"Fake",4)!=0) ) ) { continue; }
+        if (strcmp(device.address,"-")==0) { device.address[0]=0; }
+        if (strcmp(device.serial,"-")==0)  { device.serial[0]=0; }
+
+        if (deviceMatches(&device,requested))
+        {
+            *found = device;
+            result = 1;
+        }
+    }
+    fclose(fp);
+    return result;
+}
+
+static int wasProbed(struct InterfaceProbe * probes,unsigned int numberOfProbes,const char * protocol)
+{
+    unsigned int p;
+    for (p=0; p<numberOfProbes; p++)
+    {
+        if ( (probes[p].interface!=NULL) && (strcmp(probes[p].name,protocol)==0) ) { return 1; }
+    }
+    return 0;
+}
+
+static void writeCache(struct DiscoveryOptions * options,struct InterfaceProbe * probes,unsigned int numberOfProbes)
+{
+    char filename[600],temporaryFilename[620];
+    getCacheFilename(options,filename,600,1);
+    snprintf(temporaryFilename,620,"%s.%d",filename,(int) getpid());
+
+    FILE * fp = fopen(temporaryFilename,"w");
+    if (fp==NULL) { return; }
+
+    unsigned int p,d;
+    long now = (long) time(NULL);
+
+    //Entries of interfaces this discovery did not probe (Fake is only probed when asked for) stay
+    //as they were, with their own discovery time, every other one is replaced by what answered now
+    FILE * previous = fopen(filename,"r");
+    if (previous!=NULL)
+    {
+        char line[1024],protocol[32];
+        long discoveredAt = 0;
+        while (fgets(line,1024,previous)!=NULL)
+        {
+            if (sscanf(line,"%ld\t%31[^\t]",&discoveredAt,protocol)!=2) { continue; }
+            if ( (now-discoveredAt>(long) options->cacheTTL) || (wasProbed(probes,numberOfProbes,protocol)) ) { continue; }
+            fputs(line,fp);
+            if (line[strlen(line)-1]!='\n') { fputc('\n',fp); }
+        }
+        fclose(previous);
+    }
+
+    for (p=0; p<numberOfProbes; p++)
+    {
+        for (d=0; d<probes[p].numberOfDevices; d++)
+        {
+            struct DiscoveredDevice * device = &probes[p].devices[d];
+            fprintf(fp,"%ld\t%s\t%s\t%s\t%s\n",now,device->protocol,
+                    (device->address[0]!=0) ? device->address : "-",
+                    (device->serial[0]!=0)  ? device->serial  : "-",
+                    device->id);
+        }
+    }
+    fclose(fp);
+
+    //Other capture processes may read the cache at the same time, replace it atomically
+    if (rename(temporaryFilename,filename)!=0) { unlink(temporaryFilename); }
+}
+
+//----------------------------------------------------------------------------------------
+// Parallel discovery
+//----------------------------------------------------------------------------------------
+static void *probeInterface(void * ptr)
+{
+    struct InterfaceProbe * probe = (struct InterfaceProbe *) ptr;
+    unsigned long startTime = monotonicMicroseconds();
+    unsigned int i;
+
+    arv_interface_update_device_list(probe->interface);
+
+    probe->numberOfDevices = arv_interface_get_n_devices(probe->interface);
+    if (probe->numberOfDevices>MAX_DISCOVERED_DEVICES) { probe->numberOfDevices = MAX_DISCOVERED_DEVICES; }
+    for (i=0; i<probe->numberOfDevices; i++)
+    {
+        struct DiscoveredDevice * device = &probe->devices[i];
+        copyString(device->id,256,arv_interface_get_device_id(probe->interface,i));
+        copyString(device->address,64,arv_interface_get_device_address(probe->interface,i));
+        copyString(device->serial,128,arv_interface_get_device_serial_nbr(probe->interface,i));
+        copyString(device->protocol,32,arv_interface_get_device_protocol(probe->interface,i));
+        if (device->protocol[0]==0) { copyString(device->protocol,32,probe->name); }
+    }
+
+    probe->microseconds = monotonicMicroseconds() - startTime;
+    return NULL;
+}
+
+static int discoverDevices(struct DiscoveryOptions * options,const char * requested,struct DiscoveredDevice * found)
+{
+    struct InterfaceProbe probes[3];
+    unsigned int numberOfProbes = 0;
+    unsigned int p,d;
+
+    memset(probes,0,sizeof(probes));
+
+    //Interface singletons are created here, on the calling thread, before the probes start
+    probes[numberOfProbes].name = "GigEVision";
+    probes[numberOfProbes].interface = arv_gv_interface_get_instance();
+    numberOfProbes+=1;
+#ifdef HAVE_ARAVIS_USB
+    probes[numberOfProbes].name = "USB3Vision";
+    probes[numberOfProbes].interface = arv_uv_interface_get_instance();
+    numberOfProbes+=1;
+#endif
+    if ( (requested!=NULL) && (strncmp(requested,"Fake",4)==0) )
+    {
+        probes[numberOfProbes].name = "Fake";
+        probes[numberOfProbes].interface = arv_fake_interface_get_instance();
+        numberOfProbes+=1;
+    }
+
+    for (p=0; p<numberOfProbes; p++)
+    {
+        if (probes[p].interface==NULL) { continue; }
+        probes[p].threadStarted = (pthread_create(&probes[p].thread,NULL,probeInterface,&probes[p])==0);
+        if (!probes[p].threadStarted) { probeInterface(&probes[p]); }
+    }
+    for (p=0; p<numberOfProbes; p++)
+    {
+        if (probes[p].threadStarted) { pthread_join(probes[p].thread,NULL); }
+        fprintf(stderr,"Discovery on %s found %u device(s) in %lu ms\n",probes[p].name,probes[p].numberOfDevices,probes[p].microseconds/1000);
+    }
+
+    if (options->cacheTTL!=0) { writeCache(options,probes,numberOfProbes); }
+
+    for (p=0; p<numberOfProbes; p++)
+    {
+        for (d=0; d<probes[p].numberOfDevices; d++)
+        {
+            if (deviceMatches(&probes[p].devices[d],requested))
+            {
+                *found = probes[p].devices[d];
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+//----------------------------------------------------------------------------------------
+// Opening
+//----------------------------------------------------------------------------------------
+static ArvCamera * openDiscoveredDevice(struct DiscoveredDevice * device,struct StartupTimes * times,GError ** error)
+{
+    ArvInterface * interface = interfaceForProtocol(device->protocol);
+    if (interface==NULL)
+    {   //Unknown protocol, let Aravis look for it the usual way
+        unsigned long startTime = monotonicMicroseconds();
+        ArvCamera * camera = arv_camera_new(device->id,error);
+        times->open += monotonicMicroseconds() - startTime;
+        return camera;
+    }
+
+    //GigE devices are reached by address, without a broadcast discovery
+    const char * name = ( (strcmp(device->protocol,"GigEVision")==0) && (device->address[0]!=0) ) ? device->address : device->id;
+
+    unsigned long startTime = monotonicMicroseconds();
+    ArvDevice * arvDevice = arv_interface_open_device(interface,name,error);
+    times->open += monotonicMicroseconds() - startTime;
+    if (arvDevice==NULL) { return NULL; }
+
+    startTime = monotonicMicroseconds();
+    arv_device_get_genicam(arvDevice);
+    ArvCamera * camera = arv_camera_new_with_device(arvDevice,error);
+    times->genicam += monotonicMicroseconds() - startTime;
+
+    g_object_unref(arvDevice);
+    return camera;
+}
+
+ArvCamera * openCameraFast(const char * requested,struct DiscoveryOptions * options,struct StartupTimes * times,GError ** error)
+{
+    struct DiscoveryOptions defaultOptions;
+    struct StartupTimes unusedTimes;
+    if (options==NULL) { setDefaultDiscoveryOptions(&defaultOptions); options=&defaultOptions; }
+    if (times==NULL)   { times=&unusedTimes; }
+    memset(times,0,sizeof(struct StartupTimes));
+
+    if ( (requested!=NULL) && (strncmp(requested,"Fake",4)==0) )
+    {
+        arv_enable_interface("Fake");
+    }
+
+    unsigned int attempt;
+    unsigned int retryDelay = options->retryDelay;
+    for (attempt=0; attempt<=options->retries; attempt++)
+    {
+        struct DiscoveredDevice device;
+        ArvCamera * camera = NULL;
+        times->attempts = attempt+1;
+
+        if (attempt>0)
+        {
+            fprintf(stderr,"Retrying to open camera in %u ms (attempt %u of %u)\n",retryDelay,attempt+1,options->retries+1);
+            usleep(retryDelay*1000);
+            retryDelay*=2;
+        }
+        if ( (error!=NULL) && (*error!=NULL) ) { g_clear_error(error); }
+
+        //1) A recent cache entry, skips discovery altogether
+        if ( (options->cacheTTL!=0) && (findInCache(options,requested,&device)) )
+        {
+            camera = openDiscoveredDevice(&device,times,error);
+            if (camera!=NULL)
+            {
+                times->usedCache = 1;
+                return camera;
+            }
+            fprintf(stderr,"Cached device %s did not answer, rediscovering\n",device.id);
+            if ( (error!=NULL) && (*error!=NULL) ) { g_clear_error(error); }
+        }
+
+        //2) An explicit GigE address can be opened directly
+        if (looksLikeAddress(requested))
+        {
+            memset(&device,0,sizeof(device));
+            copyString(device.id,256,requested);
+            copyString(device.address,64,requested);
+            copyString(device.protocol,32,"GigEVision");
+            camera = openDiscoveredDevice(&device,times,error);
+            if (camera!=NULL) { return camera; }
+            if ( (error!=NULL) && (*error!=NULL) ) { g_clear_error(error); }
+        }
+
+        //3) Probe every interface in parallel
+        unsigned long startTime = monotonicMicroseconds();
+        int found = discoverDevices(options,requested,&device);
+        times->discovery += monotonicMicroseconds() - startTime;
+        if (found)
+        {
+            camera = openDiscoveredDevice(&device,times,error);
+            if (camera!=NULL) { return camera; }
+        } else
+        {
+            fprintf(stderr,"No device matching %s found\n",(requested!=NULL) ? requested : "any id");
+        }
+    }
+
+    if ( (error!=NULL) && (*error==NULL) )
+    {   //Make sure the caller sees a failure even when no Aravis call reported one
+        g_set_error(error,g_quark_from_static_string("device-discovery"),0,"Could not open %s after %u attempts",(requested!=NULL) ? requested : "any camera",times->attempts);
+    }
+    return NULL;
+}
+
+void printStartupTimes(FILE * fp,struct StartupTimes * times)
+{
+    fprintf(fp,"Startup breakdown%s, %u attempt(s) :\n",(times->usedCache) ? " (discovery cache hit)" : "",times->attempts);
+    fprintf(fp,"  discovery   %8.1f ms\n",(float) times->discovery/1000);
+    fprintf(fp,"  open        %8.1f ms\n",(float) times->open/1000);
+    fprintf(fp,"  genicam     %8.1f ms\n",(float) times->genicam/1000);
+    fprintf(fp,"  stream      %8.1f ms\n",(float) times->stream/1000);
+    fprintf(fp,"  first frame %8.1f ms\n",(float) times->firstFrame/1000);
+    fprintf(fp,"  total       %8.1f ms\n",(float) (times->discovery+times->open+times->genicam+times->stream+times->firstFrame)/1000);
+}
@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef DEVICE_DISCOVERY_H_INCLUDED
+#define DEVICE_DISCOVERY_H_INCLUDED
+
+/* Aravis header */
+#include <arv.h>
+
+/* Standard headers */
+#include <stdio.h>
+
+// arv_camera_new(NULL,...) discovers devices on every interface one after the
+// other before connecting. openCameraFast() instead
+//  - opens a device straight away from a local discovery cache when the cached
+//    entry is younger than the TTL (GigE devices are opened by address, which
+//    costs one unicast discovery packet instead of a broadcast on every NIC)
+//  - otherwise probes all interfaces in parallel, one thread per interface,
+//    and refreshes the cache with everything that answered
+//  - retries with a growing delay instead of giving up on the first failure
+
+struct DiscoveryOptions
+{
+    unsigned int cacheTTL;       // Seconds a cached discovery stays valid, 0 disables the cache
+    unsigned int retries;        // Extra attempts after the first failed open
+    unsigned int retryDelay;     // Milliseconds before the first retry, doubled on every retry
+    const char * cacheFile;      // NULL for $XDG_CACHE_HOME/aravis-c-examples/devices
+};
+
+// Where the time between process start and the first frame went, in microseconds
+struct StartupTimes
+{
+    unsigned long discovery;  // Interface probing, 0 when the cache was used
+    unsigned long open;       // Connection to the device, including the GenICam XML download
+    unsigned long genicam;    // GenICam node tree evaluation while the ArvCamera is set up
+    unsigned long stream;     // Stream creation and buffer allocation
+    unsigned long firstFrame; // Acquisition start until the first buffer was popped
+    unsigned int attempts;
+    char usedCache;
+};
+
+void setDefaultDiscoveryOptions(struct DiscoveryOptions * options);
+
+// requested may be NULL (first device found), a device id, a serial number or a device address
+ArvCamera * openCameraFast(const char * requested,struct DiscoveryOptions * options,struct StartupTimes * times,GError ** error);
+
+void printStartupTimes(FILE * fp,struct StartupTimes * times);
+
+#endif // DEVICE_DISCOVERY_H_INCLUDED
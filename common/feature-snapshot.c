@@ -0,0 +1,567 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "feature-snapshot.h"
+#include "timing.h"
+
+/* Standard headers */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static ArvGcPropertyNode * findProperty(ArvGcNode * node,ArvGcPropertyNodeType type)
+{
+    ArvDomNode * child;
+    for (child=arv_dom_node_get_first_child(ARV_DOM_NODE(node)); child!=NULL; child=arv_dom_node_get_next_sibling(child))
+    {
+        if ( (ARV_IS_GC_PROPERTY_NODE(child)) && (arv_gc_property_node_get_node_type(ARV_GC_PROPERTY_NODE(child))==type) )
+        {
+            return ARV_GC_PROPERTY_NODE(child);
+        }
+    }
+    return NULL;
+}
+
+static int isDecodableRegister(ArvGcNode * node)
+{
+    return ( ARV_IS_GC_INT_REG_NODE(node) || ARV_IS_GC_MASKED_INT_REG_NODE(node) || ARV_IS_GC_FLOAT_REG_NODE(node) );
+}
+
+static int hasStaticAddress(ArvGcNode * registerNode)
+{
+    //Registers indexed by a selector (pIndex), with computed addresses (pAddress, inline swiss knives)
+    //or computed lengths move around at runtime, so they can not be prefetched from a fixed block
+    ArvDomNode * child;
+    for (child=arv_dom_node_get_first_child(ARV_DOM_NODE(registerNode)); child!=NULL; child=arv_dom_node_get_next_sibling(child))
+    {
+        if (!ARV_IS_GC_PROPERTY_NODE(child))     { return 0; }
+        if (ARV_IS_GC_INDEX_NODE(child))         { return 0; }
+
+        ArvGcPropertyNodeType type = arv_gc_property_node_get_node_type(ARV_GC_PROPERTY_NODE(child));
+        if ( (type==ARV_GC_PROPERTY_NODE_TYPE_P_ADDRESS) || (type==ARV_GC_PROPERTY_NODE_TYPE_P_LENGTH) ) { return 0; }
+    }
+    return 1;
+}
+
+static int isOnDevicePort(ArvGcNode * registerNode)
+{
+    //Only the device port maps the address to arv_device_read_memory(). Chunk ports read out of the last
+    //buffer, event ports out of the last event and other ports (the transport layer, a second device) have
+    //address spaces of their own, the same address there is not the same register
+    ArvGcPropertyNode * pPort = findProperty(registerNode,ARV_GC_PROPERTY_NODE_TYPE_P_PORT);
+    if (pPort==NULL) { return 0; }
+
+    ArvGcNode * port = arv_gc_property_node_get_linked_node(pPort);
+    if ( (port==NULL) || (!ARV_IS_GC_PORT(port)) ) { return 0; }
+    if (findProperty(port,ARV_GC_PROPERTY_NODE_TYPE_CHUNK_ID)!=NULL) { return 0; }
+    if (findProperty(port,ARV_GC_PROPERTY_NODE_TYPE_EVENT_ID)!=NULL) { return 0; }
+
+    const char * name = arv_gc_feature_node_get_name(ARV_GC_FEATURE_NODE(port));
+    return ( (name!=NULL) && (strcmp(name,"Device")==0) );
+}
+
+static void resolveRegister(struct FeatureSnapshotEntry * entry)
+{
+    ArvGcNode * registerNode = NULL;
+    ArvGcNode * node = ARV_GC_NODE(entry->node);
+    GError * error = NULL;
+
+    if (isDecodableRegister(node))
+    {
+        registerNode = node;
+    } else
+    if ( ARV_IS_GC_INTEGER_NODE(node) || ARV_IS_GC_FLOAT_NODE(node) || ARV_IS_GC_ENUMERATION(node) )
+    {
+        //Plain value nodes forward their value from the node pointed to by pValue
+        ArvGcPropertyNode * pValue = findProperty(node,ARV_GC_PROPERTY_NODE_TYPE_P_VALUE);
+        if (pValue!=NULL)
+        {
+            registerNode = arv_gc_property_node_get_linked_node(pValue);
+        }
+    }
+
+    if ( (registerNode==NULL) || (!isDecodableRegister(registerNode)) || (!hasStaticAddress(registerNode)) || (!isOnDevicePort(registerNode)) )
+    {
+        return;
+    }
+
+    guint64 address = arv_gc_register_get_address(ARV_GC_REGISTER(registerNode),&error);
+    guint64 length  = (error==NULL) ? arv_gc_register_get_length(ARV_GC_REGISTER(registerNode),&error) : 0;
+    if (error!=NULL)
+    {
+        g_clear_error(&error);
+        return;
+    }
+
+    entry->isFloatRegister = ARV_IS_GC_FLOAT_REG_NODE(registerNode);
+    if (entry->isFloatRegister)
+    {
+        if ( (length!=4) && (length!=8) ) { return; }
+    } else
+    {
+        if ( (length==0) || (length>8) )  { return; }
+    }
+
+    //GenICam defaults are little endian, unsigned and the full register width
+    ArvGcPropertyNode * property;
+    entry->isBigEndian = 0;
+    entry->isSigned    = 0;
+    entry->lsb         = 0;
+    entry->msb         = (unsigned int) (8*length-1);
+
+    property = findProperty(registerNode,ARV_GC_PROPERTY_NODE_TYPE_ENDIANNESS);
+    if (property!=NULL) { entry->isBigEndian = (arv_gc_property_node_get_endianness(property,G_LITTLE_ENDIAN)==G_BIG_ENDIAN); }
+
+    property = findProperty(registerNode,ARV_GC_PROPERTY_NODE_TYPE_SIGN);
+    if (property!=NULL) { entry->isSigned = (arv_gc_property_node_get_sign(property,ARV_GC_SIGNEDNESS_UNSIGNED)==ARV_GC_SIGNEDNESS_SIGNED); }
+
+    if (ARV_IS_GC_MASKED_INT_REG_NODE(registerNode))
+    {
+        ArvGcPropertyNode * lsb = findProperty(registerNode,ARV_GC_PROPERTY_NODE_TYPE_LSB);
+        ArvGcPropertyNode * msb = findProperty(registerNode,ARV_GC_PROPERTY_NODE_TYPE_MSB);
+        ArvGcPropertyNode * bit = findProperty(registerNode,ARV_GC_PROPERTY_NODE_TYPE_BIT);
+        if (bit!=NULL)
+        {
+            entry->lsb = entry->msb = (unsigned int) arv_gc_property_node_get_int64(bit,NULL);
+        } else
+        {
+            if (lsb!=NULL) { entry->lsb = (unsigned int) arv_gc_property_node_get_int64(lsb,NULL); }
+            if (msb!=NULL) { entry->msb = (unsigned int) arv_gc_property_node_get_int64(msb,NULL); }
+        }
+
+        if (entry->isBigEndian)
+        {   //Big endian registers number their bits starting from the most significant one
+            entry->lsb = (unsigned int) (8*length-1) - entry->lsb;
+            entry->msb = (unsigned int) (8*length-1) - entry->msb;
+        }
+        if (entry->lsb>entry->msb)
+        {
+            unsigned int swap = entry->lsb;
+            entry->lsb = entry->msb;
+            entry->msb = swap;
+        }
+        if (entry->msb>=8*length) { return; }
+    }
+
+    entry->address     = address;
+    entry->length      = length;
+    entry->hasRegister = 1;
+}
+
+static void addEntry(struct FeatureSnapshot * snapshot,ArvGcFeatureNode * node,unsigned int kind)
+{
+    if (snapshot->numberOfEntries>=snapshot->allocatedEntries)
+    {
+        unsigned int newSize = (snapshot->allocatedEntries==0) ? 256 : snapshot->allocatedEntries*2;
+        struct FeatureSnapshotEntry * newEntries = realloc(snapshot->entries,newSize*sizeof(struct FeatureSnapshotEntry));
+        if (newEntries==NULL) { return; }
+        snapshot->entries          = newEntries;
+        snapshot->allocatedEntries = newSize;
+    }
+
+    struct FeatureSnapshotEntry * entry = &snapshot->entries[snapshot->numberOfEntries];
+    memset(entry,0,sizeof(struct FeatureSnapshotEntry));
+    entry->name = g_strdup(arv_gc_feature_node_get_name(node));
+    entry->node = node;
+    entry->kind = kind;
+    resolveRegister(entry);
+    snapshot->numberOfEntries+=1;
+}
+
+static void walkNode(struct FeatureSnapshot * snapshot,ArvGc * genicam,const char * name,GHashTable * visited)
+{
+    if (g_hash_table_contains(visited,name)) { return; }
+    g_hash_table_add(visited,(gpointer) name);
+
+    ArvGcNode * node = arv_gc_get_node(genicam,name);
+    if (!ARV_IS_GC_FEATURE_NODE(node)) { return; }
+
+    if (ARV_IS_GC_CATEGORY(node))
+    {
+        const GSList * iter;
+        for (iter=arv_gc_category_get_features(ARV_GC_CATEGORY(node)); iter!=NULL; iter=iter->next)
+        {
+            walkNode(snapshot,genicam,(const char *) iter->data,visited);
+        }
+        return;
+    }
+
+    ArvGcFeatureNode * feature = ARV_GC_FEATURE_NODE(node);
+    if ( (!arv_gc_feature_node_is_implemented(feature,NULL)) || (!arv_gc_feature_node_is_available(feature,NULL)) ) { return; }
+    if (arv_gc_feature_node_get_actual_access_mode(feature)==ARV_GC_ACCESS_MODE_WO) { return; }
+
+    //Enumerations and booleans also expose the integer interface, so test them first
+    if (ARV_IS_GC_ENUMERATION(node))   { addEntry(snapshot,feature,FEATURE_KIND_ENUMERATION); } else
+    if (ARV_IS_GC_BOOLEAN(node))       { addEntry(snapshot,feature,FEATURE_KIND_BOOLEAN);     } else
+    if (ARV_IS_GC_STRING(node))        { addEntry(snapshot,feature,FEATURE_KIND_STRING);      } else
+    if (ARV_IS_GC_FLOAT(node))         { addEntry(snapshot,feature,FEATURE_KIND_FLOAT);       } else
+    if (ARV_IS_GC_INTEGER(node))       { addEntry(snapshot,feature,FEATURE_KIND_INTEGER);     }
+    //Commands and raw registers are not values, skip them
+}
+
+static struct FeatureSnapshot * sortSnapshotForBlocks;
+static int compareRegisterAddresses(const void * a,const void * b)
+{
+    const struct FeatureSnapshotEntry * ea = &sortSnapshotForBlocks->entries[*(const unsigned int *) a];
+    const struct FeatureSnapshotEntry * eb = &sortSnapshotForBlocks->entries[*(const unsigned int *) b];
+    if (ea->address<eb->address) { return -1; }
+    if (ea->address>eb->address) { return 1;  }
+    return 0;
+}
+
+static void buildBlocks(struct FeatureSnapshot * snapshot)
+{
+    unsigned int i;
+    snapshot->numberOfRegisters = 0;
+    snapshot->registerOrder = malloc((snapshot->numberOfEntries+1)*sizeof(unsigned int));
+    if (snapshot->registerOrder==NULL) { return; }
+
+    for (i=0; i<snapshot->numberOfEntries; i++)
+    {
+        if (snapshot->entries[i].hasRegister) { snapshot->registerOrder[snapshot->numberOfRegisters++]=i; }
+    }
+    sortSnapshotForBlocks = snapshot;
+    qsort(snapshot->registerOrder,snapshot->numberOfRegisters,sizeof(unsigned int),compareRegisterAddresses);
+
+    //Greedily grow a block as long as the next register starts within maxGap bytes of its end
+    //and the whole read stays within one maxBlockSize transaction
+    snapshot->blocks = calloc(snapshot->numberOfRegisters+1,sizeof(struct FeatureSnapshotBlock));
+    if (snapshot->blocks==NULL) { return; }
+    snapshot->numberOfBlocks = 0;
+
+    struct FeatureSnapshotBlock * block = NULL;
+    for (i=0; i<snapshot->numberOfRegisters; i++)
+    {
+        struct FeatureSnapshotEntry * entry = &snapshot->entries[snapshot->registerOrder[i]];
+        guint64 entryEnd = entry->address + entry->length;
+
+        if (block!=NULL)
+        {
+            guint64 blockEnd = block->address + block->length;
+            if ( (entry->address<=blockEnd+snapshot->maxGap) && (entryEnd-block->address<=snapshot->maxBlockSize) )
+            {
+                if (entryEnd>blockEnd) { block->length = (unsigned int) (entryEnd - block->address); }
+                block->lastEntry = i;
+                entry->blockIndex  = snapshot->numberOfBlocks-1;
+                entry->blockOffset = (unsigned int) (entry->address - block->address);
+                continue;
+            }
+        }
+
+        block = &snapshot->blocks[snapshot->numberOfBlocks];
+        block->address    = entry->address;
+        block->length     = (unsigned int) entry->length;
+        block->firstEntry = i;
+        block->lastEntry  = i;
+        entry->blockIndex  = snapshot->numberOfBlocks;
+        entry->blockOffset = 0;
+        snapshot->numberOfBlocks+=1;
+    }
+
+    for (i=0; i<snapshot->numberOfBlocks; i++)
+    {
+        snapshot->blocks[i].data = malloc(snapshot->blocks[i].length);
+    }
+}
+
+struct FeatureSnapshot * featureSnapshotCreate(ArvDevice * device,unsigned int maxBlockSize,unsigned int maxGap)
+{
+    if (device==NULL) { return NULL; }
+    ArvGc * genicam = arv_device_get_genicam(device);
+    if (genicam==NULL) { return NULL; }
+
+    struct FeatureSnapshot * snapshot = calloc(1,sizeof(struct FeatureSnapshot));
+    if (snapshot==NULL) { return NULL; }
+
+    snapshot->device       = device;
+    snapshot->maxBlockSize = (maxBlockSize<8) ? 8 : maxBlockSize;
+    snapshot->maxGap       = maxGap;
+
+    unsigned long startTime = monotonicMicroseconds();
+    GHashTable * visited = g_hash_table_new(g_str_hash,g_str_equal);
+    walkNode(snapshot,genicam,"Root",visited);
+    g_hash_table_destroy(visited);
+    buildBlocks(snapshot);
+    snapshot->walkMicroseconds = monotonicMicroseconds() - startTime;
+
+    return snapshot;
+}
+
+static guint64 decodeRaw(const unsigned char * data,unsigned int length,char bigEndian)
+{
+    guint64 raw = 0;
+    unsigned int i;
+    if (bigEndian)
+    {
+        for (i=0; i<length; i++) { raw = (raw<<8) | data[i]; }
+    } else
+    {
+        for (i=length; i>0; i--) { raw = (raw<<8) | data[i-1]; }
+    }
+    return raw;
+}
+
+static gint64 decodeInteger(struct FeatureSnapshotEntry * entry,const unsigned char * data)
+{
+    guint64 raw  = decodeRaw(data,(unsigned int) entry->length,entry->isBigEndian);
+    unsigned int bits = entry->msb - entry->lsb + 1;
+    guint64 value = raw >> entry->lsb;
+    if (bits<64)
+    {
+        value &= (((guint64) 1)<<bits) - 1;
+        if ( (entry->isSigned) && (value & (((guint64) 1)<<(bits-1))) )
+        {
+            value |= ~((((guint64) 1)<<bits) - 1);
+        }
+    }
+    return (gint64) value;
+}
+
+static double decodeFloat(struct FeatureSnapshotEntry * entry,const unsigned char * data)
+{
+    guint64 raw = decodeRaw(data,(unsigned int) entry->length,entry->isBigEndian);
+    if (entry->length==4)
+    {
+        guint32 raw32 = (guint32) raw;
+        float value;
+        memcpy(&value,&raw32,sizeof(float));
+        return value;
+    }
+    double value;
+    memcpy(&value,&raw,sizeof(double));
+    return value;
+}
+
+static int decodeFromBlock(struct FeatureSnapshot * snapshot,struct FeatureSnapshotEntry * entry)
+{
+    struct FeatureSnapshotBlock * block = &snapshot->blocks[entry->blockIndex];
+    const unsigned char * data = block->data + entry->blockOffset;
+
+    switch (entry->kind)
+    {
+    case FEATURE_KIND_INTEGER:
+        if (entry->isFloatRegister) { return 0; }
+        entry->integerValue = decodeInteger(entry,data);
+        return 1;
+
+    case FEATURE_KIND_FLOAT:
+        entry->floatValue = (entry->isFloatRegister) ? decodeFloat(entry,data) : (double) decodeInteger(entry,data);
+        return 1;
+
+    case FEATURE_KIND_ENUMERATION:
+    {
+        if (entry->isFloatRegister) { return 0; }
+        gint64 value = decodeInteger(entry,data);
+        const GSList * iter;
+        for (iter=arv_gc_enumeration_get_entries(ARV_GC_ENUMERATION(entry->node)); iter!=NULL; iter=iter->next)
+        {
+            GError * error = NULL;
+            gint64 entryValue = arv_gc_enum_entry_get_value(ARV_GC_ENUM_ENTRY(iter->data),&error);
+            if (error!=NULL) { g_clear_error(&error); continue; }
+            if (entryValue==value)
+            {
+                entry->integerValue = value;
+                entry->stringValue  = g_strdup(arv_gc_feature_node_get_name(ARV_GC_FEATURE_NODE(iter->data)));
+                return 1;
+            }
+        }
+        return 0; //Not a known entry, let Aravis deal with it
+    }
+    }
+    return 0;
+}
+
+static int readThroughFeature(struct FeatureSnapshot * snapshot,struct FeatureSnapshotEntry * entry)
+{
+    GError * error = NULL;
+    const char * text = NULL;
+
+    switch (entry->kind)
+    {
+    case FEATURE_KIND_INTEGER:
+        entry->integerValue = arv_gc_integer_get_value(ARV_GC_INTEGER(entry->node),&error);
+        break;
+    case FEATURE_KIND_FLOAT:
+        entry->floatValue = arv_gc_float_get_value(ARV_GC_FLOAT(entry->node),&error);
+        break;
+    case FEATURE_KIND_BOOLEAN:
+        entry->integerValue = arv_gc_boolean_get_value(ARV_GC_BOOLEAN(entry->node),&error);
+        break;
+    case FEATURE_KIND_ENUMERATION:
+        text = arv_gc_enumeration_get_string_value(ARV_GC_ENUMERATION(entry->node),&error);
+        break;
+    case FEATURE_KIND_STRING:
+        text = arv_gc_string_get_value(ARV_GC_STRING(entry->node),&error);
+        break;
+    }
+    snapshot->featureReads+=1;
+
+    if (error!=NULL)
+    {
+        g_clear_error(&error);
+        return 0;
+    }
+    if (text!=NULL) { entry->stringValue = g_strdup(text); }
+    return 1;
+}
+
+static void readBlock(struct FeatureSnapshot * snapshot,struct FeatureSnapshotBlock * block)
+{
+    unsigned int i;
+    GError * error = NULL;
+
+    if ( (block->data==NULL) || (block->length==0) ) { return; }
+
+    if (!block->split)
+    {
+        snapshot->blockReads+=1;
+        if (arv_device_read_memory(snapshot->device,block->address,block->length,block->data,&error))
+        {
+            for (i=block->firstEntry; i<=block->lastEntry; i++) { snapshot->entries[snapshot->registerOrder[i]].valid=1; }
+            return;
+        }
+        g_clear_error(&error);
+        snapshot->blockReadFailures+=1;
+
+        //Some devices refuse reads that span unmapped addresses between registers,
+        //remember it and fetch the registers of this block one by one from now on
+        block->split = (block->firstEntry!=block->lastEntry);
+        if (!block->split) { return; }
+    }
+
+    for (i=block->firstEntry; i<=block->lastEntry; i++)
+    {
+        struct FeatureSnapshotEntry * entry = &snapshot->entries[snapshot->registerOrder[i]];
+        snapshot->blockReads+=1;
+        if (arv_device_read_memory(snapshot->device,entry->address,(guint32) entry->length,block->data+entry->blockOffset,&error))
+        {
+            entry->valid = 1;
+        } else
+        {
+            g_clear_error(&error);
+            snapshot->blockReadFailures+=1;
+        }
+    }
+}
+
+int featureSnapshotCapture(struct FeatureSnapshot * snapshot)
+{
+    if (snapshot==NULL) { return 0; }
+
+    unsigned int i;
+    unsigned long startTime = monotonicMicroseconds();
+
+    snapshot->blockReads        = 0;
+    snapshot->blockReadFailures = 0;
+    snapshot->featureReads      = 0;
+    snapshot->decodedFromBlocks = 0;
+
+    for (i=0; i<snapshot->numberOfEntries; i++)
+    {
+        struct FeatureSnapshotEntry * entry = &snapshot->entries[i];
+        g_free(entry->stringValue);
+        entry->stringValue = NULL;
+        entry->valid       = 0;
+        entry->fromBlock   = 0;
+    }
+
+    for (i=0; i<snapshot->numberOfBlocks; i++)
+    {
+        readBlock(snapshot,&snapshot->blocks[i]);
+    }
+
+    unsigned int captured = 0;
+    for (i=0; i<snapshot->numberOfEntries; i++)
+    {
+        struct FeatureSnapshotEntry * entry = &snapshot->entries[i];
+        if ( (entry->hasRegister) && (entry->valid) && (decodeFromBlock(snapshot,entry)) )
+        {
+            entry->fromBlock = 1;
+            snapshot->decodedFromBlocks+=1;
+        } else
+        {
+            entry->valid = readThroughFeature(snapshot,entry);
+        }
+        captured += entry->valid;
+    }
+
+    snapshot->captureMicroseconds = monotonicMicroseconds() - startTime;
+    return (captured==snapshot->numberOfEntries);
+}
+
+static void writeJSONString(FILE * fp,const char * text)
+{
+    fputc('"',fp);
+    for ( ; (text!=NULL) && (*text!=0); text++)
+    {
+        unsigned char c = (unsigned char) *text;
+        if ( (c=='"') || (c=='\\') ) { fprintf(fp,"\\%c",c);     } else
+        if (c<0x20)                   { fprintf(fp,"\\u%04x",c);  } else
+                                      { fputc(c,fp);              }
+    }
+    fputc('"',fp);
+}
+
+int featureSnapshotWriteJSON(FILE * fp,struct FeatureSnapshot * snapshot)
+{
+    if ( (fp==NULL) || (snapshot==NULL) ) { return 0; }
+
+    unsigned int i;
+    fprintf(fp,"{\n\"features\": {\n");
+    for (i=0; i<snapshot->numberOfEntries; i++)
+    {
+        struct FeatureSnapshotEntry * entry = &snapshot->entries[i];
+        fprintf(fp,"  ");
+        writeJSONString(fp,entry->name);
+        fprintf(fp,": ");
+
+        if (!entry->valid) { fprintf(fp,"null"); } else
+        switch (entry->kind)
+        {
+        case FEATURE_KIND_INTEGER:
+            fprintf(fp,"%lld",(long long) entry->integerValue);
+            break;
+        case FEATURE_KIND_FLOAT:
+            if (isfinite(entry->floatValue)) { fprintf(fp,"%.17g",entry->floatValue); } else { fprintf(fp,"null"); }
+            break;
+        case FEATURE_KIND_BOOLEAN:
+            fprintf(fp,"%s",(entry->integerValue) ? "true" : "false");
+            break;
+        default:
+            writeJSONString(fp,entry->stringValue);
+            break;
+        }
+        fprintf(fp,"%s\n",(i+1<snapshot->numberOfEntries) ? "," : "");
+    }
+    fprintf(fp,"},\n\"snapshot\": {\n");
+    fprintf(fp,"  \"features\": %u,\n",snapshot->numberOfEntries);
+    fprintf(fp,"  \"registerBacked\": %u,\n",snapshot->numberOfRegisters);
+    fprintf(fp,"  \"blocks\": %u,\n",snapshot->numberOfBlocks);
+    fprintf(fp,"  \"blockReads\": %u,\n",snapshot->blockReads);
+    fprintf(fp,"  \"blockReadFailures\": %u,\n",snapshot->blockReadFailures);
+    fprintf(fp,"  \"decodedFromBlocks\": %u,\n",snapshot->decodedFromBlocks);
+    fprintf(fp,"  \"featureReads\": %u,\n",snapshot->featureReads);
+    fprintf(fp,"  \"walkMicroseconds\": %lu,\n",snapshot->walkMicroseconds);
+    fprintf(fp,"  \"captureMicroseconds\": %lu\n",snapshot->captureMicroseconds);
+    fprintf(fp,"}\n}\n");
+    return 1;
+}
+
+void featureSnapshotDestroy(struct FeatureSnapshot * snapshot)
+{
+    if (snapshot==NULL) { return; }
+
+    unsigned int i;
+    for (i=0; i<snapshot->numberOfEntries; i++)
+    {
+        g_free(snapshot->entries[i].name);
+        g_free(snapshot->entries[i].stringValue);
+    }
+    for (i=0; i<snapshot->numberOfBlocks; i++)
+    {
+        free(snapshot->blocks[i].data);
+    }
+    free(snapshot->blocks);
+    free(snapshot->registerOrder);
+    free(snapshot->entries);
+    free(snapshot);
+}
@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef FEATURE_SNAPSHOT_H_INCLUDED
+#define FEATURE_SNAPSHOT_H_INCLUDED
+
+/* Aravis header */
+#include <arv.h>
+
+/* Standard headers */
+#include <stdio.h>
+
+// A feature snapshot walks the GenICam node tree of a device once and keeps the
+// node handles of every readable feature. Each capture then prefetches the
+// registers backing those features with as few block reads as possible and
+// decodes the simple register backed features (IntReg, MaskedIntReg, FloatReg
+// and Integer/Float/Enumeration nodes whose pValue points to one of them)
+// straight out of the prefetched blocks. Only registers on the Device port are
+// prefetched, chunk, event and other port registers live in address spaces of
+// their own. Everything else falls back to the regular per-feature Aravis path.
+
+enum FeatureKind
+{
+    FEATURE_KIND_INTEGER = 0,
+    FEATURE_KIND_FLOAT,
+    FEATURE_KIND_BOOLEAN,
+    FEATURE_KIND_ENUMERATION,
+    FEATURE_KIND_STRING
+};
+
+struct FeatureSnapshotEntry
+{
+    char * name;
+    ArvGcFeatureNode * node;
+    unsigned int kind;
+
+    //Register backing this feature, resolved once while walking the tree
+    char hasRegister;
+    char isFloatRegister;
+    char isSigned;
+    char isBigEndian;
+    unsigned int lsb,msb;
+    guint64 address;
+    guint64 length;
+    unsigned int blockIndex;
+    unsigned int blockOffset;
+
+    //Value of the last capture
+    char   fromBlock;
+    char   valid;
+    gint64 integerValue;
+    double floatValue;
+    char * stringValue;
+};
+
+struct FeatureSnapshotBlock
+{
+    guint64 address;
+    unsigned int length;
+    unsigned char * data;
+    unsigned int firstEntry,lastEntry; // Range in registerOrder
+    char split;                        // The device refused this block once, read its registers one by one
+};
+
+struct FeatureSnapshot
+{
+    ArvDevice * device;
+
+    struct FeatureSnapshotEntry * entries;
+    unsigned int numberOfEntries;
+    unsigned int allocatedEntries;
+
+    unsigned int * registerOrder; // Indices of the register backed entries sorted by address
+    unsigned int numberOfRegisters;
+
+    struct FeatureSnapshotBlock * blocks;
+    unsigned int numberOfBlocks;
+
+    unsigned int maxBlockSize; // Largest single read_memory transaction
+    unsigned int maxGap;       // Largest unused gap between two registers that is still read through
+
+    //Statistics of the last capture
+    unsigned int blockReads;
+    unsigned int blockReadFailures;
+    unsigned int featureReads;
+    unsigned int decodedFromBlocks;
+    unsigned long walkMicroseconds;
+    unsigned long captureMicroseconds;
+};
+
+struct FeatureSnapshot * featureSnapshotCreate(ArvDevice * device,unsigned int maxBlockSize,unsigned int maxGap);
+int featureSnapshotCapture(struct FeatureSnapshot * snapshot);
+int featureSnapshotWriteJSON(FILE * fp,struct FeatureSnapshot * snapshot);
+void featureSnapshotDestroy(struct FeatureSnapshot * snapshot);
+
+#endif // FEATURE_SNAPSHOT_H_INCLUDED
@@ -0,0 +1,395 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "frame-correction.h"
+#include "pnm.h"
+#include "timing.h"
+
+/* Standard headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define FRAME_CORRECTION_X86 1
+#endif
+
+typedef void (*CorrectionKernel8)(unsigned char * pixels,const struct FrameCorrectionBlock * blocks,unsigned long samples);
+typedef void (*CorrectionKernel16)(unsigned short * pixels,const struct FrameCorrectionBlock * blocks,unsigned long samples,unsigned int maxValue);
+
+//----------------------------------------------------------------------------------------
+// Portable kernels
+//----------------------------------------------------------------------------------------
+static void correct8Scalar(unsigned char * pixels,const struct FrameCorrectionBlock * blocks,unsigned long samples)
+{
+    unsigned long i;
+    for (i=0; i<samples; i++)
+    {
+        const struct FrameCorrectionBlock * block = &blocks[i/FRAME_CORRECTION_BLOCK];
+        unsigned int j = i % FRAME_CORRECTION_BLOCK;
+        unsigned int signal = (pixels[i]>block->dark[j]) ? pixels[i]-block->dark[j] : 0;
+        unsigned int value  = (signal*block->gain[j]) >> FRAME_CORRECTION_GAIN_SHIFT;
+        pixels[i] = (value>255) ? 255 : (unsigned char) value;
+    }
+}
+
+static void correct16Scalar(unsigned short * pixels,const struct FrameCorrectionBlock * blocks,unsigned long samples,unsigned int maxValue)
+{
+    unsigned long i;
+    for (i=0; i<samples; i++)
+    {
+        const struct FrameCorrectionBlock * block = &blocks[i/FRAME_CORRECTION_BLOCK];
+        unsigned int j = i % FRAME_CORRECTION_BLOCK;
+        unsigned int signal = (pixels[i]>block->dark[j]) ? pixels[i]-block->dark[j] : 0;
+        unsigned int value  = (signal*block->gain[j]) >> FRAME_CORRECTION_GAIN_SHIFT;
+        pixels[i] = (value>maxValue) ? (unsigned short) maxValue : (unsigned short) value;
+    }
+}
+
+#if FRAME_CORRECTION_X86
+//----------------------------------------------------------------------------------------
+// SSE2 kernels
+//----------------------------------------------------------------------------------------
+// 8 bit signals are at most 255, shifted left by 4 the high half of the 16x16 product is signal*gain >> 12
+__attribute__((target("sse2")))
+static void correct8SSE2(unsigned char * pixels,const struct FrameCorrectionBlock * blocks,unsigned long samples)
+{
+    const __m128i zero = _mm_setzero_si128();
+    unsigned long fullBlocks = samples / FRAME_CORRECTION_BLOCK;
+    unsigned long b;
+    for (b=0; b<fullBlocks; b++)
+    {
+        unsigned char * p = pixels + b*FRAME_CORRECTION_BLOCK;
+        __m128i raw = _mm_loadu_si128((const __m128i *) p);
+        __m128i x0 = _mm_subs_epu16(_mm_unpacklo_epi8(raw,zero),_mm_loadu_si128((const __m128i *) blocks[b].dark));
+        __m128i x1 = _mm_subs_epu16(_mm_unpackhi_epi8(raw,zero),_mm_loadu_si128((const __m128i *) (blocks[b].dark+8)));
+        __m128i y0 = _mm_mulhi_epu16(_mm_slli_epi16(x0,16-FRAME_CORRECTION_GAIN_SHIFT),_mm_loadu_si128((const __m128i *) blocks[b].gain));
+        __m128i y1 = _mm_mulhi_epu16(_mm_slli_epi16(x1,16-FRAME_CORRECTION_GAIN_SHIFT),_mm_loadu_si128((const __m128i *) (blocks[b].gain+8)));
+        _mm_storeu_si128((__m128i *) p,_mm_packus_epi16(y0,y1));
+    }
+    unsigned long done = fullBlocks*FRAME_CORRECTION_BLOCK;
+    if (done<samples) { correct8Scalar(pixels+done,blocks+fullBlocks,samples-done); }
+}
+
+// signal*gain >> 12 from the high and low halves of the product, saturated, then clamped to maxValue
+__attribute__((target("sse2")))
+static inline __m128i correctLanes16SSE2(__m128i raw,__m128i dark,__m128i gain,__m128i limit)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i sign = _mm_set1_epi16((short) 0x8000);
+    __m128i x  = _mm_subs_epu16(raw,dark);
+    __m128i hi = _mm_mulhi_epu16(x,gain);
+    __m128i lo = _mm_mullo_epi16(x,gain);
+    __m128i y  = _mm_or_si128(_mm_slli_epi16(hi,16-FRAME_CORRECTION_GAIN_SHIFT),_mm_srli_epi16(lo,FRAME_CORRECTION_GAIN_SHIFT));
+    __m128i fits = _mm_cmpeq_epi16(_mm_srli_epi16(hi,FRAME_CORRECTION_GAIN_SHIFT),zero);
+    y = _mm_or_si128(_mm_and_si128(fits,y),_mm_andnot_si128(fits,_mm_set1_epi16(-1)));
+    //No unsigned 16 bit min before SSE4.1, flipping the sign bit makes the signed one work
+    return _mm_xor_si128(_mm_min_epi16(_mm_xor_si128(y,sign),limit),sign);
+}
+
+__attribute__((target("sse2")))
+static void correct16SSE2(unsigned short * pixels,const struct FrameCorrectionBlock * blocks,unsigned long samples,unsigned int maxValue)
+{
+    const __m128i limit = _mm_set1_epi16((short) (maxValue ^ 0x8000));
+    unsigned long fullBlocks = samples / FRAME_CORRECTION_BLOCK;
+    unsigned long b;
+    for (b=0; b<fullBlocks; b++)
+    {
+        unsigned short * p = pixels + b*FRAME_CORRECTION_BLOCK;
+        __m128i y0 = correctLanes16SSE2(_mm_loadu_si128((const __m128i *) p),
+                                        _mm_loadu_si128((const __m128i *) blocks[b].dark),
+                                        _mm_loadu_si128((const __m128i *) blocks[b].gain),limit);
+        __m128i y1 = correctLanes16SSE2(_mm_loadu_si128((const __m128i *) (p+8)),
+                                        _mm_loadu_si128((const __m128i *) (blocks[b].dark+8)),
+                                        _mm_loadu_si128((const __m128i *) (blocks[b].gain+8)),limit);
+        _mm_storeu_si128((__m128i *) p,y0);
+        _mm_storeu_si128((__m128i *) (p+8),y1);
+    }
+    unsigned long done = fullBlocks*FRAME_CORRECTION_BLOCK;
+    if (done<samples) { correct16Scalar(pixels+done,blocks+fullBlocks,samples-done,maxValue); }
+}
+
+//----------------------------------------------------------------------------------------
+// AVX2 kernels
+//----------------------------------------------------------------------------------------
+__attribute__((target("avx2")))
+static void correct8AVX2(unsigned char * pixels,const struct FrameCorrectionBlock * blocks,unsigned long samples)
+{
+    unsigned long fullBlocks = samples / FRAME_CORRECTION_BLOCK;
+    unsigned long b;
+    for (b=0; b<fullBlocks; b++)
+    {
+        unsigned char * p = pixels + b*FRAME_CORRECTION_BLOCK;
+        __m256i raw = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) p));
+        __m256i x   = _mm256_subs_epu16(raw,_mm256_loadu_si256((const __m256i *) blocks[b].dark));
+        __m256i y   = _mm256_mulhi_epu16(_mm256_slli_epi16(x,16-FRAME_CORRECTION_GAIN_SHIFT),_mm256_loadu_si256((const __m256i *) blocks[b].gain));
+        _mm_storeu_si128((__m128i *) p,_mm_packus_epi16(_mm256_castsi256_si128(y),_mm256_extracti128_si256(y,1)));
+    }
+    unsigned long done = fullBlocks*FRAME_CORRECTION_BLOCK;
+    if (done<samples) { correct8Scalar(pixels+done,blocks+fullBlocks,samples-done); }
+}
+
+__attribute__((target("avx2")))
+static void correct16AVX2(unsigned short * pixels,const struct FrameCorrectionBlock * blocks,unsigned long samples,unsigned int maxValue)
+{
+    const __m256i zero  = _mm256_setzero_si256();
+    const __m256i ones  = _mm256_set1_epi16(-1);
+    const __m256i limit = _mm256_set1_epi16((short) maxValue);
+    unsigned long fullBlocks = samples / FRAME_CORRECTION_BLOCK;
+    unsigned long b;
+    for (b=0; b<fullBlocks; b++)
+    {
+        unsigned short * p = pixels + b*FRAME_CORRECTION_BLOCK;
+        __m256i gain = _mm256_loadu_si256((const __m256i *) blocks[b].gain);
+        __m256i x  = _mm256_subs_epu16(_mm256_loadu_si256((const __m256i *) p),_mm256_loadu_si256((const __m256i *) blocks[b].dark));
+        __m256i hi = _mm256_mulhi_epu16(x,gain);
+        __m256i lo = _mm256_mullo_epi16(x,gain);
+        __m256i y  = _mm256_or_si256(_mm256_slli_epi16(hi,16-FRAME_CORRECTION_GAIN_SHIFT),_mm256_srli_epi16(lo,FRAME_CORRECTION_GAIN_SHIFT));
+        __m256i fits = _mm256_cmpeq_epi16(_mm256_srli_epi16(hi,FRAME_CORRECTION_GAIN_SHIFT),zero);
+        y = _mm256_blendv_epi8(ones,y,fits);
+        _mm256_storeu_si256((__m256i *) p,_mm256_min_epu16(y,limit));
+    }
+    unsigned long done = fullBlocks*FRAME_CORRECTION_BLOCK;
+    if (done<samples) { correct16Scalar(pixels+done,blocks+fullBlocks,samples-done,maxValue); }
+}
+#endif // FRAME_CORRECTION_X86
+
+
+//----------------------------------------------------------------------------------------
+// Dispatch
+//----------------------------------------------------------------------------------------
+struct FrameCorrectionKernel
+{
+    const char * name;
+    CorrectionKernel8  correct8;
+    CorrectionKernel16 correct16;
+};
+
+static const struct FrameCorrectionKernel kernels[] =
+{
+#if FRAME_CORRECTION_X86
+    { "avx2",   correct8AVX2,   correct16AVX2   },
+    { "sse2",   correct8SSE2,   correct16SSE2   },
+#endif
+    { "scalar", correct8Scalar, correct16Scalar }
+};
+#define NUMBER_OF_KERNELS (sizeof(kernels)/sizeof(kernels[0]))
+
+static const struct FrameCorrectionKernel * selectedKernel = 0;
+
+static int cpuCanRun(const struct FrameCorrectionKernel * kernel)
+{
+#if FRAME_CORRECTION_X86
+    if (strcmp(kernel->name,"avx2")==0) { return __builtin_cpu_supports("avx2"); }
+    if (strcmp(kernel->name,"sse2")==0) { return __builtin_cpu_supports("sse2"); }
+#endif
+    return 1;
+}
+
+static const struct FrameCorrectionKernel * currentKernel()
+{
+    if (selectedKernel==0)
+    {
+        //Kernels are listed fastest first
+        unsigned int i=0;
+        for (i=0; i<NUMBER_OF_KERNELS; i++)
+        {
+            if (cpuCanRun(&kernels[i])) { selectedKernel=&kernels[i]; break; }
+        }
+    }
+    return selectedKernel;
+}
+
+const char * frameCorrectionKernel()
+{
+    return currentKernel()->name;
+}
+
+int selectFrameCorrectionKernel(const char * name)
+{
+    unsigned int i=0;
+    for (i=0; i<NUMBER_OF_KERNELS; i++)
+    {
+        if ( (strcmp(kernels[i].name,name)==0) && (cpuCanRun(&kernels[i])) )
+        {
+            selectedKernel=&kernels[i];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//----------------------------------------------------------------------------------------
+static int allocateFrameCorrection(struct FrameCorrection * correction,unsigned int width,unsigned int height,unsigned int channels,unsigned int bitsPerPixel,unsigned int significantBits)
+{
+    correction->width        = width;
+    correction->height       = height;
+    correction->channels     = channels;
+    correction->bitsPerPixel = bitsPerPixel;
+    correction->samples      = (unsigned long) width*height*channels;
+    if (bitsPerPixel==8) { correction->maxValue = 255; } else
+                         { correction->maxValue = ( (significantBits==0) || (significantBits>=16) ) ? 65535 : (1u<<significantBits)-1; }
+
+    //Padded to whole blocks, cache line aligned
+    correction->numberOfBlocks = (correction->samples + FRAME_CORRECTION_BLOCK-1) / FRAME_CORRECTION_BLOCK;
+    if (posix_memalign((void **) &correction->blocks,64,correction->numberOfBlocks*sizeof(struct FrameCorrectionBlock))!=0)
+    {
+        correction->blocks = 0;
+        return 0;
+    }
+
+    unsigned long b;
+    unsigned int j;
+    for (b=0; b<correction->numberOfBlocks; b++)
+    {
+        for (j=0; j<FRAME_CORRECTION_BLOCK; j++)
+        {
+            correction->blocks[b].dark[j] = 0;
+            correction->blocks[b].gain[j] = FRAME_CORRECTION_UNITY_GAIN;
+        }
+    }
+    currentKernel();
+    return 1;
+}
+
+static unsigned int referenceSample(const unsigned char * pixels,unsigned int bitsPerPixel,unsigned long i)
+{
+    return (bitsPerPixel==8) ? pixels[i] : ((const unsigned short *) pixels)[i];
+}
+
+static unsigned short fixedPointGain(double gain)
+{
+    double value = gain * FRAME_CORRECTION_UNITY_GAIN + 0.5;
+    if (value<0.0)     { return 0; }
+    if (value>65535.0) { return 65535; }
+    return (unsigned short) value;
+}
+
+int setFrameCorrectionReferences(struct FrameCorrection * correction,unsigned int width,unsigned int height,unsigned int channels,unsigned int bitsPerPixel,
+                                 unsigned int significantBits,const unsigned short * dark,const unsigned short * gain)
+{
+    memset(correction,0,sizeof(struct FrameCorrection));
+    if (!allocateFrameCorrection(correction,width,height,channels,bitsPerPixel,significantBits)) { return 0; }
+    unsigned long i;
+    for (i=0; i<correction->samples; i++)
+    {
+        struct FrameCorrectionBlock * block = &correction->blocks[i/FRAME_CORRECTION_BLOCK];
+        if (dark!=0) { block->dark[i%FRAME_CORRECTION_BLOCK] = dark[i]; }
+        if (gain!=0) { block->gain[i%FRAME_CORRECTION_BLOCK] = gain[i]; }
+    }
+    correction->hasDark = (dark!=0);
+    correction->hasFlat = (gain!=0);
+    return 1;
+}
+
+int loadFrameCorrection(struct FrameCorrection * correction,const char * darkFile,const char * flatFile,unsigned int significantBits)
+{
+    memset(correction,0,sizeof(struct FrameCorrection));
+    if ( (darkFile==0) && (flatFile==0) ) { return 0; }
+
+    struct MappedPNM dark = {0}, flat = {0};
+    if ( (darkFile!=0) && (!mapPNM(darkFile,&dark,1)) )
+    {
+        fprintf(stderr,"Could not read dark frame %s\n",darkFile);
+        return 0;
+    }
+    if ( (flatFile!=0) && (!mapPNM(flatFile,&flat,1)) )
+    {
+        fprintf(stderr,"Could not read flat field %s\n",flatFile);
+        unmapPNM(&dark);
+        return 0;
+    }
+
+    //PNM files of the grabber hold the raw camera samples, 16 bit ones in host order
+    struct MappedPNM * layout = (darkFile!=0) ? &dark : &flat;
+    unsigned int bitsPerPixel = (layout->pixelBytes == (unsigned long) layout->width*layout->height*layout->channels) ? 8 : 16;
+    if ( (darkFile!=0) && (flatFile!=0) &&
+         ( (dark.width!=flat.width) || (dark.height!=flat.height) || (dark.channels!=flat.channels) || (dark.pixelBytes!=flat.pixelBytes) ) )
+    {
+        fprintf(stderr,"Dark frame %ux%u:%u and flat field %ux%u:%u do not match\n",dark.width,dark.height,dark.channels,flat.width,flat.height,flat.channels);
+        unmapPNM(&dark);
+        unmapPNM(&flat);
+        return 0;
+    }
+
+    if (!allocateFrameCorrection(correction,layout->width,layout->height,layout->channels,bitsPerPixel,significantBits))
+    {
+        unmapPNM(&dark);
+        unmapPNM(&flat);
+        return 0;
+    }
+
+    unsigned long i;
+    unsigned int c;
+    if (darkFile!=0)
+    {
+        for (i=0; i<correction->samples; i++)
+            { correction->blocks[i/FRAME_CORRECTION_BLOCK].dark[i%FRAME_CORRECTION_BLOCK] = (unsigned short) referenceSample(dark.pixels,bitsPerPixel,i); }
+        correction->hasDark = 1;
+    }
+
+    if (flatFile!=0)
+    {
+        //Every channel is flattened to its own mean signal
+        double sum[3] = {0.0,0.0,0.0};
+        for (i=0; i<correction->samples; i++)
+        {
+            unsigned int level  = referenceSample(flat.pixels,bitsPerPixel,i);
+            unsigned int offset = correction->blocks[i/FRAME_CORRECTION_BLOCK].dark[i%FRAME_CORRECTION_BLOCK];
+            sum[i%correction->channels] += (level>offset) ? level-offset : 0;
+        }
+        double mean[3];
+        unsigned long perChannel = correction->samples / correction->channels;
+        for (c=0; c<correction->channels; c++) { mean[c] = sum[c] / perChannel; }
+
+        unsigned long deadPixels = 0;
+        for (i=0; i<correction->samples; i++)
+        {
+            struct FrameCorrectionBlock * block = &correction->blocks[i/FRAME_CORRECTION_BLOCK];
+            unsigned int level  = referenceSample(flat.pixels,bitsPerPixel,i);
+            unsigned int offset = block->dark[i%FRAME_CORRECTION_BLOCK];
+            if (level>offset)
+            {
+                block->gain[i%FRAME_CORRECTION_BLOCK] = fixedPointGain(mean[i%correction->channels] / (level-offset));
+            } else
+            {   //No signal in the flat, nothing to scale
+                deadPixels += 1;
+            }
+        }
+        correction->hasFlat = 1;
+        if (deadPixels!=0) { fprintf(stderr,"Flat field %s has %lu pixels without signal, they keep unity gain\n",flatFile,deadPixels); }
+    }
+
+    unmapPNM(&dark);
+    unmapPNM(&flat);
+    return 1;
+}
+
+int applyFrameCorrection(struct FrameCorrection * correction,void * pixels,unsigned int width,unsigned int height,unsigned int channels,unsigned int bitsPerPixel)
+{
+    if ( (correction==0) || (correction->blocks==0) || (pixels==0) ) { return 0; }
+    if ( (width!=correction->width) || (height!=correction->height) || (channels!=correction->channels) || (bitsPerPixel!=correction->bitsPerPixel) )
+    {
+        correction->mismatchedFrames += 1;
+        return 0;
+    }
+
+    unsigned long startTime = monotonicMicroseconds();
+    const struct FrameCorrectionKernel * kernel = currentKernel();
+    if (bitsPerPixel==8) { kernel->correct8((unsigned char *) pixels,correction->blocks,correction->samples); } else
+                         { kernel->correct16((unsigned short *) pixels,correction->blocks,correction->samples,correction->maxValue); }
+
+    unsigned long elapsed = monotonicMicroseconds() - startTime;
+    correction->frames += 1;
+    correction->totalMicroseconds += elapsed;
+    if (elapsed>correction->maxMicroseconds) { correction->maxMicroseconds=elapsed; }
+    return 1;
+}
+
+void destroyFrameCorrection(struct FrameCorrection * correction)
+{
+    if (correction==0) { return; }
+    free(correction->blocks);
+    correction->blocks = 0;
+    correction->numberOfBlocks = 0;
+}
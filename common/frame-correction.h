@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef FRAME_CORRECTION_H_INCLUDED
+#define FRAME_CORRECTION_H_INCLUDED
+
+// Dark frame and flat field correction applied to every frame in place, before
+// statistics and sinks see it : pixel = (raw - dark) * gain, clamped to the
+// pixel range.
+//
+// The references are PNM files like the ones the grabber writes, averaged over
+// many frames by its calibration mode (--calibrate dark|flat). The per pixel
+// gain is derived from the flat at load time, gain = mean(flat-dark)/(flat-dark),
+// and kept as 4.12 fixed point. Dark levels and gains are interleaved in blocks
+// of 16 pixels, so the 16 darks and 16 gains a kernel iteration needs share a
+// single 64 byte cache line and the correction streams one reference array
+// instead of two.
+//
+// The kernels are AVX2 or SSE2, picked at runtime, with a portable fallback
+// giving the same results. Nothing in here depends on Aravis
+// (see benchmarks/frame-correction-benchmark.c).
+
+#define FRAME_CORRECTION_BLOCK 16
+#define FRAME_CORRECTION_GAIN_SHIFT 12
+#define FRAME_CORRECTION_UNITY_GAIN (1<<FRAME_CORRECTION_GAIN_SHIFT)
+
+struct FrameCorrectionBlock
+{
+    unsigned short dark[FRAME_CORRECTION_BLOCK];
+    unsigned short gain[FRAME_CORRECTION_BLOCK];  // 4.12 fixed point, up to 16x
+};
+
+struct FrameCorrection
+{
+    unsigned int width;
+    unsigned int height;
+    unsigned int channels;
+    unsigned int bitsPerPixel;        // 8 or 16
+    unsigned int maxValue;            // Corrected pixels are clamped to it
+    unsigned long samples;
+    struct FrameCorrectionBlock * blocks;
+    unsigned long numberOfBlocks;
+    char hasDark;
+    char hasFlat;
+
+    //Totals for the --stats output
+    unsigned long frames;
+    unsigned long mismatchedFrames;   // Different layout than the references, left untouched
+    unsigned long totalMicroseconds;
+    unsigned long maxMicroseconds;
+};
+
+// Either file may be NULL. significantBits clamps 16 bit frames (12 for Mono12), returns 0 on failure
+int loadFrameCorrection(struct FrameCorrection * correction,const char * darkFile,const char * flatFile,unsigned int significantBits);
+
+// Corrects pixels in place, returns 0 when the frame does not match the references
+int applyFrameCorrection(struct FrameCorrection * correction,void * pixels,unsigned int width,unsigned int height,unsigned int channels,unsigned int bitsPerPixel);
+
+// Name of the kernel picked for this CPU, "avx2", "sse2" or "scalar"
+const char * frameCorrectionKernel();
+
+// Force a kernel, for benchmarking. Returns 0 if this CPU cannot run it
+int selectFrameCorrectionKernel(const char * name);
+
+// Correction without files, for benchmarks : dark and gain are read from plain arrays of samples values
+int setFrameCorrectionReferences(struct FrameCorrection * correction,unsigned int width,unsigned int height,unsigned int channels,unsigned int bitsPerPixel,
+                                 unsigned int significantBits,const unsigned short * dark,const unsigned short * gain);
+
+void destroyFrameCorrection(struct FrameCorrection * correction);
+
+#endif // FRAME_CORRECTION_H_INCLUDED
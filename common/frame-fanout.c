@@ -0,0 +1,297 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "frame-fanout.h"
+#include "pipeline-trace.h"
+#include "timing.h"
+
+/* Standard headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_FANOUT_QUEUE_DEPTH 4
+
+struct FanOutThreadArgument
+{
+    struct FrameFanOut * fanOut;
+    struct FanOutSink * sink;
+};
+
+// Drops one reference, called with the lock held
+static void releaseFanOutFrame(struct FrameFanOut * fanOut,struct FanOutFrame * frame)
+{
+    frame->references -= 1;
+    if (frame->references==0) { fanOut->framesInUse -= 1; }
+}
+
+static void * fanOutSinkThread(void * argument)
+{
+    struct FanOutThreadArgument * thread = (struct FanOutThreadArgument *) argument;
+    struct FrameFanOut * fanOut = thread->fanOut;
+    struct FanOutSink  * sink   = thread->sink;
+    free(thread);
+    namePipelineTraceThread(sink->policy->name);
+
+    pthread_mutex_lock(&fanOut->lock);
+    for (;;)
+    {
+        if (sink->queued==0)
+        {
+            if (fanOut->stop) { break; }
+            pthread_cond_wait(&sink->work,&fanOut->lock);
+            continue;
+        }
+
+        struct FanOutFrame * frame = sink->queue[sink->head];
+        sink->head    = (sink->head+1) % sink->depth;
+        sink->queued -= 1;
+        pthread_cond_signal(&sink->space);
+        pthread_mutex_unlock(&fanOut->lock);
+
+        //Holding a reference, nobody refills the frame while we read it
+        unsigned long startTime = monotonicMicroseconds();
+        traceBegin(sink->policy->name,frame->frameNumber);
+        int written = sink->write(sink->context,frame);
+        traceEnd(sink->policy->name,frame->frameNumber);
+        unsigned long elapsed = monotonicMicroseconds() - startTime;
+
+        pthread_mutex_lock(&fanOut->lock);
+        releaseFanOutFrame(fanOut,frame);
+        if (written) { sink->framesWritten += 1; } else
+                     { sink->failures      += 1; }
+        sink->writeMicroseconds += elapsed;
+    }
+    pthread_mutex_unlock(&fanOut->lock);
+    return 0;
+}
+
+void createFrameFanOut(struct FrameFanOut * fanOut)
+{
+    if (fanOut==0) { return; }
+    memset(fanOut,0,sizeof(struct FrameFanOut));
+    pthread_mutex_init(&fanOut->lock,NULL);
+}
+
+int addFrameFanOutSink(struct FrameFanOut * fanOut,struct SinkPolicy * policy,unsigned int depth,FrameSinkWriter write,void * context,char needsPixels)
+{
+    if ( (fanOut==0) || (policy==0) || (write==0) || (fanOut->started) ) { return -1; }
+    if (fanOut->numberOfSinks>=FRAME_FANOUT_MAX_SINKS)
+    {
+        fprintf(stderr,"Only %u sinks can share the frames, %s left out\n",FRAME_FANOUT_MAX_SINKS,policy->name);
+        return -1;
+    }
+    if (depth==0) { depth=policy->queueDepth; }
+    if (depth==0) { depth=DEFAULT_FANOUT_QUEUE_DEPTH; }
+
+    struct FanOutSink * sink = &fanOut->sinks[fanOut->numberOfSinks];
+    memset(sink,0,sizeof(struct FanOutSink));
+    sink->queue = (struct FanOutFrame **) calloc(depth,sizeof(struct FanOutFrame *));
+    if (sink->queue==0) { return -1; }
+    sink->policy      = policy;
+    sink->write       = write;
+    sink->context     = context;
+    sink->needsPixels = needsPixels;
+    sink->depth       = depth;
+    pthread_cond_init(&sink->work,NULL);
+    pthread_cond_init(&sink->space,NULL);
+
+    fanOut->numberOfSinks += 1;
+    return (int) fanOut->numberOfSinks-1;
+}
+
+int startFrameFanOut(struct FrameFanOut * fanOut)
+{
+    if ( (fanOut==0) || (fanOut->numberOfSinks==0) || (fanOut->started) ) { return 0; }
+
+    //Queued and being written by every sink, plus the one being filled
+    unsigned int i=0, frames=1;
+    for (i=0; i<fanOut->numberOfSinks; i++) { frames += fanOut->sinks[i].depth + 1; }
+    fanOut->frames = (struct FanOutFrame *) calloc(frames,sizeof(struct FanOutFrame));
+    if (fanOut->frames==0) { return 0; }
+    fanOut->numberOfFrames = frames;
+    fanOut->started = 1;
+
+    for (i=0; i<fanOut->numberOfSinks; i++)
+    {
+        struct FanOutSink * sink = &fanOut->sinks[i];
+        struct FanOutThreadArgument * argument = (struct FanOutThreadArgument *) malloc(sizeof(struct FanOutThreadArgument));
+        if (argument==0) { continue; }
+        argument->fanOut = fanOut;
+        argument->sink   = sink;
+        if (pthread_create(&sink->thread,NULL,fanOutSinkThread,argument)!=0)
+        {
+            fprintf(stderr,"Could not start the %s sink thread\n",sink->policy->name);
+            free(argument);
+            continue;
+        }
+        sink->threadStarted = 1;
+        fprintf(stderr,"%s sink : %s when %u frames are queued\n",sink->policy->name,sinkPolicyName(sink->policy->type),sink->depth);
+    }
+    return 1;
+}
+
+unsigned int submitFrameFanOut(struct FrameFanOut * fanOut,const void * pixels,unsigned long size,unsigned int width,unsigned int height,unsigned int channels,unsigned int bitsPerPixel,unsigned int frameNumber,
+                               const struct FrameTimestamps * timestamps)
+{
+    return submitFrameFanOutTo(fanOut,~0u,pixels,size,width,height,channels,bitsPerPixel,frameNumber,timestamps);
+}
+
+unsigned int submitFrameFanOutTo(struct FrameFanOut * fanOut,unsigned int sinks,const void * pixels,unsigned long size,unsigned int width,unsigned int height,unsigned int channels,unsigned int bitsPerPixel,
+                                 unsigned int frameNumber,const struct FrameTimestamps * timestamps)
+{
+    if ( (fanOut==0) || (fanOut->frames==0) || (pixels==0) || (size==0) ) { return 0; }
+
+    pthread_mutex_lock(&fanOut->lock);
+    fanOut->framesSubmitted += 1;
+
+    //Every sink decides on its own, only the producer adds to the queues so a decision stays valid
+    unsigned int admitted = 0, references = 0, i = 0;
+    char copyPixels = 0;
+    for (i=0; i<fanOut->numberOfSinks; i++)
+    {
+        struct FanOutSink * sink = &fanOut->sinks[i];
+        if ( (!sink->threadStarted) || (!(sinks & (1u<<i))) ) { continue; }
+        char retry = 0, decided = 0;
+        while (!decided)
+        {
+            enum SinkAdmission admission = sinkAdmission(sink->policy,sink->queued,sink->depth,frameNumber,retry);
+            if (admission==SINK_WAIT)
+            {
+                unsigned long startTime = monotonicMicroseconds();
+                while (sink->queued>=sink->depth)
+                    { pthread_cond_wait(&sink->space,&fanOut->lock); }
+                sinkBlocked(sink->policy,monotonicMicroseconds()-startTime);
+                retry = 1;
+                continue;
+            }
+            if (admission==SINK_EVICT_OLDEST)
+            {   //The oldest frame the sink has not started on gives its place
+                struct FanOutFrame * oldest = sink->queue[sink->head];
+                sink->head    = (sink->head+1) % sink->depth;
+                sink->queued -= 1;
+                sinkEvicted(sink->policy,oldest->frameNumber);
+                releaseFanOutFrame(fanOut,oldest);
+                admission = SINK_ADMIT;
+            }
+            if (admission==SINK_ADMIT)
+            {
+                admitted   |= (1u<<i);
+                references += 1;
+                if (sink->needsPixels) { copyPixels = 1; }
+            }
+            decided = 1;
+        }
+    }
+
+    if (admitted==0)
+    {   //Nobody wants it, nothing to copy
+        pthread_mutex_unlock(&fanOut->lock);
+        return 0;
+    }
+
+    struct FanOutFrame * frame = 0;
+    for (i=0; i<fanOut->numberOfFrames; i++)
+    {
+        if (fanOut->frames[i].references==0) { frame=&fanOut->frames[i]; break; }
+    }
+    if (frame==0)
+    {   //Cannot happen with the pool sized for every queue
+        for (i=0; i<fanOut->numberOfSinks; i++)
+            { if (admitted & (1u<<i)) { sinkDropped(fanOut->sinks[i].policy,frameNumber); } }
+        pthread_mutex_unlock(&fanOut->lock);
+        return 0;
+    }
+    frame->references = references;
+    fanOut->framesInUse += 1;
+    if (fanOut->framesInUse>fanOut->maxFramesInUse) { fanOut->maxFramesInUse=fanOut->framesInUse; }
+    pthread_mutex_unlock(&fanOut->lock);
+
+    //The one copy, out of the lock, no sink can see the frame yet
+    frame->size = 0;
+    if (copyPixels)
+    {
+        traceBegin("fan-out copy",frameNumber);
+        if (size>frame->allocated)
+        {
+            unsigned char * buffer = (unsigned char *) realloc(frame->pixels,size);
+            if (buffer==0)
+            {
+                pthread_mutex_lock(&fanOut->lock);
+                frame->references = 0;
+                fanOut->framesInUse -= 1;
+                for (i=0; i<fanOut->numberOfSinks; i++)
+                    { if (admitted & (1u<<i)) { sinkDropped(fanOut->sinks[i].policy,frameNumber); fanOut->sinks[i].failures += 1; } }
+                pthread_mutex_unlock(&fanOut->lock);
+                return 0;
+            }
+            frame->pixels    = buffer;
+            frame->allocated = size;
+        }
+        memcpy(frame->pixels,pixels,size);
+        frame->size = size;
+        traceEnd("fan-out copy",frameNumber);
+    }
+    frame->width        = width;
+    frame->height       = height;
+    frame->channels     = channels;
+    frame->bitsPerPixel = bitsPerPixel;
+    frame->frameNumber  = frameNumber;
+    if (timestamps!=0) { frame->timestamps=*timestamps; } else
+                       { memset(&frame->timestamps,0,sizeof(struct FrameTimestamps)); }
+
+    pthread_mutex_lock(&fanOut->lock);
+    if (copyPixels)
+    {
+        fanOut->framesCopied += 1;
+        fanOut->bytesCopied  += size;
+    }
+    for (i=0; i<fanOut->numberOfSinks; i++)
+    {
+        if (!(admitted & (1u<<i))) { continue; }
+        struct FanOutSink * sink = &fanOut->sinks[i];
+        sink->queue[(sink->head+sink->queued) % sink->depth] = frame;
+        sink->queued += 1;
+        sinkAccepted(sink->policy,sink->queued);
+        pthread_cond_signal(&sink->work);
+    }
+    pthread_mutex_unlock(&fanOut->lock);
+    return admitted;
+}
+
+void destroyFrameFanOut(struct FrameFanOut * fanOut)
+{
+    if (fanOut==0) { return; }
+
+    pthread_mutex_lock(&fanOut->lock);
+    fanOut->stop = 1;
+    unsigned int i=0;
+    for (i=0; i<fanOut->numberOfSinks; i++) { pthread_cond_signal(&fanOut->sinks[i].work); }
+    pthread_mutex_unlock(&fanOut->lock);
+
+    for (i=0; i<fanOut->numberOfSinks; i++)
+    {
+        struct FanOutSink * sink = &fanOut->sinks[i];
+        if (sink->threadStarted) { pthread_join(sink->thread,NULL); sink->threadStarted=0; }
+        printSinkPolicy(stderr,sink->policy);
+        pthread_cond_destroy(&sink->space);
+        pthread_cond_destroy(&sink->work);
+        free(sink->queue);
+        sink->queue = 0;
+    }
+
+    if (fanOut->framesSubmitted!=0)
+    {
+        fprintf(stderr,"Fan-out : %lu frames submitted to %u sinks, %lu copied once (%0.1f MB), %u of %u pooled frames in use at most\n",
+                fanOut->framesSubmitted,fanOut->numberOfSinks,fanOut->framesCopied,fanOut->bytesCopied/1000000.0,
+                fanOut->maxFramesInUse,fanOut->numberOfFrames);
+    }
+
+    //numberOfFrames stays for the --stats output
+    if (fanOut->frames!=0)
+    {
+        for (i=0; i<fanOut->numberOfFrames; i++) { free(fanOut->frames[i].pixels); }
+        free(fanOut->frames);
+        fanOut->frames = 0;
+    }
+    pthread_mutex_destroy(&fanOut->lock);
+}
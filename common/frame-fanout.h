@@ -0,0 +1,108 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef FRAME_FANOUT_H_INCLUDED
+#define FRAME_FANOUT_H_INCLUDED
+
+/* Standard headers */
+#include <pthread.h>
+
+#include "clock-mapping.h"
+#include "sink-queue.h"
+
+// Hands every frame to several sinks at once (PNM files, shared memory, the
+// tick command), each on its own thread behind its own backpressure policy,
+// so that recording to disk and publishing to shared memory can run together
+// without one waiting for the other or for the acquisition loop.
+//
+// A submitted frame is copied once, out of the Aravis buffer that goes back to
+// the stream right away, into a reference counted frame of a pool. Every sink
+// whose policy admits it gets a reference and the frame returns to the pool
+// when the last sink is done with it. A frame that no sink admits, or only
+// sinks that do not read pixels, is not copied at all.
+//
+// The pool is sized so that it can never run out : every sink holds at most
+// its queue depth plus the frame it is writing, plus the one being filled.
+//
+// Call addFrameFanOutSink() for every sink, then startFrameFanOut().
+
+#define FRAME_FANOUT_MAX_SINKS 8
+
+struct FanOutFrame
+{
+    unsigned char * pixels;
+    unsigned long size;
+    unsigned long allocated;
+    unsigned int width;
+    unsigned int height;
+    unsigned int channels;
+    unsigned int bitsPerPixel;
+    unsigned int frameNumber;
+    struct FrameTimestamps timestamps;
+    unsigned int references;   // Sinks still holding the frame, 0 when it is back in the pool
+};
+
+typedef int (*FrameSinkWriter)(void * context,const struct FanOutFrame * frame);
+
+struct FanOutSink
+{
+    struct SinkPolicy * policy;
+    FrameSinkWriter write;
+    void * context;
+    char needsPixels;          // 0 for sinks that only react to the frame, like the tick command
+
+    struct FanOutFrame ** queue; // Ring of depth frames, oldest at head
+    unsigned int depth;
+    unsigned int head;
+    unsigned int queued;
+
+    pthread_cond_t work;
+    pthread_cond_t space;
+    pthread_t thread;
+    char threadStarted;
+
+    //Totals for the --stats output
+    unsigned long framesWritten;
+    unsigned long failures;
+    unsigned long writeMicroseconds;
+};
+
+struct FrameFanOut
+{
+    struct FanOutSink sinks[FRAME_FANOUT_MAX_SINKS];
+    unsigned int numberOfSinks;
+
+    struct FanOutFrame * frames;
+    unsigned int numberOfFrames;
+    unsigned int framesInUse;
+
+    pthread_mutex_t lock;
+    char started;
+    char stop;
+
+    //Totals for the --stats output
+    unsigned long framesSubmitted;
+    unsigned long framesCopied;
+    unsigned long long bytesCopied;
+    unsigned int maxFramesInUse;
+};
+
+void createFrameFanOut(struct FrameFanOut * fanOut);
+
+// depth 0 uses policy->queueDepth, or 4 frames when that is 0 as well. Returns the sink number, -1 on failure
+int addFrameFanOutSink(struct FrameFanOut * fanOut,struct SinkPolicy * policy,unsigned int depth,FrameSinkWriter write,void * context,char needsPixels);
+
+// Allocates the pool and starts one thread per sink
+int startFrameFanOut(struct FrameFanOut * fanOut);
+
+// Returns a mask with bit N set when sink N admitted the frame, timestamps may be NULL
+unsigned int submitFrameFanOut(struct FrameFanOut * fanOut,const void * pixels,unsigned long size,unsigned int width,unsigned int height,unsigned int channels,unsigned int bitsPerPixel,unsigned int frameNumber,
+                               const struct FrameTimestamps * timestamps);
+
+// The same, offered only to the sinks with their bit set in sinks, like one stripe of a striped recording
+unsigned int submitFrameFanOutTo(struct FrameFanOut * fanOut,unsigned int sinks,const void * pixels,unsigned long size,unsigned int width,unsigned int height,unsigned int channels,unsigned int bitsPerPixel,
+                                 unsigned int frameNumber,const struct FrameTimestamps * timestamps);
+
+// Lets every sink finish its queue, then stops them, the totals stay readable
+void destroyFrameFanOut(struct FrameFanOut * fanOut);
+
+#endif // FRAME_FANOUT_H_INCLUDED
@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "frame-index.h"
+
+/* Standard headers */
+#include <stdlib.h>
+#include <string.h>
+
+// About 1300 records between two writes
+#define FRAME_INDEX_BUFFER_SIZE (64*1024)
+
+int openFrameIndex(struct FrameIndexWriter * index,const char * filename)
+{
+    memset(index,0,sizeof(struct FrameIndexWriter));
+
+    index->fp = fopen(filename,"wb");
+    if (index->fp==0)
+    {
+        fprintf(stderr,"Could not create frame index %s\n",filename);
+        return 0;
+    }
+
+    index->buffer = (char *) malloc(FRAME_INDEX_BUFFER_SIZE);
+    if (index->buffer!=0)
+    {
+        setvbuf(index->fp,index->buffer,_IOFBF,FRAME_INDEX_BUFFER_SIZE);
+    }
+
+    struct FrameIndexHeader header;
+    memset(&header,0,sizeof(struct FrameIndexHeader));
+    memcpy(header.magic,FRAME_INDEX_MAGIC,sizeof(FRAME_INDEX_MAGIC));
+    header.version    = FRAME_INDEX_VERSION;
+    header.recordSize = sizeof(struct FrameIndexRecord);
+
+    if (fwrite(&header,sizeof(struct FrameIndexHeader),1,index->fp)!=1)
+    {
+        fprintf(stderr,"Could not write frame index %s\n",filename);
+        closeFrameIndex(index);
+        return 0;
+    }
+    return 1;
+}
+
+int appendFrameIndex(struct FrameIndexWriter * index,const struct FrameIndexRecord * record)
+{
+    if ( (index==0) || (index->fp==0) ) { return 0; }
+
+    if (fwrite(record,sizeof(struct FrameIndexRecord),1,index->fp)!=1)
+    {
+        index->failures += 1;
+        return 0;
+    }
+    index->records += 1;
+    return 1;
+}
+
+void closeFrameIndex(struct FrameIndexWriter * index)
+{
+    if (index==0) { return; }
+    if (index->fp!=0)
+    {
+        if (fclose(index->fp)!=0) { index->failures += 1; }
+        index->fp = 0;
+    }
+    //The stdio buffer is only released once the stream is closed
+    free(index->buffer);
+    index->buffer = 0;
+}
+
+int readFrameIndexHeader(FILE * fp,struct FrameIndexHeader * header)
+{
+    if (fread(header,sizeof(struct FrameIndexHeader),1,fp)!=1) { return 0; }
+    if (memcmp(header->magic,FRAME_INDEX_MAGIC,sizeof(FRAME_INDEX_MAGIC))!=0) { return 0; }
+    if ( (header->version==1) && (header->recordSize==FRAME_INDEX_RECORD_SIZE_V1) ) { return 1; }
+    if ( (header->version==2) && (header->recordSize==FRAME_INDEX_RECORD_SIZE_V2) ) { return 1; }
+    if ( (header->version==3) && (header->recordSize==FRAME_INDEX_RECORD_SIZE_V3) ) { return 1; }
+    if (header->version!=FRAME_INDEX_VERSION) { return 0; }
+    if (header->recordSize!=sizeof(struct FrameIndexRecord)) { return 0; }
+    return 1;
+}
+
+int readFrameIndexRecord(FILE * fp,const struct FrameIndexHeader * header,struct FrameIndexRecord * record)
+{
+    memset(record,0,sizeof(struct FrameIndexRecord));
+    return (fread(record,header->recordSize,1,fp)==1);
+}
@@ -0,0 +1,88 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef FRAME_INDEX_H_INCLUDED
+#define FRAME_INDEX_H_INCLUDED
+
+/* Standard headers */
+#include <stdio.h>
+#include <stdint.h>
+
+// Binary per-frame index written next to a recording (frameIndex.bin).
+//
+// The file starts with a FrameIndexHeader followed by one fixed size
+// FrameIndexRecord per buffer popped from the stream, successful or not, in
+// host byte order. Records are appended through a large stdio buffer so the
+// acquisition loop only pays for a memcpy, and a crash loses at most the
+// records still in that buffer. tools/frame-index-tool converts an index to
+// CSV and reports inter-frame intervals and gaps.
+
+#define FRAME_INDEX_MAGIC   "ARVFIDX"
+#define FRAME_INDEX_VERSION 4
+
+// Version 1 records end before hostTimestamp, version 2 before outputRoot, version 3 before exposureMean, they are still read
+#define FRAME_INDEX_RECORD_SIZE_V1 48
+#define FRAME_INDEX_RECORD_SIZE_V2 56
+#define FRAME_INDEX_RECORD_SIZE_V3 64
+
+// FrameIndexRecord.outputNumber of a frame that did not produce its own file
+#define FRAME_INDEX_NOT_WRITTEN 0xFFFFFFFFu
+
+// FrameIndexRecord.flags
+#define FRAME_INDEX_WRITTEN    0x1 // Written to its own output file
+#define FRAME_INDEX_SKIPPED    0x2 // Not written, unchanged since the last kept frame (--changeThreshold)
+#define FRAME_INDEX_RING       0x4 // Pushed to the pre-trigger ring (--preTrigger)
+#define FRAME_INDEX_INCOMPLETE 0x8 // No usable image in the buffer
+#define FRAME_INDEX_STACKED    0x10 // Accumulated into the stacked frame written at the end of its window (--stack)
+#define FRAME_INDEX_RECONFIGURED 0x20 // First frame taken after a live settings change, see live-config.h
+#define FRAME_INDEX_STATISTICS 0x40 // Carries the exposure statistics of the frame (--framestats), see frame-statistics.h
+
+struct FrameIndexHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+};
+
+struct FrameIndexRecord
+{
+    uint64_t frameId;           // arv_buffer_get_frame_id()
+    uint64_t deviceTimestamp;   // arv_buffer_get_timestamp(), nanoseconds in the camera clock
+    uint64_t systemTimestamp;   // arv_buffer_get_system_timestamp() in CLOCK_MONOTONIC nanoseconds (see clock-mapping.h)
+    uint64_t outputOffset;      // Byte offset of the frame in its output, 0 with one file per frame
+    int32_t  status;            // ArvBufferStatus
+    uint32_t payloadSize;       // Bytes of image data in the buffer
+    uint32_t outputNumber;      // colorFrame_0_NNNNN number, or FRAME_INDEX_NOT_WRITTEN
+    uint32_t flags;
+    uint64_t hostTimestamp;     // deviceTimestamp mapped to the host clock (see clock-mapping.h), systemTimestamp without a camera clock, 0 in version 1
+    uint32_t outputRoot;        // -o directory the file went to, in recordingRoots.csv (see striped-recording.h), 0 before version 3
+    uint32_t reserved;
+    float    exposureMean;      // FRAME_INDEX_STATISTICS : mean in pixel units, 0 before version 4
+    uint32_t exposureMedian;    // FRAME_INDEX_STATISTICS : median in histogram bins
+    float    underExposedRatio; // FRAME_INDEX_STATISTICS : of the pixels sampled
+    float    overExposedRatio;
+};
+
+struct FrameIndexWriter
+{
+    FILE * fp;
+    char * buffer;
+
+    //Totals
+    unsigned long records;
+    unsigned long failures;
+};
+
+// Creates filename and writes the header, returns 0 on failure
+int openFrameIndex(struct FrameIndexWriter * index,const char * filename);
+
+int appendFrameIndex(struct FrameIndexWriter * index,const struct FrameIndexRecord * record);
+
+void closeFrameIndex(struct FrameIndexWriter * index);
+
+// Checks the header of an index opened for reading, returns 0 when it is not a frame index this code understands
+int readFrameIndexHeader(FILE * fp,struct FrameIndexHeader * header);
+
+// Next record of an index in any version readFrameIndexHeader() accepted, fields it lacks are 0
+int readFrameIndexRecord(FILE * fp,const struct FrameIndexHeader * header,struct FrameIndexRecord * record);
+
+#endif // FRAME_INDEX_H_INCLUDED
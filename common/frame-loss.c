@@ -0,0 +1,159 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "frame-loss.h"
+#include "timing.h"
+
+/* Standard headers */
+#include <string.h>
+
+//GigE Vision 1.x block ids are 16 bit and skip 0 when they wrap
+#define GIGE_BLOCK_ID_MAX  0xFFFF
+#define GIGE_WRAP_MARGIN   0x100
+
+void initializeFrameLossTracker(struct FrameLossTracker * tracker,FILE * log)
+{
+    if (tracker==0) { return; }
+    memset(tracker,0,sizeof(struct FrameLossTracker));
+    tracker->log            = log;
+    tracker->lastBufferTime = monotonicMicroseconds();
+    if (log!=0) { fprintf(log,"frameId,frames,cause\n"); }
+}
+
+const char * frameLossCauseName(enum FrameLossCause cause)
+{
+    switch (cause)
+    {
+        case FRAME_LOSS_TRANSPORT    : return "transport";
+        case FRAME_LOSS_UNDERRUN     : return "underrun";
+        case FRAME_LOSS_TIMEOUT      : return "timeout";
+        case FRAME_LOSS_BACKPRESSURE : return "backpressure";
+        case FRAME_LOSS_OTHER        : return "other";
+        default : break;
+    };
+    return "unknown";
+}
+
+void frameLossHistogramLabel(unsigned int bin,char * label,unsigned int length)
+{
+    if ( (label==0) || (length==0) ) { return; }
+    if (bin==0) { snprintf(label,length,"1"); } else
+    if (bin==1) { snprintf(label,length,"2"); } else
+    if (bin>=FRAME_LOSS_HISTOGRAM_BINS-1) { snprintf(label,length,"%lu+",(1ul<<(FRAME_LOSS_HISTOGRAM_BINS-2))+1); } else
+                { snprintf(label,length,"%lu-%lu",(1ul<<(bin-1))+1,1ul<<bin); }
+}
+
+void addFrameLoss(struct FrameLossTracker * tracker,guint64 frameId,unsigned long frames,enum FrameLossCause cause)
+{
+    if ( (tracker==0) || (frames==0) || (cause>=FRAME_LOSS_CAUSES) ) { return; }
+    tracker->lost               += frames;
+    tracker->lostByCause[cause] += frames;
+    tracker->run                += frames;
+    if (tracker->log!=0) { fprintf(tracker->log,"%lu,%lu,%s\n",(unsigned long) frameId,frames,frameLossCauseName(cause)); }
+}
+
+// A frame arrived, the lost frames before it make one gap
+static void closeGap(struct FrameLossTracker * tracker)
+{
+    if (tracker->run==0) { return; }
+    unsigned int bin = 0;
+    while ( (bin<FRAME_LOSS_HISTOGRAM_BINS-1) && ((1ul<<bin)<tracker->run) ) { bin+=1; }
+    tracker->gapHistogram[bin] += 1;
+    tracker->gaps              += 1;
+    if (tracker->run>tracker->longestGap) { tracker->longestGap=tracker->run; }
+    tracker->run = 0;
+}
+
+static enum FrameLossCause statusCause(ArvBufferStatus status)
+{
+    switch (status)
+    {
+        case ARV_BUFFER_STATUS_MISSING_PACKETS :
+        case ARV_BUFFER_STATUS_WRONG_PACKET_ID : return FRAME_LOSS_TRANSPORT;
+        case ARV_BUFFER_STATUS_TIMEOUT         : return FRAME_LOSS_TIMEOUT;
+        default : break;
+    };
+    return FRAME_LOSS_OTHER;
+}
+
+int checkFrameLoss(struct FrameLossTracker * tracker,ArvStream * stream,ArvBuffer * buffer)
+{
+    if ( (tracker==0) || (buffer==0) ) { return 0; }
+    unsigned long now = monotonicMicroseconds();
+    ArvBufferStatus status = arv_buffer_get_status(buffer);
+    guint64 frameId = arv_buffer_get_frame_id(buffer);
+    tracker->buffers += 1;
+
+    guint64 completed=0, failures=0, underruns=0;
+    if (stream!=0) { arv_stream_get_statistics(stream,&completed,&failures,&underruns); }
+    unsigned long newUnderruns = (underruns>tracker->lastUnderruns) ? (unsigned long) (underruns-tracker->lastUnderruns) : 0;
+    tracker->lastUnderruns = underruns;
+
+    //Frame ids the camera used since the previous buffer, 0 means the camera has none
+    unsigned long missing = 0;
+    guint64 firstMissing = tracker->lastFrameId+1;
+    if ( (frameId!=0) && (tracker->haveFrameId) && (frameId!=tracker->lastFrameId) )
+    {
+        if (frameId>tracker->lastFrameId)
+        {
+            missing = (unsigned long) (frameId-tracker->lastFrameId-1);
+        } else
+        if ( (tracker->lastFrameId<=GIGE_BLOCK_ID_MAX) && (tracker->lastFrameId>GIGE_BLOCK_ID_MAX-GIGE_WRAP_MARGIN) && (frameId<GIGE_WRAP_MARGIN) )
+        {
+            missing = (unsigned long) ((GIGE_BLOCK_ID_MAX-tracker->lastFrameId) + (frameId-1));
+            if (tracker->lastFrameId==GIGE_BLOCK_ID_MAX) { firstMissing=1; }
+        } else
+        {
+            tracker->idResets += 1; //The camera restarted or the ids are not sequential
+        }
+    }
+
+    //Every underrun is a frame lost, the ids it took are not lost a second time
+    if (newUnderruns!=0)
+    {
+        //Waiting on a sink for most of the interval is why no buffer was free
+        unsigned long interval = now - tracker->lastBufferTime;
+        enum FrameLossCause cause = ( (tracker->sinkMicroseconds!=0) && (2*tracker->sinkMicroseconds>=interval) ) ? FRAME_LOSS_BACKPRESSURE : FRAME_LOSS_UNDERRUN;
+        addFrameLoss(tracker,(missing!=0) ? firstMissing : 0,newUnderruns,cause);
+    }
+    if (missing>newUnderruns)
+    {
+        addFrameLoss(tracker,firstMissing+newUnderruns,missing-newUnderruns,FRAME_LOSS_TRANSPORT);
+    }
+    if (frameId!=0)
+    {
+        tracker->haveFrameId = 1;
+        tracker->lastFrameId = frameId;
+    }
+    tracker->lastBufferTime   = now;
+    tracker->sinkMicroseconds = 0;
+
+    if (status!=ARV_BUFFER_STATUS_SUCCESS)
+    {
+        addFrameLoss(tracker,frameId,1,statusCause(status));
+        return 0;
+    }
+    closeGap(tracker);
+    return 1;
+}
+
+void frameLossSinkTime(struct FrameLossTracker * tracker,unsigned long microseconds)
+{
+    if (tracker==0) { return; }
+    tracker->sinkMicroseconds += microseconds;
+}
+
+void finishFrameLossTracker(struct FrameLossTracker * tracker)
+{
+    if (tracker==0) { return; }
+    closeGap(tracker);
+    if (tracker->log!=0) { fflush(tracker->log); }
+    if (tracker->lost==0) { return; }
+
+    fprintf(stderr,"\nFrame loss : %lu frames in %lu gaps (longest %lu) :",tracker->lost,tracker->gaps,tracker->longestGap);
+    unsigned int i=0;
+    for (i=0; i<FRAME_LOSS_CAUSES; i++)
+    {
+        if (tracker->lostByCause[i]!=0) { fprintf(stderr," %s %lu",frameLossCauseName((enum FrameLossCause) i),tracker->lostByCause[i]); }
+    }
+    fprintf(stderr,"\n");
+}
@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef FRAME_LOSS_H_INCLUDED
+#define FRAME_LOSS_H_INCLUDED
+
+/* Aravis header */
+#include <arv.h>
+
+/* Standard headers */
+#include <stdio.h>
+
+// Frame loss detection and attribution. A buffer with a zero sized image is
+// not the only way to lose a frame : buffers come back with a failed status,
+// and frames that never made it into a buffer only show up as a jump in the
+// frame ids. checkFrameLoss() looks at the status and the frame id of every
+// popped buffer and the underrun counter of the stream, and files every lost
+// frame under one cause :
+//
+//  - transport    : missing packets, or ids that vanished with no underrun
+//                   to explain them (the whole frame was lost on the link)
+//  - underrun     : Aravis had no free buffer when the frame arrived
+//  - timeout      : the frame did not complete within the packet timeout
+//  - backpressure : an underrun while the acquisition thread spent most of
+//                   the interval handing frames to the sinks
+//  - other        : aborted, size mismatch, unsupported payload, no image
+//
+// Consecutive lost frames form a gap, whose lengths are kept in a histogram
+// with power of two bins (1, 2, 3-4, 5-8 .. 257+). 16 bit GigE block ids wrap
+// from 65535 to 1, other backward jumps are counted as resets, not losses.
+// Frames a sink policy discards are counted by the sinks, see sink-queue.h.
+
+#define FRAME_LOSS_HISTOGRAM_BINS 10
+
+enum FrameLossCause
+{
+    FRAME_LOSS_TRANSPORT = 0,
+    FRAME_LOSS_UNDERRUN,
+    FRAME_LOSS_TIMEOUT,
+    FRAME_LOSS_BACKPRESSURE,
+    FRAME_LOSS_OTHER,
+    FRAME_LOSS_CAUSES
+};
+
+struct FrameLossTracker
+{
+    FILE * log;                      // Optional CSV, frameId,frames,cause
+
+    //Since the previous buffer
+    char haveFrameId;
+    guint64 lastFrameId;
+    guint64 lastUnderruns;
+    unsigned long lastBufferTime;
+    unsigned long sinkMicroseconds;  // Acquisition thread held by the sinks
+    unsigned long run;               // Lost frames in a row so far
+
+    //Totals for the --stats output
+    unsigned long buffers;
+    unsigned long lost;
+    unsigned long lostByCause[FRAME_LOSS_CAUSES];
+    unsigned long gaps;
+    unsigned long longestGap;
+    unsigned long idResets;
+    unsigned long gapHistogram[FRAME_LOSS_HISTOGRAM_BINS];
+};
+
+void initializeFrameLossTracker(struct FrameLossTracker * tracker,FILE * log);
+
+const char * frameLossCauseName(enum FrameLossCause cause);
+
+// "1", "2", "3-4" .. "257+"
+void frameLossHistogramLabel(unsigned int bin,char * label,unsigned int length);
+
+// Call for every popped buffer, before anything else looks at it. Returns 1
+// when its image can be used, 0 when the buffer itself was lost
+int checkFrameLoss(struct FrameLossTracker * tracker,ArvStream * stream,ArvBuffer * buffer);
+
+// A buffer checkFrameLoss() accepted but that could not be used after all
+void addFrameLoss(struct FrameLossTracker * tracker,guint64 frameId,unsigned long frames,enum FrameLossCause cause);
+
+// Time the acquisition thread just spent handing a frame to the sinks
+void frameLossSinkTime(struct FrameLossTracker * tracker,unsigned long microseconds);
+
+// Closes a gap still open at the end of the run and prints a summary on stderr
+void finishFrameLossTracker(struct FrameLossTracker * tracker);
+
+#endif // FRAME_LOSS_H_INCLUDED
@@ -0,0 +1,237 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "frame-ring.h"
+#include "pipeline-trace.h"
+#include "pnm.h"
+#include "timing.h"
+
+/* Standard headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#define MEGABYTE (1024UL*1024UL)
+
+static void * frameRingWriterThread(void * argument)
+{
+    struct FrameRing * ring = (struct FrameRing *) argument;
+    char filename[1024];
+    char eventDirectory[600];
+    unsigned int createdEvent = 0;
+    namePipelineTraceThread("ring writer");
+
+    pthread_mutex_lock(&ring->lock);
+    for (;;)
+    {
+        //Oldest frame waiting to be persisted
+        struct FrameRingSlot * next = 0;
+        unsigned int i=0;
+        for (i=0; i<ring->capacity; i++)
+        {
+            struct FrameRingSlot * slot = &ring->slots[i];
+            if ( (slot->persist) && (!slot->writing) && ((next==0) || (slot->sequence<next->sequence)) )
+                { next=slot; }
+        }
+
+        if (next==0)
+        {
+            if (ring->stop) { break; }
+            pthread_cond_wait(&ring->work,&ring->lock);
+            continue;
+        }
+
+        next->writing = 1;
+        pthread_mutex_unlock(&ring->lock);
+
+        //The slot cannot be refilled while writing is set, so it is safe to read it unlocked
+        unsigned long startTime = monotonicMicroseconds();
+        snprintf(eventDirectory,sizeof(eventDirectory),"%s/event_%05u",ring->directory,next->event);
+        if (createdEvent!=next->event)
+        {
+            if ( (mkdir(eventDirectory,0755)!=0) && (errno!=EEXIST) )
+                { fprintf(stderr,"Could not create %s\n",eventDirectory); }
+            createdEvent = next->event;
+        }
+        snprintf(filename,sizeof(filename),"%s/colorFrame_0_%05u.pnm",eventDirectory,next->frameNumber);
+        traceBegin("ring write",next->frameNumber);
+        writePNM(filename,next->pixels,next->width,next->height,next->channels,next->bitsPerPixel);
+        traceEnd("ring write",next->frameNumber);
+        unsigned long elapsed = monotonicMicroseconds() - startTime;
+
+        pthread_mutex_lock(&ring->lock);
+        next->writing = 0;
+        next->persist = 0;
+        ring->framesPersisted   += 1;
+        ring->writeMicroseconds += elapsed;
+    }
+    pthread_mutex_unlock(&ring->lock);
+    return 0;
+}
+
+int createFrameRing(struct FrameRing * ring,const char * directory,unsigned int budgetMB,float preTriggerSeconds,float postTriggerSeconds)
+{
+    if ( (ring==0) || (budgetMB==0) ) { return 0; }
+    memset(ring,0,sizeof(struct FrameRing));
+    snprintf(ring->directory,sizeof(ring->directory),"%s",(directory!=0) ? directory : ".");
+    ring->budgetBytes             = budgetMB * MEGABYTE;
+    ring->preTriggerMicroseconds  = (unsigned long) (preTriggerSeconds  * 1000000.0);
+    ring->postTriggerMicroseconds = (unsigned long) (postTriggerSeconds * 1000000.0);
+
+    pthread_mutex_init(&ring->lock,NULL);
+    pthread_cond_init(&ring->work,NULL);
+    if (pthread_create(&ring->writer,NULL,frameRingWriterThread,ring)!=0)
+    {
+        fprintf(stderr,"Could not start the frame ring writer thread\n");
+        pthread_cond_destroy(&ring->work);
+        pthread_mutex_destroy(&ring->lock);
+        return 0;
+    }
+    ring->writerStarted = 1;
+    return 1;
+}
+
+// The slot size is only known once the first frame arrived, all the memory is
+// allocated and touched right then so that no page fault happens later on
+static int allocateFrameRing(struct FrameRing * ring,unsigned long frameSize)
+{
+    unsigned long capacity = ring->budgetBytes / frameSize;
+    if (capacity<2)
+    {
+        fprintf(stderr,"A %lu MB frame ring cannot hold two %lu byte frames\n",ring->budgetBytes/MEGABYTE,frameSize);
+        return 0;
+    }
+
+    struct FrameRingSlot * slots = (struct FrameRingSlot *) calloc(capacity,sizeof(struct FrameRingSlot));
+    unsigned char * memory = (unsigned char *) malloc(capacity*frameSize);
+    if ( (slots==0) || (memory==0) )
+    {
+        fprintf(stderr,"Could not allocate a frame ring of %lu frames\n",capacity);
+        free(slots);
+        free(memory);
+        return 0;
+    }
+    memset(memory,0,capacity*frameSize);
+
+    unsigned long i=0;
+    for (i=0; i<capacity; i++)
+        { slots[i].pixels = memory + i*frameSize; }
+
+    pthread_mutex_lock(&ring->lock);
+    ring->slots    = slots;
+    ring->memory   = memory;
+    ring->slotSize = frameSize;
+    ring->capacity = (unsigned int) capacity;
+    pthread_mutex_unlock(&ring->lock);
+
+    fprintf(stderr,"Frame ring holds %lu frames of %lu bytes\n",capacity,frameSize);
+    return 1;
+}
+
+int pushFrameRing(struct FrameRing * ring,const void * pixels,unsigned long size,unsigned int width,unsigned int height,unsigned int channels,unsigned int bitsPerPixel,unsigned int frameNumber)
+{
+    if ( (ring==0) || (pixels==0) || (size==0) ) { return 0; }
+    if ( (ring->capacity==0) && (!allocateFrameRing(ring,size)) ) { return 0; }
+
+    pthread_mutex_lock(&ring->lock);
+    ring->framesPushed += 1;
+    if (size>ring->slotSize)
+    {
+        ring->oversized += 1;
+        pthread_mutex_unlock(&ring->lock);
+        return 0;
+    }
+
+    struct FrameRingSlot * slot = &ring->slots[ring->head];
+    if ( (slot->persist) || (slot->writing) )
+    {   //The writer is behind, keep what was triggered and lose this frame instead
+        ring->overruns += 1;
+        pthread_mutex_unlock(&ring->lock);
+        return 0;
+    }
+    slot->valid = 0;
+    slot->event = 0;
+    ring->head = (ring->head+1) % ring->capacity;
+    pthread_mutex_unlock(&ring->lock);
+
+    //The copy runs unlocked, the writer never looks at a slot that is not valid
+    memcpy(slot->pixels,pixels,size);
+    unsigned long now = monotonicMicroseconds();
+
+    pthread_mutex_lock(&ring->lock);
+    slot->size         = size;
+    slot->width        = width;
+    slot->height       = height;
+    slot->channels     = channels;
+    slot->bitsPerPixel = bitsPerPixel;
+    slot->frameNumber  = frameNumber;
+    slot->timestamp    = now;
+    slot->sequence     = ring->sequence++;
+    slot->valid        = 1;
+    if ( (ring->event!=0) && (now<=ring->postTriggerDeadline) )
+    {
+        slot->persist = 1;
+        slot->event   = ring->event;
+        pthread_cond_signal(&ring->work);
+    }
+    pthread_mutex_unlock(&ring->lock);
+    return 1;
+}
+
+unsigned int triggerFrameRing(struct FrameRing * ring,const char * reason)
+{
+    if (ring==0) { return 0; }
+    unsigned long now = monotonicMicroseconds();
+    unsigned int preTriggerFrames = 0;
+
+    pthread_mutex_lock(&ring->lock);
+    //A trigger inside the post trigger window of the previous one extends that event
+    if ( (ring->event==0) || (now>ring->postTriggerDeadline) )
+        { ring->event += 1; }
+    ring->postTriggerDeadline = now + ring->postTriggerMicroseconds;
+
+    unsigned int i=0;
+    for (i=0; i<ring->capacity; i++)
+    {
+        struct FrameRingSlot * slot = &ring->slots[i];
+        if ( (slot->valid) && (!slot->persist) && (!slot->writing) && (slot->event!=ring->event) &&
+             (slot->timestamp + ring->preTriggerMicroseconds >= now) )
+        {
+            slot->persist = 1;
+            slot->event   = ring->event;
+            preTriggerFrames += 1;
+        }
+    }
+    unsigned int event = ring->event;
+    pthread_cond_signal(&ring->work);
+    pthread_mutex_unlock(&ring->lock);
+
+    fprintf(stderr,"\nEvent %u triggered (%s), %u pre-trigger frames queued\n",event,(reason!=0) ? reason : "no reason",preTriggerFrames);
+    return event;
+}
+
+void destroyFrameRing(struct FrameRing * ring)
+{
+    if (ring==0) { return; }
+    if (ring->writerStarted)
+    {
+        pthread_mutex_lock(&ring->lock);
+        ring->stop = 1;
+        pthread_cond_signal(&ring->work);
+        pthread_mutex_unlock(&ring->lock);
+        pthread_join(ring->writer,NULL);
+        ring->writerStarted = 0;
+    }
+    pthread_cond_destroy(&ring->work);
+    pthread_mutex_destroy(&ring->lock);
+
+    fprintf(stderr,"Frame ring : %lu frames pushed, %lu written over %u events, %lu overruns\n",
+            ring->framesPushed,ring->framesPersisted,ring->event,ring->overruns);
+
+    free(ring->slots);
+    free(ring->memory);
+    ring->slots    = 0;
+    ring->memory   = 0;
+    ring->capacity = 0;
+}
@@ -0,0 +1,77 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef FRAME_RING_H_INCLUDED
+#define FRAME_RING_H_INCLUDED
+
+/* Standard headers */
+#include <pthread.h>
+
+// Pre-trigger recording : every frame is copied into a preallocated ring that
+// fits a memory budget, and nothing reaches the disk until an event is
+// triggered. The frames of the last preTrigger seconds, and every frame of
+// the following postTrigger seconds, are then written by a background thread
+// into <directory>/event_<N>/ while acquisition carries on.
+//
+// A frame that would overwrite a slot still waiting for the writer is dropped
+// and counted as an overrun rather than stalling the acquisition thread.
+
+struct FrameRingSlot
+{
+    unsigned char * pixels;
+    unsigned long size;
+    unsigned int width;
+    unsigned int height;
+    unsigned int channels;
+    unsigned int bitsPerPixel;
+    unsigned int frameNumber;
+    unsigned long timestamp;   // monotonicMicroseconds() when pushed
+    unsigned long sequence;    // Push order, the writer persists oldest first
+    unsigned int event;        // Event the slot has to be written for
+    char valid;
+    char persist;              // Waiting for the writer
+    char writing;
+};
+
+struct FrameRing
+{
+    char directory[512];
+    unsigned long budgetBytes;
+    unsigned long preTriggerMicroseconds;
+    unsigned long postTriggerMicroseconds;
+
+    struct FrameRingSlot * slots;
+    unsigned char * memory;
+    unsigned int capacity;     // Decided on the first frame, from its size and the budget
+    unsigned long slotSize;
+    unsigned int head;
+    unsigned long sequence;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  work;
+    pthread_t writer;
+    char writerStarted;
+    char stop;
+
+    unsigned int event;                // Current event number, 0 before the first trigger
+    unsigned long postTriggerDeadline; // Frames pushed before this are persisted
+
+    //Totals for the --stats output
+    unsigned long framesPushed;
+    unsigned long framesPersisted;
+    unsigned long overruns;
+    unsigned long oversized;
+    unsigned long writeMicroseconds;
+};
+
+int createFrameRing(struct FrameRing * ring,const char * directory,unsigned int budgetMB,float preTriggerSeconds,float postTriggerSeconds);
+
+// Copies the frame into the ring, returns 0 when it had to be dropped
+int pushFrameRing(struct FrameRing * ring,const void * pixels,unsigned long size,unsigned int width,unsigned int height,unsigned int channels,unsigned int bitsPerPixel,unsigned int frameNumber);
+
+// Safe to call from any thread but not from a signal handler, returns the event number
+unsigned int triggerFrameRing(struct FrameRing * ring,const char * reason);
+
+// Lets the writer finish what has been triggered so far, then frees the ring
+void destroyFrameRing(struct FrameRing * ring);
+
+#endif // FRAME_RING_H_INCLUDED
@@ -0,0 +1,470 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "frame-stacking.h"
+#include "timing.h"
+
+/* Standard headers */
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define FRAME_STACKING_X86 1
+#endif
+
+typedef void (*AccumulateKernel8)(unsigned short * accumulator,const unsigned char * pixels,unsigned long samples);
+typedef void (*AccumulateKernel16)(unsigned int * accumulator,const unsigned short * pixels,unsigned long samples);
+typedef void (*MedianKernel8)(const unsigned char * history,unsigned long frameBytes,unsigned int frames,unsigned char * output,unsigned long samples);
+typedef void (*MedianKernel16)(const unsigned char * history,unsigned long frameBytes,unsigned int frames,unsigned short * output,unsigned long samples);
+
+//----------------------------------------------------------------------------------------
+// Portable kernels
+//----------------------------------------------------------------------------------------
+static void accumulate8Scalar(unsigned short * accumulator,const unsigned char * pixels,unsigned long samples)
+{
+    unsigned long i;
+    for (i=0; i<samples; i++) { accumulator[i] += pixels[i]; }
+}
+
+static void accumulate16Scalar(unsigned int * accumulator,const unsigned short * pixels,unsigned long samples)
+{
+    unsigned long i;
+    for (i=0; i<samples; i++) { accumulator[i] += pixels[i]; }
+}
+
+// Insertion sort of one pixel across the window, fine for the tails the SIMD kernels leave
+static void median8Scalar(const unsigned char * history,unsigned long frameBytes,unsigned int frames,unsigned char * output,unsigned long samples)
+{
+    unsigned char values[FRAME_STACK_MAX_MEDIAN_WINDOW] = {0};
+    unsigned long i;
+    unsigned int f,k;
+    for (i=0; i<samples; i++)
+    {
+        for (f=0; f<frames; f++)
+        {
+            unsigned char value = history[f*frameBytes+i];
+            for (k=f; (k>0) && (values[k-1]>value); k--) { values[k]=values[k-1]; }
+            values[k] = value;
+        }
+        output[i] = values[(frames-1)/2];
+    }
+}
+
+static void median16Scalar(const unsigned char * history,unsigned long frameBytes,unsigned int frames,unsigned short * output,unsigned long samples)
+{
+    unsigned short values[FRAME_STACK_MAX_MEDIAN_WINDOW] = {0};
+    unsigned long i;
+    unsigned int f,k;
+    for (i=0; i<samples; i++)
+    {
+        for (f=0; f<frames; f++)
+        {
+            unsigned short value = ((const unsigned short *) (history+f*frameBytes))[i];
+            for (k=f; (k>0) && (values[k-1]>value); k--) { values[k]=values[k-1]; }
+            values[k] = value;
+        }
+        output[i] = values[(frames-1)/2];
+    }
+}
+
+#if FRAME_STACKING_X86
+//----------------------------------------------------------------------------------------
+// SSE2 kernels
+//----------------------------------------------------------------------------------------
+__attribute__((target("sse2")))
+static void accumulate8SSE2(unsigned short * accumulator,const unsigned char * pixels,unsigned long samples)
+{
+    const __m128i zero = _mm_setzero_si128();
+    unsigned long i=0;
+    for (i=0; i+16<=samples; i+=16)
+    {
+        __m128i p  = _mm_loadu_si128((const __m128i *) (pixels+i));
+        __m128i a0 = _mm_loadu_si128((const __m128i *) (accumulator+i));
+        __m128i a1 = _mm_loadu_si128((const __m128i *) (accumulator+i+8));
+        _mm_storeu_si128((__m128i *) (accumulator+i),  _mm_add_epi16(a0,_mm_unpacklo_epi8(p,zero)));
+        _mm_storeu_si128((__m128i *) (accumulator+i+8),_mm_add_epi16(a1,_mm_unpackhi_epi8(p,zero)));
+    }
+    if (i<samples) { accumulate8Scalar(accumulator+i,pixels+i,samples-i); }
+}
+
+__attribute__((target("sse2")))
+static void accumulate16SSE2(unsigned int * accumulator,const unsigned short * pixels,unsigned long samples)
+{
+    const __m128i zero = _mm_setzero_si128();
+    unsigned long i=0;
+    for (i=0; i+8<=samples; i+=8)
+    {
+        __m128i p  = _mm_loadu_si128((const __m128i *) (pixels+i));
+        __m128i a0 = _mm_loadu_si128((const __m128i *) (accumulator+i));
+        __m128i a1 = _mm_loadu_si128((const __m128i *) (accumulator+i+4));
+        _mm_storeu_si128((__m128i *) (accumulator+i),  _mm_add_epi32(a0,_mm_unpacklo_epi16(p,zero)));
+        _mm_storeu_si128((__m128i *) (accumulator+i+4),_mm_add_epi32(a1,_mm_unpackhi_epi16(p,zero)));
+    }
+    if (i<samples) { accumulate16Scalar(accumulator+i,pixels+i,samples-i); }
+}
+
+// Odd-even transposition sort of the window, 16 pixels at a time
+__attribute__((target("sse2")))
+static void median8SSE2(const unsigned char * history,unsigned long frameBytes,unsigned int frames,unsigned char * output,unsigned long samples)
+{
+    __m128i v[FRAME_STACK_MAX_MEDIAN_WINDOW];
+    memset(v,0,sizeof(v));
+    unsigned long i=0;
+    unsigned int f,pass;
+    for (i=0; i+16<=samples; i+=16)
+    {
+        for (f=0; f<frames; f++) { v[f] = _mm_loadu_si128((const __m128i *) (history+f*frameBytes+i)); }
+        for (pass=0; pass<frames; pass++)
+        {
+            for (f=(pass&1); f+1<frames; f+=2)
+            {
+                __m128i low = _mm_min_epu8(v[f],v[f+1]);
+                v[f+1]      = _mm_max_epu8(v[f],v[f+1]);
+                v[f]        = low;
+            }
+        }
+        _mm_storeu_si128((__m128i *) (output+i),v[(frames-1)/2]);
+    }
+    if (i<samples) { median8Scalar(history+i,frameBytes,frames,output+i,samples-i); }
+}
+
+// SSE2 only has signed 16 bit min/max, flipping the sign bit makes them unsigned
+__attribute__((target("sse2")))
+static void median16SSE2(const unsigned char * history,unsigned long frameBytes,unsigned int frames,unsigned short * output,unsigned long samples)
+{
+    const __m128i sign = _mm_set1_epi16((short) 0x8000);
+    __m128i v[FRAME_STACK_MAX_MEDIAN_WINDOW];
+    memset(v,0,sizeof(v));
+    unsigned long i=0;
+    unsigned int f,pass;
+    for (i=0; i+8<=samples; i+=8)
+    {
+        for (f=0; f<frames; f++) { v[f] = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (history+f*frameBytes+i*2)),sign); }
+        for (pass=0; pass<frames; pass++)
+        {
+            for (f=(pass&1); f+1<frames; f+=2)
+            {
+                __m128i low = _mm_min_epi16(v[f],v[f+1]);
+                v[f+1]      = _mm_max_epi16(v[f],v[f+1]);
+                v[f]        = low;
+            }
+        }
+        _mm_storeu_si128((__m128i *) (output+i),_mm_xor_si128(v[(frames-1)/2],sign));
+    }
+    if (i<samples) { median16Scalar(history+i*2,frameBytes,frames,output+i,samples-i); }
+}
+
+//----------------------------------------------------------------------------------------
+// AVX2 kernels
+//----------------------------------------------------------------------------------------
+__attribute__((target("avx2")))
+static void accumulate8AVX2(unsigned short * accumulator,const unsigned char * pixels,unsigned long samples)
+{
+    unsigned long i=0;
+    for (i=0; i+32<=samples; i+=32)
+    {
+        __m256i p0 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (pixels+i)));
+        __m256i p1 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (pixels+i+16)));
+        __m256i a0 = _mm256_loadu_si256((const __m256i *) (accumulator+i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *) (accumulator+i+16));
+        _mm256_storeu_si256((__m256i *) (accumulator+i),   _mm256_add_epi16(a0,p0));
+        _mm256_storeu_si256((__m256i *) (accumulator+i+16),_mm256_add_epi16(a1,p1));
+    }
+    if (i<samples) { accumulate8Scalar(accumulator+i,pixels+i,samples-i); }
+}
+
+__attribute__((target("avx2")))
+static void accumulate16AVX2(unsigned int * accumulator,const unsigned short * pixels,unsigned long samples)
+{
+    unsigned long i=0;
+    for (i=0; i+16<=samples; i+=16)
+    {
+        __m256i p0 = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (pixels+i)));
+        __m256i p1 = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) (pixels+i+8)));
+        __m256i a0 = _mm256_loadu_si256((const __m256i *) (accumulator+i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *) (accumulator+i+8));
+        _mm256_storeu_si256((__m256i *) (accumulator+i),  _mm256_add_epi32(a0,p0));
+        _mm256_storeu_si256((__m256i *) (accumulator+i+8),_mm256_add_epi32(a1,p1));
+    }
+    if (i<samples) { accumulate16Scalar(accumulator+i,pixels+i,samples-i); }
+}
+
+__attribute__((target("avx2")))
+static void median8AVX2(const unsigned char * history,unsigned long frameBytes,unsigned int frames,unsigned char * output,unsigned long samples)
+{
+    __m256i v[FRAME_STACK_MAX_MEDIAN_WINDOW];
+    memset(v,0,sizeof(v));
+    unsigned long i=0;
+    unsigned int f,pass;
+    for (i=0; i+32<=samples; i+=32)
+    {
+        for (f=0; f<frames; f++) { v[f] = _mm256_loadu_si256((const __m256i *) (history+f*frameBytes+i)); }
+        for (pass=0; pass<frames; pass++)
+        {
+            for (f=(pass&1); f+1<frames; f+=2)
+            {
+                __m256i low = _mm256_min_epu8(v[f],v[f+1]);
+                v[f+1]      = _mm256_max_epu8(v[f],v[f+1]);
+                v[f]        = low;
+            }
+        }
+        _mm256_storeu_si256((__m256i *) (output+i),v[(frames-1)/2]);
+    }
+    if (i<samples) { median8Scalar(history+i,frameBytes,frames,output+i,samples-i); }
+}
+
+__attribute__((target("avx2")))
+static void median16AVX2(const unsigned char * history,unsigned long frameBytes,unsigned int frames,unsigned short * output,unsigned long samples)
+{
+    __m256i v[FRAME_STACK_MAX_MEDIAN_WINDOW];
+    memset(v,0,sizeof(v));
+    unsigned long i=0;
+    unsigned int f,pass;
+    for (i=0; i+16<=samples; i+=16)
+    {
+        for (f=0; f<frames; f++) { v[f] = _mm256_loadu_si256((const __m256i *) (history+f*frameBytes+i*2)); }
+        for (pass=0; pass<frames; pass++)
+        {
+            for (f=(pass&1); f+1<frames; f+=2)
+            {
+                __m256i low = _mm256_min_epu16(v[f],v[f+1]);
+                v[f+1]      = _mm256_max_epu16(v[f],v[f+1]);
+                v[f]        = low;
+            }
+        }
+        _mm256_storeu_si256((__m256i *) (output+i),v[(frames-1)/2]);
+    }
+    if (i<samples) { median16Scalar(history+i*2,frameBytes,frames,output+i,samples-i); }
+}
+#endif // FRAME_STACKING_X86
+
+
+//----------------------------------------------------------------------------------------
+// Dispatch
+//----------------------------------------------------------------------------------------
+struct FrameStackingKernel
+{
+    const char * name;
+    AccumulateKernel8  accumulate8;
+    AccumulateKernel16 accumulate16;
+    MedianKernel8      median8;
+    MedianKernel16     median16;
+};
+
+static const struct FrameStackingKernel kernels[] =
+{
+#if FRAME_STACKING_X86
+    { "avx2",   accumulate8AVX2,   accumulate16AVX2,   median8AVX2,   median16AVX2   },
+    { "sse2",   accumulate8SSE2,   accumulate16SSE2,   median8SSE2,   median16SSE2   },
+#endif
+    { "scalar", accumulate8Scalar, accumulate16Scalar, median8Scalar, median16Scalar }
+};
+#define NUMBER_OF_KERNELS (sizeof(kernels)/sizeof(kernels[0]))
+
+static const struct FrameStackingKernel * selectedKernel = 0;
+
+static int cpuCanRun(const struct FrameStackingKernel * kernel)
+{
+#if FRAME_STACKING_X86
+    if (strcmp(kernel->name,"avx2")==0) { return __builtin_cpu_supports("avx2"); }
+    if (strcmp(kernel->name,"sse2")==0) { return __builtin_cpu_supports("sse2"); }
+#endif
+    return 1;
+}
+
+static const struct FrameStackingKernel * currentKernel()
+{
+    if (selectedKernel==0)
+    {
+        //Kernels are listed fastest first
+        unsigned int i=0;
+        for (i=0; i<NUMBER_OF_KERNELS; i++)
+        {
+            if (cpuCanRun(&kernels[i])) { selectedKernel=&kernels[i]; break; }
+        }
+    }
+    return selectedKernel;
+}
+
+const char * frameStackingKernel()
+{
+    return currentKernel()->name;
+}
+
+int selectFrameStackingKernel(const char * name)
+{
+    unsigned int i=0;
+    for (i=0; i<NUMBER_OF_KERNELS; i++)
+    {
+        if ( (strcmp(kernels[i].name,name)==0) && (cpuCanRun(&kernels[i])) )
+        {
+            selectedKernel=&kernels[i];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//----------------------------------------------------------------------------------------
+int parseFrameStackMode(const char * name,enum FrameStackMode * mode)
+{
+    if (strcmp(name,"sum")==0)    { *mode=FRAME_STACK_SUM;    return 1; }
+    if (strcmp(name,"mean")==0)   { *mode=FRAME_STACK_MEAN;   return 1; }
+    if (strcmp(name,"median")==0) { *mode=FRAME_STACK_MEDIAN; return 1; }
+    return 0;
+}
+
+const char * frameStackModeName(enum FrameStackMode mode)
+{
+    switch (mode)
+    {
+        case FRAME_STACK_SUM    : return "sum";
+        case FRAME_STACK_MEAN   : return "mean";
+        case FRAME_STACK_MEDIAN : return "median";
+    };
+    return "?";
+}
+
+int initializeFrameStack(struct FrameStack * stack,unsigned int window,enum FrameStackMode mode)
+{
+    memset(stack,0,sizeof(struct FrameStack));
+    unsigned int maximumWindow = (mode==FRAME_STACK_MEDIAN) ? FRAME_STACK_MAX_MEDIAN_WINDOW : FRAME_STACK_MAX_WINDOW;
+    if ( (window==0) || (window>maximumWindow) ) { return 0; }
+    stack->window = window;
+    stack->mode   = mode;
+    currentKernel();
+    return 1;
+}
+
+static int prepareFrameStack(struct FrameStack * stack,unsigned int width,unsigned int height,unsigned int channels,unsigned int bitsPerPixel)
+{
+    unsigned long samples = (unsigned long) width*height*channels;
+    unsigned long bytesPerSample = bitsPerPixel/8;
+
+    if (samples>stack->allocatedSamples)
+    {
+        free(stack->accumulator);
+        free(stack->history);
+        free(stack->output);
+        //Sized for 16 bit input, the largest case
+        stack->accumulator = malloc(samples*sizeof(unsigned int));
+        stack->output      = malloc(samples*sizeof(unsigned short));
+        stack->history     = (stack->mode==FRAME_STACK_MEDIAN) ? (unsigned char *) malloc(samples*sizeof(unsigned short)*stack->window) : 0;
+        stack->allocatedSamples = samples;
+        if ( (stack->accumulator==0) || (stack->output==0) || ( (stack->mode==FRAME_STACK_MEDIAN) && (stack->history==0) ) )
+        {
+            free(stack->accumulator); stack->accumulator=0;
+            free(stack->history);     stack->history=0;
+            free(stack->output);      stack->output=0;
+            stack->allocatedSamples = 0;
+            return 0;
+        }
+    }
+
+    stack->width        = width;
+    stack->height       = height;
+    stack->channels     = channels;
+    stack->bitsPerPixel = bitsPerPixel;
+    stack->samples      = samples;
+    stack->framesInWindow = 0;
+    if (stack->mode!=FRAME_STACK_MEDIAN) { memset(stack->accumulator,0,samples*bytesPerSample*2); }
+    return 1;
+}
+
+static void finishFrameStack(struct FrameStack * stack)
+{
+    const struct FrameStackingKernel * kernel = currentKernel();
+    unsigned long samples = stack->samples;
+    unsigned int window   = stack->framesInWindow;
+    unsigned long i;
+
+    if (stack->mode==FRAME_STACK_MEDIAN)
+    {
+        unsigned long frameBytes = samples*(stack->bitsPerPixel/8);
+        if (stack->bitsPerPixel==8) { kernel->median8(stack->history,frameBytes,window,(unsigned char *) stack->output,samples); } else
+                                    { kernel->median16(stack->history,frameBytes,window,(unsigned short *) stack->output,samples); }
+        stack->outputBitsPerPixel = stack->bitsPerPixel;
+    } else
+    if (stack->bitsPerPixel==8)
+    {
+        const unsigned short * sums = (const unsigned short *) stack->accumulator;
+        if (stack->mode==FRAME_STACK_SUM)
+        {   //255*256 still fits 16 bits, the sums are the output
+            memcpy(stack->output,sums,samples*sizeof(unsigned short));
+            stack->outputBitsPerPixel = 16;
+        } else
+        {
+            unsigned char * output = (unsigned char *) stack->output;
+            unsigned int half = window/2;
+            for (i=0; i<samples; i++) { output[i] = (unsigned char) ((sums[i]+half)/window); }
+            stack->outputBitsPerPixel = 8;
+        }
+    } else
+    {
+        const unsigned int * sums = (const unsigned int *) stack->accumulator;
+        unsigned short * output = (unsigned short *) stack->output;
+        if (stack->mode==FRAME_STACK_SUM)
+        {
+            for (i=0; i<samples; i++) { output[i] = (sums[i]>65535) ? 65535 : (unsigned short) sums[i]; }
+        } else
+        {
+            unsigned int half = window/2;
+            for (i=0; i<samples; i++) { output[i] = (unsigned short) ((sums[i]+half)/window); }
+        }
+        stack->outputBitsPerPixel = 16;
+    }
+    stack->outputSize = samples*(stack->outputBitsPerPixel/8);
+}
+
+int pushFrameStack(struct FrameStack * stack,const void * pixels,unsigned int width,unsigned int height,unsigned int channels,unsigned int bitsPerPixel)
+{
+    if ( (stack==0) || (stack->window==0) || (pixels==0) || (width==0) || (height==0) ) { return 0; }
+    if ( (bitsPerPixel!=8) && (bitsPerPixel!=16) ) { return 0; }
+
+    unsigned long startTime = monotonicMicroseconds();
+
+    //A frame with another layout starts a new window
+    if ( (stack->framesInWindow==0) || (stack->width!=width) || (stack->height!=height) ||
+         (stack->channels!=channels) || (stack->bitsPerPixel!=bitsPerPixel) )
+    {
+        if (stack->framesInWindow!=0) { stack->restarts += 1; }
+        if (!prepareFrameStack(stack,width,height,channels,bitsPerPixel)) { return 0; }
+    }
+
+    const struct FrameStackingKernel * kernel = currentKernel();
+    if (stack->mode==FRAME_STACK_MEDIAN)
+    {
+        unsigned long frameBytes = stack->samples*(bitsPerPixel/8);
+        memcpy(stack->history + stack->framesInWindow*frameBytes,pixels,frameBytes);
+    } else
+    if (bitsPerPixel==8) { kernel->accumulate8((unsigned short *) stack->accumulator,(const unsigned char *) pixels,stack->samples); } else
+                         { kernel->accumulate16((unsigned int *) stack->accumulator,(const unsigned short *) pixels,stack->samples); }
+
+    stack->framesIn       += 1;
+    stack->framesInWindow += 1;
+
+    int complete = (stack->framesInWindow==stack->window);
+    if (complete)
+    {
+        finishFrameStack(stack);
+        stack->framesOut += 1;
+        stack->framesInWindow = 0;
+    }
+
+    unsigned long elapsed = monotonicMicroseconds() - startTime;
+    stack->totalMicroseconds += elapsed;
+    if (elapsed>stack->maxMicroseconds) { stack->maxMicroseconds=elapsed; }
+    return complete;
+}
+
+void destroyFrameStack(struct FrameStack * stack)
+{
+    if (stack==0) { return; }
+    free(stack->accumulator);
+    free(stack->history);
+    free(stack->output);
+    stack->accumulator = 0;
+    stack->history     = 0;
+    stack->output      = 0;
+    stack->allocatedSamples = 0;
+}
@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef FRAME_STACKING_H_INCLUDED
+#define FRAME_STACKING_H_INCLUDED
+
+// Temporal stacking for low light : every window of consecutive frames is
+// reduced to one output frame, so the sinks (and the disk) see one frame per
+// window instead of all of them.
+//
+//  - sum    : 8 bit frames are accumulated in 16 bit lanes and come out as 16
+//             bit frames, 16 bit frames in 32 bit lanes and come out saturated
+//             to 16 bits (a 12 bit sensor can sum 16 frames without clipping)
+//  - mean   : the same sums divided by the window, rounded, at the input depth
+//  - median : per pixel median of the window, keeps a copy of every frame of
+//             the window and sorts them with SIMD min/max networks
+//
+// The accumulation and median kernels are AVX2 or SSE2, picked at runtime, with
+// a portable fallback. Nothing in here depends on Aravis.
+
+#define FRAME_STACK_MAX_WINDOW 256
+#define FRAME_STACK_MAX_MEDIAN_WINDOW 32
+
+enum FrameStackMode
+{
+    FRAME_STACK_SUM = 0,
+    FRAME_STACK_MEAN,
+    FRAME_STACK_MEDIAN
+};
+
+struct FrameStack
+{
+    unsigned int window;
+    enum FrameStackMode mode;
+
+    //Layout of the current window, a frame with another layout restarts it
+    unsigned int width;
+    unsigned int height;
+    unsigned int channels;
+    unsigned int bitsPerPixel;    // 8 or 16
+    unsigned long samples;        // width*height*channels
+
+    void * accumulator;           // 16 bit lanes for 8 bit frames, 32 bit lanes for 16 bit frames
+    unsigned char * history;      // window frames, median only
+    void * output;
+    unsigned long allocatedSamples;
+    unsigned int framesInWindow;
+
+    //Output frame, valid after pushFrameStack() returned 1
+    unsigned int outputBitsPerPixel;
+    unsigned long outputSize;     // Bytes
+
+    //Totals for the --stats output
+    unsigned long framesIn;
+    unsigned long framesOut;
+    unsigned long restarts;
+    unsigned long totalMicroseconds;
+    unsigned long maxMicroseconds;
+};
+
+// Returns 0 for a window outside 1..FRAME_STACK_MAX_WINDOW (FRAME_STACK_MAX_MEDIAN_WINDOW for median)
+int initializeFrameStack(struct FrameStack * stack,unsigned int window,enum FrameStackMode mode);
+
+// "sum", "mean" or "median", returns 0 for anything else
+int parseFrameStackMode(const char * name,enum FrameStackMode * mode);
+
+const char * frameStackModeName(enum FrameStackMode mode);
+
+// Adds a frame, returns 1 when it completed a window and stack->output holds the stacked frame
+int pushFrameStack(struct FrameStack * stack,const void * pixels,unsigned int width,unsigned int height,unsigned int channels,unsigned int bitsPerPixel);
+
+// Name of the kernel picked for this CPU, "avx2", "sse2" or "scalar"
+const char * frameStackingKernel();
+
+// Force a kernel, for benchmarking. Returns 0 if this CPU cannot run it
+int selectFrameStackingKernel(const char * name);
+
+void destroyFrameStack(struct FrameStack * stack);
+
+#endif // FRAME_STACKING_H_INCLUDED
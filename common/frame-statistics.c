@@ -0,0 +1,460 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "frame-statistics.h"
+#include "timing.h"
+
+/* Standard headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define FRAME_STATISTICS_X86 1
+#endif
+
+// A histogram increments the same few bins over and over on a uniform image,
+// and every increment has to wait for the store of the previous one to the
+// same bin. Spreading consecutive pixels over 4 partial histograms that are
+// summed at the end breaks that dependency chain, this is what the kernels
+// below do, the SIMD part loads the pixels, sums them and computes the bin
+// indices 16 or 32 pixels at a time.
+#define PARTIAL_HISTOGRAMS 4
+
+// Flush the 32 bit SIMD accumulators of the 16 bit kernels before they can overflow
+#define PIXELS_PER_FLUSH 8192
+
+typedef void (*RowKernel8)(const unsigned char * row,unsigned int width,unsigned int * partial,unsigned long long * sum);
+typedef void (*RowKernel16)(const unsigned short * row,unsigned int width,unsigned int shift,unsigned int maxBin,unsigned int * partial,unsigned long long * sum);
+
+
+//----------------------------------------------------------------------------------------
+// Portable kernels
+//----------------------------------------------------------------------------------------
+static void rowStatistics8Scalar(const unsigned char * row,unsigned int width,unsigned int * partial,unsigned long long * sum)
+{
+    unsigned int * h0 = partial;
+    unsigned int * h1 = partial + 256;
+    unsigned int * h2 = partial + 512;
+    unsigned int * h3 = partial + 768;
+    unsigned long long total = 0;
+    unsigned int x=0;
+
+    for (x=0; x+4<=width; x+=4)
+    {
+        unsigned int a=row[x], b=row[x+1], c=row[x+2], d=row[x+3];
+        h0[a]++; h1[b]++; h2[c]++; h3[d]++;
+        total += a+b+c+d;
+    }
+    for (; x<width; x++)
+    {
+        h0[row[x]]++;
+        total += row[x];
+    }
+    *sum += total;
+}
+
+static void rowStatistics16Scalar(const unsigned short * row,unsigned int width,unsigned int shift,unsigned int maxBin,unsigned int * partial,unsigned long long * sum)
+{
+    unsigned int * h[PARTIAL_HISTOGRAMS] = { partial, partial + FRAME_STATISTICS_MAX_BINS, partial + 2*FRAME_STATISTICS_MAX_BINS, partial + 3*FRAME_STATISTICS_MAX_BINS };
+    unsigned long long total = 0;
+    unsigned int x=0;
+
+    for (x=0; x<width; x++)
+    {
+        unsigned int value = row[x];
+        unsigned int bin = value >> shift;
+        if (bin>maxBin) { bin=maxBin; }
+        h[x & (PARTIAL_HISTOGRAMS-1)][bin]++;
+        total += value;
+    }
+    *sum += total;
+}
+
+#if FRAME_STATISTICS_X86
+//----------------------------------------------------------------------------------------
+// SSE2 kernels
+//----------------------------------------------------------------------------------------
+#define HISTOGRAM_8_FROM_64(q) \
+    { \
+        h0[(q)&0xFF]++;       h1[((q)>>8)&0xFF]++;  h2[((q)>>16)&0xFF]++; h3[((q)>>24)&0xFF]++; \
+        h0[((q)>>32)&0xFF]++; h1[((q)>>40)&0xFF]++; h2[((q)>>48)&0xFF]++; h3[((q)>>56)&0xFF]++; \
+    }
+
+#define HISTOGRAM_16_FROM_64(q) \
+    { \
+        h0[(q)&0xFFFF]++; h1[((q)>>16)&0xFFFF]++; h2[((q)>>32)&0xFFFF]++; h3[((q)>>48)&0xFFFF]++; \
+    }
+
+__attribute__((target("sse2")))
+static void rowStatistics8SSE2(const unsigned char * row,unsigned int width,unsigned int * partial,unsigned long long * sum)
+{
+    unsigned int * h0 = partial;
+    unsigned int * h1 = partial + 256;
+    unsigned int * h2 = partial + 512;
+    unsigned int * h3 = partial + 768;
+    const __m128i zero = _mm_setzero_si128();
+    __m128i accumulator = _mm_setzero_si128();
+    unsigned int x=0;
+
+    for (x=0; x+16<=width; x+=16)
+    {
+        __m128i pixels = _mm_loadu_si128((const __m128i *) (row+x));
+        //Sum of absolute differences against zero adds 8 bytes into each 64 bit lane
+        accumulator = _mm_add_epi64(accumulator,_mm_sad_epu8(pixels,zero));
+
+        unsigned long long low  = (unsigned long long) _mm_cvtsi128_si64(pixels);
+        unsigned long long high = (unsigned long long) _mm_cvtsi128_si64(_mm_unpackhi_epi64(pixels,pixels));
+        HISTOGRAM_8_FROM_64(low);
+        HISTOGRAM_8_FROM_64(high);
+    }
+
+    unsigned long long total = (unsigned long long) _mm_cvtsi128_si64(accumulator) +
+                               (unsigned long long) _mm_cvtsi128_si64(_mm_unpackhi_epi64(accumulator,accumulator));
+    *sum += total;
+
+    if (x<width)
+        { rowStatistics8Scalar(row+x,width-x,partial,sum); }
+}
+
+__attribute__((target("sse2")))
+static void rowStatistics16SSE2(const unsigned short * row,unsigned int width,unsigned int shift,unsigned int maxBin,unsigned int * partial,unsigned long long * sum)
+{
+    unsigned int * h0 = partial;
+    unsigned int * h1 = partial + FRAME_STATISTICS_MAX_BINS;
+    unsigned int * h2 = partial + 2*FRAME_STATISTICS_MAX_BINS;
+    unsigned int * h3 = partial + 3*FRAME_STATISTICS_MAX_BINS;
+    const __m128i zero    = _mm_setzero_si128();
+    const __m128i limit   = _mm_set1_epi16((short) maxBin);
+    const __m128i count   = _mm_cvtsi32_si128((int) shift);
+    unsigned int x=0;
+
+    while (x+8<=width)
+    {
+        __m128i accumulator = _mm_setzero_si128();
+        unsigned int chunkEnd = x + PIXELS_PER_FLUSH;
+        if (chunkEnd>width) { chunkEnd=width; }
+
+        for (; x+8<=chunkEnd; x+=8)
+        {
+            __m128i pixels = _mm_loadu_si128((const __m128i *) (row+x));
+            accumulator = _mm_add_epi32(accumulator,_mm_unpacklo_epi16(pixels,zero));
+            accumulator = _mm_add_epi32(accumulator,_mm_unpackhi_epi16(pixels,zero));
+
+            //SSE2 has no unsigned 16 bit min, a - saturate(a - b) is the same thing
+            __m128i bins = _mm_srl_epi16(pixels,count);
+            bins = _mm_sub_epi16(bins,_mm_subs_epu16(bins,limit));
+
+            unsigned long long low  = (unsigned long long) _mm_cvtsi128_si64(bins);
+            unsigned long long high = (unsigned long long) _mm_cvtsi128_si64(_mm_unpackhi_epi64(bins,bins));
+            HISTOGRAM_16_FROM_64(low);
+            HISTOGRAM_16_FROM_64(high);
+        }
+
+        unsigned int lanes[4];
+        _mm_storeu_si128((__m128i *) lanes,accumulator);
+        *sum += (unsigned long long) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    if (x<width)
+        { rowStatistics16Scalar(row+x,width-x,shift,maxBin,partial,sum); }
+}
+
+//----------------------------------------------------------------------------------------
+// AVX2 kernels
+//----------------------------------------------------------------------------------------
+__attribute__((target("avx2")))
+static void rowStatistics8AVX2(const unsigned char * row,unsigned int width,unsigned int * partial,unsigned long long * sum)
+{
+    unsigned int * h0 = partial;
+    unsigned int * h1 = partial + 256;
+    unsigned int * h2 = partial + 512;
+    unsigned int * h3 = partial + 768;
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i accumulator = _mm256_setzero_si256();
+    unsigned int x=0;
+
+    for (x=0; x+32<=width; x+=32)
+    {
+        __m256i pixels = _mm256_loadu_si256((const __m256i *) (row+x));
+        accumulator = _mm256_add_epi64(accumulator,_mm256_sad_epu8(pixels,zero));
+
+        unsigned long long q0 = (unsigned long long) _mm256_extract_epi64(pixels,0);
+        unsigned long long q1 = (unsigned long long) _mm256_extract_epi64(pixels,1);
+        unsigned long long q2 = (unsigned long long) _mm256_extract_epi64(pixels,2);
+        unsigned long long q3 = (unsigned long long) _mm256_extract_epi64(pixels,3);
+        HISTOGRAM_8_FROM_64(q0);
+        HISTOGRAM_8_FROM_64(q1);
+        HISTOGRAM_8_FROM_64(q2);
+        HISTOGRAM_8_FROM_64(q3);
+    }
+
+    unsigned long long lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes,accumulator);
+    *sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+    if (x<width)
+        { rowStatistics8Scalar(row+x,width-x,partial,sum); }
+}
+
+__attribute__((target("avx2")))
+static void rowStatistics16AVX2(const unsigned short * row,unsigned int width,unsigned int shift,unsigned int maxBin,unsigned int * partial,unsigned long long * sum)
+{
+    unsigned int * h0 = partial;
+    unsigned int * h1 = partial + FRAME_STATISTICS_MAX_BINS;
+    unsigned int * h2 = partial + 2*FRAME_STATISTICS_MAX_BINS;
+    unsigned int * h3 = partial + 3*FRAME_STATISTICS_MAX_BINS;
+    const __m256i zero  = _mm256_setzero_si256();
+    const __m256i limit = _mm256_set1_epi16((short) maxBin);
+    const __m128i count = _mm_cvtsi32_si128((int) shift);
+    unsigned int x=0;
+
+    while (x+16<=width)
+    {
+        __m256i accumulator = _mm256_setzero_si256();
+        unsigned int chunkEnd = x + PIXELS_PER_FLUSH;
+        if (chunkEnd>width) { chunkEnd=width; }
+
+        for (; x+16<=chunkEnd; x+=16)
+        {
+            __m256i pixels = _mm256_loadu_si256((const __m256i *) (row+x));
+            accumulator = _mm256_add_epi32(accumulator,_mm256_unpacklo_epi16(pixels,zero));
+            accumulator = _mm256_add_epi32(accumulator,_mm256_unpackhi_epi16(pixels,zero));
+
+            __m256i bins = _mm256_min_epu16(_mm256_srl_epi16(pixels,count),limit);
+
+            unsigned long long q0 = (unsigned long long) _mm256_extract_epi64(bins,0);
+            unsigned long long q1 = (unsigned long long) _mm256_extract_epi64(bins,1);
+            unsigned long long q2 = (unsigned long long) _mm256_extract_epi64(bins,2);
+            unsigned long long q3 = (unsigned long long) _mm256_extract_epi64(bins,3);
+            HISTOGRAM_16_FROM_64(q0);
+            HISTOGRAM_16_FROM_64(q1);
+            HISTOGRAM_16_FROM_64(q2);
+            HISTOGRAM_16_FROM_64(q3);
+        }
+
+        unsigned int lanes[8];
+        _mm256_storeu_si256((__m256i *) lanes,accumulator);
+        *sum += (unsigned long long) lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+                (unsigned long long) lanes[4] + lanes[5] + lanes[6] + lanes[7];
+    }
+
+    if (x<width)
+        { rowStatistics16Scalar(row+x,width-x,shift,maxBin,partial,sum); }
+}
+#endif // FRAME_STATISTICS_X86
+
+
+//----------------------------------------------------------------------------------------
+// Dispatch
+//----------------------------------------------------------------------------------------
+struct FrameStatisticsKernel
+{
+    const char * name;
+    RowKernel8  row8;
+    RowKernel16 row16;
+};
+
+static const struct FrameStatisticsKernel kernels[] =
+{
+#if FRAME_STATISTICS_X86
+    { "sse2",   rowStatistics8SSE2,   rowStatistics16SSE2   },
+    { "avx2",   rowStatistics8AVX2,   rowStatistics16AVX2   },
+#endif
+    { "scalar", rowStatistics8Scalar, rowStatistics16Scalar }
+};
+#define NUMBER_OF_KERNELS (sizeof(kernels)/sizeof(kernels[0]))
+
+static const struct FrameStatisticsKernel * selectedKernel = 0;
+
+static int cpuCanRun(const struct FrameStatisticsKernel * kernel)
+{
+#if FRAME_STATISTICS_X86
+    if (strcmp(kernel->name,"avx2")==0) { return __builtin_cpu_supports("avx2"); }
+    if (strcmp(kernel->name,"sse2")==0) { return __builtin_cpu_supports("sse2"); }
+#endif
+    return 1;
+}
+
+static const struct FrameStatisticsKernel * currentKernel()
+{
+    if (selectedKernel==0)
+    {
+        //Kernels are listed fastest first. The histogram scatter dominates and AVX2 only adds the
+        //cross lane extracts of the upper 128 bits, frame-statistics-benchmark has SSE2 ahead
+        unsigned int i=0;
+        for (i=0; i<NUMBER_OF_KERNELS; i++)
+        {
+            if (cpuCanRun(&kernels[i])) { selectedKernel=&kernels[i]; break; }
+        }
+    }
+    return selectedKernel;
+}
+
+const char * frameStatisticsKernel()
+{
+    return currentKernel()->name;
+}
+
+int selectFrameStatisticsKernel(const char * name)
+{
+    unsigned int i=0;
+    for (i=0; i<NUMBER_OF_KERNELS; i++)
+    {
+        if ( (strcmp(kernels[i].name,name)==0) && (cpuCanRun(&kernels[i])) )
+        {
+            selectedKernel=&kernels[i];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+//----------------------------------------------------------------------------------------
+int frameStatisticsLayout(const char * pixelFormat,unsigned int * bitsPerPixel,unsigned int * significantBits)
+{
+    if ( (pixelFormat==0) || (bitsPerPixel==0) || (significantBits==0) ) { return 0; }
+
+    const char * digits = 0;
+    if (strncmp(pixelFormat,"Mono",4)==0)
+        { digits = pixelFormat + 4; } else
+    if ( (strncmp(pixelFormat,"Bayer",5)==0) && (strlen(pixelFormat)>7) )
+        { digits = pixelFormat + 7; } // BayerGR, BayerRG, BayerGB, BayerBG
+    else
+        { return 0; }
+
+    char * end = 0;
+    unsigned long bits = strtoul(digits,&end,10);
+    if ( (end==digits) || (*end!=0) ) { return 0; } // Mono12Packed, Mono10p, ..
+
+    if (bits==8)                  { *bitsPerPixel=8;  *significantBits=8; return 1; }
+    if ( (bits>8) && (bits<=16) ) { *bitsPerPixel=16; *significantBits=(unsigned int) bits; return 1; }
+    return 0;
+}
+
+void initializeFrameStatistics(struct FrameStatisticsState * state,unsigned int budgetMicroseconds)
+{
+    memset(state,0,sizeof(struct FrameStatisticsState));
+    state->budgetMicroseconds = budgetMicroseconds;
+    state->underExposedLevel  = 0.02;
+    state->overExposedLevel   = 0.98;
+    state->rowStep            = 1;
+    currentKernel();
+}
+
+int computeFrameStatistics(
+                           struct FrameStatisticsState * state,
+                           const void * pixels,
+                           unsigned int width,
+                           unsigned int height,
+                           unsigned int bitsPerPixel,
+                           unsigned int significantBits,
+                           struct FrameStatistics * result
+                          )
+{
+    if ( (state==0) || (pixels==0) || (result==0) || (width==0) || (height==0) ) { return 0; }
+    if ( (bitsPerPixel!=8) && (bitsPerPixel!=16) ) { return 0; }
+    if (significantBits==0)            { significantBits=bitsPerPixel; }
+    if (significantBits>bitsPerPixel)  { significantBits=bitsPerPixel; }
+
+    unsigned long startTime = monotonicMicroseconds();
+    const struct FrameStatisticsKernel * kernel = currentKernel();
+
+    unsigned int shift = (significantBits>12) ? significantBits-12 : 0;
+    unsigned int bins  = 1 << (significantBits-shift);
+    unsigned int partial[PARTIAL_HISTOGRAMS*FRAME_STATISTICS_MAX_BINS];
+    unsigned long long sum = 0;
+    unsigned int rowStep = (state->rowStep!=0) ? state->rowStep : 1;
+    unsigned int rows = 0;
+    unsigned int y=0;
+
+    if (bitsPerPixel==8)
+    {
+        memset(partial,0,sizeof(unsigned int)*PARTIAL_HISTOGRAMS*256);
+        for (y=0; y<height; y+=rowStep)
+        {
+            kernel->row8((const unsigned char *) pixels + (size_t) y*width,width,partial,&sum);
+            rows++;
+        }
+    } else
+    {
+        memset(partial,0,sizeof(partial));
+        for (y=0; y<height; y+=rowStep)
+        {
+            kernel->row16((const unsigned short *) pixels + (size_t) y*width,width,shift,bins-1,partial,&sum);
+            rows++;
+        }
+    }
+
+    //Fold the partial histograms
+    unsigned int stride = (bitsPerPixel==8) ? 256 : FRAME_STATISTICS_MAX_BINS;
+    unsigned int i=0;
+    for (i=0; i<bins; i++)
+    {
+        result->histogram[i] = partial[i] + partial[stride+i] + partial[2*stride+i] + partial[3*stride+i];
+    }
+
+    result->bins          = bins;
+    result->rowStep       = rowStep;
+    result->pixelsSampled = (unsigned long) rows * width;
+    result->mean          = (double) sum / result->pixelsSampled;
+
+    //Median and exposure counts straight from the histogram, they cost a few thousand adds at most
+    unsigned int underLevel = (unsigned int) (state->underExposedLevel * (bins-1));
+    unsigned int overLevel  = (unsigned int) (state->overExposedLevel  * (bins-1) + 0.999);
+    unsigned long cumulative = 0;
+    result->median       = bins-1;
+    result->underExposed = 0;
+    result->overExposed  = 0;
+    for (i=0; i<bins; i++)
+    {
+        if ( (cumulative*2 < result->pixelsSampled) && ((cumulative+result->histogram[i])*2 >= result->pixelsSampled) )
+            { result->median = i; }
+        cumulative += result->histogram[i];
+        if (i<=underLevel) { result->underExposed += result->histogram[i]; }
+        if (i>=overLevel)  { result->overExposed  += result->histogram[i]; }
+    }
+
+    result->computeMicroseconds = monotonicMicroseconds() - startTime;
+
+    //Adapt the row step of the next frame to the budget, only go back to denser
+    //sampling when twice the work still leaves some headroom so it does not oscillate
+    if (state->budgetMicroseconds!=0)
+    {
+        if ( (result->computeMicroseconds > state->budgetMicroseconds) && (rowStep<FRAME_STATISTICS_MAX_ROW_STEP) )
+            { state->rowStep = rowStep*2; } else
+        if ( (rowStep>1) && (result->computeMicroseconds*2 < state->budgetMicroseconds*3/4) )
+            { state->rowStep = rowStep/2; }
+    }
+
+    state->frames            += 1;
+    state->subsampledFrames  += (rowStep>1);
+    state->totalMicroseconds += result->computeMicroseconds;
+    if (result->computeMicroseconds > state->maxMicroseconds) { state->maxMicroseconds = result->computeMicroseconds; }
+    state->sumOfMeans        += result->mean;
+    state->pixelsSampled     += result->pixelsSampled;
+    state->underExposed      += result->underExposed;
+    state->overExposed       += result->overExposed;
+    return 1;
+}
+
+void writeFrameStatisticsHeader(FILE * fp)
+{
+    if (fp==0) { return; }
+    fprintf(fp,"frame,mean,median,underExposed,overExposed,pixelsSampled,rowStep,microseconds\n");
+}
+
+void writeFrameStatisticsRow(FILE * fp,unsigned int frameNumber,struct FrameStatistics * result)
+{
+    if ( (fp==0) || (result==0) ) { return; }
+    fprintf(fp,"%u,%0.3f,%u,%lu,%lu,%lu,%u,%lu\n",
+            frameNumber,
+            result->mean,
+            result->median,
+            result->underExposed,
+            result->overExposed,
+            result->pixelsSampled,
+            result->rowStep,
+            result->computeMicroseconds);
+}
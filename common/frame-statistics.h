@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef FRAME_STATISTICS_H_INCLUDED
+#define FRAME_STATISTICS_H_INCLUDED
+
+/* Standard headers */
+#include <stdio.h>
+
+// Exposure statistics computed on every frame while it is still in the
+// Aravis buffer : a histogram (one bin per level up to 12 bits, so 256 bins
+// for 8 bit pixels and 4096 bins for 12 bit pixels, 14/16 bit pixels are
+// scaled down to 4096 bins), the exact mean, the median and the number of
+// under/over exposed pixels. 06-grabber also stores the mean, median and the
+// under/over exposed ratios in the frameIndex.bin record of the frame.
+//
+// The pixel sum and histogram are computed by an SSE2 kernel (AVX2 is there
+// for benchmarking, it is slower on the histogram), with a portable fallback. When a frame takes longer than the
+// budget, the following frames are analysed on every 2nd, 4th, .. row until
+// they fit again. Nothing in here depends on Aravis so the kernels can be
+// benchmarked on their own (see benchmarks/frame-statistics-benchmark.c).
+
+#define FRAME_STATISTICS_MAX_BINS 4096
+#define FRAME_STATISTICS_MAX_ROW_STEP 16
+
+struct FrameStatistics
+{
+    unsigned int bins;
+    unsigned int histogram[FRAME_STATISTICS_MAX_BINS];
+    double mean;                  // In pixel units of the frame, not in bins
+    unsigned int median;          // In bins
+    unsigned long pixelsSampled;
+    unsigned long underExposed;   // Pixels at or below the under exposure level
+    unsigned long overExposed;    // Pixels at or above the over exposure level
+    unsigned int rowStep;         // 1 when every row was analysed
+    unsigned long computeMicroseconds;
+};
+
+struct FrameStatisticsState
+{
+    unsigned int budgetMicroseconds;    // 0 never subsamples
+    float underExposedLevel;            // Fraction of full scale, default 0.02
+    float overExposedLevel;             // Fraction of full scale, default 0.98
+    unsigned int rowStep;
+
+    //Totals over the whole run, for the --stats output
+    unsigned long frames;
+    unsigned long subsampledFrames;
+    unsigned long totalMicroseconds;
+    unsigned long maxMicroseconds;
+    double sumOfMeans;
+    unsigned long long pixelsSampled;
+    unsigned long long underExposed;
+    unsigned long long overExposed;
+};
+
+void initializeFrameStatistics(struct FrameStatisticsState * state,unsigned int budgetMicroseconds);
+
+// bitsPerPixel is the container size (8 or 16), significantBits the bits really used (8,10,12,14 or 16)
+int computeFrameStatistics(
+                           struct FrameStatisticsState * state,
+                           const void * pixels,
+                           unsigned int width,
+                           unsigned int height,
+                           unsigned int bitsPerPixel,
+                           unsigned int significantBits,
+                           struct FrameStatistics * result
+                          );
+
+// Pixel layout of a GenICam pixel format name such as Mono8, Mono12 or BayerRG16.
+// Returns 0 for packed, color and multi channel formats that the kernels do not handle
+int frameStatisticsLayout(const char * pixelFormat,unsigned int * bitsPerPixel,unsigned int * significantBits);
+
+// Name of the kernel picked for this CPU, "avx2", "sse2" or "scalar"
+const char * frameStatisticsKernel();
+
+// Force a kernel, for benchmarking. Returns 0 if this CPU cannot run it
+int selectFrameStatisticsKernel(const char * name);
+
+// CSV columns : frame,mean,median,underExposed,overExposed,pixelsSampled,rowStep,microseconds
+void writeFrameStatisticsHeader(FILE * fp);
+void writeFrameStatisticsRow(FILE * fp,unsigned int frameNumber,struct FrameStatistics * result);
+
+#endif // FRAME_STATISTICS_H_INCLUDED
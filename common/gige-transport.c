@@ -0,0 +1,166 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "gige-transport.h"
+#include "timing.h"
+
+/* Standard headers */
+#include <string.h>
+
+void setDefaultGigETransport(struct GigETransport * transport)
+{
+    memset(transport,0,sizeof(struct GigETransport));
+    transport->packetDelay      = -1;
+    transport->packetSocket     = -1;
+    transport->socketBufferSize = -1;
+    transport->resend           = -1;
+}
+
+int gigETransportRequested(struct GigETransport * transport)
+{
+    return ( (transport->autoTune) || (transport->packetSize!=0) || (transport->packetDelay>=0) ||
+             (transport->packetSocket>=0) || (transport->socketBufferSize>=0) || (transport->resend>=0) ||
+             (transport->packetTimeout!=0) || (transport->frameRetention!=0) );
+}
+
+void applyGigECameraTransport(struct GigETransport * transport,ArvCamera * camera,FILE * log)
+{
+    transport->isGigE = 0;
+    if (!gigETransportRequested(transport)) { return; }
+    if (!arv_camera_is_gv_device(camera))
+    {
+        fprintf(log,"GigE transport options ignored, the camera is not a GigE Vision device\n");
+        return;
+    }
+    transport->isGigE = 1;
+
+    //The packet socket (needs CAP_NET_RAW) skips the kernel UDP stack, Aravis falls back to a standard socket without it
+    if (transport->packetSocket>=0)
+    {
+        arv_camera_gv_set_stream_options(camera,(transport->packetSocket) ? ARV_GV_STREAM_OPTION_NONE : ARV_GV_STREAM_OPTION_PACKET_SOCKET_DISABLED);
+    }
+
+    GError * error = NULL;
+    if (transport->packetSize!=0)
+    {
+        arv_camera_gv_set_packet_size(camera,transport->packetSize,&error);
+    } else
+    if (transport->autoTune)
+    {   //Tries decreasing sizes up to the interface MTU until a test packet gets through
+        arv_camera_gv_auto_packet_size(camera,&error);
+    }
+    if (error!=NULL)
+    {
+        fprintf(log,"GigE packet size could not be set (%s)\n",error->message);
+        g_clear_error(&error);
+    }
+
+    if (transport->packetDelay>=0)
+    {
+        arv_camera_gv_set_packet_delay(camera,transport->packetDelay,&error);
+        if (error!=NULL)
+        {
+            fprintf(log,"GigE packet delay could not be set (%s)\n",error->message);
+            g_clear_error(&error);
+        }
+    }
+
+    transport->appliedPacketSize  = arv_camera_gv_get_packet_size(camera,NULL);
+    transport->appliedPacketDelay = (long) arv_camera_gv_get_packet_delay(camera,NULL);
+    fprintf(log,"GigE packet size %u bytes, packet delay %ld ns, %s socket\n",
+            transport->appliedPacketSize,transport->appliedPacketDelay,
+            (transport->packetSocket==0) ? "standard UDP" : "packet (standard UDP without CAP_NET_RAW)");
+}
+
+// Largest receive buffer the kernel grants an unprivileged process, 0 when unknown
+static long maximumReceiveBuffer()
+{
+    long value = 0;
+    FILE * fp = fopen("/proc/sys/net/core/rmem_max","r");
+    if (fp!=0)
+    {
+        if (fscanf(fp,"%ld",&value)!=1) { value=0; }
+        fclose(fp);
+    }
+    return value;
+}
+
+void applyGigEStreamTransport(struct GigETransport * transport,ArvStream * stream,size_t payload,FILE * log)
+{
+    if ( (!transport->isGigE) || (!ARV_IS_GV_STREAM(stream)) ) { return; }
+
+    long socketBufferSize = transport->socketBufferSize;
+    if ( (socketBufferSize<0) && (transport->autoTune) ) { socketBufferSize=0; }
+
+    if (socketBufferSize==0)
+    {   //At least one whole frame has to fit while the receive thread is busy
+        g_object_set(stream,"socket-buffer",ARV_GV_STREAM_SOCKET_BUFFER_AUTO,NULL);
+        socketBufferSize = (long) payload;
+    } else
+    if (socketBufferSize>0)
+    {
+        g_object_set(stream,"socket-buffer",ARV_GV_STREAM_SOCKET_BUFFER_FIXED,"socket-buffer-size",(gint) socketBufferSize,NULL);
+    }
+
+    int resend = transport->resend;
+    if ( (resend<0) && (transport->autoTune) ) { resend=1; }
+    if (resend>=0)
+    {
+        g_object_set(stream,"packet-resend",(resend) ? ARV_GV_STREAM_PACKET_RESEND_ALWAYS : ARV_GV_STREAM_PACKET_RESEND_NEVER,NULL);
+    }
+    if (transport->packetTimeout!=0)  { g_object_set(stream,"packet-timeout",(guint) transport->packetTimeout,NULL); }
+    if (transport->frameRetention!=0) { g_object_set(stream,"frame-retention",(guint) transport->frameRetention,NULL); }
+
+    fprintf(log,"GigE receive buffer ");
+    if (socketBufferSize>0) { fprintf(log,"%ld bytes (payload %zu bytes)",socketBufferSize,payload); } else
+                            { fprintf(log,"default"); }
+    fprintf(log,", resend %s",(resend<0) ? "default" : (resend) ? "always" : "never");
+    if (transport->packetTimeout!=0)  { fprintf(log,", packet timeout %u μs",transport->packetTimeout); }
+    if (transport->frameRetention!=0) { fprintf(log,", frame retention %u μs",transport->frameRetention); }
+    fprintf(log,"\n");
+
+    //The kernel silently caps SO_RCVBUF
+    long rmemMax = maximumReceiveBuffer();
+    if ( (socketBufferSize>0) && (rmemMax>0) && (rmemMax<socketBufferSize) )
+    {
+        fprintf(log,"net.core.rmem_max is %ld bytes, raise it to at least %ld (sysctl -w net.core.rmem_max=%ld) or the receive buffer stays smaller\n",
+                rmemMax,socketBufferSize,socketBufferSize);
+    }
+}
+
+void reportGigETransport(struct GigETransport * transport,ArvStream * stream,FILE * csv)
+{
+    if ( (!transport->isGigE) || (!ARV_IS_GV_STREAM(stream)) ) { return; }
+
+    unsigned long now = monotonicMicroseconds();
+    if ( (transport->lastReportTime!=0) && (now - transport->lastReportTime < 1000000) ) { return; }
+
+    guint64 completed=0, failures=0, underruns=0, resent=0, missing=0;
+    arv_stream_get_statistics(stream,&completed,&failures,&underruns);
+    arv_gv_stream_get_statistics(ARV_GV_STREAM(stream),&resent,&missing);
+
+    if (transport->lastReportTime==0)
+    {
+        if (csv!=0) { fprintf(csv,"second,completed,failures,underruns,resentPackets,missingPackets\n"); }
+    } else
+    {
+        transport->seconds += 1;
+        guint64 secondFailures = failures - transport->lastFailures;
+        if (secondFailures>transport->worstSecondFailures) { transport->worstSecondFailures = secondFailures; }
+        if (csv!=0)
+        {
+            fprintf(csv,"%lu,%lu,%lu,%lu,%lu,%lu\n",transport->seconds,
+                    (unsigned long) (completed-transport->lastCompleted),(unsigned long) secondFailures,
+                    (unsigned long) (underruns-transport->lastUnderruns),
+                    (unsigned long) (resent-transport->lastResent),(unsigned long) (missing-transport->lastMissing));
+        }
+    }
+
+    transport->lastReportTime = now;
+    transport->lastCompleted  = completed;
+    transport->lastFailures   = failures;
+    transport->lastUnderruns  = underruns;
+    transport->lastResent     = resent;
+    transport->lastMissing    = missing;
+    transport->resentPackets  = resent;
+    transport->missingPackets = missing;
+}
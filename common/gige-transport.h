@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef GIGE_TRANSPORT_H_INCLUDED
+#define GIGE_TRANSPORT_H_INCLUDED
+
+/* Aravis header */
+#include <arv.h>
+
+/* Standard headers */
+#include <stdio.h>
+
+// GigE Vision stream transport settings. arv_camera_create_stream() with no
+// options keeps the camera packet size (often 576 or 1500 bytes), a receive
+// buffer sized by the kernel default and the Aravis resend policy, which is
+// where most of the failed buffers on a busy link come from.
+//
+// applyGigECameraTransport() runs before the stream is created : it picks the
+// socket type and sets the packet size and the inter-packet delay.
+// applyGigEStreamTransport() runs on the new stream : receive buffer size,
+// resend policy and timeouts. With autoTune the largest packet size that gets
+// through is negotiated with the camera, the receive buffer follows the payload
+// size and missing packets are always resent. Both log what they applied.
+//
+// reportGigETransport() is called from the acquisition loop and appends one CSV
+// line per second with the completed, failed and underrun buffers and the
+// resent and missing packets of that second.
+//
+// Everything is a no-op for USB3 Vision and fake cameras.
+
+struct GigETransport
+{
+    //Requested, see setDefaultGigETransport()
+    char autoTune;
+    int  packetSize;          // Bytes, 0 keeps the camera value
+    long packetDelay;         // Nanoseconds between packets, -1 keeps the camera value
+    int  packetSocket;        // 1 packet socket, 0 standard UDP socket, -1 Aravis default
+    long socketBufferSize;    // Bytes, 0 follows the payload size, -1 Aravis default
+    int  resend;              // 1 always, 0 never, -1 Aravis default
+    unsigned int packetTimeout;  // Microseconds, 0 Aravis default
+    unsigned int frameRetention; // Microseconds, 0 Aravis default
+
+    //What the camera ended up with
+    char isGigE;
+    unsigned int appliedPacketSize;
+    long appliedPacketDelay;
+
+    //Per second report
+    unsigned long lastReportTime;
+    guint64 lastCompleted, lastFailures, lastUnderruns, lastResent, lastMissing;
+
+    //Totals for the --stats output
+    guint64 resentPackets;
+    guint64 missingPackets;
+    guint64 worstSecondFailures;
+    unsigned long seconds;
+};
+
+void setDefaultGigETransport(struct GigETransport * transport);
+
+// 1 when any transport option was given, nothing is touched otherwise
+int gigETransportRequested(struct GigETransport * transport);
+
+// Before arv_camera_create_stream()
+void applyGigECameraTransport(struct GigETransport * transport,ArvCamera * camera,FILE * log);
+
+// After arv_camera_create_stream(), payload is arv_camera_get_payload()
+void applyGigEStreamTransport(struct GigETransport * transport,ArvStream * stream,size_t payload,FILE * log);
+
+// Appends a line to csv once per second, the first call writes the header
+void reportGigETransport(struct GigETransport * transport,ArvStream * stream,FILE * csv);
+
+#endif // GIGE_TRANSPORT_H_INCLUDED
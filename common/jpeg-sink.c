@@ -0,0 +1,478 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "jpeg-sink.h"
+#include "pipeline-trace.h"
+#include "recording-journal.h"
+#include "timing.h"
+
+/* Standard headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+#ifdef HAVE_LIBJPEG
+#include <jpeglib.h>
+#endif
+
+#define JPEG_MAX_SLICES 32
+
+// Slices are a whole number of 8 MCU rows so that their restart markers line up
+#define RESTART_CYCLE 8
+
+struct JpegFrameJob
+{
+    unsigned char * pixels;
+    size_t allocated;
+    unsigned int width;
+    unsigned int height;
+    unsigned int channels;
+    unsigned int frameNumber;
+    unsigned long submitTime;
+    unsigned long sequence;
+    char busy;
+    char failed;
+
+    unsigned int numberOfSlices;
+    unsigned int rowsPerSlice;
+    unsigned int nextSlice;
+    unsigned int slicesDone;
+    unsigned char * sliceData[JPEG_MAX_SLICES];
+    unsigned long sliceSize[JPEG_MAX_SLICES];
+};
+
+#ifdef HAVE_LIBJPEG
+//----------------------------------------------------------------------------------------
+// Encoding
+//----------------------------------------------------------------------------------------
+
+// The default libjpeg error handler calls exit(), jump back to the encoder instead
+struct JpegErrorHandler
+{
+    struct jpeg_error_mgr manager;
+    jmp_buf jump;
+};
+
+static void jpegErrorExit(j_common_ptr cinfo)
+{
+    struct JpegErrorHandler * handler = (struct JpegErrorHandler *) cinfo->err;
+    (*cinfo->err->output_message)(cinfo);
+    longjmp(handler->jump,1);
+}
+
+static int encodeSlice(struct JpegSink * sink,struct JpegFrameJob * job,unsigned int slice,unsigned char ** output,unsigned long * outputSize)
+{
+    struct jpeg_compress_struct cinfo;
+    struct JpegErrorHandler error;
+    unsigned int firstRow = slice * job->rowsPerSlice;
+    unsigned int rows = job->rowsPerSlice;
+    if (firstRow+rows>job->height) { rows = job->height - firstRow; }
+
+    *output = 0;
+    *outputSize = 0;
+
+    cinfo.err = jpeg_std_error(&error.manager);
+    error.manager.error_exit = jpegErrorExit;
+    if (setjmp(error.jump))
+    {
+        jpeg_destroy_compress(&cinfo);
+        free(*output);
+        *output = 0;
+        return 0;
+    }
+
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo,output,outputSize);
+
+    cinfo.image_width      = job->width;
+    cinfo.image_height     = rows;
+    cinfo.input_components = job->channels;
+    cinfo.in_color_space   = (job->channels==3) ? JCS_RGB : JCS_GRAYSCALE;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo,sink->quality,TRUE);
+    //Every slice has to use the very same tables, so no per slice Huffman optimization
+    cinfo.optimize_coding = FALSE;
+    if (job->numberOfSlices>1) { cinfo.restart_in_rows = 1; }
+
+    jpeg_start_compress(&cinfo,TRUE);
+    unsigned int stride = job->width * job->channels;
+    while (cinfo.next_scanline < cinfo.image_height)
+    {
+        JSAMPROW row = (JSAMPROW) (job->pixels + (size_t) (firstRow + cinfo.next_scanline) * stride);
+        jpeg_write_scanlines(&cinfo,&row,1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    return 1;
+}
+
+// Offset of the first entropy coded byte, right after the SOS header, and optionally patch the SOF height
+static unsigned long findScanData(unsigned char * data,unsigned long size,unsigned int patchHeight)
+{
+    unsigned long p = 2; // Skip SOI
+    while (p+4<=size)
+    {
+        if (data[p]!=0xFF) { return 0; }
+        unsigned char marker = data[p+1];
+        unsigned int length  = (data[p+2]<<8) | data[p+3];
+        if ( (patchHeight!=0) && (marker>=0xC0) && (marker<=0xC2) && (p+7<=size) )
+        {
+            data[p+5] = (unsigned char) (patchHeight>>8);
+            data[p+6] = (unsigned char) (patchHeight&0xFF);
+        }
+        if (marker==0xDA) { return p+2+length; }
+        p += 2+length;
+    }
+    return 0;
+}
+
+static unsigned long writeStitchedFrame(struct JpegSink * sink,struct JpegFrameJob * job)
+{
+    char filename[1024];
+    snprintf(filename,sizeof(filename),"%s/colorFrame_0_%05u.jpg",sink->directory,job->frameNumber);
+
+    FILE * fp = fopen(filename,"wb");
+    if (fp==0)
+    {
+        fprintf(stderr,"JPEG sink could not open output file %s\n",filename);
+        return 0;
+    }
+
+    unsigned long written = 0;
+    if (job->numberOfSlices==1)
+    {
+        written = fwrite(job->sliceData[0],1,job->sliceSize[0],fp);
+    } else
+    {
+        static const unsigned char restartMarker[2] = { 0xFF, 0xD0 + RESTART_CYCLE-1 };
+        static const unsigned char endOfImage[2]    = { 0xFF, 0xD9 };
+        unsigned int slice;
+        for (slice=0; slice<job->numberOfSlices; slice++)
+        {
+            unsigned char * data = job->sliceData[slice];
+            unsigned long size   = job->sliceSize[slice];
+            unsigned long scanStart = findScanData(data,size,(slice==0) ? job->height : 0);
+            if ( (scanStart==0) || (size<scanStart+2) ) { written=0; break; }
+
+            if (slice==0) { written += fwrite(data,1,scanStart,fp); } // SOI up to and including SOS of the whole frame
+                     else { written += fwrite(restartMarker,1,2,fp); }
+            written += fwrite(data+scanStart,1,size-2-scanStart,fp);  // Entropy coded data without EOI
+        }
+        if (written!=0) { written += fwrite(endOfImage,1,2,fp); }
+    }
+    fclose(fp);
+    return written;
+}
+#endif // HAVE_LIBJPEG
+
+
+//----------------------------------------------------------------------------------------
+// Worker pool
+//----------------------------------------------------------------------------------------
+static struct JpegFrameJob * nextJobWithSlices(struct JpegSink * sink)
+{
+    struct JpegFrameJob * next = 0;
+    unsigned int i=0;
+    for (i=0; i<sink->queueDepth; i++)
+    {
+        struct JpegFrameJob * job = &sink->jobs[i];
+        if ( (job->busy) && (job->nextSlice<job->numberOfSlices) && ((next==0) || (job->sequence<next->sequence)) )
+            { next=job; }
+    }
+    return next;
+}
+
+// Queued frame no worker has started on, for drop-oldest
+static struct JpegFrameJob * oldestWaitingJob(struct JpegSink * sink)
+{
+    struct JpegFrameJob * oldest = 0;
+    unsigned int i=0;
+    for (i=0; i<sink->queueDepth; i++)
+    {
+        struct JpegFrameJob * job = &sink->jobs[i];
+        if ( (job->busy) && (job->numberOfSlices!=0) && (job->nextSlice==0) && ((oldest==0) || (job->sequence<oldest->sequence)) )
+            { oldest=job; }
+    }
+    return oldest;
+}
+
+static void * jpegWorkerThread(void * argument)
+{
+    struct JpegSink * sink = (struct JpegSink *) argument;
+    namePipelineTraceThread("jpeg worker");
+
+    pthread_mutex_lock(&sink->lock);
+    for (;;)
+    {
+        struct JpegFrameJob * job = nextJobWithSlices(sink);
+        if (job==0)
+        {
+            if (sink->stop) { break; }
+            pthread_cond_wait(&sink->work,&sink->lock);
+            continue;
+        }
+
+        unsigned int slice = job->nextSlice++;
+        pthread_mutex_unlock(&sink->lock);
+
+        unsigned char * data = 0;
+        unsigned long size = 0;
+        int encoded = 0;
+        traceBegin("jpeg encode",job->frameNumber);
+#ifdef HAVE_LIBJPEG
+        encoded = encodeSlice(sink,job,slice,&data,&size);
+#endif
+        traceEnd("jpeg encode",job->frameNumber);
+
+        pthread_mutex_lock(&sink->lock);
+        job->sliceData[slice] = data;
+        job->sliceSize[slice] = size;
+        if (!encoded) { job->failed=1; }
+        job->slicesDone += 1;
+        if (job->slicesDone<job->numberOfSlices) { continue; }
+        pthread_mutex_unlock(&sink->lock);
+
+        //Last slice of the frame, this worker joins them and writes the file
+        unsigned long written = 0;
+        traceBegin("jpeg write",job->frameNumber);
+#ifdef HAVE_LIBJPEG
+        if (!job->failed) { written = writeStitchedFrame(sink,job); }
+#endif
+        traceEnd("jpeg write",job->frameNumber);
+        if ( (written!=0) && (sink->journal!=0) )
+        {
+            char name[RECORDING_JOURNAL_NAME_LENGTH];
+            snprintf(name,sizeof(name),"colorFrame_0_%05u.jpg",job->frameNumber);
+            journalFrame(sink->journal,job->frameNumber,name);
+        }
+        unsigned long now = monotonicMicroseconds();
+        unsigned long latency = now - job->submitTime;
+        unsigned int i;
+        for (i=0; i<job->numberOfSlices; i++)
+        {
+            free(job->sliceData[i]);
+            job->sliceData[i] = 0;
+        }
+
+        pthread_mutex_lock(&sink->lock);
+        if (written!=0)
+        {
+            sink->framesEncoded += 1;
+            sink->rawBytes      += (unsigned long long) job->width * job->height * job->channels;
+            sink->encodedBytes  += written;
+            sink->totalLatencyMicroseconds += latency;
+            if (latency>sink->maxLatencyMicroseconds) { sink->maxLatencyMicroseconds=latency; }
+            sink->lastFrameTime = now;
+        } else
+        {
+            sink->failures += 1;
+        }
+        job->busy = 0;
+        sink->framesInFlight -= 1;
+        pthread_cond_broadcast(&sink->idle);
+    }
+    pthread_mutex_unlock(&sink->lock);
+    return 0;
+}
+
+int createJpegSink(struct JpegSink * sink,const char * directory,unsigned int quality,unsigned int workers,unsigned int slices,unsigned int queueDepth,struct SinkPolicy * policy)
+{
+#ifndef HAVE_LIBJPEG
+    fprintf(stderr,"JPEG output is not available, this was built without libjpeg\n");
+    return 0;
+#endif
+    if (sink==0) { return 0; }
+    if (workers==0)    { workers=1; }
+    if (slices==0)     { slices=1; }
+    if (slices>JPEG_MAX_SLICES) { slices=JPEG_MAX_SLICES; }
+    if ( (policy!=0) && (policy->queueDepth!=0) ) { queueDepth=policy->queueDepth; }
+    if (queueDepth==0) { queueDepth=2*workers; }
+    if ( (quality==0) || (quality>100) ) { quality=90; }
+
+    memset(sink,0,sizeof(struct JpegSink));
+    snprintf(sink->directory,sizeof(sink->directory),"%s",(directory!=0) ? directory : ".");
+    sink->quality    = quality;
+    sink->workers    = workers;
+    sink->slices     = slices;
+    sink->queueDepth = queueDepth;
+    if (policy!=0) { sink->policy = *policy; } else
+                   { setDefaultSinkPolicy(&sink->policy,"jpeg",SINK_POLICY_DROP_NEWEST); }
+    sink->jobs    = (struct JpegFrameJob *) calloc(queueDepth,sizeof(struct JpegFrameJob));
+    sink->threads = (pthread_t *) calloc(workers,sizeof(pthread_t));
+    if ( (sink->jobs==0) || (sink->threads==0) )
+    {
+        free(sink->jobs);
+        free(sink->threads);
+        sink->jobs    = 0;
+        sink->threads = 0;
+        return 0;
+    }
+
+    pthread_mutex_init(&sink->lock,NULL);
+    pthread_cond_init(&sink->work,NULL);
+    pthread_cond_init(&sink->idle,NULL);
+
+    unsigned int i=0;
+    for (i=0; i<workers; i++)
+    {
+        if (pthread_create(&sink->threads[i],NULL,jpegWorkerThread,sink)!=0) { break; }
+        sink->threadsStarted += 1;
+    }
+    if (sink->threadsStarted==0)
+    {
+        fprintf(stderr,"Could not start any JPEG worker thread\n");
+        destroyJpegSink(sink);
+        return 0;
+    }
+
+    fprintf(stderr,"JPEG output, quality %u, %u workers, up to %u slices per frame, %s when %u frames are queued\n",quality,sink->threadsStarted,slices,sinkPolicyName(sink->policy.type),queueDepth);
+    return 1;
+}
+
+int submitJpegFrame(struct JpegSink * sink,const void * pixels,unsigned int width,unsigned int height,unsigned int channels,unsigned int frameNumber)
+{
+    if ( (sink==0) || (pixels==0) || (width==0) || (height==0) ) { return 0; }
+    if ( (channels!=1) && (channels!=3) ) { return 0; }
+
+    pthread_mutex_lock(&sink->lock);
+    sink->framesSubmitted += 1;
+    if (sink->startTime==0) { sink->startTime = monotonicMicroseconds(); }
+
+    struct JpegFrameJob * job = 0;
+    char retry = 0;
+    while (job==0)
+    {
+        enum SinkAdmission admission = sinkAdmission(&sink->policy,sink->framesInFlight,sink->queueDepth,frameNumber,retry);
+        if (admission==SINK_DISCARD)
+        {
+            sink->framesDropped += 1;
+            pthread_mutex_unlock(&sink->lock);
+            return 0;
+        } else
+        if (admission==SINK_WAIT)
+        {
+            unsigned long startTime = monotonicMicroseconds();
+            while (sink->framesInFlight>=sink->queueDepth)
+                { pthread_cond_wait(&sink->idle,&sink->lock); }
+            sinkBlocked(&sink->policy,monotonicMicroseconds()-startTime);
+            retry = 1;
+        } else
+        if (admission==SINK_EVICT_OLDEST)
+        {
+            job = oldestWaitingJob(sink);
+            if (job==0)
+            {   //Every queued frame is already being encoded
+                sinkDropped(&sink->policy,frameNumber);
+                sink->framesDropped += 1;
+                pthread_mutex_unlock(&sink->lock);
+                return 0;
+            }
+            sinkEvicted(&sink->policy,job->frameNumber);
+            sink->framesDropped  += 1;
+            sink->framesInFlight -= 1;
+        } else
+        {
+            unsigned int i=0;
+            for (i=0; i<sink->queueDepth; i++)
+            {
+                if (!sink->jobs[i].busy) { job=&sink->jobs[i]; break; }
+            }
+            if (job==0)
+            {   //Cannot happen while framesInFlight<queueDepth
+                sinkDropped(&sink->policy,frameNumber);
+                sink->framesDropped += 1;
+                pthread_mutex_unlock(&sink->lock);
+                return 0;
+            }
+        }
+    }
+    sinkAccepted(&sink->policy,sink->framesInFlight+1);
+    job->busy = 1; // Reserved, no worker looks at it before numberOfSlices is set
+    job->numberOfSlices = 0;
+    pthread_mutex_unlock(&sink->lock);
+
+    size_t size = (size_t) width * height * channels;
+    if (size>job->allocated)
+    {
+        unsigned char * buffer = (unsigned char *) realloc(job->pixels,size);
+        if (buffer==0)
+        {
+            pthread_mutex_lock(&sink->lock);
+            job->busy = 0;
+            sink->failures += 1;
+            pthread_mutex_unlock(&sink->lock);
+            return 0;
+        }
+        job->pixels    = buffer;
+        job->allocated = size;
+    }
+    memcpy(job->pixels,pixels,size);
+
+    //Whole multiples of 8 MCU rows, MCUs are 8 rows in grayscale and 16 with the default 4:2:0 color sampling
+    unsigned int sliceUnit = RESTART_CYCLE * ((channels==1) ? 8 : 16);
+    unsigned int units = (height + sliceUnit-1) / sliceUnit;
+    unsigned int numberOfSlices = (sink->slices<units) ? sink->slices : units;
+    if (numberOfSlices==0) { numberOfSlices=1; }
+    unsigned int rowsPerSlice = ((units + numberOfSlices-1) / numberOfSlices) * sliceUnit;
+    numberOfSlices = (height + rowsPerSlice-1) / rowsPerSlice;
+
+    pthread_mutex_lock(&sink->lock);
+    job->width          = width;
+    job->height         = height;
+    job->channels       = channels;
+    job->frameNumber    = frameNumber;
+    job->submitTime     = monotonicMicroseconds();
+    job->sequence       = sink->framesSubmitted;
+    job->failed         = 0;
+    job->rowsPerSlice   = rowsPerSlice;
+    job->nextSlice      = 0;
+    job->slicesDone     = 0;
+    job->numberOfSlices = numberOfSlices;
+    sink->framesInFlight += 1;
+    pthread_cond_broadcast(&sink->work);
+    pthread_mutex_unlock(&sink->lock);
+    return 1;
+}
+
+double jpegSinkFrameRate(struct JpegSink * sink)
+{
+    if ( (sink==0) || (sink->framesEncoded==0) || (sink->lastFrameTime<=sink->startTime) ) { return 0.0; }
+    return (double) sink->framesEncoded * 1000000.0 / (sink->lastFrameTime - sink->startTime);
+}
+
+void destroyJpegSink(struct JpegSink * sink)
+{
+    if ( (sink==0) || (sink->jobs==0) ) { return; }
+
+    pthread_mutex_lock(&sink->lock);
+    while ( (sink->threadsStarted!=0) && (sink->framesInFlight!=0) )
+        { pthread_cond_wait(&sink->idle,&sink->lock); }
+    sink->stop = 1;
+    pthread_cond_broadcast(&sink->work);
+    pthread_mutex_unlock(&sink->lock);
+
+    unsigned int i=0;
+    for (i=0; i<sink->threadsStarted; i++)
+        { pthread_join(sink->threads[i],NULL); }
+
+    if (sink->framesSubmitted!=0)
+    {
+        fprintf(stderr,"JPEG output : %lu of %lu frames written (%lu dropped), %0.2f fps, latency %0.1f ms average / %0.1f ms max, %0.1fx smaller than raw\n",
+                sink->framesEncoded,sink->framesSubmitted,sink->framesDropped,jpegSinkFrameRate(sink),
+                (sink->framesEncoded!=0) ? sink->totalLatencyMicroseconds/1000.0/sink->framesEncoded : 0.0,
+                sink->maxLatencyMicroseconds/1000.0,
+                (sink->encodedBytes!=0) ? (double) sink->rawBytes/sink->encodedBytes : 0.0);
+        printSinkPolicy(stderr,&sink->policy);
+    }
+
+    pthread_cond_destroy(&sink->idle);
+    pthread_cond_destroy(&sink->work);
+    pthread_mutex_destroy(&sink->lock);
+    for (i=0; i<sink->queueDepth; i++)
+        { free(sink->jobs[i].pixels); }
+    free(sink->jobs);
+    free(sink->threads);
+    sink->jobs    = 0;
+    sink->threads = 0;
+    sink->threadsStarted = 0;
+}
@@ -0,0 +1,77 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef JPEG_SINK_H_INCLUDED
+#define JPEG_SINK_H_INCLUDED
+
+/* Standard headers */
+#include <pthread.h>
+
+#include "sink-queue.h"
+
+struct RecordingJournal;
+
+// JPEG output for review archives, 10-20x smaller than the raw PNM files.
+//
+// Frames are copied into a bounded queue and encoded by a pool of worker
+// threads. A frame is cut into horizontal slices of a whole number of 8 MCU
+// rows that are encoded in parallel as independent JPEGs with a restart marker
+// after every MCU row. With 8 MCU rows per slice the RST0..RST7 sequence of
+// every slice lines up with the one of the whole frame, so the slices are
+// joined into one baseline JPEG by keeping the headers of the first slice
+// (with the full height), and the entropy coded data of every slice separated
+// by RST7. A large frame is therefore encoded by several cores at once, and
+// small frames simply go to different workers.
+//
+// When the queue is full the sink policy decides what is lost (drop-newest by
+// default, see sink-queue.h), a dropped oldest frame is one no worker started.
+//
+// Needs libjpeg (or libjpeg-turbo), without it createJpegSink() fails.
+
+struct JpegFrameJob;
+
+struct JpegSink
+{
+    char directory[512];
+    unsigned int quality;
+    unsigned int workers;
+    unsigned int slices;        // Upper bound of slices per frame, 1 disables slicing
+
+    pthread_t * threads;
+    unsigned int threadsStarted;
+    pthread_mutex_t lock;
+    pthread_cond_t  work;
+    pthread_cond_t  idle;
+    char stop;
+
+    struct JpegFrameJob * jobs; // Preallocated frame slots
+    unsigned int queueDepth;
+    unsigned int framesInFlight;
+    struct SinkPolicy policy;
+    struct RecordingJournal * journal; // Optional, every written file is journaled (--journal)
+
+    //Totals for the --stats output
+    unsigned long startTime;
+    unsigned long framesSubmitted;
+    unsigned long framesEncoded;
+    unsigned long framesDropped;
+    unsigned long failures;
+    unsigned long long rawBytes;
+    unsigned long long encodedBytes;
+    unsigned long totalLatencyMicroseconds;
+    unsigned long maxLatencyMicroseconds;
+    unsigned long lastFrameTime;
+};
+
+// policy may be NULL for drop-newest, its queueDepth overrides queueDepth
+int createJpegSink(struct JpegSink * sink,const char * directory,unsigned int quality,unsigned int workers,unsigned int slices,unsigned int queueDepth,struct SinkPolicy * policy);
+
+// Copies the frame, 0 when the policy discarded it. Only returns at once if the policy is not block
+int submitJpegFrame(struct JpegSink * sink,const void * pixels,unsigned int width,unsigned int height,unsigned int channels,unsigned int frameNumber);
+
+// Frames per second written, from the first submission to the last file
+double jpegSinkFrameRate(struct JpegSink * sink);
+
+// Encodes what is queued, then stops the workers, the totals stay readable
+void destroyJpegSink(struct JpegSink * sink);
+
+#endif // JPEG_SINK_H_INCLUDED
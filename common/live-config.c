@@ -0,0 +1,352 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "live-config.h"
+#include "control-socket.h"
+#include "timing.h"
+
+/* Standard headers */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static void mergeChange(struct LiveConfigChange * into,const struct LiveConfigChange * change)
+{
+    if (change->mask & LIVE_CONFIG_EXPOSURE)    { into->exposure   = change->exposure; }
+    if (change->mask & LIVE_CONFIG_GAIN)        { into->gain       = change->gain; }
+    if (change->mask & LIVE_CONFIG_BLACK_LEVEL) { into->blackLevel = change->blackLevel; }
+    if (change->mask & LIVE_CONFIG_FRAME_RATE)  { into->frameRate  = change->frameRate; }
+    into->mask |= change->mask;
+}
+
+// Writes the features, called on the controller thread without the lock
+static unsigned int writeChange(struct LiveConfig * live,const struct LiveConfigChange * change,struct LiveConfigChange * written)
+{
+    GError * error = NULL;
+    memset(written,0,sizeof(struct LiveConfigChange));
+
+    //Frame rate first, a longer exposure may only fit once the period grew
+    if (change->mask & LIVE_CONFIG_FRAME_RATE)
+    {
+        arv_camera_set_frame_rate(live->camera,change->frameRate,&error);
+        if (error==NULL) { written->mask|=LIVE_CONFIG_FRAME_RATE; written->frameRate=arv_camera_get_frame_rate(live->camera,NULL); } else
+                         { fprintf(stderr,"Live config : frame rate %0.2f refused (%s)\n",change->frameRate,error->message); g_clear_error(&error); }
+    }
+    if (change->mask & LIVE_CONFIG_EXPOSURE)
+    {
+        arv_camera_set_exposure_time(live->camera,change->exposure,&error);
+        if (error==NULL) { written->mask|=LIVE_CONFIG_EXPOSURE; written->exposure=arv_camera_get_exposure_time(live->camera,NULL); } else
+                         { fprintf(stderr,"Live config : exposure %0.1f refused (%s)\n",change->exposure,error->message); g_clear_error(&error); }
+    }
+    if (change->mask & LIVE_CONFIG_GAIN)
+    {
+        arv_camera_set_gain(live->camera,change->gain,&error);
+        if (error==NULL) { written->mask|=LIVE_CONFIG_GAIN; written->gain=arv_camera_get_gain(live->camera,NULL); } else
+                         { fprintf(stderr,"Live config : gain %0.2f refused (%s)\n",change->gain,error->message); g_clear_error(&error); }
+    }
+    if (change->mask & LIVE_CONFIG_BLACK_LEVEL)
+    {
+        arv_camera_set_black_level(live->camera,change->blackLevel,&error);
+        if (error==NULL) { written->mask|=LIVE_CONFIG_BLACK_LEVEL; written->blackLevel=arv_camera_get_black_level(live->camera,NULL); } else
+                         { fprintf(stderr,"Live config : black level %0.2f refused (%s)\n",change->blackLevel,error->message); g_clear_error(&error); }
+    }
+    return written->mask;
+}
+
+static void * liveConfigThread(void * argument)
+{
+    struct LiveConfig * live = (struct LiveConfig *) argument;
+
+    pthread_mutex_lock(&live->lock);
+    for (;;)
+    {
+        if ( (!live->stop) && (live->requested.mask==0) && (!live->reloadRequested) )
+            { pthread_cond_wait(&live->wake,&live->lock); continue; }
+        if (live->stop) { break; }
+
+        if (live->reloadRequested)
+        {
+            live->reloadRequested = 0;
+            struct LiveConfigChange fromFile;
+            pthread_mutex_unlock(&live->lock);
+            int loaded = readLiveConfigSettings(live->settingsFile,&fromFile);
+            pthread_mutex_lock(&live->lock);
+            if (!loaded) { live->failures += 1; continue; }
+
+            //Only what differs from the camera, the file usually holds the startup values too
+            if ( (fromFile.mask & LIVE_CONFIG_EXPOSURE)    && (fabs(fromFile.exposure-live->exposure)<0.5) )        { fromFile.mask &= ~LIVE_CONFIG_EXPOSURE; }
+            if ( (fromFile.mask & LIVE_CONFIG_GAIN)        && (fabs(fromFile.gain-live->gain)<0.001) )              { fromFile.mask &= ~LIVE_CONFIG_GAIN; }
+            if ( (fromFile.mask & LIVE_CONFIG_BLACK_LEVEL) && (fabs(fromFile.blackLevel-live->blackLevel)<0.001) )  { fromFile.mask &= ~LIVE_CONFIG_BLACK_LEVEL; }
+            if ( (fromFile.mask & LIVE_CONFIG_FRAME_RATE)  && (fabs(fromFile.frameRate-live->frameRate)<0.001) )    { fromFile.mask &= ~LIVE_CONFIG_FRAME_RATE; }
+            if (live->exposureAndGainLocked) { fromFile.mask &= ~(LIVE_CONFIG_EXPOSURE|LIVE_CONFIG_GAIN); }
+            if (live->frameRateLocked)       { fromFile.mask &= ~LIVE_CONFIG_FRAME_RATE; }
+            live->reloads += 1;
+            if (fromFile.mask==0)
+            {
+                fprintf(stderr,"Live config : %s changes nothing\n",live->settingsFile);
+                continue;
+            }
+            mergeChange(&live->requested,&fromFile);
+            live->requestedChange += 1;
+            live->requests += 1;
+        }
+
+        struct LiveConfigChange change = live->requested;
+        unsigned int changeNumber = live->requestedChange;
+        double previousFrameRate = live->frameRate;
+        memset(&live->requested,0,sizeof(struct LiveConfigChange));
+        pthread_mutex_unlock(&live->lock);
+
+        struct LiveConfigChange written;
+        unsigned long startTime = monotonicMicroseconds();
+        unsigned int writtenMask = writeChange(live,&change,&written);
+        unsigned long elapsed = monotonicMicroseconds() - startTime;
+
+        //The frame on its way during the write still has the old settings
+        uint64_t period = (previousFrameRate>0.0) ? (uint64_t) (1000000000.0/previousFrameRate) : 0;
+        uint64_t effectiveTime = monotonicNanoseconds() + period;
+
+        pthread_mutex_lock(&live->lock);
+        live->writeMicroseconds += elapsed;
+        if (elapsed>live->maxWriteMicroseconds) { live->maxWriteMicroseconds=elapsed; }
+        if (writtenMask!=change.mask) { live->failures += 1; }
+        if (writtenMask==0) { continue; }
+
+        if (writtenMask & LIVE_CONFIG_EXPOSURE)    { live->exposure   = written.exposure; }
+        if (writtenMask & LIVE_CONFIG_GAIN)        { live->gain       = written.gain; }
+        if (writtenMask & LIVE_CONFIG_BLACK_LEVEL) { live->blackLevel = written.blackLevel; }
+        if (writtenMask & LIVE_CONFIG_FRAME_RATE)  { live->frameRate  = written.frameRate; live->frameRateChanged = 1; }
+        live->appliedChange = changeNumber;
+        live->effectiveTime = effectiveTime;
+        live->applied += 1;
+
+        if (live->log!=0)
+        {
+            fprintf(live->log,"applied,%u,,%0.1f,%0.3f,%0.3f,%0.3f,%lu\n",changeNumber,
+                    live->exposure,live->gain,live->blackLevel,live->frameRate,elapsed);
+            fflush(live->log);
+        }
+        fprintf(stderr,"\nLive config : change %u applied in %0.1f ms, exposure %0.1f μsec, gain %0.2f, black level %0.2f, %0.2f fps\n",
+                changeNumber,elapsed/1000.0,live->exposure,live->gain,live->blackLevel,live->frameRate);
+    }
+    pthread_mutex_unlock(&live->lock);
+    return 0;
+}
+
+int startLiveConfig(struct LiveConfig * live,ArvCamera * camera,const char * settingsFile,FILE * log,char exposureAndGainLocked,char frameRateLocked)
+{
+    if ( (live==0) || (camera==0) ) { return 0; }
+    memset(live,0,sizeof(struct LiveConfig));
+    live->camera = camera;
+    live->log    = log;
+    live->exposureAndGainLocked = exposureAndGainLocked;
+    live->frameRateLocked       = frameRateLocked;
+    if (settingsFile!=0) { snprintf(live->settingsFile,sizeof(live->settingsFile),"%s",settingsFile); }
+
+    //What the camera runs with now, for get and for what a reload has to change
+    live->exposure   = arv_camera_get_exposure_time(camera,NULL);
+    live->gain       = arv_camera_get_gain(camera,NULL);
+    live->blackLevel = arv_camera_get_black_level(camera,NULL);
+    live->frameRate  = arv_camera_get_frame_rate(camera,NULL);
+    live->startTime  = monotonicMicroseconds();
+
+    pthread_mutex_init(&live->lock,NULL);
+    pthread_cond_init(&live->wake,NULL);
+    if (pthread_create(&live->thread,NULL,liveConfigThread,live)!=0)
+    {
+        fprintf(stderr,"Could not start the live config thread\n");
+        pthread_cond_destroy(&live->wake);
+        pthread_mutex_destroy(&live->lock);
+        return 0;
+    }
+    live->threadStarted = 1;
+    if (log!=0) { fprintf(log,"event,change,frame,exposure,gain,blackLevel,frameRate,writeMicroseconds\n"); }
+    return 1;
+}
+
+unsigned int requestLiveConfigChange(struct LiveConfig * live,const struct LiveConfigChange * change,char * reply,size_t replySize)
+{
+    if ( (live==0) || (!live->threadStarted) || (change==0) || (change->mask==0) )
+    {
+        snprintf(reply,replySize,"error nothing to change\n");
+        return 0;
+    }
+    if ( (live->exposureAndGainLocked) && (change->mask & (LIVE_CONFIG_EXPOSURE|LIVE_CONFIG_GAIN)) )
+    {
+        snprintf(reply,replySize,"error exposure and gain belong to --autoexposure\n");
+        return 0;
+    }
+    if ( (live->frameRateLocked) && (change->mask & LIVE_CONFIG_FRAME_RATE) )
+    {
+        snprintf(reply,replySize,"error the frame rate belongs to --timelapse\n");
+        return 0;
+    }
+    if ( ( (change->mask & LIVE_CONFIG_EXPOSURE)   && (change->exposure<=0.0) ) ||
+         ( (change->mask & LIVE_CONFIG_FRAME_RATE) && (change->frameRate<=0.0) ) )
+    {
+        snprintf(reply,replySize,"error exposure and frame rate have to be positive\n");
+        return 0;
+    }
+
+    pthread_mutex_lock(&live->lock);
+    mergeChange(&live->requested,change);
+    live->requestedChange += 1;
+    live->requests += 1;
+    unsigned int changeNumber = live->requestedChange;
+    pthread_cond_signal(&live->wake);
+    pthread_mutex_unlock(&live->lock);
+
+    snprintf(reply,replySize,"ok change %u\n",changeNumber);
+    return changeNumber;
+}
+
+void requestLiveConfigReload(struct LiveConfig * live)
+{
+    if ( (live==0) || (!live->threadStarted) ) { return; }
+    if (live->settingsFile[0]==0)
+    {
+        fprintf(stderr,"\nLive config : no settings file to reload\n");
+        return;
+    }
+    pthread_mutex_lock(&live->lock);
+    live->reloadRequested = 1;
+    pthread_cond_signal(&live->wake);
+    pthread_mutex_unlock(&live->lock);
+}
+
+static int parseSetting(const char * name,const char * value,struct LiveConfigChange * change)
+{
+    char * end = 0;
+    double number = strtod(value,&end);
+    if (end==value) { return 0; }
+    if (strcmp(name,"exposure")==0)   { change->exposure=number;   change->mask|=LIVE_CONFIG_EXPOSURE;    return 1; }
+    if (strcmp(name,"gain")==0)       { change->gain=number;       change->mask|=LIVE_CONFIG_GAIN;        return 1; }
+    if (strcmp(name,"blackLevel")==0) { change->blackLevel=number; change->mask|=LIVE_CONFIG_BLACK_LEVEL; return 1; }
+    if (strcmp(name,"frameRate")==0)  { change->frameRate=number;  change->mask|=LIVE_CONFIG_FRAME_RATE;  return 1; }
+    return 0;
+}
+
+void handleLiveConfigCommand(void * userData,const char * command,char * reply,size_t replySize)
+{
+    struct LiveConfig * live = (struct LiveConfig *) userData;
+
+    if (strncmp(command,"set ",4)==0)
+    {
+        //set name value [name value ...], applied together
+        struct LiveConfigChange change;
+        memset(&change,0,sizeof(struct LiveConfigChange));
+        char words[CONTROL_SOCKET_MAX_LINE];
+        snprintf(words,sizeof(words),"%s",command+4);
+        char * saved = 0;
+        char * name = strtok_r(words," ",&saved);
+        while (name!=0)
+        {
+            char * value = strtok_r(NULL," ",&saved);
+            if ( (value==0) || (!parseSetting(name,value,&change)) )
+            {
+                snprintf(reply,replySize,"error use set exposure|gain|blackLevel|frameRate <value>\n");
+                return;
+            }
+            name = strtok_r(NULL," ",&saved);
+        }
+        requestLiveConfigChange(live,&change,reply,replySize);
+    } else
+    if (strcmp(command,"get")==0)
+    {
+        pthread_mutex_lock(&live->lock);
+        snprintf(reply,replySize,"exposure %0.1f gain %0.3f blackLevel %0.3f frameRate %0.3f change %u\n",
+                 live->exposure,live->gain,live->blackLevel,live->frameRate,live->appliedChange);
+        pthread_mutex_unlock(&live->lock);
+    } else
+    if (strcmp(command,"stats")==0)
+    {
+        pthread_mutex_lock(&live->lock);
+        unsigned long elapsed = monotonicMicroseconds() - live->startTime;
+        snprintf(reply,replySize,"frames %lu dropped %lu fps %0.2f changes %lu applied %lu failures %lu reloads %lu lastChange %u taggedChange %u\n",
+                 live->framesGrabbed,live->framesDropped,(elapsed!=0) ? live->framesGrabbed*1000000.0/elapsed : 0.0,
+                 live->requests,live->applied,live->failures,live->reloads,live->appliedChange,live->taggedChange);
+        pthread_mutex_unlock(&live->lock);
+    } else
+    if (strcmp(command,"reload")==0)
+    {
+        if (live->settingsFile[0]==0) { snprintf(reply,replySize,"error no settings file\n"); return; }
+        requestLiveConfigReload(live);
+        snprintf(reply,replySize,"ok reloading %s\n",live->settingsFile);
+    } else
+    {
+        snprintf(reply,replySize,"error unknown command, use set, get, stats or reload\n");
+    }
+}
+
+unsigned int liveConfigFrame(struct LiveConfig * live,unsigned int frameNumber,uint64_t systemTimestamp,unsigned long framesDropped,double * frameRate)
+{
+    if ( (live==0) || (!live->threadStarted) ) { return 0; }
+    if (systemTimestamp==0) { systemTimestamp = monotonicNanoseconds(); }
+
+    unsigned int tagged = 0;
+    pthread_mutex_lock(&live->lock);
+    live->framesGrabbed = frameNumber+1;
+    live->framesDropped = framesDropped;
+    if ( (live->appliedChange!=live->taggedChange) && (systemTimestamp>=live->effectiveTime) )
+    {
+        live->taggedChange = live->appliedChange;
+        tagged = live->appliedChange;
+        if (live->log!=0) { fprintf(live->log,"firstFrame,%u,%u,,,,,\n",tagged,frameNumber); fflush(live->log); }
+    }
+    if ( (frameRate!=0) && (live->frameRateChanged) ) { *frameRate = live->frameRate; }
+    pthread_mutex_unlock(&live->lock);
+    return tagged;
+}
+
+int readLiveConfigSettings(const char * filename,struct LiveConfigChange * change)
+{
+    memset(change,0,sizeof(struct LiveConfigChange));
+    FILE * fp = fopen(filename,"r");
+    if (fp==0)
+    {
+        fprintf(stderr,"\nLive config : could not read %s\n",filename);
+        return 0;
+    }
+
+    //One "key": value per line, like writeSettings() writes them
+    char line[512];
+    while (fgets(line,sizeof(line),fp)!=0)
+    {
+        char * key = strchr(line,'"');
+        if (key==0) { continue; }
+        key += 1;
+        char * keyEnd = strchr(key,'"');
+        if (keyEnd==0) { continue; }
+        *keyEnd = 0;
+        char * value = strchr(keyEnd+1,':');
+        if (value==0) { continue; }
+        parseSetting(key,value+1,change);
+    }
+    fclose(fp);
+
+    //Like at startup, 0 means leave the camera alone
+    if ( (change->mask & LIVE_CONFIG_EXPOSURE)   && (change->exposure<=0.0) )  { change->mask &= ~LIVE_CONFIG_EXPOSURE; }
+    if ( (change->mask & LIVE_CONFIG_GAIN)       && (change->gain==0.0) )      { change->mask &= ~LIVE_CONFIG_GAIN; }
+    if ( (change->mask & LIVE_CONFIG_BLACK_LEVEL)&& (change->blackLevel==0.0) ){ change->mask &= ~LIVE_CONFIG_BLACK_LEVEL; }
+    if ( (change->mask & LIVE_CONFIG_FRAME_RATE) && (change->frameRate<=0.0) ) { change->mask &= ~LIVE_CONFIG_FRAME_RATE; }
+    return 1;
+}
+
+void stopLiveConfig(struct LiveConfig * live)
+{
+    if ( (live==0) || (!live->threadStarted) ) { return; }
+    pthread_mutex_lock(&live->lock);
+    live->stop = 1;
+    pthread_cond_signal(&live->wake);
+    pthread_mutex_unlock(&live->lock);
+    pthread_join(live->thread,NULL);
+    live->threadStarted = 0;
+    pthread_cond_destroy(&live->wake);
+    pthread_mutex_destroy(&live->lock);
+
+    if (live->requests!=0)
+    {
+        fprintf(stderr,"Live config : %lu changes requested, %lu applied, %lu failures, %lu reloads, %0.1f ms per write (%0.1f max)\n",
+                live->requests,live->applied,live->failures,live->reloads,
+                (live->applied!=0) ? live->writeMicroseconds/1000.0/live->applied : 0.0,live->maxWriteMicroseconds/1000.0);
+    }
+}
@@ -0,0 +1,120 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef LIVE_CONFIG_H_INCLUDED
+#define LIVE_CONFIG_H_INCLUDED
+
+/* Aravis header */
+#include <arv.h>
+
+/* Standard headers */
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+// Live reconfiguration : exposure, gain, black level and frame rate change
+// while the stream keeps running, instead of restarting the grabber and
+// paying for discovery and buffer setup again.
+//
+// Changes come from the control socket (handleLiveConfigCommand() is a
+// ControlCommandHandler) or from re-reading a settings file in the schema of
+// info.json on SIGHUP. They are merged into one pending request and written
+// to the camera by a controller thread, the acquisition thread never waits
+// for the control channel. Requests that arrive while a write is going on are
+// applied together right after it.
+//
+// The acquisition thread calls liveConfigFrame() for every frame, which
+// recognizes the first frame taken with the new settings : the first one
+// whose host timestamp is at least one frame period (at the old rate) after
+// the write completed, so the frame that was being exposed during the write
+// is not mistaken for it. That frame is logged with the change number.
+//
+// A camera in software trigger mode (06-grabber --timelapse) takes a frame per
+// trigger, its frame rate is not changed : set frameRate is refused and a
+// reload leaves it out.
+//
+// Commands, one per line :
+//   set exposure|gain|blackLevel|frameRate <value> [...]   ok change <N>
+//   get                                                    current values
+//   stats                                                  frames, drops, rate, changes
+//   reload                                                 re-read the settings file
+
+#define LIVE_CONFIG_EXPOSURE    0x1
+#define LIVE_CONFIG_GAIN        0x2
+#define LIVE_CONFIG_BLACK_LEVEL 0x4
+#define LIVE_CONFIG_FRAME_RATE  0x8
+
+struct LiveConfigChange
+{
+    unsigned int mask;         // LIVE_CONFIG_* fields that are set
+    double exposure;           // μsec
+    double gain;               // dB
+    double blackLevel;
+    double frameRate;          // Hz
+};
+
+struct LiveConfig
+{
+    ArvCamera * camera;
+    char settingsFile[512];
+    FILE * log;                // Optional CSV of applied changes and the frames they first show in
+    char exposureAndGainLocked; // Software auto exposure owns them
+    char frameRateLocked;      // The camera is triggered (--timelapse), the trigger sets the rate
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;
+    char threadStarted;
+    char stop;
+
+    //Pending request, merged until the controller thread takes it
+    struct LiveConfigChange requested;
+    unsigned int requestedChange;  // Number of the newest accepted request
+    char reloadRequested;
+
+    //Written by the controller thread
+    double exposure;
+    double gain;
+    double blackLevel;
+    double frameRate;
+    char frameRateChanged;
+    unsigned int appliedChange;
+    uint64_t effectiveTime;        // CLOCK_MONOTONIC nanoseconds from which frames carry appliedChange
+
+    //Acquisition thread
+    unsigned int taggedChange;
+    unsigned long framesGrabbed;
+    unsigned long framesDropped;
+    unsigned long startTime;
+
+    //Totals for the --stats output
+    unsigned long requests;
+    unsigned long applied;
+    unsigned long failures;
+    unsigned long reloads;
+    unsigned long writeMicroseconds;
+    unsigned long maxWriteMicroseconds;
+};
+
+// settingsFile may be NULL to disable reload, log may be NULL
+int startLiveConfig(struct LiveConfig * live,ArvCamera * camera,const char * settingsFile,FILE * log,char exposureAndGainLocked,char frameRateLocked);
+
+// Queues a change, returns its number or 0 when it was refused (reason in reply)
+unsigned int requestLiveConfigChange(struct LiveConfig * live,const struct LiveConfigChange * change,char * reply,size_t replySize);
+
+// Re-reads the settings file on the controller thread, not safe in a signal handler
+void requestLiveConfigReload(struct LiveConfig * live);
+
+// ControlCommandHandler for the commands above, userData is the struct LiveConfig
+void handleLiveConfigCommand(void * userData,const char * command,char * reply,size_t replySize);
+
+// Called for every frame by the acquisition thread, systemTimestamp in CLOCK_MONOTONIC nanoseconds
+// (systemTimestampToMonotonic(), 0 when unknown).
+// Returns the change this frame is the first to carry, 0 otherwise. frameRate is updated when a change set it
+unsigned int liveConfigFrame(struct LiveConfig * live,unsigned int frameNumber,uint64_t systemTimestamp,unsigned long framesDropped,double * frameRate);
+
+// Values of a settings file written by writeSettings(), only the ones a stream can change
+int readLiveConfigSettings(const char * filename,struct LiveConfigChange * change);
+
+void stopLiveConfig(struct LiveConfig * live);
+
+#endif // LIVE_CONFIG_H_INCLUDED
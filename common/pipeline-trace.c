@@ -0,0 +1,195 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#define _GNU_SOURCE
+
+#include "pipeline-trace.h"
+
+/* Standard headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+int pipelineTraceEnabled = 0;
+
+static unsigned int eventsPerRing = PIPELINE_TRACE_DEFAULT_EVENTS;
+static struct PipelineTraceRing * rings = 0;
+static pthread_mutex_t ringsLock = PTHREAD_MUTEX_INITIALIZER;
+static __thread struct PipelineTraceRing * threadRing = 0;
+
+static uint64_t traceNanoseconds()
+{
+    struct timespec ts;
+    if ( clock_gettime(CLOCK_MONOTONIC,&ts) != 0) {
+        return 0;
+    }
+    return (uint64_t) ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+// Ring of the calling thread, registered on its first event
+static struct PipelineTraceRing * getThreadRing()
+{
+    if (threadRing!=0) { return threadRing; }
+
+    //A cache line of its own, the rings of two busy threads would otherwise share the written counters
+    struct PipelineTraceRing * ring = 0;
+    if (posix_memalign((void **) &ring,64,sizeof(struct PipelineTraceRing))!=0) { return 0; }
+    memset(ring,0,sizeof(struct PipelineTraceRing));
+    ring->events = (struct PipelineTraceEvent *) calloc(eventsPerRing,sizeof(struct PipelineTraceEvent));
+    if (ring->events==0) { free(ring); return 0; }
+    ring->capacity = eventsPerRing;
+    ring->threadId = (int) syscall(SYS_gettid);
+    snprintf(ring->name,sizeof(ring->name),"thread %d",ring->threadId);
+
+    pthread_mutex_lock(&ringsLock);
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&ringsLock);
+
+    threadRing = ring;
+    return ring;
+}
+
+int startPipelineTrace(unsigned int eventsPerThread)
+{
+    if (eventsPerThread==0) { eventsPerThread=PIPELINE_TRACE_DEFAULT_EVENTS; }
+    eventsPerRing = 1;
+    while (eventsPerRing<eventsPerThread) { eventsPerRing<<=1; }
+
+    __atomic_store_n(&pipelineTraceEnabled,1,__ATOMIC_RELEASE);
+    return 1;
+}
+
+void namePipelineTraceThread(const char * name)
+{
+    if (!pipelineTraceEnabled) { return; }
+    struct PipelineTraceRing * ring = getThreadRing();
+    if (ring==0) { return; }
+    pthread_mutex_lock(&ringsLock);
+    snprintf(ring->name,sizeof(ring->name),"%s",name);
+    pthread_mutex_unlock(&ringsLock);
+}
+
+void recordPipelineTraceEvent(char phase,const char * name,unsigned int frame)
+{
+    struct PipelineTraceRing * ring = getThreadRing();
+    if (ring==0) { return; }
+
+    //Only this thread writes the ring, the fields are relaxed atomics so a snapshot may read them
+    uint64_t written = ring->written;
+    struct PipelineTraceEvent * event = &ring->events[written & (ring->capacity-1)];
+    __atomic_store_n(&event->timestamp,traceNanoseconds(),__ATOMIC_RELAXED);
+    __atomic_store_n(&event->name,name,__ATOMIC_RELAXED);
+    __atomic_store_n(&event->frame,frame,__ATOMIC_RELAXED);
+    __atomic_store_n(&event->phase,phase,__ATOMIC_RELAXED);
+    __atomic_store_n(&ring->written,written+1,__ATOMIC_RELEASE);
+}
+
+void pipelineTraceStreamCallback(void * userData,ArvStreamCallbackType type,ArvBuffer * buffer)
+{
+    if (!pipelineTraceEnabled) { return; }
+    unsigned int frameId = (buffer!=0) ? (unsigned int) arv_buffer_get_frame_id(buffer) : 0;
+    switch (type)
+    {
+        case ARV_STREAM_CALLBACK_TYPE_INIT         : namePipelineTraceThread("aravis stream"); break;
+        case ARV_STREAM_CALLBACK_TYPE_START_BUFFER : recordPipelineTraceEvent('B',"buffer",frameId); break;
+        case ARV_STREAM_CALLBACK_TYPE_BUFFER_DONE  : recordPipelineTraceEvent('E',"buffer",frameId); break;
+        default : break;
+    };
+}
+
+// Appends the events of one ring that were not overwritten while copying, returns how many
+static unsigned long writeRing(FILE * fp,struct PipelineTraceRing * ring,struct PipelineTraceEvent * copy,int pid,char * first,unsigned long * lost)
+{
+    uint64_t end   = __atomic_load_n(&ring->written,__ATOMIC_ACQUIRE);
+    uint64_t start = (end>ring->capacity) ? end-ring->capacity : 0;
+    uint64_t i=0;
+    for (i=start; i<end; i++)
+    {
+        struct PipelineTraceEvent * event = &ring->events[i & (ring->capacity-1)];
+        struct PipelineTraceEvent * to    = &copy[i-start];
+        to->timestamp = __atomic_load_n(&event->timestamp,__ATOMIC_RELAXED);
+        to->name      = __atomic_load_n(&event->name,__ATOMIC_RELAXED);
+        to->frame     = __atomic_load_n(&event->frame,__ATOMIC_RELAXED);
+        to->phase     = __atomic_load_n(&event->phase,__ATOMIC_RELAXED);
+    }
+    //What the thread recorded meanwhile may have replaced the oldest copies, and the slot it is writing now
+    uint64_t now = __atomic_load_n(&ring->written,__ATOMIC_ACQUIRE);
+    uint64_t valid = (now+1>ring->capacity) ? now+1-ring->capacity : 0;
+    if (valid<start) { valid=start; }
+    *lost += (unsigned long) valid;
+
+    fprintf(fp,"%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",(*first) ? "" : ",\n",pid,ring->threadId,ring->name);
+    *first = 0;
+    unsigned long events = 0;
+    for (i=valid; i<end; i++)
+    {
+        struct PipelineTraceEvent * event = &copy[i-start];
+        if (event->name==0) { continue; }
+        fprintf(fp,",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":%d,\"tid\":%d%s,\"args\":{\"frame\":%u}}",
+                event->name,event->phase,(unsigned long long) (event->timestamp/1000),(unsigned int) (event->timestamp%1000),
+                pid,ring->threadId,(event->phase=='i') ? ",\"s\":\"t\"" : "",event->frame);
+        events += 1;
+    }
+    return events;
+}
+
+int writePipelineTrace(const char * filename)
+{
+    if ( (filename==0) || (!pipelineTraceEnabled) ) { return 0; }
+
+    char temporary[1100];
+    snprintf(temporary,sizeof(temporary),"%s.tmp",filename);
+    FILE * fp = fopen(temporary,"w");
+    if (fp==0)
+    {
+        fprintf(stderr,"Could not write the trace to %s\n",temporary);
+        return 0;
+    }
+    struct PipelineTraceEvent * copy = (struct PipelineTraceEvent *) malloc(eventsPerRing*sizeof(struct PipelineTraceEvent));
+    if (copy==0) { fclose(fp); return 0; }
+
+    int pid = (int) getpid();
+    char first = 1;
+    unsigned long events = 0, lost = 0;
+    unsigned int threads = 0;
+    fprintf(fp,"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    pthread_mutex_lock(&ringsLock);
+    struct PipelineTraceRing * ring = 0;
+    for (ring=rings; ring!=0; ring=ring->next)
+    {
+        events  += writeRing(fp,ring,copy,pid,&first,&lost);
+        threads += 1;
+    }
+    pthread_mutex_unlock(&ringsLock);
+    fprintf(fp,"\n]}\n");
+    int failed = ferror(fp);
+    fclose(fp);
+    free(copy);
+
+    //Renamed complete, a viewer never opens half a file
+    if ( (failed) || (rename(temporary,filename)!=0) )
+    {
+        fprintf(stderr,"Could not write the trace to %s\n",filename);
+        return 0;
+    }
+    fprintf(stderr,"\nTrace : %lu events of %u threads written to %s (%lu older ones overwritten)\n",events,threads,filename,lost);
+    return 1;
+}
+
+void stopPipelineTrace()
+{
+    __atomic_store_n(&pipelineTraceEnabled,0,__ATOMIC_RELEASE);
+    pthread_mutex_lock(&ringsLock);
+    while (rings!=0)
+    {
+        struct PipelineTraceRing * ring = rings;
+        rings = ring->next;
+        free(ring->events);
+        free(ring);
+    }
+    pthread_mutex_unlock(&ringsLock);
+}
@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef PIPELINE_TRACE_H_INCLUDED
+#define PIPELINE_TRACE_H_INCLUDED
+
+/* Aravis header */
+#include <arv.h>
+
+/* Standard headers */
+#include <stdint.h>
+
+// Timeline of the pipeline stages (--trace), to see why a stall happened and
+// not only that it did. Begin/end events of pop, correction, statistics,
+// stacking, writes, shared memory publishing and push-back, plus the buffers
+// of the Aravis stream thread, are written as a Chrome trace JSON file that
+// chrome://tracing and ui.perfetto.dev open directly.
+//
+// Every thread records into its own ring, allocated by its first event : one
+// writer per ring and no lock, an event is a clock read and four stores. The
+// rings keep the most recent events, writePipelineTrace() takes a snapshot and
+// can run while the threads keep recording.
+//
+// Disabled, traceBegin() and friends are one predictable branch on a global,
+// and nothing at all when built with -DPIPELINE_TRACE_DISABLED.
+
+#define PIPELINE_TRACE_DEFAULT_EVENTS 65536
+
+struct PipelineTraceEvent
+{
+    uint64_t timestamp;        // CLOCK_MONOTONIC nanoseconds
+    const char * name;         // Has to outlive the trace, a literal or a sink name
+    uint32_t frame;
+    char phase;                // 'B', 'E' or 'i' as in the Chrome trace format
+};
+
+struct PipelineTraceRing
+{
+    struct PipelineTraceEvent * events;
+    uint32_t capacity;         // Power of two
+    uint64_t written;          // Events ever recorded, the next one goes to written%capacity
+    char name[32];
+    int threadId;
+    struct PipelineTraceRing * next;
+};
+
+extern int pipelineTraceEnabled;
+
+// eventsPerThread 0 uses PIPELINE_TRACE_DEFAULT_EVENTS, rounded up to a power of two
+int startPipelineTrace(unsigned int eventsPerThread);
+
+// Label of the calling thread in the timeline
+void namePipelineTraceThread(const char * name);
+
+void recordPipelineTraceEvent(char phase,const char * name,unsigned int frame);
+
+// Snapshot of every ring as a Chrome trace JSON file
+int writePipelineTrace(const char * filename);
+
+// Frees the rings, call once every traced thread is gone
+void stopPipelineTrace();
+
+// Pass to arv_camera_create_stream() to trace the buffers of the stream thread
+void pipelineTraceStreamCallback(void * userData,ArvStreamCallbackType type,ArvBuffer * buffer);
+
+static inline void traceBegin(const char * name,unsigned int frame)
+{
+#ifndef PIPELINE_TRACE_DISABLED
+    if (__builtin_expect(pipelineTraceEnabled,0)) { recordPipelineTraceEvent('B',name,frame); }
+#endif
+}
+
+static inline void traceEnd(const char * name,unsigned int frame)
+{
+#ifndef PIPELINE_TRACE_DISABLED
+    if (__builtin_expect(pipelineTraceEnabled,0)) { recordPipelineTraceEvent('E',name,frame); }
+#endif
+}
+
+static inline void traceInstant(const char * name,unsigned int frame)
+{
+#ifndef PIPELINE_TRACE_DISABLED
+    if (__builtin_expect(pipelineTraceEnabled,0)) { recordPipelineTraceEvent('i',name,frame); }
+#endif
+}
+
+#endif // PIPELINE_TRACE_H_INCLUDED
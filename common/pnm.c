@@ -0,0 +1,120 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "pnm.h"
+
+/* Standard headers */
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+int writePNM(const char * filename,const void * pixels,unsigned int width,unsigned int height,unsigned int channels,unsigned int bitsPerPixel)
+{
+    if ( (filename==0) || (pixels==0) ) { return 0; }
+    if ( (width==0) || (height==0) || (bitsPerPixel==0) || (bitsPerPixel>16) ) { return 0; }
+    if ( (channels!=1) && (channels!=3) ) { return 0; }
+
+    FILE * fd = fopen(filename,"wb");
+    if (fd==0)
+    {
+        fprintf(stderr,"writePNM could not open output file %s\n",filename);
+        return 0;
+    }
+
+    fprintf(fd,"%s\n%u %u\n%u\n",(channels==3) ? "P6" : "P5",width,height,(1u<<bitsPerPixel)-1);
+
+    size_t size = (size_t) width * height * channels * ((bitsPerPixel+7)/8);
+    size_t written = fwrite(pixels,1,size,fd);
+    fclose(fd);
+    return (written==size);
+}
+
+// Next unsigned number of a PNM header, skipping whitespace and # comments
+static int readHeaderNumber(const unsigned char * data,unsigned long size,unsigned long * position,unsigned int * value)
+{
+    unsigned long i = *position;
+    while (i<size)
+    {
+        if (data[i]=='#')
+        {
+            while ( (i<size) && (data[i]!='\n') ) { i++; }
+        } else
+        if (isspace(data[i])) { i++; } else
+                              { break; }
+    }
+    if ( (i>=size) || (!isdigit(data[i])) ) { return 0; }
+
+    unsigned long number = 0;
+    while ( (i<size) && (isdigit(data[i])) && (number<=0xFFFFFF) )
+    {
+        number = number*10 + (data[i]-'0');
+        i++;
+    }
+    *value    = (unsigned int) number;
+    *position = i;
+    return 1;
+}
+
+int mapPNM(const char * filename,struct MappedPNM * pnm,int populate)
+{
+    memset(pnm,0,sizeof(struct MappedPNM));
+
+    int fd = open(filename,O_RDONLY);
+    if (fd<0) { return 0; }
+
+    struct stat fileStatus;
+    if ( (fstat(fd,&fileStatus)!=0) || (fileStatus.st_size<8) )
+    {
+        close(fd);
+        return 0;
+    }
+
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if (populate) { flags |= MAP_POPULATE; }
+#endif
+    void * map = mmap(0,fileStatus.st_size,PROT_READ,flags,fd,0);
+    close(fd); //The mapping keeps the file
+    if (map==MAP_FAILED) { return 0; }
+
+    pnm->map     = map;
+    pnm->mapSize = (unsigned long) fileStatus.st_size;
+
+    const unsigned char * data = (const unsigned char *) map;
+    unsigned long position = 2;
+    unsigned int maximumValue = 0;
+    if ( (data[0]!='P') || ( (data[1]!='5') && (data[1]!='6') ) ||
+         (!readHeaderNumber(data,pnm->mapSize,&position,&pnm->width))  ||
+         (!readHeaderNumber(data,pnm->mapSize,&position,&pnm->height)) ||
+         (!readHeaderNumber(data,pnm->mapSize,&position,&maximumValue)) ||
+         (maximumValue==0) || (maximumValue>65535) )
+    {
+        unmapPNM(pnm);
+        return 0;
+    }
+    position += 1; //Exactly one whitespace before the pixels
+
+    pnm->channels     = (data[1]=='6') ? 3 : 1;
+    pnm->bitsPerPixel = 1;
+    while ( (1u<<pnm->bitsPerPixel)-1 < maximumValue ) { pnm->bitsPerPixel += 1; }
+    pnm->pixelBytes   = (unsigned long) pnm->width * pnm->height * pnm->channels * ((maximumValue>255) ? 2 : 1);
+    pnm->pixels       = data + position;
+
+    if ( (pnm->width==0) || (pnm->height==0) || (position+pnm->pixelBytes>pnm->mapSize) )
+    {
+        unmapPNM(pnm);
+        return 0;
+    }
+    return 1;
+}
+
+void unmapPNM(struct MappedPNM * pnm)
+{
+    if ( (pnm==0) || (pnm->map==0) ) { return; }
+    munmap(pnm->map,pnm->mapSize);
+    pnm->map    = 0;
+    pnm->pixels = 0;
+}
@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef PNM_H_INCLUDED
+#define PNM_H_INCLUDED
+
+// The PNM writer of the examples and of the helpers in common/ that persist
+// frames on their own threads (WritePPM() in acquisition-core.h wraps it) :
+// P5 for 1 channel, P6 for 3 channels, the pixels are written as they came
+// from the camera. Anything else writes nothing and returns 0.
+int writePNM(const char * filename,const void * pixels,unsigned int width,unsigned int height,unsigned int channels,unsigned int bitsPerPixel);
+
+// A PNM file mapped read only, pixels points inside the mapping
+struct MappedPNM
+{
+    void * map;
+    unsigned long mapSize;
+    const unsigned char * pixels;
+    unsigned long pixelBytes;
+    unsigned int width;
+    unsigned int height;
+    unsigned int channels;
+    unsigned int bitsPerPixel;
+};
+
+// Maps a P5 or P6 file like the ones above, populate faults every page in at once
+int mapPNM(const char * filename,struct MappedPNM * pnm,int populate);
+
+void unmapPNM(struct MappedPNM * pnm);
+
+#endif // PNM_H_INCLUDED
@@ -0,0 +1,368 @@
+/* SPDX-License-Identifier:Unlicense */
+
+// syncfs()
+#define _GNU_SOURCE
+
+#include "recording-journal.h"
+#include "timing.h"
+
+/* Standard headers */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+uint32_t recordingJournalChecksum(const struct RecordingJournalRecord * record)
+{
+    struct RecordingJournalRecord copy = *record;
+    copy.checksum = 0;
+
+    const unsigned char * bytes = (const unsigned char *) &copy;
+    uint32_t hash = 2166136261u;
+    unsigned int i=0;
+    for (i=0; i<sizeof(struct RecordingJournalRecord); i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+int readRecordingJournalHeader(FILE * fp,struct RecordingJournalHeader * header)
+{
+    if (fread(header,sizeof(struct RecordingJournalHeader),1,fp)!=1) { return 0; }
+    if (memcmp(header->magic,RECORDING_JOURNAL_MAGIC,sizeof(RECORDING_JOURNAL_MAGIC))!=0) { return 0; }
+    if (header->version!=RECORDING_JOURNAL_VERSION) { return 0; }
+    if (header->recordSize!=sizeof(struct RecordingJournalRecord)) { return 0; }
+    return 1;
+}
+
+static int writeAll(int fd,const void * data,size_t size)
+{
+    const char * bytes = (const char *) data;
+    while (size>0)
+    {
+        ssize_t written = write(fd,bytes,size);
+        if (written<0)
+        {
+            if (errno==EINTR) { continue; }
+            return 0;
+        }
+        bytes += written;
+        size  -= written;
+    }
+    return 1;
+}
+
+// Appends records and makes them durable, called with the lock held
+static int appendRecords(struct RecordingJournal * journal,struct RecordingJournalRecord * records,unsigned int count)
+{
+    unsigned int i=0;
+    for (i=0; i<count; i++)
+        { records[i].checksum = recordingJournalChecksum(&records[i]); }
+
+    if ( (!writeAll(journal->fd,records,count*sizeof(struct RecordingJournalRecord))) || (fdatasync(journal->fd)!=0) )
+    {
+        fprintf(stderr,"Could not append to the recording journal in %s\n",journal->directory);
+        journal->failures += count;
+        return 0;
+    }
+    return 1;
+}
+
+// Fills size and commit of frames whose data is durable, and appends them
+static void commitFrames(struct RecordingJournal * journal,struct RecordingJournalRecord * records,unsigned int count,unsigned long syncStart)
+{
+    char filename[1024];
+    unsigned long now = realtimeMicroseconds();
+    unsigned int committed=0;
+    unsigned int i=0;
+
+    journal->commits += 1;
+    for (i=0; i<count; i++)
+    {
+        struct stat fileStatus;
+        snprintf(filename,sizeof(filename),"%s/%s",journal->directory,records[i].name);
+        if (stat(filename,&fileStatus)!=0)
+        {
+            journal->failures += 1;
+            continue;
+        }
+        unsigned long lag = (now>records[i].commitTime) ? now - records[i].commitTime : 0;
+        if (lag>journal->maxCommitLagMicroseconds) { journal->maxCommitLagMicroseconds=lag; }
+
+        records[committed]            = records[i];
+        records[committed].fileSize   = (uint64_t) fileStatus.st_size;
+        records[committed].commitTime = now;
+        records[committed].commit     = journal->commits;
+        committed += 1;
+    }
+
+    if ( (committed!=0) && (appendRecords(journal,records,committed)) )
+    {
+        for (i=0; i<committed; i++)
+        {
+            //JPEG workers finish out of order, keep the range
+            if ( (journal->framesCommitted==0) || (records[i].frameNumber<journal->firstFrame) ) { journal->firstFrame = records[i].frameNumber; }
+            if ( (journal->framesCommitted==0) || (records[i].frameNumber>journal->lastFrame) )  { journal->lastFrame  = records[i].frameNumber; }
+            journal->framesCommitted += 1;
+            journal->bytesCommitted  += records[i].fileSize;
+        }
+    }
+
+    unsigned long elapsed = monotonicMicroseconds() - syncStart;
+    journal->syncMicroseconds += elapsed;
+    if (elapsed>journal->maxSyncMicroseconds) { journal->maxSyncMicroseconds=elapsed; }
+}
+
+static void * journalCommitThread(void * argument)
+{
+    struct RecordingJournal * journal = (struct RecordingJournal *) argument;
+    struct RecordingJournalRecord * batch = 0;
+    unsigned int batchAllocated = 0;
+
+    pthread_mutex_lock(&journal->lock);
+    for (;;)
+    {
+        if ( (!journal->stop) && (journal->pendingCount==0) )
+            { pthread_cond_wait(&journal->wake,&journal->lock); }
+
+        if (!journal->stop)
+        {   //Let the interval fill up a group commit
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME,&deadline);
+            deadline.tv_sec  += journal->syncIntervalMilliseconds / 1000;
+            deadline.tv_nsec += (journal->syncIntervalMilliseconds % 1000) * 1000000L;
+            if (deadline.tv_nsec>=1000000000L) { deadline.tv_sec+=1; deadline.tv_nsec-=1000000000L; }
+            while ( (!journal->stop) && (pthread_cond_timedwait(&journal->wake,&journal->lock,&deadline)!=ETIMEDOUT) ) { }
+        }
+
+        //Take the pending frames, the sinks keep journaling while this one syncs
+        unsigned int count = journal->pendingCount;
+        if (count>batchAllocated)
+        {
+            struct RecordingJournalRecord * grown = (struct RecordingJournalRecord *) realloc(batch,count*sizeof(struct RecordingJournalRecord));
+            if (grown==0) { count=batchAllocated; } else
+                          { batch=grown; batchAllocated=count; }
+        }
+        if (count!=0)
+        {
+            memcpy(batch,journal->pending,count*sizeof(struct RecordingJournalRecord));
+            memmove(journal->pending,journal->pending+count,(journal->pendingCount-count)*sizeof(struct RecordingJournalRecord));
+            journal->pendingCount -= count;
+        }
+        char stop = journal->stop;
+        pthread_mutex_unlock(&journal->lock);
+
+        if (count!=0)
+        {
+            //One call for the data and directory entries of every file of the batch
+            unsigned long syncStart = monotonicMicroseconds();
+            if (syncfs(journal->directoryFd)!=0)
+            {
+                fprintf(stderr,"Could not sync %s, %u frames are not journaled\n",journal->directory,count);
+                pthread_mutex_lock(&journal->lock);
+                journal->failures += count;
+            } else
+            {
+                pthread_mutex_lock(&journal->lock);
+                commitFrames(journal,batch,count,syncStart);
+            }
+        } else
+        {
+            pthread_mutex_lock(&journal->lock);
+        }
+
+        if ( (stop) && ( (journal->pendingCount==0) || (count==0) ) ) { break; }
+    }
+    pthread_mutex_unlock(&journal->lock);
+    free(batch);
+    return 0;
+}
+
+int openRecordingJournal(struct RecordingJournal * journal,const char * directory,unsigned int syncIntervalMilliseconds)
+{
+    if (journal==0) { return 0; }
+    memset(journal,0,sizeof(struct RecordingJournal));
+    snprintf(journal->directory,sizeof(journal->directory),"%s",(directory!=0) ? directory : ".");
+    journal->syncIntervalMilliseconds = syncIntervalMilliseconds;
+    journal->fd          = -1;
+    journal->directoryFd = open(journal->directory,O_RDONLY|O_DIRECTORY);
+    if (journal->directoryFd<0)
+    {
+        fprintf(stderr,"Could not open %s for the recording journal\n",journal->directory);
+        return 0;
+    }
+
+    char filename[1024];
+    snprintf(filename,sizeof(filename),"%s/journal.bin",journal->directory);
+    journal->fd = open(filename,O_WRONLY|O_CREAT|O_TRUNC|O_APPEND,0644);
+    if (journal->fd<0)
+    {
+        fprintf(stderr,"Could not create %s\n",filename);
+        close(journal->directoryFd);
+        journal->directoryFd = -1;
+        return 0;
+    }
+
+    struct RecordingJournalHeader header;
+    memset(&header,0,sizeof(struct RecordingJournalHeader));
+    memcpy(header.magic,RECORDING_JOURNAL_MAGIC,sizeof(RECORDING_JOURNAL_MAGIC));
+    header.version    = RECORDING_JOURNAL_VERSION;
+    header.recordSize = sizeof(struct RecordingJournalRecord);
+    header.startTime  = realtimeMicroseconds();
+    header.syncIntervalMilliseconds = syncIntervalMilliseconds;
+
+    //The journal itself has to survive before anything is recorded in it
+    if ( (!writeAll(journal->fd,&header,sizeof(struct RecordingJournalHeader))) || (fsync(journal->fd)!=0) || (fsync(journal->directoryFd)!=0) )
+    {
+        fprintf(stderr,"Could not write %s\n",filename);
+        close(journal->fd);
+        close(journal->directoryFd);
+        journal->fd          = -1;
+        journal->directoryFd = -1;
+        return 0;
+    }
+
+    pthread_mutex_init(&journal->lock,NULL);
+    pthread_cond_init(&journal->wake,NULL);
+    if (syncIntervalMilliseconds!=0)
+    {
+        if (pthread_create(&journal->committer,NULL,journalCommitThread,journal)!=0)
+        {
+            fprintf(stderr,"Could not start the journal thread, every frame will be committed on its own\n");
+            journal->syncIntervalMilliseconds = 0;
+        } else
+        {
+            journal->committerStarted = 1;
+        }
+    }
+
+    if (journal->syncIntervalMilliseconds!=0)
+        { fprintf(stderr,"Recording journal %s, frames made durable every %u ms\n",filename,journal->syncIntervalMilliseconds); } else
+        { fprintf(stderr,"Recording journal %s, every frame made durable on its own\n",filename); }
+    return 1;
+}
+
+int journalFrame(struct RecordingJournal * journal,unsigned int frameNumber,const char * name)
+{
+    if ( (journal==0) || (journal->fd<0) || (name==0) ) { return 0; }
+
+    struct RecordingJournalRecord record;
+    memset(&record,0,sizeof(struct RecordingJournalRecord));
+    record.type        = RECORDING_JOURNAL_FRAME;
+    record.frameNumber = frameNumber;
+    record.commitTime  = realtimeMicroseconds();
+    snprintf(record.name,sizeof(record.name),"%s",name);
+
+    if (!journal->committerStarted)
+    {   //Baseline, the file, its directory entry and the record, one after the other
+        char filename[1024];
+        snprintf(filename,sizeof(filename),"%s/%s",journal->directory,name);
+        unsigned long syncStart = monotonicMicroseconds();
+        int fd = open(filename,O_RDONLY);
+        int synced = (fd>=0) && (fdatasync(fd)==0);
+        if (fd>=0) { close(fd); }
+
+        pthread_mutex_lock(&journal->lock);
+        journal->framesJournaled += 1;
+        if ( (synced) && (fsync(journal->directoryFd)==0) )
+            { commitFrames(journal,&record,1,syncStart); } else
+            { journal->failures += 1; }
+        pthread_mutex_unlock(&journal->lock);
+        return synced;
+    }
+
+    pthread_mutex_lock(&journal->lock);
+    if (journal->pendingCount==journal->pendingAllocated)
+    {
+        unsigned int allocated = (journal->pendingAllocated!=0) ? 2*journal->pendingAllocated : 256;
+        struct RecordingJournalRecord * grown = (struct RecordingJournalRecord *) realloc(journal->pending,allocated*sizeof(struct RecordingJournalRecord));
+        if (grown==0)
+        {
+            journal->failures += 1;
+            pthread_mutex_unlock(&journal->lock);
+            return 0;
+        }
+        journal->pending          = grown;
+        journal->pendingAllocated = allocated;
+    }
+    journal->pending[journal->pendingCount++] = record;
+    journal->framesJournaled += 1;
+    if (journal->pendingCount==1) { pthread_cond_signal(&journal->wake); }
+    pthread_mutex_unlock(&journal->lock);
+    return 1;
+}
+
+void closeRecordingJournal(struct RecordingJournal * journal)
+{
+    if ( (journal==0) || (journal->fd<0) ) { return; }
+
+    if (journal->committerStarted)
+    {
+        pthread_mutex_lock(&journal->lock);
+        journal->stop = 1;
+        pthread_cond_signal(&journal->wake);
+        pthread_mutex_unlock(&journal->lock);
+        pthread_join(journal->committer,NULL);
+        journal->committerStarted = 0;
+    }
+
+    struct RecordingJournalRecord closed;
+    memset(&closed,0,sizeof(struct RecordingJournalRecord));
+    closed.type        = RECORDING_JOURNAL_CLOSED;
+    closed.frameNumber = journal->lastFrame;
+    closed.fileSize    = journal->framesCommitted;
+    closed.commitTime  = realtimeMicroseconds();
+    closed.commit      = journal->commits;
+    pthread_mutex_lock(&journal->lock);
+    int clean = appendRecords(journal,&closed,1);
+    pthread_mutex_unlock(&journal->lock);
+
+    close(journal->fd);
+    close(journal->directoryFd);
+    journal->fd          = -1;
+    journal->directoryFd = -1;
+    pthread_cond_destroy(&journal->wake);
+    pthread_mutex_destroy(&journal->lock);
+    free(journal->pending);
+    journal->pending = 0;
+
+    writeRecordingSummary(journal->directory,journal->framesCommitted,journal->firstFrame,journal->lastFrame,clean,0);
+    fprintf(stderr,"Recording journal : %lu of %lu frames durable in %u commits, %0.1f ms per commit (%0.1f max), %0.1f ms max lag, %lu failures\n",
+            journal->framesCommitted,journal->framesJournaled,journal->commits,
+            (journal->commits!=0) ? journal->syncMicroseconds/1000.0/journal->commits : 0.0,
+            journal->maxSyncMicroseconds/1000.0,journal->maxCommitLagMicroseconds/1000.0,journal->failures);
+}
+
+int writeRecordingSummary(const char * directory,unsigned long frames,unsigned int firstFrame,unsigned int lastFrame,int cleanShutdown,unsigned long discardedFiles)
+{
+    char filename[1024], temporary[1040];
+    snprintf(filename,sizeof(filename),"%s/recording.json",(directory!=0) ? directory : ".");
+    snprintf(temporary,sizeof(temporary),"%s.tmp",filename);
+
+    FILE * fp = fopen(temporary,"w");
+    if (fp==0)
+    {
+        fprintf(stderr,"Could not write %s\n",temporary);
+        return 0;
+    }
+    fprintf(fp,"{\n\"framesCommitted\": %lu,\n",frames);
+    fprintf(fp,"\"firstFrame\": %u,\n",(frames!=0) ? firstFrame : 0);
+    fprintf(fp,"\"lastFrame\": %u,\n",(frames!=0) ? lastFrame : 0);
+    fprintf(fp,"\"cleanShutdown\": %s,\n",(cleanShutdown) ? "true" : "false");
+    fprintf(fp,"\"discardedFiles\": %lu\n}\n",discardedFiles);
+
+    //Either the previous summary or this one, never half of it
+    int written = (fflush(fp)==0) && (fdatasync(fileno(fp))==0);
+    if (fclose(fp)!=0) { written=0; }
+    if ( (!written) || (rename(temporary,filename)!=0) )
+    {
+        fprintf(stderr,"Could not write %s\n",filename);
+        unlink(temporary);
+        return 0;
+    }
+    return 1;
+}
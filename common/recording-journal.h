@@ -0,0 +1,111 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef RECORDING_JOURNAL_H_INCLUDED
+#define RECORDING_JOURNAL_H_INCLUDED
+
+/* Standard headers */
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+// Crash safe recording : an append-only journal (journal.bin) of the frame
+// files that are known to be complete on disk, so that after a SIGKILL or a
+// power loss the recording can be cut back to a consistent state
+// (tools/recording-recover).
+//
+// A sink calls journalFrame() once it closed a frame file. Frames are made
+// durable in group commits : every syncInterval milliseconds a background
+// thread syncs the file system of the recording with one syncfs(), which
+// covers the data of every new file and its directory entry, and only then
+// appends a record per frame to the journal and fdatasync()s it. A record in
+// the journal therefore always describes a file that was fully on disk before
+// the record was, and the acquisition threads never wait for the disk.
+//
+// With syncInterval 0 every frame is committed on its own, fdatasync() of the
+// file, of the directory and of the journal, by the thread that wrote it.
+// That is the baseline the group commit is measured against
+// (benchmarks/recording-journal-benchmark.c).
+//
+// Records carry a checksum, a torn last record is detected and dropped. A
+// clean shutdown ends the journal with a RECORDING_JOURNAL_CLOSED record and
+// writes recording.json with what was actually captured.
+
+#define RECORDING_JOURNAL_MAGIC   "ARVJRNL"
+#define RECORDING_JOURNAL_VERSION 1
+#define RECORDING_JOURNAL_NAME_LENGTH 32
+
+// RecordingJournalRecord.type
+#define RECORDING_JOURNAL_FRAME  1
+#define RECORDING_JOURNAL_CLOSED 2
+
+struct RecordingJournalHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t startTime;                // Host realtime clock, microseconds
+    uint32_t syncIntervalMilliseconds;
+    uint32_t reserved;
+};
+
+struct RecordingJournalRecord
+{
+    uint32_t type;
+    uint32_t frameNumber;
+    uint64_t fileSize;
+    uint64_t commitTime;               // Host realtime clock, microseconds, when the frame became durable
+    uint32_t commit;                   // Group commit that made the frame durable
+    uint32_t checksum;                 // See recordingJournalChecksum()
+    char     name[RECORDING_JOURNAL_NAME_LENGTH]; // File inside the recording directory
+};
+
+struct RecordingJournal
+{
+    char directory[512];
+    int fd;
+    int directoryFd;
+    unsigned int syncIntervalMilliseconds;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;
+    pthread_t committer;
+    char committerStarted;
+    char stop;
+
+    //Frames written but not durable yet, commitTime holds when they were journaled
+    struct RecordingJournalRecord * pending;
+    unsigned int pendingCount;
+    unsigned int pendingAllocated;
+    uint32_t commits;
+
+    //Totals for the --stats output
+    unsigned long framesJournaled;
+    unsigned long framesCommitted;
+    unsigned long failures;
+    unsigned long long bytesCommitted;
+    unsigned long syncMicroseconds;
+    unsigned long maxSyncMicroseconds;
+    unsigned long maxCommitLagMicroseconds; // From journalFrame() to durable
+    unsigned int firstFrame;
+    unsigned int lastFrame;
+};
+
+// Creates <directory>/journal.bin, returns 0 on failure
+int openRecordingJournal(struct RecordingJournal * journal,const char * directory,unsigned int syncIntervalMilliseconds);
+
+// The file <directory>/<name> is complete and closed, safe to call from any thread
+int journalFrame(struct RecordingJournal * journal,unsigned int frameNumber,const char * name);
+
+// Commits what is pending, closes the journal and writes recording.json
+void closeRecordingJournal(struct RecordingJournal * journal);
+
+// FNV-1a of the record with its checksum field set to 0
+uint32_t recordingJournalChecksum(const struct RecordingJournalRecord * record);
+
+// Checks the header of a journal opened for reading, returns 0 when it is not a journal this code understands
+int readRecordingJournalHeader(FILE * fp,struct RecordingJournalHeader * header);
+
+// <directory>/recording.json, replaced atomically
+int writeRecordingSummary(const char * directory,unsigned long frames,unsigned int firstFrame,unsigned int lastFrame,int cleanShutdown,unsigned long discardedFiles);
+
+#endif // RECORDING_JOURNAL_H_INCLUDED
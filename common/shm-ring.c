@@ -0,0 +1,313 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "shm-ring.h"
+#include "timing.h"
+
+/* Standard headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define SLOT_ALIGNMENT 64
+
+static unsigned long alignUp(unsigned long value,unsigned long alignment)
+{
+    return (value + alignment-1) / alignment * alignment;
+}
+
+// Not FUTEX_PRIVATE_FLAG, the word is shared between processes
+static void futexWake(uint32_t * word)
+{
+    syscall(SYS_futex,word,FUTEX_WAKE,INT_MAX,NULL,NULL,0);
+}
+
+static void futexWait(uint32_t * word,uint32_t value,const struct timespec * timeout)
+{
+    syscall(SYS_futex,word,FUTEX_WAIT,value,timeout,NULL,0);
+}
+
+//----------------------------------------------------------------------------------------
+// Publisher
+//----------------------------------------------------------------------------------------
+int createSharedFrameRing(struct SharedFrameRing * ring,const char * streamName,unsigned int slots,unsigned long slotSize)
+{
+    if ( (ring==0) || (streamName==0) || (slots==0) || (slotSize==0) ) { return 0; }
+    memset(ring,0,sizeof(struct SharedFrameRing));
+    if (slots>SHARED_FRAME_RING_MAX_SLOTS) { slots=SHARED_FRAME_RING_MAX_SLOTS; }
+    snprintf(ring->name,sizeof(ring->name),"/%s.frames",streamName);
+
+    slotSize = alignUp(slotSize,SLOT_ALIGNMENT);
+    unsigned long dataStart  = alignUp(sizeof(struct SharedFrameRingHeader),SLOT_ALIGNMENT);
+    unsigned long objectSize = dataStart + slots*slotSize;
+
+    //A stale object of a publisher that did not exit cleanly would keep its pins
+    shm_unlink(ring->name);
+    int fd = shm_open(ring->name,O_CREAT|O_RDWR,0660);
+    if (fd<0)
+    {
+        fprintf(stderr,"Could not create the shared memory object %s\n",ring->name);
+        return 0;
+    }
+    //Consumers pin slots and sleep on the futex, so they need to write, whatever the umask
+    fchmod(fd,0660);
+    if (ftruncate(fd,objectSize)!=0)
+    {
+        close(fd);
+        shm_unlink(ring->name);
+        return 0;
+    }
+    void * shared = mmap(NULL,objectSize,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+    close(fd);
+    if (shared==MAP_FAILED)
+    {
+        shm_unlink(ring->name);
+        return 0;
+    }
+
+    ring->base   = (unsigned char *) shared;
+    ring->header = (struct SharedFrameRingHeader *) shared;
+    struct SharedFrameRingHeader * header = ring->header;
+    header->numberOfSlots = slots;
+    ring->slots           = slots;
+    header->slotSize      = slotSize;
+    header->objectSize    = objectSize;
+    unsigned int i=0;
+    for (i=0; i<slots; i++) { header->slots[i].dataOffset = dataStart + i*slotSize; }
+    //Consumers check the magic last
+    __atomic_store_n(&header->magic,SHARED_FRAME_RING_MAGIC,__ATOMIC_RELEASE);
+
+    fprintf(stderr,"Frames are also published in %s, %u slots of %lu bytes for zero copy consumers\n",ring->name,slots,slotSize);
+    return 1;
+}
+
+// Marks a slot as being written unless a consumer holds it
+static int claimSlot(struct SharedFrameSlot * slot)
+{
+    if (__atomic_load_n(&slot->readers,__ATOMIC_SEQ_CST)!=0) { return 0; }
+    uint64_t previous = slot->sequence;
+    __atomic_store_n(&slot->sequence,0,__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&slot->readers,__ATOMIC_SEQ_CST)!=0)
+    {   //Pinned in between, it saw its frame or will see the mark
+        __atomic_store_n(&slot->sequence,previous,__ATOMIC_SEQ_CST);
+        return 0;
+    }
+    return 1;
+}
+
+int publishSharedFrame(struct SharedFrameRing * ring,const void * pixels,unsigned long size,unsigned int width,unsigned int height,unsigned int channels,unsigned int bitsPerPixel,
+                       unsigned int frameNumber,const struct FrameTimestamps * timestamps)
+{
+    if ( (ring==0) || (ring->header==0) || (pixels==0) ) { return 0; }
+    struct SharedFrameRingHeader * header = ring->header;
+    if (size>header->slotSize)
+    {
+        ring->oversized += 1;
+        return 0;
+    }
+
+    //Oldest slot first, past the ones consumers hold
+    struct SharedFrameSlot * slot = 0;
+    unsigned int attempt=0;
+    for (attempt=0; attempt<header->numberOfSlots; attempt++)
+    {
+        unsigned int index = (ring->nextSlot+attempt) % header->numberOfSlots;
+        if (claimSlot(&header->slots[index]))
+        {
+            slot = &header->slots[index];
+            ring->nextSlot = (index+1) % header->numberOfSlots;
+            break;
+        }
+        ring->pinnedSkips += 1;
+    }
+    if (slot==0)
+    {
+        ring->dropped += 1;
+        return 0;
+    }
+
+    memcpy(ring->base+slot->dataOffset,pixels,size);
+    slot->frameNumber     = frameNumber;
+    slot->width           = width;
+    slot->height          = height;
+    slot->channels        = channels;
+    slot->bitsPerPixel    = bitsPerPixel;
+    slot->size            = size;
+    slot->deviceTimestamp = (timestamps!=0) ? timestamps->device : 0;
+    slot->systemTimestamp = (timestamps!=0) ? timestamps->system : 0;
+    slot->hostTimestamp   = (timestamps!=0) ? timestamps->host   : 0;
+    slot->publishTime     = monotonicNanoseconds();
+
+    uint64_t sequence = header->latest + 1;
+    __atomic_store_n(&slot->sequence,sequence,__ATOMIC_RELEASE);
+    __atomic_store_n(&header->latest,sequence,__ATOMIC_RELEASE);
+    __atomic_store_n(&header->published,(uint32_t) sequence,__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&header->waiters,__ATOMIC_SEQ_CST)!=0)
+    {
+        futexWake(&header->published);
+        ring->wakeups += 1;
+    }
+    ring->published += 1;
+    return 1;
+}
+
+void destroySharedFrameRing(struct SharedFrameRing * ring)
+{
+    if ( (ring==0) || (ring->header==0) ) { return; }
+    //Consumers still attached keep their mapping, and learn that nothing more will come
+    __atomic_store_n(&ring->header->closed,1,__ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&ring->header->published,1,__ATOMIC_SEQ_CST);
+    futexWake(&ring->header->published);
+    munmap(ring->base,ring->header->objectSize);
+    shm_unlink(ring->name);
+    ring->header = 0;
+    ring->base   = 0;
+}
+
+//----------------------------------------------------------------------------------------
+// Consumer
+//----------------------------------------------------------------------------------------
+int attachSharedFrameConsumer(struct SharedFrameConsumer * consumer,const char * streamName)
+{
+    if ( (consumer==0) || (streamName==0) ) { return 0; }
+    memset(consumer,0,sizeof(struct SharedFrameConsumer));
+    char name[80];
+    snprintf(name,sizeof(name),"/%s.frames",streamName);
+
+    int fd = shm_open(name,O_RDWR,0);
+    if (fd<0) { return 0; }
+    struct stat status;
+    if ( (fstat(fd,&status)!=0) || ((unsigned long) status.st_size<sizeof(struct SharedFrameRingHeader)) )
+    {
+        close(fd);
+        return 0;
+    }
+    void * shared = mmap(NULL,status.st_size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+    close(fd);
+    if (shared==MAP_FAILED) { return 0; }
+
+    struct SharedFrameRingHeader * header = (struct SharedFrameRingHeader *) shared;
+    if ( (__atomic_load_n(&header->magic,__ATOMIC_ACQUIRE)!=SHARED_FRAME_RING_MAGIC) || (header->objectSize!=(unsigned long) status.st_size) )
+    {
+        munmap(shared,status.st_size);
+        return 0;
+    }
+    consumer->header     = header;
+    consumer->base       = (const unsigned char *) shared;
+    consumer->objectSize = status.st_size;
+    return 1;
+}
+
+// Slot of the oldest or the newest frame after the last one acquired, -1 when there is none
+static int findSlot(struct SharedFrameConsumer * consumer,char newest,uint64_t * sequence)
+{
+    struct SharedFrameRingHeader * header = consumer->header;
+    int found = -1;
+    unsigned int i=0;
+    for (i=0; i<header->numberOfSlots; i++)
+    {
+        uint64_t candidate = __atomic_load_n(&header->slots[i].sequence,__ATOMIC_ACQUIRE);
+        if (candidate<=consumer->lastSequence) { continue; }
+        if ( (found<0) || ((newest) ? (candidate>*sequence) : (candidate<*sequence)) )
+        {
+            found = (int) i;
+            *sequence = candidate;
+        }
+    }
+    return found;
+}
+
+static int acquireFrame(struct SharedFrameConsumer * consumer,struct SharedFrameView * view,int timeoutMilliseconds,char newest)
+{
+    if ( (consumer==0) || (consumer->header==0) || (view==0) ) { return -1; }
+    struct SharedFrameRingHeader * header = consumer->header;
+    view->slot = -1;
+    unsigned long deadline = (timeoutMilliseconds>0) ? monotonicNanoseconds() + (unsigned long) timeoutMilliseconds*1000000ul : 0;
+
+    for (;;)
+    {
+        uint32_t published = __atomic_load_n(&header->published,__ATOMIC_SEQ_CST);
+        uint64_t sequence = 0;
+        int index = findSlot(consumer,newest,&sequence);
+        if (index>=0)
+        {
+            struct SharedFrameSlot * slot = &header->slots[index];
+            __atomic_add_fetch(&slot->readers,1,__ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&slot->sequence,__ATOMIC_SEQ_CST)!=sequence)
+            {   //Rewritten between finding and pinning it
+                __atomic_sub_fetch(&slot->readers,1,__ATOMIC_SEQ_CST);
+                consumer->retries += 1;
+                continue;
+            }
+            view->slot         = index;
+            view->sequence     = sequence;
+            view->pixels       = consumer->base + slot->dataOffset;
+            view->size         = slot->size;
+            view->width        = slot->width;
+            view->height       = slot->height;
+            view->channels     = slot->channels;
+            view->bitsPerPixel = slot->bitsPerPixel;
+            view->frameNumber  = slot->frameNumber;
+            view->timestamps.device = slot->deviceTimestamp;
+            view->timestamps.system = slot->systemTimestamp;
+            view->timestamps.host   = slot->hostTimestamp;
+            view->publishTime  = slot->publishTime;
+            view->missed       = (consumer->lastSequence!=0) ? (unsigned long) (sequence-consumer->lastSequence-1) : 0;
+            consumer->lastSequence = sequence;
+            consumer->acquired += 1;
+            consumer->missed   += view->missed;
+            return 1;
+        }
+
+        if (__atomic_load_n(&header->closed,__ATOMIC_SEQ_CST)) { return -1; }
+        if (timeoutMilliseconds==0) { consumer->timeouts += 1; return 0; }
+
+        //Sleep until the futex word moves on from what the frames were looked for with
+        struct timespec remaining;
+        struct timespec * timeout = 0;
+        if (timeoutMilliseconds>0)
+        {
+            unsigned long now = monotonicNanoseconds();
+            if (now>=deadline) { consumer->timeouts += 1; return 0; }
+            remaining.tv_sec  = (deadline-now) / 1000000000ul;
+            remaining.tv_nsec = (deadline-now) % 1000000000ul;
+            timeout = &remaining;
+        }
+        __atomic_add_fetch(&header->waiters,1,__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&header->published,__ATOMIC_SEQ_CST)==published) { futexWait(&header->published,published,timeout); }
+        __atomic_sub_fetch(&header->waiters,1,__ATOMIC_SEQ_CST);
+    }
+}
+
+int acquireNextFrame(struct SharedFrameConsumer * consumer,struct SharedFrameView * view,int timeoutMilliseconds)
+{
+    return acquireFrame(consumer,view,timeoutMilliseconds,0);
+}
+
+int acquireLatestFrame(struct SharedFrameConsumer * consumer,struct SharedFrameView * view,int timeoutMilliseconds)
+{
+    return acquireFrame(consumer,view,timeoutMilliseconds,1);
+}
+
+void releaseFrame(struct SharedFrameConsumer * consumer,struct SharedFrameView * view)
+{
+    if ( (consumer==0) || (consumer->header==0) || (view==0) || (view->slot<0) ) { return; }
+    __atomic_sub_fetch(&consumer->header->slots[view->slot].readers,1,__ATOMIC_SEQ_CST);
+    view->slot   = -1;
+    view->pixels = 0;
+}
+
+void detachSharedFrameConsumer(struct SharedFrameConsumer * consumer)
+{
+    if ( (consumer==0) || (consumer->header==0) ) { return; }
+    munmap((void *) consumer->base,consumer->objectSize);
+    consumer->header = 0;
+    consumer->base   = 0;
+}
@@ -0,0 +1,157 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef SHM_RING_H_INCLUDED
+#define SHM_RING_H_INCLUDED
+
+/* Standard headers */
+#include <stdint.h>
+
+#include "clock-mapping.h"
+
+// Zero copy access to the frames of a shared memory stream. Consumers of the
+// SharedMemoryVideoBuffers streams copy every frame out to be sure it does not
+// change under them. With --shmRing N the publisher also writes every frame
+// into one of N slots of the POSIX shared memory object /<stream>.frames, and
+// a consumer gets a read only view of the slot itself :
+//
+//     struct SharedFrameConsumer consumer;
+//     struct SharedFrameView view;
+//     attachSharedFrameConsumer(&consumer,"stream1");
+//     while (acquireNextFrame(&consumer,&view,1000)>0)
+//     {
+//         ... view.pixels, view.width, view.timestamps.host ...
+//         releaseFrame(&consumer,&view);
+//     }
+//     detachSharedFrameConsumer(&consumer);
+//
+// An acquired slot is pinned : the publisher skips it until it is released,
+// so the pixels cannot change while they are read, and goes on with the other
+// slots. When every slot is pinned the frame is not put in the ring. Pinning
+// is a counter in the slot that the publisher checks after marking the slot
+// as being written, and a consumer checks the mark after pinning, so one of
+// them always sees the other.
+//
+// acquireNextFrame() returns the frames in order, acquireLatestFrame() the
+// newest one, both only frames newer than the last one acquired. Frames that
+// were overwritten before they could be acquired, or that a latest skipped,
+// are counted in view.missed and in the consumer totals. Both wait up to a
+// timeout for a new frame, on a futex the publisher wakes, so a waiting
+// consumer costs nothing and wakes up as soon as the frame is there.
+//
+// A consumer killed while it holds a frame leaves that slot pinned until the
+// publisher restarts, the stream carries on with one slot less.
+//
+// Nothing in here depends on Aravis, the consumer side is also built as the
+// libshm-frame-consumer shared library (see meson.build).
+
+#define SHARED_FRAME_RING_MAGIC    0x53465231  // "SFR1"
+#define SHARED_FRAME_RING_MAX_SLOTS 64
+
+// One slot, on its own cache lines, followed somewhere by its pixels
+struct SharedFrameSlot
+{
+    uint64_t sequence;        // Frame in the slot, 0 while empty or being written
+    uint32_t readers;         // Consumers holding it
+    uint32_t frameNumber;
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;
+    uint32_t bitsPerPixel;
+    uint64_t size;
+    uint64_t dataOffset;      // Pixels, from the start of the object
+    uint64_t deviceTimestamp;
+    uint64_t systemTimestamp;
+    uint64_t hostTimestamp;
+    uint64_t publishTime;     // monotonicNanoseconds() when the slot was complete
+} __attribute__((aligned(64)));
+
+struct SharedFrameRingHeader
+{
+    uint32_t magic;
+    uint32_t numberOfSlots;
+    uint64_t slotSize;        // Bytes of pixels a slot holds
+    uint64_t objectSize;
+    uint64_t latest;          // Sequence of the newest frame, frames count from 1
+    uint32_t published;       // Futex word, low 32 bits of latest
+    uint32_t waiters;         // Consumers sleeping on published
+    uint32_t closed;          // The publisher has gone
+    struct SharedFrameSlot slots[SHARED_FRAME_RING_MAX_SLOTS];
+};
+
+//----------------------------------------------------------------------------------------
+// Publisher
+//----------------------------------------------------------------------------------------
+struct SharedFrameRing
+{
+    char name[80];
+    struct SharedFrameRingHeader * header;
+    unsigned char * base;
+    unsigned int slots;
+    unsigned int nextSlot;
+
+    //Totals for the --stats output
+    unsigned long published;
+    unsigned long pinnedSkips;    // Slots passed over because a consumer held them
+    unsigned long dropped;        // Frames not in the ring, every slot was held
+    unsigned long oversized;      // Frames larger than slotSize
+    unsigned long wakeups;        // Frames published while consumers were waiting
+};
+
+// Creates /<stream>.frames with slots slots of slotSize bytes, returns 0 on failure
+int createSharedFrameRing(struct SharedFrameRing * ring,const char * streamName,unsigned int slots,unsigned long slotSize);
+
+// Copies a frame into a free slot and wakes the waiting consumers, timestamps may be NULL.
+// Returns 0 when it was not put in the ring
+int publishSharedFrame(struct SharedFrameRing * ring,const void * pixels,unsigned long size,unsigned int width,unsigned int height,unsigned int channels,unsigned int bitsPerPixel,
+                       unsigned int frameNumber,const struct FrameTimestamps * timestamps);
+
+// Tells the consumers the stream ended and removes the object, the totals stay readable
+void destroySharedFrameRing(struct SharedFrameRing * ring);
+
+//----------------------------------------------------------------------------------------
+// Consumer
+//----------------------------------------------------------------------------------------
+struct SharedFrameView
+{
+    const unsigned char * pixels;  // Read only, valid until releaseFrame()
+    unsigned long size;
+    unsigned int width;
+    unsigned int height;
+    unsigned int channels;
+    unsigned int bitsPerPixel;
+    unsigned int frameNumber;
+    uint64_t sequence;
+    struct FrameTimestamps timestamps;
+    uint64_t publishTime;          // monotonicNanoseconds(), see timing.h
+    unsigned long missed;          // Frames lost since the previous acquisition
+    int slot;                      // -1 when nothing is held
+};
+
+struct SharedFrameConsumer
+{
+    struct SharedFrameRingHeader * header;   // Mapped writable for the pins and the futex
+    const unsigned char * base;
+    unsigned long objectSize;
+    uint64_t lastSequence;         // Last frame acquired
+
+    //Totals
+    unsigned long acquired;
+    unsigned long missed;
+    unsigned long timeouts;
+    unsigned long retries;         // Slots that were rewritten while being pinned
+};
+
+// Returns 0 while nobody publishes /<stream>.frames
+int attachSharedFrameConsumer(struct SharedFrameConsumer * consumer,const char * streamName);
+
+// 1 with a frame in view, 0 on timeout, -1 when the publisher is gone.
+// timeoutMilliseconds 0 does not wait, negative waits forever
+int acquireNextFrame(struct SharedFrameConsumer * consumer,struct SharedFrameView * view,int timeoutMilliseconds);
+
+int acquireLatestFrame(struct SharedFrameConsumer * consumer,struct SharedFrameView * view,int timeoutMilliseconds);
+
+void releaseFrame(struct SharedFrameConsumer * consumer,struct SharedFrameView * view);
+
+void detachSharedFrameConsumer(struct SharedFrameConsumer * consumer);
+
+#endif // SHM_RING_H_INCLUDED
@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "shm-sink.h"
+#include "clock-mapping.h"
+#include "color-convert.h"
+#include "frame-fanout.h"
+#include "pipeline-trace.h"
+#include "shm-ring.h"
+
+#include "sharedMemoryVideoBuffers.h"
+
+int writeSharedMemorySinkFrame(void * context,const struct FanOutFrame * frame)
+{
+    struct SharedMemorySink * sink = (struct SharedMemorySink *) context;
+    if (!startWritingToVideoBufferPointer(sink->frame)) { return 0; }
+    copy_to_shared_memory((void *) sink->frame,frame->pixels,frame->size);
+    stopWritingToVideoBufferPointer(sink->frame);
+    publishClockMapping(sink->clock,frame->frameNumber,&frame->timestamps);
+    if (sink->ring!=0)
+    {
+        publishSharedFrame(sink->ring,frame->pixels,frame->size,frame->width,frame->height,frame->channels,frame->bitsPerPixel,
+                           frame->frameNumber,&frame->timestamps);
+    }
+    return 1;
+}
+
+int writeSharedMemoryYUVSinkFrame(void * context,const struct FanOutFrame * frame)
+{
+    struct SharedMemoryYUVSink * sink = (struct SharedMemoryYUVSink *) context;
+    traceBegin("yuv convert",frame->frameNumber);
+    int converted = convertColorFrame(sink->converter,frame->pixels,frame->size,frame->width,frame->height);
+    traceEnd("yuv convert",frame->frameNumber);
+    if (!converted) { return 0; }
+    if (!startWritingToVideoBufferPointer(sink->frame)) { return 0; }
+    copy_to_shared_memory((void *) sink->frame,sink->converter->output,sink->converter->layout.size);
+    stopWritingToVideoBufferPointer(sink->frame);
+    publishClockMapping(sink->clock,frame->frameNumber,&frame->timestamps);
+    return 1;
+}
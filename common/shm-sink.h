@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef SHM_SINK_H_INCLUDED
+#define SHM_SINK_H_INCLUDED
+
+struct ClockMappingPublisher;
+struct ColorConverter;
+struct FanOutFrame;
+struct SharedFrameRing;
+struct VideoFrame;
+
+// Shared memory sink of a fan-out, publishes every frame it gets to one
+// SharedMemoryVideoBuffers stream. Only the programs that link that library
+// use it, see shm_examples in meson.build. context is a SharedMemorySink.
+struct SharedMemorySink
+{
+    struct VideoFrame * frame;             // From getVideoBufferPointer()
+    struct ClockMappingPublisher * clock;  // Timestamps of the frame after its pixels, may be NULL
+    struct SharedFrameRing * ring;         // Zero copy consumers, see shm-ring.h, may be NULL
+};
+
+int writeSharedMemorySinkFrame(void * context,const struct FanOutFrame * frame);
+
+// Converts every frame it gets to NV12 or YUV420 (see color-convert.h) and
+// publishes the planes to their own stream, context is a SharedMemoryYUVSink.
+struct SharedMemoryYUVSink
+{
+    struct ColorConverter * converter;
+    struct VideoFrame * frame;             // Of converter->layout.stride[0] x rows, one channel
+    struct ClockMappingPublisher * clock;  // May be NULL
+};
+
+int writeSharedMemoryYUVSinkFrame(void * context,const struct FanOutFrame * frame);
+
+#endif // SHM_SINK_H_INCLUDED
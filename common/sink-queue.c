@@ -0,0 +1,121 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "sink-queue.h"
+
+/* Standard headers */
+#include <stdlib.h>
+#include <string.h>
+
+//----------------------------------------------------------------------------------------
+// Policies
+//----------------------------------------------------------------------------------------
+void setDefaultSinkPolicy(struct SinkPolicy * policy,const char * name,enum SinkPolicyType type)
+{
+    if (policy==0) { return; }
+    memset(policy,0,sizeof(struct SinkPolicy));
+    snprintf(policy->name,sizeof(policy->name),"%s",(name!=0) ? name : "sink");
+    policy->type       = type;
+    policy->decimation = 2;
+}
+
+int parseSinkPolicy(struct SinkPolicy * policy,const char * text)
+{
+    if ( (policy==0) || (text==0) ) { return 0; }
+    if (strcmp(text,"block")==0)       { policy->type=SINK_POLICY_BLOCK;       return 1; }
+    if (strcmp(text,"drop-newest")==0) { policy->type=SINK_POLICY_DROP_NEWEST; return 1; }
+    if (strcmp(text,"drop-oldest")==0) { policy->type=SINK_POLICY_DROP_OLDEST; return 1; }
+    if (strncmp(text,"decimate",8)==0)
+    {
+        unsigned int decimation = 2;
+        if ( (text[8]==':') && (text[9]!=0) ) { decimation=atoi(text+9); } else
+        if (text[8]!=0) { return 0; }
+        if (decimation<2) { return 0; }
+        policy->type       = SINK_POLICY_DECIMATE;
+        policy->decimation = decimation;
+        return 1;
+    }
+    return 0;
+}
+
+const char * sinkPolicyName(enum SinkPolicyType type)
+{
+    switch (type)
+    {
+        case SINK_POLICY_BLOCK       : return "block";
+        case SINK_POLICY_DROP_NEWEST : return "drop-newest";
+        case SINK_POLICY_DROP_OLDEST : return "drop-oldest";
+        case SINK_POLICY_DECIMATE    : return "decimate";
+    };
+    return "unknown";
+}
+
+static void logSinkDrop(struct SinkPolicy * policy,unsigned int frameNumber,const char * reason)
+{
+    if (policy->dropLog!=0)
+        { fprintf(policy->dropLog,"%s,%u,%s\n",policy->name,frameNumber,reason); }
+}
+
+enum SinkAdmission sinkAdmission(struct SinkPolicy * policy,unsigned int queued,unsigned int depth,unsigned int frameNumber,char retry)
+{
+    if (!retry) { policy->submitted += 1; }
+
+    if ( (policy->type==SINK_POLICY_DECIMATE) && (!retry) && (2*queued>=depth) && (frameNumber % policy->decimation!=0) )
+    {   //Behind, only every Nth frame goes in
+        policy->decimated += 1;
+        logSinkDrop(policy,frameNumber,"decimated");
+        return SINK_DISCARD;
+    }
+
+    if (queued<depth) { return SINK_ADMIT; }
+
+    switch (policy->type)
+    {
+        case SINK_POLICY_BLOCK       : return SINK_WAIT;
+        case SINK_POLICY_DROP_OLDEST : return SINK_EVICT_OLDEST;
+        default : break;
+    };
+
+    sinkDropped(policy,frameNumber);
+    return SINK_DISCARD;
+}
+
+void sinkAccepted(struct SinkPolicy * policy,unsigned int queued)
+{
+    policy->accepted += 1;
+    if (queued>policy->maxQueued) { policy->maxQueued=queued; }
+}
+
+void sinkEvicted(struct SinkPolicy * policy,unsigned int frameNumber)
+{
+    policy->droppedOldest += 1;
+    logSinkDrop(policy,frameNumber,"drop-oldest");
+}
+
+void sinkDropped(struct SinkPolicy * policy,unsigned int frameNumber)
+{
+    policy->droppedNewest += 1;
+    logSinkDrop(policy,frameNumber,"drop-newest");
+}
+
+void sinkBlocked(struct SinkPolicy * policy,unsigned long microseconds)
+{
+    policy->blocked             += 1;
+    policy->blockedMicroseconds += microseconds;
+    if (microseconds>policy->maxBlockedMicroseconds) { policy->maxBlockedMicroseconds=microseconds; }
+}
+
+unsigned long sinkPolicyDiscarded(struct SinkPolicy * policy)
+{
+    if (policy==0) { return 0; }
+    return policy->decimated + policy->droppedNewest + policy->droppedOldest;
+}
+
+void printSinkPolicy(FILE * fp,struct SinkPolicy * policy)
+{
+    if ( (fp==0) || (policy==0) || (policy->submitted==0) ) { return; }
+    fprintf(fp,"%s sink (%s) : %lu of %lu frames accepted, %lu decimated, %lu newest dropped, %lu oldest dropped, %lu blocked for %0.1f ms, %u queued at most\n",
+            policy->name,sinkPolicyName(policy->type),policy->accepted,policy->submitted,
+            policy->decimated,policy->droppedNewest,policy->droppedOldest,
+            policy->blocked,policy->blockedMicroseconds/1000.0,policy->maxQueued);
+}
+
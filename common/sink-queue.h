@@ -0,0 +1,90 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef SINK_QUEUE_H_INCLUDED
+#define SINK_QUEUE_H_INCLUDED
+
+/* Standard headers */
+#include <stdio.h>
+
+// Backpressure policies for the frame sinks : when a sink falls behind the
+// camera we decide which frames it loses, instead of holding on to the Aravis
+// buffers until the stream runs out of them and drops whatever arrives.
+//
+// Every sink gets a bounded queue of frames (see frame-fanout.h) and one of
+// these policies for a frame that arrives while the queue is full :
+//
+//  - block       : wait for the sink to free a slot, no frame is lost by the
+//                  sink, the transport drops frames if it lasts too long
+//  - drop-newest : discard the arriving frame
+//  - drop-oldest : discard the oldest frame the sink has not started on, so
+//                  that what gets written is as recent as possible
+//  - decimate:N  : once the queue is half full only every Nth frame (by frame
+//                  number) is accepted, so the frames that survive a slow
+//                  stretch stay evenly spaced, and the rest are dropped as with
+//                  drop-newest if the queue fills up anyway
+//
+// Every discarded frame is counted per sink and per reason, and logged to a
+// CSV when one is given, so the recording says exactly which frames are
+// missing and why.
+
+enum SinkPolicyType
+{
+    SINK_POLICY_BLOCK = 0,
+    SINK_POLICY_DROP_NEWEST,
+    SINK_POLICY_DROP_OLDEST,
+    SINK_POLICY_DECIMATE
+};
+
+// What a sink does with an arriving frame, see sinkAdmission()
+enum SinkAdmission
+{
+    SINK_ADMIT = 0,       // A slot is free
+    SINK_WAIT,            // Full, wait for a slot and ask again
+    SINK_EVICT_OLDEST,    // Full, replace the oldest frame not started yet
+    SINK_DISCARD          // Drop the arriving frame, already counted
+};
+
+struct SinkPolicy
+{
+    char name[16];             // "pnm", "jpeg", "shm", used in the logs
+    enum SinkPolicyType type;
+    unsigned int decimation;   // N of decimate:N
+    unsigned int queueDepth;   // Frames the sink may hold, 0 keeps the sink default
+    FILE * dropLog;            // Optional CSV, sink,frame,reason
+
+    //Totals for the --stats output
+    unsigned long submitted;
+    unsigned long accepted;
+    unsigned long decimated;
+    unsigned long droppedNewest;
+    unsigned long droppedOldest;
+    unsigned long blocked;               // Frames that had to wait for a slot
+    unsigned long blockedMicroseconds;
+    unsigned long maxBlockedMicroseconds;
+    unsigned int  maxQueued;
+};
+
+void setDefaultSinkPolicy(struct SinkPolicy * policy,const char * name,enum SinkPolicyType type);
+
+// "block", "drop-newest", "drop-oldest" or "decimate:N", returns 0 for anything else
+int parseSinkPolicy(struct SinkPolicy * policy,const char * text);
+
+const char * sinkPolicyName(enum SinkPolicyType type);
+
+// Decision for a frame arriving while queued of depth slots are taken, counts
+// submitted, decimated and dropped-newest frames on its own. Call with the
+// sink lock held, and call it again after a SINK_WAIT
+enum SinkAdmission sinkAdmission(struct SinkPolicy * policy,unsigned int queued,unsigned int depth,unsigned int frameNumber,char retry);
+
+// Bookkeeping for what the caller did with the decision
+void sinkAccepted(struct SinkPolicy * policy,unsigned int queued);
+void sinkEvicted(struct SinkPolicy * policy,unsigned int frameNumber);
+void sinkDropped(struct SinkPolicy * policy,unsigned int frameNumber); // Nothing could be evicted
+void sinkBlocked(struct SinkPolicy * policy,unsigned long microseconds);
+
+unsigned long sinkPolicyDiscarded(struct SinkPolicy * policy);
+
+// One line summary on stderr
+void printSinkPolicy(FILE * fp,struct SinkPolicy * policy);
+
+#endif // SINK_QUEUE_H_INCLUDED
@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "striped-recording.h"
+#include "frame-fanout.h"
+#include "timing.h"
+
+/* Standard headers */
+#include <string.h>
+
+void initializeStripedRecording(struct StripedRecording * striping)
+{
+    if (striping==0) { return; }
+    memset(striping,0,sizeof(struct StripedRecording));
+}
+
+int addRecordingRoot(struct StripedRecording * striping,const char * directory)
+{
+    if ( (striping==0) || (directory==0) ) { return 0; }
+    if (striping->numberOfStripes>=STRIPED_RECORDING_MAX_ROOTS)
+    {
+        fprintf(stderr,"Only %u output directories can be striped, %s left out\n",STRIPED_RECORDING_MAX_ROOTS,directory);
+        return 0;
+    }
+    struct RecordingStripe * stripe = &striping->stripes[striping->numberOfStripes];
+    memset(stripe,0,sizeof(struct RecordingStripe));
+    snprintf(stripe->directory,sizeof(stripe->directory),"%s",directory);
+    stripe->fanOutSink = -1;
+    striping->numberOfStripes += 1;
+    return 1;
+}
+
+// Fan-out writer of one stripe
+static int writeStripeFrame(void * context,const struct FanOutFrame * frame)
+{
+    struct RecordingStripe * stripe = (struct RecordingStripe *) context;
+    if (!writePNMSinkFrame(&stripe->sink,frame)) { return 0; }
+    __atomic_add_fetch(&stripe->frames,1,__ATOMIC_RELAXED);
+    __atomic_add_fetch(&stripe->bytes,frame->size,__ATOMIC_RELAXED);
+    return 1;
+}
+
+unsigned int startStripedRecording(struct StripedRecording * striping,struct FrameFanOut * fanOut,const struct SinkPolicy * policy)
+{
+    if ( (striping==0) || (fanOut==0) || (policy==0) || (striping->numberOfStripes==0) ) { return 0; }
+    striping->fanOut = fanOut;
+
+    char filename[1024];
+    snprintf(filename,sizeof(filename),"%s/recordingRoots.csv",striping->stripes[0].directory);
+    FILE * roots = fopen(filename,"w");
+    if (roots!=0) { fprintf(roots,"root,directory\n"); }
+
+    unsigned int i=0, started=0;
+    for (i=0; i<striping->numberOfStripes; i++)
+    {
+        struct RecordingStripe * stripe = &striping->stripes[i];
+        char name[sizeof(policy->name)+10]; //The name and any root number
+        snprintf(name,sizeof(name),"%s%u",policy->name,i);
+        setDefaultSinkPolicy(&stripe->policy,name,policy->type);
+        stripe->policy.decimation = policy->decimation;
+        stripe->policy.queueDepth = policy->queueDepth;
+        stripe->policy.dropLog    = policy->dropLog;
+        stripe->sink.directory    = stripe->directory;
+        stripe->sink.journal      = 0; //A journal commits one file system, see 06-grabber.c
+
+        stripe->fanOutSink = addFrameFanOutSink(fanOut,&stripe->policy,0,writeStripeFrame,stripe,1);
+        if (stripe->fanOutSink>=0) { started += 1; }
+        if (roots!=0) { fprintf(roots,"%u,%s\n",i,stripe->directory); }
+    }
+    if (roots!=0) { fclose(roots); }
+
+    snprintf(filename,sizeof(filename),"%s/recordingStripes.csv",striping->stripes[0].directory);
+    striping->report = fopen(filename,"w");
+    if (striping->report!=0) { fprintf(striping->report,"second,root,frames,megabytes,queued,maxQueued,discarded\n"); }
+
+    fprintf(stderr,"Striping frame files over %u output directories\n",started);
+    return started;
+}
+
+unsigned int nextRecordingStripe(struct StripedRecording * striping)
+{
+    if ( (striping==0) || (striping->numberOfStripes==0) ) { return 0; }
+    //A stripe without a sink would lose every Nth frame, it is passed over
+    unsigned int attempt=0;
+    for (attempt=0; attempt<striping->numberOfStripes; attempt++)
+    {
+        unsigned int stripe = striping->nextStripe;
+        striping->nextStripe = (striping->nextStripe+1) % striping->numberOfStripes;
+        if (striping->stripes[stripe].fanOutSink>=0) { return stripe; }
+    }
+    return 0;
+}
+
+unsigned int stripedRecordingSinks(const struct StripedRecording * striping,unsigned int stripe)
+{
+    unsigned int sinks = ~0u, i = 0;
+    if (striping==0) { return sinks; }
+    for (i=0; i<striping->numberOfStripes; i++)
+    {
+        int sink = striping->stripes[i].fanOutSink;
+        if ( (i!=stripe) && (sink>=0) ) { sinks &= ~(1u<<sink); }
+    }
+    return sinks;
+}
+
+void reportStripedRecording(struct StripedRecording * striping)
+{
+    if ( (striping==0) || (striping->fanOut==0) ) { return; }
+
+    unsigned long now = monotonicMicroseconds();
+    if (striping->lastReportTime==0) { striping->lastReportTime = now; return; }
+    if (now - striping->lastReportTime < 1000000) { return; }
+    striping->lastReportTime = now;
+    striping->seconds += 1;
+
+    unsigned int i=0;
+    for (i=0; i<striping->numberOfStripes; i++)
+    {
+        struct RecordingStripe * stripe = &striping->stripes[i];
+        if (stripe->fanOutSink<0) { continue; }
+
+        unsigned long frames    = __atomic_load_n(&stripe->frames,__ATOMIC_RELAXED);
+        unsigned long long bytes = __atomic_load_n(&stripe->bytes,__ATOMIC_RELAXED);
+        unsigned long secondBytes = (unsigned long) (bytes - stripe->lastBytes);
+        if ( (striping->seconds==1) || (secondBytes<stripe->worstSecondBytes) ) { stripe->worstSecondBytes = secondBytes; }
+        if (secondBytes>stripe->bestSecondBytes) { stripe->bestSecondBytes = secondBytes; }
+
+        //The queue and the policy counters move under the fan-out lock
+        pthread_mutex_lock(&striping->fanOut->lock);
+        unsigned int queued       = striping->fanOut->sinks[stripe->fanOutSink].queued;
+        unsigned int maxQueued    = stripe->policy.maxQueued;
+        unsigned long discarded   = sinkPolicyDiscarded(&stripe->policy);
+        pthread_mutex_unlock(&striping->fanOut->lock);
+
+        if (striping->report!=0)
+        {
+            fprintf(striping->report,"%lu,%u,%lu,%0.2f,%u,%u,%lu\n",striping->seconds,i,frames-stripe->lastFrames,secondBytes/1000000.0,queued,maxQueued,discarded);
+        }
+        stripe->lastFrames = frames;
+        stripe->lastBytes  = bytes;
+    }
+}
+
+void finishStripedRecording(struct StripedRecording * striping)
+{
+    if (striping==0) { return; }
+    if (striping->report!=0)
+    {
+        fclose(striping->report);
+        striping->report = 0;
+    }
+
+    unsigned int i=0;
+    for (i=0; (i<striping->numberOfStripes) && (striping->fanOut!=0); i++)
+    {
+        struct RecordingStripe * stripe = &striping->stripes[i];
+        if (stripe->fanOutSink<0) { continue; }
+        struct FanOutSink * sink = &striping->fanOut->sinks[stripe->fanOutSink];
+        fprintf(stderr,"Root %u %s : %lu frames, %0.1f MB, %0.1f MB/s while writing, %lu discarded, up to %u queued\n",i,stripe->directory,
+                stripe->frames,stripe->bytes/1000000.0,
+                (sink->writeMicroseconds!=0) ? (double) stripe->bytes/sink->writeMicroseconds : 0.0,
+                sinkPolicyDiscarded(&stripe->policy),stripe->policy.maxQueued);
+    }
+}
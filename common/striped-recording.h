@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef STRIPED_RECORDING_H_INCLUDED
+#define STRIPED_RECORDING_H_INCLUDED
+
+/* Standard headers */
+#include <stdio.h>
+
+#include "acquisition-core.h"
+#include "sink-queue.h"
+
+struct FrameFanOut;
+
+// PNM recording striped over several output roots, one per disk, for rates a
+// single disk cannot sustain. 06-grabber -o /mnt/a -o /mnt/b -o /mnt/c
+// writes frame files round-robin to the three roots, in the order they are
+// kept, each root by its own fan-out sink (see frame-fanout.h) with its own
+// thread, queue and copy of the PNM policy named pnm0, pnm1, ... A slow disk
+// only fills its own queue, and what its policy does about it is in
+// sinkDrops.csv under its name.
+//
+// The first root also holds everything else of the recording (info.json,
+// frameIndex.bin, the CSV files). recordingRoots.csv there lists the roots by
+// number, and frameIndex.bin records the root every file went to in
+// outputRoot, so a recording can be put back together from the index alone.
+// File names keep the global frame number, they do not collide between roots.
+//
+// reportStripedRecording() is called from the acquisition loop and appends to
+// recordingStripes.csv once per second, per root, the frames and MB written
+// that second and the queue depth, so a disk falling behind shows up while
+// recording rather than in the totals.
+
+#define STRIPED_RECORDING_MAX_ROOTS 6
+
+struct RecordingStripe
+{
+    char directory[512];
+    struct SinkPolicy policy;      // Copy of the PNM policy with its own counters
+    struct PNMSinkContext sink;
+    int fanOutSink;                // -1 when it could not be added
+
+    //Written by the sink thread of the stripe
+    unsigned long frames;
+    unsigned long long bytes;
+
+    //Per second report
+    unsigned long lastFrames;
+    unsigned long long lastBytes;
+    unsigned long worstSecondBytes; // Slowest full second, to spot the slow disk
+    unsigned long bestSecondBytes;
+};
+
+struct StripedRecording
+{
+    struct RecordingStripe stripes[STRIPED_RECORDING_MAX_ROOTS];
+    unsigned int numberOfStripes;
+    unsigned int nextStripe;
+    struct FrameFanOut * fanOut;
+
+    FILE * report;                 // recordingStripes.csv
+    unsigned long lastReportTime;
+    unsigned long seconds;
+};
+
+void initializeStripedRecording(struct StripedRecording * striping);
+
+// One more -o root, returns 0 when there are already STRIPED_RECORDING_MAX_ROOTS
+int addRecordingRoot(struct StripedRecording * striping,const char * directory);
+
+// Adds one sink per root to a fan-out that is not started yet, with a copy of
+// policy each, and writes recordingRoots.csv into the first root. Returns the
+// number of stripes that got a sink
+unsigned int startStripedRecording(struct StripedRecording * striping,struct FrameFanOut * fanOut,const struct SinkPolicy * policy);
+
+// Root the next kept frame goes to
+unsigned int nextRecordingStripe(struct StripedRecording * striping);
+
+// Fan-out sinks that get a frame of that stripe, every sink but the other stripes
+unsigned int stripedRecordingSinks(const struct StripedRecording * striping,unsigned int stripe);
+
+void reportStripedRecording(struct StripedRecording * striping);
+
+// Prints a line per root, call after destroyFrameFanOut(), the totals stay readable
+void finishStripedRecording(struct StripedRecording * striping);
+
+#endif // STRIPED_RECORDING_H_INCLUDED
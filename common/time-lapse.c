@@ -0,0 +1,145 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#include "time-lapse.h"
+#include "timing.h"
+
+/* Standard headers */
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+int startTimeLapse(struct TimeLapse * timeLapse,ArvCamera * camera,double intervalSeconds,FILE * log)
+{
+    if ( (timeLapse==0) || (camera==0) || (intervalSeconds<=0.0) ) { return 0; }
+    memset(timeLapse,0,sizeof(struct TimeLapse));
+    timeLapse->intervalMicroseconds = (unsigned long) (intervalSeconds*1000000.0);
+    if (timeLapse->intervalMicroseconds==0) { timeLapse->intervalMicroseconds=1; }
+
+    GError * error = NULL;
+    gboolean supported = arv_camera_is_software_trigger_supported(camera,&error);
+    if (error!=NULL)
+    {
+        supported = FALSE;
+        g_clear_error(&error);
+    }
+    if (!supported)
+    {
+        fprintf(stderr,"The camera cannot be triggered from software, it will run free and frames will be paced instead\n");
+        return 0;
+    }
+
+    arv_camera_set_trigger(camera,"Software",&error);
+    if (error!=NULL)
+    {
+        fprintf(stderr,"Could not put the camera in software trigger mode (%s), it will run free and frames will be paced instead\n",error->message);
+        g_clear_error(&error);
+        arv_camera_clear_triggers(camera,NULL);
+        return 0;
+    }
+
+    timeLapse->log = log;
+    if (log!=0) { fprintf(log,"trigger,deadline,lateness,latency,frameId\n"); }
+    fprintf(stderr,"Time-lapse : one software trigger every %0.3f s\n",timeLapse->intervalMicroseconds/1000000.0);
+    return 1;
+}
+
+int triggerTimeLapse(struct TimeLapse * timeLapse,ArvCamera * camera,ArvStream * stream)
+{
+    unsigned long now = monotonicMicroseconds();
+    if (timeLapse->start==0)
+    {
+        timeLapse->start    = now;
+        timeLapse->deadline = now;
+    }
+
+    //Deadlines a slow frame made us miss are skipped, not triggered late one after the other
+    if (now >= timeLapse->deadline + timeLapse->intervalMicroseconds)
+    {
+        unsigned long behind = (now - timeLapse->deadline) / timeLapse->intervalMicroseconds;
+        timeLapse->missedDeadlines += behind;
+        timeLapse->deadline        += behind * timeLapse->intervalMicroseconds;
+    }
+
+    if (timeLapse->deadline > now)
+    {
+        struct timespec ts;
+        ts.tv_sec  = timeLapse->deadline / 1000000;
+        ts.tv_nsec = (timeLapse->deadline % 1000000) * 1000;
+        if (clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&ts,0)==EINTR) { return 0; }
+    }
+
+    //A frame that missed its timeout would pass for the one we are about to trigger
+    ArvBuffer * stale;
+    while ( (stale=arv_stream_try_pop_buffer(stream))!=NULL )
+    {
+        timeLapse->staleFrames += 1;
+        arv_stream_push_buffer(stream,stale);
+    }
+
+    GError * error = NULL;
+    timeLapse->triggerDeadline = timeLapse->deadline;
+    timeLapse->triggerTime     = monotonicMicroseconds();
+    arv_camera_software_trigger(camera,&error);
+    timeLapse->triggers += 1;
+    timeLapse->deadline += timeLapse->intervalMicroseconds;
+
+    unsigned long lateness = (timeLapse->triggerTime > timeLapse->triggerDeadline) ? timeLapse->triggerTime - timeLapse->triggerDeadline : 0;
+    timeLapse->totalLatenessMicroseconds += lateness;
+    if (lateness>timeLapse->maxLatenessMicroseconds) { timeLapse->maxLatenessMicroseconds=lateness; }
+
+    if (error!=NULL)
+    {
+        timeLapse->failures += 1;
+        timeLapse->waiting   = 0;
+        if (timeLapse->log!=0)
+            { fprintf(timeLapse->log,"%lu,%lu,%lu,-1,-1\n",timeLapse->triggers,timeLapse->triggerDeadline-timeLapse->start,lateness); }
+        g_clear_error(&error);
+        return 1;
+    }
+    timeLapse->waiting = 1;
+    return 1;
+}
+
+ArvBuffer * popTimeLapseBuffer(struct TimeLapse * timeLapse,ArvStream * stream)
+{
+    if (!timeLapse->waiting) { return NULL; }
+
+    unsigned long now = monotonicMicroseconds();
+    unsigned long timeout = (timeLapse->deadline > now) ? timeLapse->deadline - now : 0;
+    if (timeout<TIME_LAPSE_MIN_TIMEOUT) { timeout = TIME_LAPSE_MIN_TIMEOUT; }
+
+    ArvBuffer * buffer = arv_stream_timeout_pop_buffer(stream,timeout);
+    unsigned long arrival = monotonicMicroseconds();
+    timeLapse->waiting = 0;
+
+    unsigned long lateness = (timeLapse->triggerTime > timeLapse->triggerDeadline) ? timeLapse->triggerTime - timeLapse->triggerDeadline : 0;
+    if (buffer==NULL)
+    {
+        timeLapse->timeouts += 1;
+        if (timeLapse->log!=0)
+            { fprintf(timeLapse->log,"%lu,%lu,%lu,-1,-1\n",timeLapse->triggers,timeLapse->triggerDeadline-timeLapse->start,lateness); }
+        return NULL;
+    }
+
+    unsigned long latency = arrival - timeLapse->triggerTime;
+    if ( (timeLapse->frames==0) || (latency<timeLapse->minLatencyMicroseconds) ) { timeLapse->minLatencyMicroseconds=latency; }
+    if (latency>timeLapse->maxLatencyMicroseconds) { timeLapse->maxLatencyMicroseconds=latency; }
+    timeLapse->totalLatencyMicroseconds += latency;
+    timeLapse->frames += 1;
+    if (timeLapse->log!=0)
+    {
+        fprintf(timeLapse->log,"%lu,%lu,%lu,%lu,%lu\n",timeLapse->triggers,timeLapse->triggerDeadline-timeLapse->start,lateness,latency,
+                (unsigned long) arv_buffer_get_frame_id(buffer));
+    }
+    return buffer;
+}
+
+void stopTimeLapse(struct TimeLapse * timeLapse,ArvCamera * camera)
+{
+    if ( (timeLapse==0) || (camera==0) ) { return; }
+    arv_camera_clear_triggers(camera,NULL);
+    fprintf(stderr,"Time-lapse : %lu triggers, %lu frames, %lu timeouts, %lu stale, %lu deadlines missed, trigger to frame %0.1f ms on average (%0.1f to %0.1f ms)\n",
+            timeLapse->triggers,timeLapse->frames,timeLapse->timeouts,timeLapse->staleFrames,timeLapse->missedDeadlines,
+            (timeLapse->frames!=0) ? timeLapse->totalLatencyMicroseconds/1000.0/timeLapse->frames : 0.0,
+            timeLapse->minLatencyMicroseconds/1000.0,timeLapse->maxLatencyMicroseconds/1000.0);
+}
@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef TIME_LAPSE_H_INCLUDED
+#define TIME_LAPSE_H_INCLUDED
+
+/* Aravis header */
+#include <arv.h>
+
+/* Standard headers */
+#include <stdio.h>
+
+// Software triggered time-lapse. Pacing a free running camera with usleep()
+// still has it stream every frame at its full rate, over the link, through
+// the Aravis buffers and the CPU, only for most of them to be thrown away.
+// With --timelapse S the camera is put in software trigger mode instead, and
+// the grabber triggers one frame every S seconds, so only the frames that are
+// kept cross the wire.
+//
+// Triggers go out at absolute deadlines, start + n*S on CLOCK_MONOTONIC, so a
+// slow frame does not push the ones after it. A deadline that already passed
+// by a whole interval is skipped and counted as missed rather than triggered
+// late. After a trigger the grabber waits for the frame until the next
+// deadline, at least TIME_LAPSE_MIN_TIMEOUT : from the trigger to the buffer
+// coming out of the stream is the trigger to frame latency (exposure, readout
+// and transfer), and no frame by then is a timeout. A frame that shows up after its timeout would be taken
+// for the next one, so it is dropped before the next trigger and counted as
+// stale.
+//
+// Every trigger is a line of timeLapse.csv : trigger,deadline,lateness,
+// latency (μs, -1 on timeout),frameId.
+
+#define TIME_LAPSE_MIN_TIMEOUT 100000 // μs
+
+struct TimeLapse
+{
+    unsigned long intervalMicroseconds;
+    unsigned long start;          // monotonicMicroseconds() of the first deadline
+    unsigned long deadline;       // Of the next trigger
+    unsigned long triggerTime;    // When the last trigger went out
+    unsigned long triggerDeadline; // Of the last trigger
+    char waiting;                 // A trigger is out without its frame
+    FILE * log;                   // Optional CSV, see above
+
+    //Totals for the --stats output
+    unsigned long triggers;
+    unsigned long frames;
+    unsigned long timeouts;
+    unsigned long missedDeadlines;
+    unsigned long staleFrames;
+    unsigned long failures;       // arv_camera_software_trigger() errors
+    unsigned long totalLatencyMicroseconds;
+    unsigned long minLatencyMicroseconds;
+    unsigned long maxLatencyMicroseconds;
+    unsigned long totalLatenessMicroseconds; // Trigger after its deadline
+    unsigned long maxLatenessMicroseconds;
+};
+
+// Puts the camera in software trigger mode, call before arv_camera_start_acquisition().
+// Returns 0 when the camera cannot be triggered from software, it is left free running
+int startTimeLapse(struct TimeLapse * timeLapse,ArvCamera * camera,double intervalSeconds,FILE * log);
+
+// Sleeps until the next deadline and triggers. Returns 0 when a signal woke it
+// up first, the deadline stays, call it again once the signal is handled
+int triggerTimeLapse(struct TimeLapse * timeLapse,ArvCamera * camera,ArvStream * stream);
+
+// Waits for the frame of the last trigger until the next deadline, NULL on timeout
+ArvBuffer * popTimeLapseBuffer(struct TimeLapse * timeLapse,ArvStream * stream);
+
+// Back to free running, after arv_camera_stop_acquisition()
+void stopTimeLapse(struct TimeLapse * timeLapse,ArvCamera * camera);
+
+#endif // TIME_LAPSE_H_INCLUDED
@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier:Unlicense */
+
+#ifndef TIMING_H_INCLUDED
+#define TIMING_H_INCLUDED
+
+#include <time.h>
+
+// Absolute CLOCK_MONOTONIC time in microseconds. Unlike GetTickCountMicroseconds
+// in the examples this has no per-process base, so values taken on different
+// threads and modules can be compared directly.
+static inline unsigned long monotonicMicroseconds()
+{
+    struct timespec ts;
+    if ( clock_gettime(CLOCK_MONOTONIC,&ts) != 0) {
+        return 0;
+    }
+    return ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+// The same clock in nanoseconds, for what is shorter than a few microseconds
+static inline unsigned long monotonicNanoseconds()
+{
+    struct timespec ts;
+    if ( clock_gettime(CLOCK_MONOTONIC,&ts) != 0) {
+        return 0;
+    }
+    return ts.tv_sec*1000000000ul + ts.tv_nsec;
+}
+
+// CLOCK_REALTIME in microseconds, for what is stored in files next to a recording
+static inline unsigned long realtimeMicroseconds()
+{
+    struct timespec ts;
+    if ( clock_gettime(CLOCK_REALTIME,&ts) != 0) {
+        return 0;
+    }
+    return ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+#endif // TIMING_H_INCLUDED
@@ -0,0 +1,375 @@
+/* SPDX-License-Identifier:Unlicense */
+
+/* Standard headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "clock-mapping.h"
+#include "frame-index.h"
+
+// Reads the frameIndex.bin of a 06-grabber recording, optionally converts it to
+// CSV, and summarizes the inter-frame intervals in both the camera and the host
+// clock, the frame id gaps (frames the camera sent that never arrived), the
+// timing gaps (intervals well above the median) and the buffer statuses.
+//
+// The camera clock is also fitted against the host clock over the whole
+// recording (see clock-mapping.h) : drift, residual error and the transport
+// latency above the fastest frames, and from version 2 on how far the
+// mapping the grabber made on the fly was from it.
+//
+// Usage : frame-index-tool frameIndex.bin [--csv file.csv|-] [--gaps N] [--gapFactor 1.5]
+
+static const char * statusName(int32_t status)
+{
+    //ArvBufferStatus, kept here so the tool does not need Aravis
+    switch (status)
+    {
+        case -1 : return "unknown";
+        case 0  : return "success";
+        case 1  : return "cleared";
+        case 2  : return "timeout";
+        case 3  : return "missingPackets";
+        case 4  : return "wrongPacketId";
+        case 5  : return "sizeMismatch";
+        case 6  : return "filling";
+        case 7  : return "aborted";
+        case 8  : return "payloadNotSupported";
+    };
+    return "other";
+}
+#define NUMBER_OF_STATUSES 11 // -1 to 8 and anything else
+
+static int compareDoubles(const void * a,const void * b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x>y) - (x<y);
+}
+
+struct IntervalSummary
+{
+    unsigned long count;
+    double mean,deviation,minimum,median,p99,maximum;
+};
+
+// Sorts intervals in place
+static void summarizeIntervals(double * intervals,unsigned long count,struct IntervalSummary * summary)
+{
+    memset(summary,0,sizeof(struct IntervalSummary));
+    summary->count = count;
+    if (count==0) { return; }
+
+    double sum=0.0, sumOfSquares=0.0;
+    unsigned long i=0;
+    for (i=0; i<count; i++)
+    {
+        sum          += intervals[i];
+        sumOfSquares += intervals[i]*intervals[i];
+    }
+    summary->mean      = sum / count;
+    double variance    = sumOfSquares / count - summary->mean*summary->mean;
+    summary->deviation = (variance>0.0) ? sqrt(variance) : 0.0;
+
+    qsort(intervals,count,sizeof(double),compareDoubles);
+    summary->minimum = intervals[0];
+    summary->median  = intervals[count/2];
+    summary->p99     = intervals[(unsigned long) ((count-1)*0.99)];
+    summary->maximum = intervals[count-1];
+}
+
+static void printIntervals(FILE * fp,const char * clockName,const struct IntervalSummary * summary)
+{
+    if (summary->count==0)
+    {
+        fprintf(fp,"%-7s clock : no intervals\n",clockName);
+        return;
+    }
+    fprintf(fp,"%-7s clock : %lu intervals, mean %0.1f μs (%0.2f fps), stddev %0.1f, min %0.1f, median %0.1f, p99 %0.1f, max %0.1f μs\n",
+            clockName,summary->count,summary->mean,(summary->mean>0.0) ? 1000000.0/summary->mean : 0.0,
+            summary->deviation,summary->minimum,summary->median,summary->p99,summary->maximum);
+}
+
+// Camera clock against host clock over the last stretch without a camera clock reset
+static void reportClockMapping(FILE * report,const struct FrameIndexRecord * records,unsigned long count)
+{
+    unsigned long r=0, start=0, last=0, samples=0;
+    char haveLast = 0;
+    for (r=0; r<count; r++)
+    {
+        if ( (records[r].status!=0) || (records[r].deviceTimestamp==0) ) { continue; }
+        if ( (haveLast) && (records[r].deviceTimestamp<records[last].deviceTimestamp) ) { start=r; samples=0; }
+        haveLast = 1;
+        last     = r;
+        samples += 1;
+    }
+    if (samples<CLOCK_MAPPING_MIN_SAMPLES)
+    {
+        fprintf(report,"Clock mapping : not enough camera timestamps\n");
+        return;
+    }
+
+    double * device  = (double *) malloc(sizeof(double)*samples);
+    double * host    = (double *) malloc(sizeof(double)*samples);
+    double * scratch = (double *) malloc(sizeof(double)*samples*2);
+    if ( (device==0) || (host==0) || (scratch==0) )
+    {
+        free(device); free(host); free(scratch);
+        return;
+    }
+    uint64_t deviceOrigin = records[start].deviceTimestamp, hostOrigin = records[start].systemTimestamp;
+    unsigned long n = 0;
+    for (r=start; r<count; r++)
+    {
+        if ( (records[r].status!=0) || (records[r].deviceTimestamp==0) ) { continue; }
+        device[n] = (double) records[r].deviceTimestamp - (double) deviceOrigin;
+        host[n]   = (double) records[r].systemTimestamp - (double) hostOrigin;
+        n += 1;
+    }
+
+    struct ClockFit fit;
+    if (!fitClockMapping(device,host,(unsigned int) n,scratch,&fit))
+    {
+        fprintf(report,"Clock mapping : the camera timestamps do not advance\n");
+        free(device); free(host); free(scratch);
+        return;
+    }
+    fprintf(report,"Clock mapping : camera clock drift %+0.2f ppm against the host, residual %0.1f μs, %u of %u frames within 3 sigma%s\n",
+            (fit.drift-1.0)*1000000.0,fit.residual/1000.0,fit.inliers,fit.samples,(start!=0) ? " since the last camera clock reset" : "");
+    fprintf(report,"Transport latency above the fastest frames : mean %0.1f μs, max %0.1f μs\n",fit.latency/1000.0,fit.maxLatency/1000.0);
+
+    //What the grabber mapped while recording, version 2 indexes and later
+    unsigned long online = 0;
+    double differenceSum = 0.0, differenceMax = 0.0;
+    n = 0;
+    for (r=start; r<count; r++)
+    {
+        if ( (records[r].status!=0) || (records[r].deviceTimestamp==0) ) { continue; }
+        if ( (records[r].hostTimestamp!=0) && (records[r].hostTimestamp!=records[r].systemTimestamp) )
+        {
+            double difference = fabs( ((double) records[r].hostTimestamp - (double) hostOrigin) - (fit.offset + fit.drift*device[n]) );
+            differenceSum += difference;
+            if (difference>differenceMax) { differenceMax=difference; }
+            scratch[online++] = ((double) records[r].systemTimestamp - (double) records[r].hostTimestamp) / 1000.0;
+        }
+        n += 1;
+    }
+    if (online!=0)
+    {
+        struct IntervalSummary latency;
+        summarizeIntervals(scratch,online,&latency);
+        fprintf(report,"Online mapping : %lu frames, latency mean %0.1f μs, median %0.1f, p99 %0.1f, max %0.1f μs, %0.1f μs from the whole recording fit on average (max %0.1f)\n",
+                online,latency.mean,latency.median,latency.p99,latency.maximum,differenceSum/online/1000.0,differenceMax/1000.0);
+    }
+    free(device); free(host); free(scratch);
+}
+
+int main(int argc, char **argv)
+{
+    const char * indexFile = 0;
+    const char * csvFile   = 0;
+    unsigned int gapsToList = 10;
+    double gapFactor = 1.5;
+    unsigned int i=0;
+
+    for (i=1; i<argc; i++)
+    {
+        if ( (strcmp(argv[i],"--csv")==0) && (i+1<argc) ) {
+            csvFile=argv[i+1];
+            i++;
+        } else if ( (strcmp(argv[i],"--gaps")==0) && (i+1<argc) ) {
+            gapsToList=atoi(argv[i+1]);
+            i++;
+        } else if ( (strcmp(argv[i],"--gapFactor")==0) && (i+1<argc) ) {
+            gapFactor=atof(argv[i+1]);
+            i++;
+        } else {
+            indexFile=argv[i];
+        }
+    }
+
+    if (indexFile==0)
+    {
+        fprintf(stderr,"Usage : %s frameIndex.bin [--csv file.csv|-] [--gaps N] [--gapFactor 1.5]\n",argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE * fp = fopen(indexFile,"rb");
+    if (fp==0)
+    {
+        fprintf(stderr,"Could not open %s\n",indexFile);
+        return EXIT_FAILURE;
+    }
+
+    struct FrameIndexHeader header;
+    if (!readFrameIndexHeader(fp,&header))
+    {
+        fprintf(stderr,"%s is not a frame index of version %u or older\n",indexFile,FRAME_INDEX_VERSION);
+        fclose(fp);
+        return EXIT_FAILURE;
+    }
+
+    //Load every record, a day at 100 fps is about 400MB
+    unsigned long capacity = 4096, count = 0;
+    struct FrameIndexRecord * records = (struct FrameIndexRecord *) malloc(sizeof(struct FrameIndexRecord)*capacity);
+    while (records!=0)
+    {
+        if (count==capacity)
+        {
+            capacity *= 2;
+            struct FrameIndexRecord * grown = (struct FrameIndexRecord *) realloc(records,sizeof(struct FrameIndexRecord)*capacity);
+            if (grown==0) { free(records); records=0; break; }
+            records = grown;
+        }
+        if (!readFrameIndexRecord(fp,&header,&records[count])) { break; }
+        count += 1;
+    }
+    fclose(fp);
+
+    if (records==0)
+    {
+        fprintf(stderr,"Could not allocate memory for the frame index\n");
+        return EXIT_FAILURE;
+    }
+
+    //The summary goes to stderr when the CSV takes stdout
+    FILE * report = stdout;
+    FILE * csv    = 0;
+    if (csvFile!=0)
+    {
+        if (strcmp(csvFile,"-")==0) { csv = stdout; report = stderr; } else
+                                    { csv = fopen(csvFile,"w"); }
+        if (csv==0)
+        {
+            fprintf(stderr,"Could not create %s\n",csvFile);
+            free(records);
+            return EXIT_FAILURE;
+        }
+        fprintf(csv,"frameId,deviceTimestamp,systemTimestamp,status,payloadSize,outputNumber,outputOffset,flags,deviceIntervalMicroseconds,systemIntervalMicroseconds,hostTimestamp,outputRoot,exposureMean,exposureMedian,underExposedRatio,overExposedRatio\n");
+    }
+
+    double * deviceIntervals = (double *) malloc(sizeof(double)*(count+1));
+    double * systemIntervals = (double *) malloc(sizeof(double)*(count+1));
+    double * gapIntervals    = (double *) malloc(sizeof(double)*(count+1));
+    if ( (deviceIntervals==0) || (systemIntervals==0) || (gapIntervals==0) )
+    {
+        fprintf(stderr,"Could not allocate memory for the intervals\n");
+        free(deviceIntervals); free(systemIntervals); free(gapIntervals); free(records);
+        if ( (csv!=0) && (csv!=stdout) ) { fclose(csv); }
+        return EXIT_FAILURE;
+    }
+
+    unsigned long statuses[NUMBER_OF_STATUSES] = {0};
+    unsigned long deviceCount=0, systemCount=0;
+    unsigned long written=0, skipped=0, ring=0, incomplete=0, stacked=0, reconfigured=0;
+    unsigned long idGaps=0, missingIds=0, idResets=0;
+    char haveFrameIds = 0;
+    const struct FrameIndexRecord * previous = 0;
+    unsigned long r=0;
+
+    for (r=0; r<count; r++)
+    {
+        const struct FrameIndexRecord * record = &records[r];
+        int32_t status = record->status;
+        statuses[ ((status>=-1) && (status<NUMBER_OF_STATUSES-2)) ? status+1 : NUMBER_OF_STATUSES-1 ] += 1;
+        if (record->flags & FRAME_INDEX_WRITTEN)    { written    += 1; }
+        if (record->flags & FRAME_INDEX_SKIPPED)    { skipped    += 1; }
+        if (record->flags & FRAME_INDEX_RING)       { ring       += 1; }
+        if (record->flags & FRAME_INDEX_INCOMPLETE) { incomplete += 1; }
+        if (record->flags & FRAME_INDEX_STACKED)    { stacked    += 1; }
+        if (record->flags & FRAME_INDEX_RECONFIGURED) { reconfigured += 1; }
+        if (record->frameId!=0) { haveFrameIds = 1; }
+
+        //Intervals only between frames that actually arrived
+        double deviceInterval = 0.0, systemInterval = 0.0;
+        if (status==0)
+        {
+            if (previous!=0)
+            {
+                if ( (record->deviceTimestamp!=0) && (previous->deviceTimestamp!=0) )
+                {
+                    deviceInterval = ((double) record->deviceTimestamp - (double) previous->deviceTimestamp) / 1000.0;
+                    deviceIntervals[deviceCount++] = deviceInterval;
+                }
+                systemInterval = ((double) record->systemTimestamp - (double) previous->systemTimestamp) / 1000.0;
+                systemIntervals[systemCount++] = systemInterval;
+
+                if (record->frameId > previous->frameId+1)
+                {
+                    idGaps     += 1;
+                    missingIds += record->frameId - previous->frameId - 1;
+                } else
+                if (record->frameId <= previous->frameId)
+                {
+                    idResets   += 1; //16 bit GigE block ids wrap, or the camera restarted
+                }
+            }
+            previous = record;
+        }
+
+        if (csv!=0)
+        {
+            fprintf(csv,"%lu,%lu,%lu,%s,%u,%d,%lu,%u,%0.1f,%0.1f,%lu,%u,%0.2f,%u,%0.6f,%0.6f\n",
+                    (unsigned long) record->frameId,(unsigned long) record->deviceTimestamp,(unsigned long) record->systemTimestamp,
+                    statusName(status),record->payloadSize,
+                    (record->outputNumber==FRAME_INDEX_NOT_WRITTEN) ? -1 : (int) record->outputNumber,
+                    (unsigned long) record->outputOffset,record->flags,deviceInterval,systemInterval,(unsigned long) record->hostTimestamp,record->outputRoot,
+                    record->exposureMean,record->exposureMedian,record->underExposedRatio,record->overExposedRatio);
+        }
+    }
+    if ( (csv!=0) && (csv!=stdout) ) { fclose(csv); }
+
+    //Timing gaps use the host clock, which every camera has
+    memcpy(gapIntervals,systemIntervals,sizeof(double)*systemCount);
+    struct IntervalSummary deviceSummary, systemSummary;
+    summarizeIntervals(deviceIntervals,deviceCount,&deviceSummary);
+    summarizeIntervals(systemIntervals,systemCount,&systemSummary);
+
+    fprintf(report,"%s : %lu records, %lu written, %lu skipped, %lu stacked, %lu to the ring, %lu incomplete, %lu reconfigured\n",indexFile,count,written,skipped,stacked,ring,incomplete,reconfigured);
+    fprintf(report,"Statuses :");
+    for (i=0; i<NUMBER_OF_STATUSES; i++)
+    {
+        if (statuses[i]!=0) { fprintf(report," %s %lu",(i==NUMBER_OF_STATUSES-1) ? "other" : statusName((int32_t) i-1),statuses[i]); }
+    }
+    fprintf(report,"\n");
+    printIntervals(report,"Camera",&deviceSummary);
+    printIntervals(report,"Host",&systemSummary);
+
+    if (haveFrameIds)
+    {
+        fprintf(report,"Frame ids : %lu gaps, %lu frames missing, %lu wraps or resets\n",idGaps,missingIds,idResets);
+    }
+
+    //Intervals above gapFactor x median, listed in recording order
+    unsigned long timingGaps = 0;
+    double gapThreshold = systemSummary.median * gapFactor;
+    unsigned long interval = 0;
+    previous = 0;
+    for (r=0; r<count; r++)
+    {
+        if (records[r].status!=0) { continue; }
+        if (previous!=0)
+        {
+            double systemInterval = gapIntervals[interval++];
+            if ( (systemSummary.median>0.0) && (systemInterval>gapThreshold) )
+            {
+                if (timingGaps<gapsToList)
+                {
+                    fprintf(report,"  gap of %0.1f μs (%0.1f frames) before frame id %lu, record %lu\n",
+                            systemInterval,systemInterval/systemSummary.median,(unsigned long) records[r].frameId,r);
+                }
+                timingGaps += 1;
+            }
+        }
+        previous = &records[r];
+    }
+    fprintf(report,"Timing gaps : %lu intervals above %0.1f x median\n",timingGaps,gapFactor);
+    reportClockMapping(report,records,count);
+
+    free(deviceIntervals);
+    free(systemIntervals);
+    free(gapIntervals);
+    free(records);
+    return EXIT_SUCCESS;
+}
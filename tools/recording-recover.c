@@ -0,0 +1,234 @@
+/* SPDX-License-Identifier:Unlicense */
+
+/* Standard headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "frame-index.h"
+#include "recording-journal.h"
+
+// Brings a 06-grabber --journal recording that was interrupted by a crash, a
+// SIGKILL or a power loss back to its last consistent frame :
+//
+//  - journal.bin is cut after its last complete record with a valid checksum,
+//    and after the last record whose file is still there with its size
+//  - frame files that the journal does not vouch for (written after the last
+//    commit, or torn) are removed
+//  - frameIndex.bin is cut to whole records, and before the first frame that
+//    says it was written to a file after the last one committed. A frame the
+//    index says was written that is not in the journal while later ones are
+//    was never on disk (a queue policy discarded it, or its write failed), its
+//    record stays and is marked not written
+//  - recording.json is rewritten with what is left
+//
+// Usage : recording-recover directory [--dry-run]
+
+struct CommittedFrame
+{
+    char name[RECORDING_JOURNAL_NAME_LENGTH];
+    unsigned int frameNumber;
+};
+
+static int compareNames(const void * a,const void * b)
+{
+    return strcmp(((const struct CommittedFrame *) a)->name,((const struct CommittedFrame *) b)->name);
+}
+
+static int compareFrameNumbers(const void * a,const void * b)
+{
+    unsigned int x = *(const unsigned int *) a;
+    unsigned int y = *(const unsigned int *) b;
+    return (x>y) - (x<y);
+}
+
+// Frame files of the grabber, colorFrame_0_NNNNN.pnm or .jpg
+static int isFrameFile(const char * name)
+{
+    if (strncmp(name,"colorFrame_",11)!=0) { return 0; }
+    const char * extension = strrchr(name,'.');
+    return (extension!=0) && ( (strcmp(extension,".pnm")==0) || (strcmp(extension,".jpg")==0) );
+}
+
+static unsigned long recoverFrameIndex(const char * directory,const unsigned int * committedNumbers,unsigned long committed,char dryRun)
+{
+    char filename[1024];
+    snprintf(filename,sizeof(filename),"%s/frameIndex.bin",directory);
+    FILE * fp = fopen(filename,(dryRun) ? "rb" : "r+b");
+    if (fp==0) { return 0; }
+
+    struct FrameIndexHeader header;
+    if (!readFrameIndexHeader(fp,&header))
+    {
+        fprintf(stderr,"%s is not a frame index, left alone\n",filename);
+        fclose(fp);
+        return 0;
+    }
+
+    //The index marks a frame written once a sink took it, the journal once its file was complete
+    unsigned int lastCommitted = (committed!=0) ? committedNumbers[committed-1] : 0;
+    unsigned long records = 0, unwritten = 0;
+    struct FrameIndexRecord record;
+    long position = ftell(fp);
+    while (readFrameIndexRecord(fp,&header,&record))
+    {
+        if ( (record.flags & FRAME_INDEX_WRITTEN) && (record.outputNumber!=FRAME_INDEX_NOT_WRITTEN) &&
+             (bsearch(&record.outputNumber,committedNumbers,committed,sizeof(unsigned int),compareFrameNumbers)==0) )
+        {
+            if ( (committed==0) || (record.outputNumber>lastCommitted) ) { break; } //Past the last commit
+
+            record.flags       &= ~FRAME_INDEX_WRITTEN;
+            record.outputNumber = FRAME_INDEX_NOT_WRITTEN;
+            unwritten += 1;
+            if (!dryRun)
+            {
+                fseek(fp,position,SEEK_SET);
+                if (fwrite(&record,header.recordSize,1,fp)!=1) { fprintf(stderr,"Could not update %s\n",filename); }
+            }
+        }
+        records  += 1;
+        position += header.recordSize;
+        fseek(fp,position,SEEK_SET);
+    }
+    fseek(fp,0,SEEK_END);
+    long size = ftell(fp);
+    fclose(fp);
+
+    long keep = (long) (sizeof(struct FrameIndexHeader) + records*header.recordSize);
+    fprintf(stdout,"frameIndex.bin : %lu consistent records, %lu %s not written, %ld bytes cut\n",
+            records,unwritten,(dryRun) ? "would be marked" : "marked",size-keep);
+    if ( (!dryRun) && (keep<size) && (truncate(filename,keep)!=0) )
+        { fprintf(stderr,"Could not truncate %s\n",filename); }
+    return records;
+}
+
+int main(int argc, char **argv)
+{
+    const char * directory = 0;
+    char dryRun = 0;
+    unsigned int i=0;
+
+    for (i=1; i<argc; i++)
+    {
+        if (strcmp(argv[i],"--dry-run")==0) {
+            dryRun=1;
+        } else {
+            directory=argv[i];
+        }
+    }
+    if (directory==0)
+    {
+        fprintf(stderr,"Usage : %s directory [--dry-run]\n",argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    char filename[1024];
+    snprintf(filename,sizeof(filename),"%s/journal.bin",directory);
+    FILE * fp = fopen(filename,"rb");
+    if (fp==0)
+    {
+        fprintf(stderr,"Could not open %s\n",filename);
+        return EXIT_FAILURE;
+    }
+
+    struct RecordingJournalHeader header;
+    if (!readRecordingJournalHeader(fp,&header))
+    {
+        fprintf(stderr,"%s is not a recording journal this tool understands\n",filename);
+        fclose(fp);
+        return EXIT_FAILURE;
+    }
+
+    //Committed prefix : valid records whose file is still complete
+    struct CommittedFrame * frames = 0;
+    unsigned long committed = 0, allocated = 0, records = 0;
+    unsigned int firstFrame = 0, lastFrame = 0;
+    char cleanShutdown = 0, damaged = 0;
+    struct RecordingJournalRecord record;
+    while (fread(&record,sizeof(struct RecordingJournalRecord),1,fp)==1)
+    {
+        if (record.checksum!=recordingJournalChecksum(&record)) { damaged=1; break; }
+        if (record.type==RECORDING_JOURNAL_CLOSED) { records+=1; cleanShutdown=1; break; }
+        if (record.type!=RECORDING_JOURNAL_FRAME)  { damaged=1; break; }
+
+        struct stat fileStatus;
+        char frameFile[1100];
+        record.name[RECORDING_JOURNAL_NAME_LENGTH-1] = 0;
+        snprintf(frameFile,sizeof(frameFile),"%s/%s",directory,record.name);
+        if ( (stat(frameFile,&fileStatus)!=0) || ((uint64_t) fileStatus.st_size!=record.fileSize) )
+        {
+            fprintf(stdout,"%s is missing or does not have its committed size, the recording ends before it\n",record.name);
+            damaged=1;
+            break;
+        }
+
+        if (committed==allocated)
+        {
+            allocated = (allocated!=0) ? 2*allocated : 1024;
+            struct CommittedFrame * grown = (struct CommittedFrame *) realloc(frames,allocated*sizeof(struct CommittedFrame));
+            if (grown==0) { fprintf(stderr,"Out of memory\n"); fclose(fp); free(frames); return EXIT_FAILURE; }
+            frames = grown;
+        }
+        snprintf(frames[committed].name,RECORDING_JOURNAL_NAME_LENGTH,"%s",record.name);
+        frames[committed].frameNumber = record.frameNumber;
+        if ( (committed==0) || (record.frameNumber<firstFrame) ) { firstFrame=record.frameNumber; }
+        if ( (committed==0) || (record.frameNumber>lastFrame) )  { lastFrame=record.frameNumber; }
+        committed += 1;
+        records   += 1;
+    }
+    fseek(fp,0,SEEK_END);
+    long journalSize = ftell(fp);
+    fclose(fp);
+
+    long keep = (long) (sizeof(struct RecordingJournalHeader) + records*sizeof(struct RecordingJournalRecord));
+    fprintf(stdout,"journal.bin : %lu committed frames (%u to %u), %s, %ld bytes cut\n",
+            committed,firstFrame,lastFrame,(cleanShutdown) ? "clean shutdown" : (damaged) ? "damaged tail" : "interrupted",journalSize-keep);
+    if ( (!dryRun) && (keep<journalSize) && (truncate(filename,keep)!=0) )
+        { fprintf(stderr,"Could not truncate %s\n",filename); }
+
+    //Every frame file the journal does not vouch for goes
+    qsort(frames,committed,sizeof(struct CommittedFrame),compareNames);
+    unsigned long discarded = 0;
+    DIR * listing = opendir(directory);
+    if (listing!=0)
+    {
+        struct dirent * entry;
+        while ( (entry=readdir(listing))!=0 )
+        {
+            if (!isFrameFile(entry->d_name)) { continue; }
+            size_t length = strlen(entry->d_name);
+            if (length<RECORDING_JOURNAL_NAME_LENGTH)
+            {
+                struct CommittedFrame key;
+                memcpy(key.name,entry->d_name,length+1);
+                if (bsearch(&key,frames,committed,sizeof(struct CommittedFrame),compareNames)!=0) { continue; }
+            }
+
+            char frameFile[1100];
+            snprintf(frameFile,sizeof(frameFile),"%s/%s",directory,entry->d_name);
+            fprintf(stdout,"%s %s\n",(dryRun) ? "would remove" : "removing",entry->d_name);
+            if ( (!dryRun) && (unlink(frameFile)!=0) )
+                { fprintf(stderr,"Could not remove %s\n",frameFile); continue; }
+            discarded += 1;
+        }
+        closedir(listing);
+    }
+
+    unsigned int * committedNumbers = (unsigned int *) malloc((committed+1)*sizeof(unsigned int));
+    if (committedNumbers!=0)
+    {
+        unsigned long n=0;
+        for (n=0; n<committed; n++) { committedNumbers[n]=frames[n].frameNumber; }
+        qsort(committedNumbers,committed,sizeof(unsigned int),compareFrameNumbers);
+        recoverFrameIndex(directory,committedNumbers,committed,dryRun);
+        free(committedNumbers);
+    }
+    free(frames);
+
+    fprintf(stdout,"%lu frame files %s\n",discarded,(dryRun) ? "would be removed" : "removed");
+    if (!dryRun) { writeRecordingSummary(directory,committed,firstFrame,lastFrame,cleanShutdown,discarded); }
+    return EXIT_SUCCESS;
+}